@@ -0,0 +1,29 @@
+#include "includes/mpv_dbn.h"
+#include "includes/hist_extract.h"
+
+/**
+ * @brief Extract the calibration histograms of the runs in files/physics_runs.csv into physics_runs/ (see
+ *    extract_runs), instead of copying the whole run folders with get_physics_runs().
+ * 
+ * NOTE: must be run on SDCC (unless source_dir is a local copy).
+ * 
+ * @param n_workers number of runs extracted at a time.
+ * @param with_adc also copy h_alladc_<channel> (needed to refit the channels).
+ * @param benchmark instead, compare extracting with copying the whole folders (in a scratch directory).
+ * @param source_dir directory with Tim's qa_output_000<run> folders.
+ */
+void bnl_extract_phys_runs(unsigned int n_workers = 8, bool with_adc = false, bool benchmark = false, std::string source_dir = PHYSICS_RUNS_SOURCE) {
+  std::vector<int> runs;
+  for (std::pair<int, int> p : read_physics_runs()) {
+    if (p.second > 0) {
+      runs.push_back(p.second);
+    }
+  }
+  if (benchmark) {
+    benchmark_extraction(runs, source_dir, Form("%s/emcal_extract_benchmark", gSystem->TempDirectory()), with_adc, n_workers);
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::vector<ExtractResult> results = extract_runs(runs, source_dir, "physics_runs", with_adc, n_workers);
+  print_extract_report(results, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
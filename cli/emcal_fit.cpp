@@ -0,0 +1,29 @@
+#include "../includes/cli_args.h"
+#include "../run_pipeline.cpp"
+
+/**
+ * @brief emcal-fit: fetch the runs of files/physics_runs.csv and fit each sector (the fetch and fit stages of
+ *    run_pipeline; results cached in .pipeline/). Run from the repository root.
+ */
+int main(int argc, char **argv) {
+  CliArgs args("emcal-fit", "Fetch the physics runs and fit the channel MPVs of every sector (cached in .pipeline/).");
+  args.option("--workers", "8", "stages run at a time");
+  args.option("--source", PHYSICS_RUNS_SOURCE, "directory with the qa_output_000<run> folders");
+  args.flag("--force", "refit every sector");
+  args.flag("--profile", "print the time of every stage at the end (as EMCAL_PROFILE=1)");
+  args.option("--trace", "", "write a trace of the stages to this file, for chrome://tracing or ui.perfetto.dev");
+  try {
+    if (!args.parse(argc, argv)) {
+      return 0;
+    }
+    Profiler::instance().enable(args.is_set("--profile") || profiling());
+    if (!args.get("--trace").empty()) {
+      Profiler::instance().start_trace(args.get("--trace"));
+    }
+    run_pipeline(args.get_int("--workers"), args.get("--source"), "fit", false, args.is_set("--force"));
+  } catch (const std::exception &e) {
+    fprintf(stderr, "emcal-fit: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <functional>
+
+#include "../includes/cli_args.h"
+#include "../includes/hist_service.h"
+
+/**
+ * @brief emcal-hist: thin client of emcal-histd. Commands (after the options):
+ *    - slice <run> <histogram> [<first bin> [<last bin>]]: print the bins (low edge, content, error);
+ *    - fit <run> <channel>...: single pixel fit of each channel;
+ *    - compare <reference> <run>...: MPV and single pixel ratios reference / run of each run;
+ *    - stats, shutdown.
+ *    Prints the round trip and service time of each request to stderr.
+ */
+int main(int argc, char **argv) {
+  typedef std::chrono::steady_clock clock;
+  CliArgs args("emcal-hist", "Query emcal-histd: slice <run> <histogram> [<first bin> [<last bin>]] | fit <run> <channel>... |\n"
+                             "compare <reference> <run>... | stats | shutdown.");
+  args.arguments("<command> [<argument>...]");
+  args.option("--socket", HIST_SERVICE_SOCKET, "socket of emcal-histd");
+  args.option("--first-channel", "64", "first channel of the compare projection range");
+  args.option("--last-channel", "318", "last channel (inclusive) of the compare projection range");
+  try {
+    if (!args.parse(argc, argv)) {
+      return 0;
+    }
+    const std::vector<std::string> &command = args.get_arguments();
+    if (command.empty()) {
+      args.print_usage(stderr);
+      return 1;
+    }
+
+    HistClient client(args.get("--socket"));
+    auto timed = [&](const std::function<void()> &request) {
+      clock::time_point start = clock::now();
+      request();
+      fprintf(stderr, "%.3f ms (service %.3f ms)\n", std::chrono::duration<double>(clock::now() - start).count()*1000,
+              client.last_service_time());
+    };
+    const std::string &name = command[0];
+    if (name == "slice" && command.size() >= 3) {
+      timed([&]() {
+        HistSlice slice = client.slice(std::stoi(command[1]), command[2], command.size() > 3 ? std::stoi(command[3]) : 1,
+                                       command.size() > 4 ? std::stoi(command[4]) : -1);
+        for (size_t i = 0; i < slice.contents.size(); i++) {
+          printf("%d %g %g %g\n", slice.first_bin + (int) i, slice.edges[i], slice.contents[i], slice.errors[i]);
+        }
+      });
+    } else if (name == "fit" && command.size() >= 3) {
+      for (size_t i = 2; i < command.size(); i++) {
+        timed([&]() {
+          SinglePixelFit fit = client.fit(std::stoi(command[1]), std::stoi(command[i]));
+          printf("run %s channel %s: status %d, chi2/ndf %.1f/%d, gap %.3f +- %.3f, first peak %.3f +- %.3f (%d calls, %.1f ms)\n",
+                 command[1].c_str(), command[i].c_str(), fit.status, fit.chi2, fit.ndf, fit.params[3], fit.errors[3],
+                 fit.params[4], fit.errors[4], fit.telemetry.n_calls, 1000*fit.telemetry.wall_time);
+        });
+      }
+    } else if (name == "compare" && command.size() >= 3) {
+      for (size_t i = 2; i < command.size(); i++) {
+        timed([&]() {
+          RunComparison cmp = client.compare(std::stoi(command[1]), std::stoi(command[i]), args.get_int("--first-channel"), args.get_int("--last-channel"));
+          printf("run %d / %d: mpv ratio %.4f +- %.4f, sp ratio %.4f +- %.4f, gain vs mpv r = %.3f\n", cmp.reference, cmp.run,
+                 cmp.mpv_stats.mean(), cmp.mpv_stats.std_dev(), cmp.sp_stats.mean(), cmp.sp_stats.std_dev(), cmp.gain_mpv_corr);
+        });
+      }
+    } else if (name == "stats" && command.size() == 1) {
+      timed([&]() { printf("%s", client.stats().c_str()); });
+    } else if (name == "shutdown" && command.size() == 1) {
+      timed([&]() { client.shutdown(); });
+    } else {
+      args.print_usage(stderr);
+      return 1;
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "emcal-hist: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
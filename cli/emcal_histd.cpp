@@ -0,0 +1,30 @@
+#include <TROOT.h>
+
+#include "../includes/cli_args.h"
+#include "../includes/hist_service.h"
+
+/**
+ * @brief emcal-histd: the histogram service (HistService), answering emcal-hist and other HistClient requests until
+ *    "emcal-hist shutdown". Run from the repository root.
+ */
+int main(int argc, char **argv) {
+  CliArgs args("emcal-histd", "Serve histogram slices, single pixel fits and run comparisons of the physics runs over a Unix socket.");
+  args.option("--socket", HIST_SERVICE_SOCKET, "socket to listen on");
+  args.option("--open-runs", "8", "run files kept open");
+  args.option("--runs-dir", "physics_runs", "directory with the qa_output_000<run> folders");
+  try {
+    if (!args.parse(argc, argv)) {
+      return 0;
+    }
+    if (args.get_int("--open-runs") < 1) {
+      throw std::runtime_error("--open-runs must be at least 1");
+    }
+    gROOT->SetBatch(true);
+    HistService service(args.get("--socket"), args.get_int("--open-runs"), args.get("--runs-dir"));
+    service.serve();
+  } catch (const std::exception &e) {
+    fprintf(stderr, "emcal-histd: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include "../includes/cli_args.h"
+#include "../includes/adc_ingest.h"
+#include "../includes/waveform.h"
+
+/**
+ * @brief emcal-ingest: build the per-channel ADC histograms (h_alladc_<channel>) and the channel peak positions
+ *    (h_peakpos) of raw-event files (see includes/raw_event.h), written as "<out>/qa_output_000<run>/histograms.root"
+ *    for fit_all_runs and emcal-mipfit. With --synthesize, writes a raw-event file of simulated cosmics instead; with
+ *    --waveform-benchmark, times the waveform-to-amplitude kernel (see includes/waveform.h).
+ */
+int main(int argc, char **argv) {
+  CliArgs args("emcal-ingest", "Fill the ADC histograms of raw-event files into <out>/qa_output_000<run>/histograms.root.");
+  args.arguments("<raw-event file>...");
+  args.option("--out", "ingest_runs", "directory the qa_output_000<run> folders are written into (not physics_runs)");
+  args.option("--threads", "8", "threads filling each file");
+  args.option("--bins", "501", "bins of h_alladc_<channel>");
+  args.option("--min", "-0.5", "low edge of h_alladc_<channel> [ADC]");
+  args.option("--max", "500.5", "high edge of h_alladc_<channel> [ADC]");
+  args.option("--trigger-mask", "0", "accept events with any of these trigger bits (0: every event)");
+  args.option("--hit-threshold", "5", "amplitude of a hit channel [ADC]");
+  args.option("--min-hits", "0", "skip events with fewer hit channels");
+  args.option("--max-hits", "384", "skip events with more hit channels");
+  args.option("--peak-min", "50", "low edge of the peak search of h_peakpos [ADC]");
+  args.option("--synthesize", "0", "write this many simulated events to the (single) file instead of reading it");
+  args.option("--run", "1", "run number of a synthesized file");
+  args.option("--waveform-benchmark", "0", "time the waveform kernel on this many synthetic events (no files)");
+  args.option("--samples", "16", "digitizer samples per channel of the waveform benchmark");
+  args.option("--trials", "8", "template times of the waveform benchmark's template fit");
+  args.flag("--profile", "print the time of every stage at the end (as EMCAL_PROFILE=1)");
+  args.option("--trace", "", "write a trace of the stages to this file, for chrome://tracing or ui.perfetto.dev");
+  try {
+    if (!args.parse(argc, argv)) {
+      return 0;
+    }
+    long n_benchmark = std::stol(args.get("--waveform-benchmark"));
+    if (n_benchmark > 0) {
+      benchmark_waveform_kernel(n_benchmark, args.get_int("--samples"), args.get_int("--trials"));
+      return 0;
+    }
+    const std::vector<std::string> &files = args.get_arguments();
+    if (files.empty()) {
+      args.print_usage(stderr);
+      return 1;
+    }
+    Profiler::instance().enable(args.is_set("--profile") || profiling());
+    if (!args.get("--trace").empty()) {
+      Profiler::instance().start_trace(args.get("--trace"));
+    }
+
+    long n_synthesize = std::stol(args.get("--synthesize"));
+    if (n_synthesize > 0) {
+      if (files.size() != 1) {
+        throw std::runtime_error("--synthesize writes a single file");
+      }
+      write_synthetic_raw_events(files[0], args.get_int("--run"), n_synthesize);
+      printf("wrote %ld events of run %d to %s\n", n_synthesize, args.get_int("--run"), files[0].c_str());
+      return 0;
+    }
+
+    AdcIngestConfig config;
+    config.n_bins = args.get_int("--bins");
+    config.x_min = std::stod(args.get("--min"));
+    config.x_max = std::stod(args.get("--max"));
+    config.trigger_mask = std::stoul(args.get("--trigger-mask"), nullptr, 0);
+    config.hit_threshold = std::stof(args.get("--hit-threshold"));
+    config.min_hit_channels = args.get_int("--min-hits");
+    config.max_hit_channels = args.get_int("--max-hits");
+    config.peak_min = std::stod(args.get("--peak-min"));
+    config.n_threads = args.get_int("--threads");
+    for (const std::string &file : files) {
+      ingest_raw_events(file, args.get("--out"), config);
+    }
+    Profiler::instance().finish();
+  } catch (const std::exception &e) {
+    fprintf(stderr, "emcal-ingest: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
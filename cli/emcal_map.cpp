@@ -0,0 +1,34 @@
+#include "../includes/cli_args.h"
+#include "../run_pipeline.cpp"
+
+/**
+ * @brief emcal-map: fetch and fit (see emcal-fit), then write files/dbn_mpv.csv, the IB summaries, the block database
+ *    with the new MPV columns and optionally the binary calibration table (run_pipeline up to the export stage). Run from
+ *    the repository root.
+ */
+int main(int argc, char **argv) {
+  CliArgs args("emcal-map", "Fit the physics runs and write the MPV map, IB summaries and block database (files/).");
+  args.option("--workers", "8", "stages run at a time");
+  args.option("--source", PHYSICS_RUNS_SOURCE, "directory with the qa_output_000<run> folders");
+  args.option("--calib", "", "also write the binary calibration table to this file (e.g. files/emcal_calib.bin)");
+  args.flag("--force", "rerun every stage");
+  args.flag("--profile", "print the time of every stage at the end (as EMCAL_PROFILE=1)");
+  args.option("--trace", "", "write a trace of the stages to this file, for chrome://tracing or ui.perfetto.dev");
+  try {
+    if (!args.parse(argc, argv)) {
+      return 0;
+    }
+    Profiler::instance().enable(args.is_set("--profile") || profiling());
+    if (!args.get("--trace").empty()) {
+      Profiler::instance().start_trace(args.get("--trace"));
+    }
+    run_pipeline(args.get_int("--workers"), args.get("--source"), "export", false, args.is_set("--force"));
+    if (!args.get("--calib").empty()) {
+      write_calib_table(args.get("--calib"), true, -1);
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "emcal-map: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "../includes/cli_args.h"
+#include "../includes/mip_fit.h"
+
+/**
+ * @brief emcal-mipfit: refit the MIP peak of every channel of runs from their h_alladc_<channel> (Landau x Gauss, all
+ *    channels of a run in parallel) and write "<out>/qa_output_000<run>/mip_fits.root" (h_allchannels of the fits),
+ *    mip_fits.csv, mip_fit_telemetry.csv and mip_diff.csv (against the upstream h_allchannels). Without run numbers,
+ *    fits the runs of files/physics_runs.csv.
+ */
+int main(int argc, char **argv) {
+  CliArgs args("emcal-mipfit", "Fit the channel MPVs of runs from their ADC spectra into <out>/qa_output_000<run>/mip_fits.root.");
+  args.arguments("[<run>...]");
+  args.option("--runs-dir", "physics_runs", "directory with the qa_output_000<run> folders");
+  args.option("--out", "", "directory the results are written into (default: --runs-dir)");
+  args.option("--threads", "0", "channels fitted at a time (0: one per core)");
+  args.option("--fit-min", "50", "low edge of the peak search and of the fits [ADC]");
+  args.option("--min-entries", "100", "skip channels with fewer entries above --fit-min");
+  args.flag("--profile", "print the time of every stage at the end (as EMCAL_PROFILE=1)");
+  args.option("--trace", "", "write a trace of the stages to this file, for chrome://tracing or ui.perfetto.dev");
+  try {
+    if (!args.parse(argc, argv)) {
+      return 0;
+    }
+    Profiler::instance().enable(args.is_set("--profile") || profiling());
+    if (!args.get("--trace").empty()) {
+      Profiler::instance().start_trace(args.get("--trace"));
+    }
+    std::vector<int> runs;
+    for (const std::string &run : args.get_arguments()) {
+      runs.push_back(std::stoi(run));
+    }
+    if (runs.empty()) {
+      for (std::pair<int, int> p : read_physics_runs()) {
+        if (p.second > 0) {
+          runs.push_back(p.second);
+        }
+      }
+    }
+    MipFitConfig config;
+    config.fit_min = std::stod(args.get("--fit-min"));
+    config.min_entries = std::stod(args.get("--min-entries"));
+    config.n_threads = args.get_int("--threads");
+    std::string out_dir = args.get("--out").empty() ? args.get("--runs-dir") : args.get("--out");
+    size_t n_failed = 0;
+    for (int run : runs) {
+      try {
+        fit_run_mips(run, args.get("--runs-dir"), out_dir, config);
+      } catch (const std::exception &e) {
+        fprintf(stderr, "emcal-mipfit: run %d: %s\n", run, e.what());
+        n_failed++;
+      }
+    }
+    Profiler::instance().finish();
+    if (n_failed > 0) {
+      fprintf(stderr, "emcal-mipfit: %zu of %zu runs failed\n", n_failed, runs.size());
+      return 1;
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "emcal-mipfit: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#include "../includes/cli_args.h"
+#include "../emcal_plots/plot.cpp"
+
+/**
+ * @brief emcal-plot: the plots of plot() from the block database, in batch mode. Run from the repository root.
+ */
+int main(int argc, char **argv) {
+  CliArgs args("emcal-plot", "Plot the maps and distributions of the block database into emcal_plots/.");
+  args.option("--cut", "", "expression selecting the blocks of the value maps, e.g. \"sector <= 32\"");
+  args.option("--palette", "bird", "bird, rainbow, viridis or grayscale");
+  args.option("--workers", "1", "plots rendered at a time");
+  args.flag("--raster", "render the maps headless to PNG");
+  args.flag("--fork", "render in forked processes instead of threads");
+  args.flag("--force", "re-render every plot");
+  args.flag("--profile", "print the time of every stage at the end (as EMCAL_PROFILE=1)");
+  args.option("--trace", "", "write a trace of the stages to this file, for chrome://tracing or ui.perfetto.dev");
+  try {
+    if (!args.parse(argc, argv)) {
+      return 0;
+    }
+    Profiler::instance().enable(args.is_set("--profile") || profiling());
+    if (!args.get("--trace").empty()) {
+      Profiler::instance().start_trace(args.get("--trace"));
+    }
+    gROOT->SetBatch(true);
+    plot(args.get("--cut"), args.is_set("--raster"), args.get("--palette"), args.get_int("--workers"), args.is_set("--fork"), args.is_set("--force"));
+  } catch (const std::exception &e) {
+    fprintf(stderr, "emcal-plot: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
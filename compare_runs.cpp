@@ -0,0 +1,41 @@
+#include "includes/mpv_dbn.h"
+#include "includes/run_compare.h"
+
+/**
+ * @brief Compare candidate runs of a sector to a reference run (generalizes physics_runs/qa_output_00017867/compareruns.C).
+ *    Writes a summary row per candidate to files/run_comparison_<reference>.csv and, optionally, the ratio, projection,
+ *    48 x 8 map and gain vs MPV correlation plots into the reference run's qa_output directory.
+ * 
+ * NOTE: depends on physics_runs/qa_output_000<run>/histograms.root for every run.
+ * 
+ * @param reference reference run number.
+ * @param candidates comma-separated candidate run numbers.
+ * @param save_plots 
+ * @param first_channel first channel (0-based) of the projection range.
+ * @param last_channel last channel (0-based, inclusive) of the projection range.
+ */
+void compare_runs(int reference = 17867, std::string candidates = "17804,17899,17995", bool save_plots = true, int first_channel = 64, int last_channel = 318) {
+  RunHists reference_hists;
+  if (!read_run_hists(reference, reference_hists)) {
+    throw std::runtime_error(Form("unable to read reference run %d", reference));
+  }
+  std::vector<RunHists> candidate_hists;
+  std::stringstream candidate_stream(candidates);
+  std::string word;
+  while (std::getline(candidate_stream, word, ',')) {
+    RunHists hists;
+    if (read_run_hists(std::stoi(word), hists)) {
+      candidate_hists.push_back(hists);
+    }
+  }
+
+  std::vector<RunComparison> comparisons = compare_run_batch(reference_hists, candidate_hists, first_channel, last_channel);
+  for (const RunComparison &cmp : comparisons) {
+    printf("run %d / %d: mpv ratio %.4f +- %.4f, sp ratio %.4f +- %.4f, gain vs mpv r = %.3f\n", cmp.reference, cmp.run,
+      cmp.mpv_stats.mean(), cmp.mpv_stats.std_dev(), cmp.sp_stats.mean(), cmp.sp_stats.std_dev(), cmp.gain_mpv_corr);
+    if (save_plots) {
+      save_run_comparison_plots(cmp, first_channel, last_channel, Form("physics_runs/qa_output_000%d/compare_%d", reference, cmp.run));
+    }
+  }
+  write_run_comparison_csv(comparisons, Form("files/run_comparison_%d.csv", reference));
+}
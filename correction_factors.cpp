@@ -0,0 +1,44 @@
+#include "includes/mpv_dbn.h"
+#include "includes/aggregate.h"
+
+/**
+ * @brief Print and save block MPV correction factors grouped by any combination of block attributes.
+ * 
+ * NOTE: depends on "files/sPHENIX_EMCal_blocks - dbn_mpv.csv".
+ * 
+ * @param group_by comma-separated attributes (see parse_group_attr), e.g. "fiber_batch" or "sector,fiber_type".
+ * @param reference comma-separated key of the reference group, e.g. "21-A"; "" normalizes to the mean over all groups.
+ * @param cut expression (see includes/expr.h) selecting the blocks to use, e.g. "vendor == UIUC && sector > 12".
+ */
+void correction_factors(std::string group_by = "fiber_batch", std::string reference = "", std::string cut = "") {
+  std::vector<GroupAttr> attrs;
+  std::vector<std::string> reference_key;
+  std::string word;
+  std::stringstream group_by_stream(group_by);
+  while (std::getline(group_by_stream, word, ',')) {
+    attrs.push_back(parse_group_attr(word));
+  }
+  std::stringstream reference_stream(reference);
+  while (std::getline(reference_stream, word, ',')) {
+    reference_key.push_back(word);
+  }
+
+  std::vector<Block> all_blocks = read_block_database("files/sPHENIX_EMCal_blocks - dbn_mpv.csv");
+  GroupBy groups(attrs);
+  groups.aggregate(all_blocks, block_quantity(&Block::mpv), [](double mpv) {
+    return mpv > MPV_CUTOFF_LOW && mpv < MPV_CUTOFF_HIGH;
+  }, cut);
+
+  int reference_group = -1;
+  if (!reference_key.empty()) {
+    reference_group = groups.find(reference_key);
+    if (reference_group < 0) {
+      throw std::runtime_error(Form("no group matches reference '%s'", reference.c_str()));
+    }
+  }
+  groups.print(reference_group);
+
+  std::string file_name = group_by;
+  std::replace(file_name.begin(), file_name.end(), ',', '_');
+  groups.write_csv(Form("files/correction_factors_%s.csv", file_name.c_str()), reference_group);
+}
@@ -0,0 +1,123 @@
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <TH2D.h>
+#include <TCanvas.h>
+#include <TStyle.h>
+
+#include "../includes/mpv_dbn.h"
+#include "../includes/blocks.h"
+#include "../includes/expr.h"
+#include "../includes/aggregate.h"
+#include "../includes/correlation.h"
+
+/**
+ * @brief Numeric block attributes included in the correlation matrix (name, expression; valid where value > 0).
+ */
+const std::vector<std::pair<std::string, std::string>> correlation_columns = {
+  {"mpv", "mpv"},
+  {"ch0_mpv", "ch0_mpv"},
+  {"ch1_mpv", "ch1_mpv"},
+  {"ch2_mpv", "ch2_mpv"},
+  {"ch3_mpv", "ch3_mpv"},
+  {"density", "density"},
+  {"fiber_count", "fiber_count"},
+  {"fiber_t1_count", "fiber_t1_count"},
+  {"fiber_t2_count", "fiber_t2_count"},
+  {"fiber_t3_count", "fiber_t3_count"},
+  {"fiber_t4_count", "fiber_t4_count"},
+  {"scint_ratio", "scint_ratio"},
+};
+
+/**
+ * @brief Correlation matrices (Pearson, Spearman, covariance) between block attributes, and 2D density plots of chosen pairs.
+ *
+ * NOTE: depends on "files/sPHENIX_EMCal_blocks - dbn_mpv.csv" and, if sp_gap is set, the physics run histograms.
+ *
+ * @param split "" (all blocks together) or a group attribute to split by (see parse_group_attr), e.g. "vendor" or "fiber_type_compressed".
+ * @param pairs comma-separated x:y column pairs to draw as 2D density histograms.
+ * @param sp_gap include the single-pixel gap of each block (averaged over its channels) as a column.
+ * @param cut expression (see includes/expr.h) selecting the blocks to use.
+ */
+void correlations(std::string split = "", std::string pairs = "mpv:density,mpv:scint_ratio,mpv:fiber_count,mpv:sp_gap", bool sp_gap = true, std::string cut = "") {
+  std::vector<Block> all_blocks = read_block_database("files/sPHENIX_EMCal_blocks - dbn_mpv.csv");
+  BlockTable table(all_blocks);
+
+  CorrelationEngine engine;
+  for (const auto &column : correlation_columns) {
+    engine.add_column(column.first, column.second);
+  }
+  if (sp_gap) {
+    std::vector<std::vector<double>> sp_gaps = get_sp_gaps(false);
+    std::vector<double> block_sp_gap;
+    for (const Block &block : all_blocks) {
+      block_sp_gap.push_back(sp_gaps[block.sector - 1][block.block_number - 1]);
+    }
+    engine.add_external("sp_gap", block_sp_gap);
+  }
+
+  // group of each block: the split attribute (if any), restricted to the cut
+  std::vector<int> row_group(all_blocks.size(), 0);
+  std::vector<std::string> group_labels = {"all"};
+  if (!split.empty()) {
+    GroupBy groups({parse_group_attr(split)});
+    groups.aggregate(all_blocks, block_quantity(&Block::mpv));
+    group_labels.clear();
+    for (size_t g = 0; g < groups.n_groups(); g++) {
+      group_labels.push_back(groups.label(g));
+    }
+    for (size_t b = 0; b < all_blocks.size(); b++) {
+      row_group[b] = groups.group_of(b);
+    }
+  }
+  if (!cut.empty()) {
+    Selection selection = Expr::compile(cut).select(table);
+    for (size_t b = 0; b < all_blocks.size(); b++) {
+      if (!is_selected(selection, b)) {
+        row_group[b] = -1;
+      }
+    }
+  }
+  engine.compute(table, row_group, group_labels.size());
+
+  std::string suffix = split.empty() ? "" : "_" + split;
+  engine.write_csv(Form("files/correlations%s.csv", suffix.c_str()), group_labels);
+
+  gStyle->SetOptStat(0);
+  gStyle->SetPaintTextFormat(".2f");
+  for (size_t g = 0; g < engine.n_groups(); g++) {
+    std::string group_suffix = split.empty() ? "" : "_" + group_labels[g];
+    std::replace(group_suffix.begin(), group_suffix.end(), '=', '_');
+    for (bool use_spearman : {false, true}) {
+      TCanvas *c = new TCanvas("", "", 1000, 900);
+      c->SetLeftMargin(0.15);
+      c->SetBottomMargin(0.15);
+      TH2D *h = engine.matrix_hist(g, use_spearman);
+      h->SetTitle(Form("%s (%s)", h->GetTitle(), group_labels[g].c_str()));
+      h->Draw("COLZ TEXT");
+      c->SaveAs(Form("emcal_plots/correlation_%s%s.pdf", use_spearman ? "spearman" : "pearson", group_suffix.c_str()));
+      delete h;
+      delete c;
+    }
+  }
+
+  std::stringstream pairs_stream(pairs);
+  std::string pair;
+  while (std::getline(pairs_stream, pair, ',')) {
+    size_t colon = pair.find(':');
+    int i = colon == std::string::npos ? -1 : engine.column_index(pair.substr(0, colon));
+    int j = colon == std::string::npos ? -1 : engine.column_index(pair.substr(colon + 1));
+    if (i < 0 || j < 0) {
+      std::cerr << "skipping unknown column pair '" << pair << "'" << std::endl;
+      continue;
+    }
+    TCanvas *c = new TCanvas();
+    TH2D *h = engine.density_hist(i, j);
+    h->Draw("COLZ");
+    c->SaveAs(Form("emcal_plots/corr_%s_vs_%s%s.pdf", engine.column_name(j).c_str(), engine.column_name(i).c_str(), suffix.c_str()));
+    delete h;
+    delete c;
+  }
+}
@@ -5,12 +5,12 @@
 #include <vector>
 #include <functional>
 #include <map>
+#include <memory>
 
 #include <TH2D.h>
 #include <THStack.h>
 #include <TCanvas.h>
 #include <TStyle.h>
-#include <TPaveText.h>
 #include <TLatex.h>
 #include <TPaveStats.h>
 #include <TGraph.h>
@@ -18,23 +18,27 @@
 #include <TLegend.h>
 #include <TF1.h>
 #include <TH1S.h>
+#include <TROOT.h>
 
 #include "../includes/mpv_dbn.h"
 #include "../includes/utils.h"
+#include "../includes/blocks.h"
+#include "../includes/expr.h"
+#include "../includes/hist_spec.h"
+#include "../includes/raster.h"
+#include "../includes/label_layer.h"
+#include "../includes/plot_context.h"
+#include "../includes/job_graph.h"
+#include "../includes/fingerprint.h"
+#include "../includes/profiler.h"
+#include "../includes/root_arena.h"
 
 /**
  * TODO:
  * 
- * maybe correlation plots
- * 
  * maybe do a "string hist" of fiber batch? (the bins in the correct order)
  */
 
-/**
- * @brief list of fiber batches to treat as if they were empty (e.g., we don't have fiber batch information about the block)
- */
-const std::vector<std::string> FIBER_BATCH_TREAT_EMPTY = {"0", "none"};
-
 /**
  * @brief The default (naive) sector mapping (from Caroline's sector sheet). NOTE: we are looking down on the narrow ends of blocks / inside of detector!
  */
@@ -52,20 +56,6 @@ const std::vector<int> true_sector_mapping = {
    5, 49, 37, 19, 51, 35, 39, 43,  3,  1, 29, 23, 59, 31, 41, 53,  9, 63, 17, 33, 57, 15, 13, 45,  7, 11, 25, 27, 61, 21, 47, 55  // bottom of plot = South
 };
 
-/**
- * @brief ...
- */
-const std::map<std::string, std::string> fiber_type_compressor = {
-  {"", ""},
-  {"I-K", "K"},
-  {"K", "K"},
-  {"P-SG", "SG"},
-  {"PSG+IK+K", ""},
-  {"SG", "SG"},
-  {"SG-B", "SG"},
-  {"SG47", "SG"},
-};
-
 /**
  * @brief Check if a sector mapping is valid.
  * 
@@ -86,104 +76,33 @@ void check_sector_mapping(const std::vector<int> mapping) {
   }
 }
 
-class FiberBatch {
-  public:
-  FiberBatch(std::string fiber_batch) : str(fiber_batch) {
-    if (fiber_batch == "" || std::find(FIBER_BATCH_TREAT_EMPTY.begin(), FIBER_BATCH_TREAT_EMPTY.end(), fiber_batch) != FIBER_BATCH_TREAT_EMPTY.end()) {
-      valid = false;
-      batch_number = -1;
-      batch_letter = 'X';
-      return;
-    } else {
-      valid = true;
-      // REALLY valid if the constructor exits without throwing a runtime_error...
-    }
-    size_t dash_pos = fiber_batch.find('-');
-    if (dash_pos == std::string::npos) {
-      throw std::runtime_error(Form("unable to locate '-' in fiber batch: %s", fiber_batch.c_str()));
-    }
-    std::string numeric = fiber_batch.substr(0, dash_pos);
-    std::string alpha = fiber_batch.substr(dash_pos + 1, fiber_batch.length() - dash_pos);
-    // check numeric is numeric
-    for (const char &x: numeric) {
-      if (!isdigit(x)) {
-        throw std::runtime_error(Form("fiber type lhs contains a non-numeric character: %s", fiber_batch.c_str()));
-      }
-    }
-    batch_number = std::stoi(numeric);
-    // check alpha is exactly one character
-    if (alpha.length() != 1) {
-      throw std::runtime_error(Form("fiber type rhs contained more than one character: %s", fiber_batch.c_str()));
-    }
-    // check alpha is alpha and is uppercase
-    for (const char &x: alpha) {
-      if (!isalpha(x) || x != toupper(x)) {
-        throw std::runtime_error(Form("fiber type rhs contains a non-letter or is not uppercase: %s", fiber_batch.c_str()));
-      }
-    }
-    batch_letter = alpha[0];
-  }
-  bool operator ==(const FiberBatch &rhs) const {
-    return batch_number == rhs.batch_number && batch_letter == rhs.batch_letter;
-  }
-  bool operator !=(const FiberBatch &rhs) const {
-    return !(*this == rhs); 
-  }
-  bool operator <(const FiberBatch &rhs) const {
-    if (batch_number < rhs.batch_number) {
-      return true;
-    } else if (batch_number == rhs.batch_number && batch_letter < rhs.batch_letter) {
-      return true;
-    } else {
-      return false;
-    }
-  }
-  bool operator >(const FiberBatch &rhs) const {
-    return !(*this < rhs);
-  }
-  bool operator <=(const FiberBatch &rhs) const {
-    return (*this < rhs) || (*this == rhs);
-  }
-  bool operator >=(const FiberBatch &rhs) const {
-    return (*this > rhs) || (*this == rhs);
-  }
+/**
+ * @brief Plotted value of every row of a BlockTable, and which rows are drawn.
+ */
+typedef struct BlockValues {
+  Selection selected;
+  std::vector<double> values;
+} BlockValues;
 
-  bool valid;
-  std::string str;
-  int batch_number;
-  char batch_letter;
-};
+typedef std::function<BlockValues(const BlockTable &)> value_getter;
 
 /**
- * @brief Struct that packages all information associated with a block.
+ * @brief Build a value getter from expressions (see includes/expr.h), e.g. ("mpv", "mpv > 0 && vendor == UIUC"). The
+ *    getter evaluates both over the whole table at once.
+ * 
+ * @param value expression for the plotted value.
+ * @param cut expression selecting the blocks to plot; "" plots every block.
+ * @return value_getter 
  */
-typedef struct Block {
-  unsigned int sector;
-  unsigned int block_number;
-  std::string dbn;
-  double mpv;
-  double mpv_err;
-  double ch0_mpv;
-  double ch0_mpv_err;
-  double ch1_mpv;
-  double ch1_mpv_err;
-  double ch2_mpv;
-  double ch2_mpv_err;
-  double ch3_mpv;
-  double ch3_mpv_err;
-  double density;
-  double fiber_count;
-  double fiber_t1_count;
-  double fiber_t2_count;
-  double fiber_t3_count;
-  double fiber_t4_count;
-  double scint_ratio;
-  std::string fiber_type;
-  FiberBatch fiber_batch;
-  std::string w_powder;
-} Block;
-
-typedef std::function<std::pair<bool, double>(Block)> value_getter;
+value_getter expr_value_getter(const std::string &value, const std::string &cut) {
+  ScopedTimer timer("plot: parse value and cut expressions");
+  Expr value_expr = Expr::compile(value);
+  Expr cut_expr = Expr::compile(cut.empty() ? "1" : cut);
+  return [value_expr, cut_expr](const BlockTable &table) {
+    ScopedTimer timer("plot: evaluate value and cut expressions");
+    return BlockValues{cut_expr.select(table), value_expr.project(table)};
+  };
+}
 
 /**
  * @brief Struct that packages all details of a single plot (e.g., density).
@@ -226,123 +145,86 @@ std::pair<unsigned int, unsigned int> get_block_loc(Block block, std::vector<int
 }
 
 /**
- * @brief Plot sector numbers (1 - 64) and block type (1 - 24) onto the current canvas. Draws sector numbers above/below sector.
- *    Draws block type left of y axis. NOTE: drawn numbers overlap with x and y axis number, so  one must ...->SetLabelOffset(999.0). 
+ * @brief Add a label whose box is given in block-level coordinates to a layer, scaled to channel level if needed.
+ */
+void add_map_label(LabelLayer &layer, bool channel_lvl, double x_center, double y_center, double width, double height,
+                   const std::string &text, int align, int font) {
+  double scale = channel_lvl ? 2 : 1;
+  layer.add(scale*(x_center - width/2), scale*(y_center - height/2), scale*(x_center + width/2), scale*(y_center + height/2),
+            text, align, font);
+}
+
+/**
+ * @brief Sector numbers (1 - 64) above/below each sector, block type (1 - 24) left of the y axis and A/B/C/D above/below
+ *    each block column.
  * 
- * @param channel_lvl whether plotting on a channel/tower-level canvas (TRUE) or block-level (FALSE).
+ * @param channel_lvl whether for a channel/tower-level canvas (TRUE) or block-level (FALSE).
  */
-void plot_sector_and_block_labels(bool channel_lvl = false) {
+LabelLayer *make_sector_and_block_labels(bool channel_lvl) {
+  LabelLayer *layer = new LabelLayer();
   double sector_box_width = 3;
   double sector_box_height = 1.5;
-  // odd sectors
-  for (unsigned int i = 0; i < 32; i++) {
-    double x_center = 2 + 4*i;
-    double y_center = 48 + 1.5;
-    TPaveText *text;
-    if (!channel_lvl) {
-      text = new TPaveText(x_center - sector_box_width/2, y_center - sector_box_height/2, x_center + sector_box_width/2, y_center + sector_box_height/2, "NB");
-    } else {
-      text = new TPaveText(2*(x_center - sector_box_width/2), 2*(y_center - sector_box_height/2), 2*(x_center + sector_box_width/2), 2*(y_center + sector_box_height/2), "NB");
-    }
-    text->SetTextFont(42);
-    text->SetFillColorAlpha(0, 0);
-    text->AddText(Form("%d", 2*i + 1));
-    text->SetTextAlign(22);
-    text->Draw();
-  }
-  // even sectors
   for (unsigned int i = 0; i < 32; i++) {
-    double x_center = 2 + 4*i;
-    double y_center = -1.5;
-    TPaveText *text;
-    if (!channel_lvl) {
-      text = new TPaveText(x_center - sector_box_width/2, y_center - sector_box_height/2, x_center + sector_box_width/2, y_center + sector_box_height/2, "NB");
-    } else {
-      text = new TPaveText(2*(x_center - sector_box_width/2), 2*(y_center - sector_box_height/2), 2*(x_center + sector_box_width/2), 2*(y_center + sector_box_height/2), "NB");
-    }
-    text->SetTextFont(42);
-    text->SetFillColorAlpha(0, 0);
-    text->AddText(Form("%d", 2*i + 2));
-    text->SetTextAlign(22);
-    text->Draw();
+    // odd sectors
+    add_map_label(*layer, channel_lvl, 2 + 4*i, 48 + 1.5, sector_box_width, sector_box_height, Form("%d", 2*i + 1), 22, 42);
+    // even sectors
+    add_map_label(*layer, channel_lvl, 2 + 4*i, -1.5, sector_box_width, sector_box_height, Form("%d", 2*i + 2), 22, 42);
   }
 
   double block_box_width = 3;
   double block_box_height = 1;
   for (unsigned int i = 0; i < 24; i++) {
-    double x_center1 = -2;
-    double y_center1 = 23.5 - i;
-    TPaveText *text1;
-    if (!channel_lvl) {
-      text1 = new TPaveText(x_center1 - block_box_width/2, y_center1 - block_box_height/2, x_center1 + block_box_width/2, y_center1 + block_box_height/2, "NB");
-    } else {
-      text1 = new TPaveText(2*(x_center1 - block_box_width/2), 2*(y_center1 - block_box_height/2), 2*(x_center1 + block_box_width/2), 2*(y_center1 + block_box_height/2), "NB");
-    }
-    
-    text1->SetTextFont(42);
-    text1->SetFillColorAlpha(0, 0);
-    text1->AddText(Form("%d", i + 1));
-    text1->SetTextAlign(32);
-    text1->Draw();
-
-    double x_center2 = -2;
-    double y_center2 = 24.5 + i;
-    TPaveText *text2;
-    if (!channel_lvl) {
-      text2 = new TPaveText(x_center2 - block_box_width/2, y_center2 - block_box_height/2, x_center2 + block_box_width/2, y_center2 + block_box_height/2, "NB");
-    } else {
-      text2 = new TPaveText(2*(x_center2 - block_box_width/2), 2*(y_center2 - block_box_height/2), 2*(x_center2 + block_box_width/2), 2*(y_center2 + block_box_height/2), "NB");
-    }
-    text2->SetTextFont(42);
-    text2->SetFillColorAlpha(0, 0);
-    text2->AddText(Form("%d", i + 1));
-    text2->SetTextAlign(32);
-    text2->Draw();
+    add_map_label(*layer, channel_lvl, -2, 23.5 - i, block_box_width, block_box_height, Form("%d", i + 1), 32, 42);
+    add_map_label(*layer, channel_lvl, -2, 24.5 + i, block_box_width, block_box_height, Form("%d", i + 1), 32, 42);
   }
 
   double label_box_width = 1;
   double label_box_height = 0.8;
-
-  // south ABCD
   std::vector<std::string> south_labels = {"A", "B", "C", "D"};
-  for (unsigned int i = 0; i < 32; i++) {
-    double x_start = 4*i + 0.5;
-    for (unsigned int j = 0; j < 4; j++) {
-      double x_center = x_start + j;
-      double y_center = 48.5;
-      TPaveText *text;
-      if (!channel_lvl) {
-        text = new TPaveText(x_center - label_box_width/2, y_center - label_box_height/2, x_center + label_box_width/2, y_center + label_box_height/2, "NB");
-      } else {
-        text = new TPaveText(2*(x_center - label_box_width/2), 2*(y_center - label_box_height/2), 2*(x_center + label_box_width/2), 2*(y_center + label_box_height/2), "NB");
-      }
-      text->SetTextFont(82);
-      text->SetFillColorAlpha(0, 0);
-      text->AddText(south_labels[j].c_str());
-      text->SetTextAlign(22);
-      text->Draw();
-    }
-  }
-  // north ABCD
   std::vector<std::string> north_labels = {"D", "C", "B", "A"};
   for (unsigned int i = 0; i < 32; i++) {
     double x_start = 4*i + 0.5;
     for (unsigned int j = 0; j < 4; j++) {
-      double x_center = x_start + j;
-      double y_center = -0.5;
-      TPaveText *text;
-      if (!channel_lvl) {
-        text = new TPaveText(x_center - label_box_width/2, y_center - label_box_height/2, x_center + label_box_width/2, y_center + label_box_height/2, "NB");
-      } else {
-        text = new TPaveText(2*(x_center - label_box_width/2), 2*(y_center - label_box_height/2), 2*(x_center + label_box_width/2), 2*(y_center + label_box_height/2), "NB");
-      }
-      text->SetTextFont(82);
-      text->SetFillColorAlpha(0, 0);
-      text->AddText(north_labels[j].c_str());
-      text->SetTextAlign(22);
-      text->Draw();
+      add_map_label(*layer, channel_lvl, x_start + j, 48.5, label_box_width, label_box_height, south_labels[j], 22, 82);
+      add_map_label(*layer, channel_lvl, x_start + j, -0.5, label_box_width, label_box_height, north_labels[j], 22, 82);
     }
   }
+  return layer;
+}
+
+/**
+ * @brief Shared sector and block labels (see make_sector_and_block_labels), built once (thread-safe) for all canvases.
+ */
+LabelLayer &sector_and_block_label_layer(bool channel_lvl) {
+  static LabelLayer *layers[2] = {make_sector_and_block_labels(false), make_sector_and_block_labels(true)};
+  return *layers[channel_lvl];
+}
+
+/**
+ * @brief Plot sector numbers (1 - 64) and block type (1 - 24) onto the current canvas. Draws sector numbers above/below sector.
+ *    Draws block type left of y axis. NOTE: drawn numbers overlap with x and y axis number, so  one must ...->SetLabelOffset(999.0). 
+ * 
+ * @param channel_lvl whether plotting on a channel/tower-level canvas (TRUE) or block-level (FALSE).
+ */
+void plot_sector_and_block_labels(bool channel_lvl = false) {
+  sector_and_block_label_layer(channel_lvl).Draw();
+}
+
+/**
+ * @brief DBN of each block at its (pseudo sector mapping) location, as a single drawable.
+ * 
+ * @param all_blocks all blocks in the EMCal.
+ * @return new LabelLayer (set kCanDelete to let the canvas own it)
+ */
+LabelLayer *make_dbn_labels(const std::vector<Block> &all_blocks) {
+  LabelLayer *dbn_labels = new LabelLayer();
+  for (const Block& block : all_blocks) {
+    auto offsets = get_block_loc(block, pseudo_sector_mapping);
+    double x_center = offsets.first + 0.5;
+    double y_center = offsets.second + 0.5;
+    dbn_labels->add(x_center - 2.5, y_center - 2.5, x_center + 2.5, y_center + 2.5, block.dbn, 22, 102, 0.0035);
+  }
+  return dbn_labels;
 }
 
 /**
@@ -351,67 +233,132 @@ void plot_sector_and_block_labels(bool channel_lvl = false) {
  * @param channel_lvl whether plotting on a channel/tower-level canvas (TRUE) or block-level (FALSE).
  */
 void plot_sector_labels_debug(bool channel_lvl = false) {
-  double sector_box_width = 3;
-  double sector_box_height = 1.5;
-  // SOUTH (odd pseudo-sectors)
-  for (unsigned int i = 0; i < 32; i++) {
-    double x_center;
-    x_center = 2 + 4*i;
-    double y_center = 36;
-    TPaveText *text;
-    if (!channel_lvl) {
-      text = new TPaveText(x_center - sector_box_width/2, y_center - sector_box_height/2, x_center + sector_box_width/2, y_center + sector_box_height/2, "NB");
-    } else {
-      text = new TPaveText(2*(x_center - sector_box_width/2), 2*(y_center - sector_box_height/2), 2*(x_center + sector_box_width/2), 2*(y_center + sector_box_height/2), "NB");
+  auto make_labels = [](bool channel_lvl) {
+    LabelLayer *layer = new LabelLayer();
+    double sector_box_width = 3;
+    double sector_box_height = 1.5;
+    for (unsigned int i = 0; i < 32; i++) {
+      // SOUTH (odd pseudo-sectors)
+      add_map_label(*layer, channel_lvl, 2 + 4*i, 36, sector_box_width, sector_box_height, Form("%d", true_sector_mapping[i]), 22, 42);
+      // NORTH (even pseudo-sectors)
+      add_map_label(*layer, channel_lvl, 2 + 4*i, 12, sector_box_width, sector_box_height, Form("%d", true_sector_mapping[i + 32]), 22, 42);
+    }
+    return layer;
+  };
+  static LabelLayer *layers[2] = {make_labels(false), make_labels(true)};
+  layers[channel_lvl]->Draw();
+}
+
+/**
+ * @brief Labels, grid and axis ticks drawn by draw_axes (and plot_sector_and_block_labels / plot_sector_labels_debug),
+ *    in map cell coordinates, for the raster renderer.
+ * 
+ * @param channel_lvl whether the map is channel/tower-level (256 x 96) or block-level (128 x 48).
+ * @param mode "tim" or "caroline" (see draw_axes).
+ * @return MapDecor (titles are left empty)
+ */
+MapDecor map_decor(bool channel_lvl, std::string mode) {
+  double scale = channel_lvl ? 2 : 1;
+  int nx = channel_lvl ? 256 : 128;
+  int ny = channel_lvl ? 96 : 48;
+  MapDecor decor;
+  decor.grid_x = nx/32;
+  decor.grid_y = ny/2;
+  auto add = [&](double x, double y, std::string text, int align) {
+    decor.labels.push_back({scale*x, scale*y, text, align});
+  };
+  if (mode == "caroline") {
+    for (unsigned int i = 0; i < 32; i++) {
+      add(2 + 4*i, 48 + 1.5, Form("%d", 2*i + 1), 22);
+      add(2 + 4*i, -1.5, Form("%d", 2*i + 2), 22);
+    }
+    for (unsigned int i = 0; i < 24; i++) {
+      add(-0.5, 23.5 - i, Form("%d", i + 1), 32);
+      add(-0.5, 24.5 + i, Form("%d", i + 1), 32);
+    }
+    const char *south_labels[4] = {"A", "B", "C", "D"};
+    const char *north_labels[4] = {"D", "C", "B", "A"};
+    for (unsigned int i = 0; i < 32; i++) {
+      for (unsigned int j = 0; j < 4; j++) {
+        add(4*i + 0.5 + j, 48.5, south_labels[j], 22);
+        add(4*i + 0.5 + j, -0.5, north_labels[j], 22);
+      }
+    }
+  } else if (mode == "tim") {
+    for (unsigned int i = 0; i < 32; i++) {
+      add(2 + 4*i, 36, Form("%d", true_sector_mapping[i]), 22);
+      add(2 + 4*i, 12, Form("%d", true_sector_mapping[i + 32]), 22);
+    }
+    // same ranges and primary divisions as the TGaxis objects of draw_axes
+    for (int k = 0; k <= 16; k++) {
+      decor.x_ticks.push_back({k*nx/16.0, Form("%d", (int) (-2*scale + k*8*scale))});
     }
-    text->SetTextFont(42);
-    text->SetFillColorAlpha(0, 0);
-    text->AddText(Form("%d", true_sector_mapping[i]));
-    text->SetTextAlign(22);
-    text->Draw();
+    for (int k = 0; k <= 12; k++) {
+      decor.y_ticks.push_back({k*ny/12.0, Form("%d", (int) (-24*scale + k*4*scale))});
+    }
+  } else {
+    throw std::runtime_error(Form("unknown mode '%s'", mode.c_str()));
   }
-  // NORTH (even pseudo-sectors)
-  for (unsigned int i = 0; i < 32; i++) {
-    double x_center;
-    x_center = 2 + 4*i;
-    double y_center = 12;
-    TPaveText *text;
-    if (!channel_lvl) {
-      text = new TPaveText(x_center - sector_box_width/2, y_center - sector_box_height/2, x_center + sector_box_width/2, y_center + sector_box_height/2, "NB");
-    } else {
-      text = new TPaveText(2*(x_center - sector_box_width/2), 2*(y_center - sector_box_height/2), 2*(x_center + sector_box_width/2), 2*(y_center + sector_box_height/2), "NB");
+  return decor;
+}
+
+/**
+ * @brief Render a map histogram to PNG with the raster renderer instead of a TCanvas (same layout as draw_axes).
+ * 
+ * @param h 128 x 48 block-level or 256 x 96 channel-level map; its titles and minimum/maximum are used.
+ * @param channel_lvl 
+ * @param mode "tim" or "caroline" (see draw_axes).
+ * @param file_name 
+ * @param palette 
+ */
+void save_map_png(TH2D *h, bool channel_lvl, std::string mode, const std::string &file_name, Palette palette = Palette::BIRD) {
+  int nx = h->GetNbinsX();
+  int ny = h->GetNbinsY();
+  std::vector<double> cells(nx*ny);
+  for (int j = 0; j < ny; j++) {
+    for (int i = 0; i < nx; i++) {
+      cells[j*nx + i] = h->GetBinContent(i + 1, j + 1);
     }
-    text->SetTextFont(42);
-    text->SetFillColorAlpha(0, 0);
-    text->AddText(Form("%d", true_sector_mapping[i + 32]));
-    text->SetTextAlign(22);
-    text->Draw();
   }
+  MapDecor decor = map_decor(channel_lvl, mode);
+  decor.title = h->GetTitle();
+  decor.x_title = h->GetXaxis()->GetTitle();
+  decor.y_title = h->GetYaxis()->GetTitle();
+  decor.z_title = h->GetZaxis()->GetTitle();
+  render_map(cells, nx, ny, h->GetMinimum(), h->GetMaximum(), decor, palette, channel_lvl ? 4 : 8).write_png(file_name);
 }
 
 /**
- * @brief Plots EMCal plots for a single value (e.g., density).
+ * @brief Block maps of a single value: with the pseudo sector mapping (flat COLZ plots) and the true one (3D plots).
+ */
+typedef struct ValueMaps {
+  TH2D *h_pseudo;
+  TH2D *h_true;
+} ValueMaps;
+
+/**
+ * @brief Fill the block maps of a single value (e.g., density) and set up their titles, ranges and axes for drawing.
  * 
+ * @param ctx plotting context.
  * @param all_blocks all blocks in the EMCal.
  * @param cfg plot configuration for the value to plot.
+ * @param values of cfg.get_value over the BlockTable of all_blocks.
+ * @return ValueMaps (owned by the caller)
  */
-void plot_helper(std::vector<Block> all_blocks, PlotConfig cfg) {
-  gStyle->SetOptStat(0);
-  gStyle->SetLineScalePS(0.5);
-  
-  TH2D* h_pseudo = new TH2D("", "", 128, 0, 128, 48, 0, 48);
-  TH2D* h_true = new TH2D("", "", 128, -2, 126, 48, -24, 24);
+ValueMaps make_value_maps(const PlotContext &ctx, const std::vector<Block> &all_blocks, const PlotConfig &cfg, const BlockValues &values) {
+  TH2D* h_pseudo = ctx.hist<TH2D>("h_pseudo_" + cfg.file_name, "", 128, 0, 128, 48, 0, 48);
+  TH2D* h_true = ctx.hist<TH2D>("h_true_" + cfg.file_name, "", 128, -2, 126, 48, -24, 24);
 
-  for (const Block& block : all_blocks) {
+  for (size_t row = 0; row < all_blocks.size(); row++) {
+    const Block &block = all_blocks[row];
     auto pseudo_offsets = get_block_loc(block, pseudo_sector_mapping);
     auto true_offsets = get_block_loc(block, true_sector_mapping);
     unsigned int pseudo_x_offset = pseudo_offsets.first;
     unsigned int pseudo_y_offset = pseudo_offsets.second;
     unsigned int true_x_offset = true_offsets.first;
     unsigned int true_y_offset = true_offsets.second;
-    std::pair<bool, double> p = cfg.get_value(block);
-    if (p.first) {
-      double value = p.second;
+    if (is_selected(values.selected, row)) {
+      double value = values.values[row];
       h_pseudo->SetBinContent(pseudo_x_offset + 1, pseudo_y_offset + 1, value);
       h_true->SetBinContent(true_x_offset + 1, true_y_offset + 1, value);
       // printf("set bin content for %3d, %3d = sector %2d, block_num %2d\n", x_offset, y_offset, block.sector, block.block_number);
@@ -421,39 +368,13 @@ void plot_helper(std::vector<Block> all_blocks, PlotConfig cfg) {
   }
 
   std::string title = Form("sPHENIX EMCAL %s;#phi [Blocks];#eta [Blocks];%s%s", cfg.title.c_str(), cfg.title.c_str(), cfg.units.c_str());
-
-  TCanvas* c0 = new TCanvas("c0", "", 700, 500);
-  c0->SetRightMargin(0.125);
-  c0->SetGrid();
-  gStyle->SetOptStat(0);
-  h_pseudo->SetTitle(title.c_str());
-  h_pseudo->SetMinimum(cfg.plot_min);
-  h_pseudo->SetMaximum(cfg.plot_max);
-  h_true->SetMinimum(cfg.plot_min);
-  h_true->SetMaximum(cfg.plot_max);
-  h_pseudo->SetAxisRange(0, 128 - 1, "X");
-  h_pseudo->SetAxisRange(0, 48 - 1, "Y");
-  // h_pseudo->GetXaxis()->SetRange(0, 128);
-  // h_pseudo->GetYaxis()->SetRange(0, 48);
-  h_pseudo->GetXaxis()->SetNdivisions(32, false);
-  h_pseudo->GetYaxis()->SetNdivisions(2, false);
-  h_pseudo->GetXaxis()->SetLabelOffset(999.0);
-  h_pseudo->GetYaxis()->SetLabelOffset(999.0);
-  h_pseudo->GetXaxis()->SetTickLength(0);
-  h_pseudo->GetYaxis()->SetTickLength(0);
-  h_pseudo->Draw("COLZ0");
-  plot_sector_and_block_labels();
-  c0->SaveAs(Form("emcal_plots/plot_colz_%s.pdf", cfg.file_name.c_str()));
-
-  TCanvas* c1 = new TCanvas("c1", "", 1200, 500);
-  c1->SetRightMargin(0.125);
-  c1->SetGrid();
-  gStyle->SetOptStat(0);
   h_pseudo->SetTitle(title.c_str());
   h_pseudo->SetMinimum(cfg.plot_min);
   h_pseudo->SetMaximum(cfg.plot_max);
+  h_true->SetTitle(title.c_str());
   h_true->SetMinimum(cfg.plot_min);
   h_true->SetMaximum(cfg.plot_max);
+
   h_pseudo->SetAxisRange(0, 128 - 1, "X");
   h_pseudo->SetAxisRange(0, 48 - 1, "Y");
   // h_pseudo->GetXaxis()->SetRange(0, 128);
@@ -464,674 +385,252 @@ void plot_helper(std::vector<Block> all_blocks, PlotConfig cfg) {
   h_pseudo->GetYaxis()->SetLabelOffset(999.0);
   h_pseudo->GetXaxis()->SetTickLength(0);
   h_pseudo->GetYaxis()->SetTickLength(0);
-  h_pseudo->Draw("COLZ0");
-
-  plot_sector_and_block_labels();
-
-  // dbns
-  unsigned int max_strlen = 0;
-  for (const Block& block : all_blocks) {
-    auto offsets = get_block_loc(block, pseudo_sector_mapping);
-    double x_center = offsets.first + 0.5;
-    double y_center = offsets.second + 0.5;
-    TPaveText *text = new TPaveText(x_center - 2.5, y_center - 2.5, x_center + 2.5, y_center + 2.5, "NB");
-    text->SetTextFont(102);
-    text->SetTextSize(0.0035);
-    text->SetFillColorAlpha(0, 0);
-    text->AddText(Form("%s", block.dbn.c_str()));
-    text->SetTextAlign(22);
-    text->Draw();
-  }
 
-  c1->SaveAs(Form("emcal_plots/plot_colz_dbn_%s.pdf", cfg.file_name.c_str()));
-  
-  gStyle->SetImageScaling(2.0);
   // h->SetMinimum(0);
-  
   h_true->GetXaxis()->SetTitleOffset(1.7);
   h_true->GetYaxis()->SetTitleOffset(1.7);
   h_true->GetZaxis()->SetTitleOffset(1.2);
-
-  TCanvas* c2 = new TCanvas("c2", "", 900, 500);
-  h_true->SetLineColorAlpha(kBlack, 1.0);
-  h_true->SetTitle(title.c_str());
-  h_true->Draw("LEGO2 0");
-  c2->SaveAs(Form("emcal_plots/plot_lego_%s.png", cfg.file_name.c_str()));
-
-  TCanvas* c3 = new TCanvas("c3", "", 900, 500);
-  h_true->SetLineColorAlpha(kBlack, 1.0);
-  h_true->SetFillColorAlpha(cfg.color, 1.0);
-  h_true->SetTitle(title.c_str());
-  h_true->Draw("LEGO1 CYL 0");
-  c3->SaveAs(Form("emcal_plots/plot_cyl_%s_front.png", cfg.file_name.c_str()));
-  gPad->SetPhi(gPad->GetPhi() + 180);
-  gPad->Update();
-  c3->SaveAs(Form("emcal_plots/plot_cyl_%s_back.png", cfg.file_name.c_str()));
-  
-  TCanvas* c4 = new TCanvas("c4", "", 900, 500);
   h_true->SetLineColorAlpha(kBlack, 1.0);
   h_true->SetFillColorAlpha(cfg.color, 1.0);
-  h_true->SetTitle(title.c_str());
-  h_true->Draw("LEGO1 PSR 0");
-  c4->SaveAs(Form("emcal_plots/plot_psr_%s_front.png", cfg.file_name.c_str()));
-  gPad->SetPhi(gPad->GetPhi() + 180);
-  gPad->Update();
-  c4->SaveAs(Form("emcal_plots/plot_psr_%s_back.png", cfg.file_name.c_str()));
-  
-  delete c0;
-  delete c1;
-  delete c2;
-  delete c3;
-  delete c4;
+  return {h_pseudo, h_true};
+}
 
-  gStyle->SetImageScaling(1.0);
+/**
+ * @brief Output file of the flat (COLZ) map of a value: PNG if the context renders raster maps, PDF otherwise.
+ * 
+ * @param dbn whether the map with the DBN of every block (PDF only).
+ */
+std::string value_colz_output(const PlotContext &ctx, const PlotConfig &cfg, bool dbn) {
+  return ctx.path(Form("plot_colz_%s%s.%s", dbn ? "dbn_" : "", cfg.file_name.c_str(), ctx.raster && !dbn ? "png" : "pdf"));
 }
 
 /**
- * @brief 
+ * @brief Draw and save the flat map of a value (see value_colz_output), optionally with the DBN of every block.
  * 
- * @param all_blocks 
+ * @param ctx 
+ * @param maps 
+ * @param cfg 
+ * @param dbn_blocks if not null, the blocks whose DBNs are drawn (ROOT renderer only).
  */
-void make_histograms(std::vector<Block> all_blocks) {
-  TH1D *h_mpv_block_dist = new TH1D("h_mpv_block_dist", "Distribution of EMCal Block MPV;MPV;Count [Blocks]", 80, 0, 1000);
-  TH1D *h_mpv_chnl_dist = new TH1D("h_mpv_chnl_dist", "Distribution of EMCal Channel MPV;MPV;Count [Channels]", 80, 0, 1000);
-  
-  TH1D *h_fiber_count_block_dist = new TH1D("h_fiber_count_block_dist", "Distribution of EMCal Block Fiber Count;Fiber Count [%];Count [Block]", 80, 80, 120);
-  TH1D *h_fiber_count_tower_dist = new TH1D("h_fiber_count_tower_dist", "Distribution of EMCal Tower Fiber Count;Fiber Count [%];Count [Towers]", 80, 80, 120);
-  
-  THStack *hs_mpv_block_dist = new THStack("hs_mpv_block_dist", "Distribution of EMCal Block MPV;MPV;Count [Blocks]");
-  TH1D *h_mpv_block_dist_uiuc_1 = new TH1D("", "", 80, 0, 800);
-  TH1D *h_mpv_block_dist_uiuc_2 = new TH1D("", "", 80, 0, 800);
-  TH1D *h_mpv_block_dist_china_sg = new TH1D("", "", 80, 0, 800);
-  TH1D *h_mpv_block_dist_china_k = new TH1D("", "", 80, 0, 800);
-  
-  THStack *hs_mpv_chnl_dist = new THStack("hs_mpv_chnl_dist", "Distribution of EMCal Channel MPV;MPV;Count [Channels]");
-  TH1D *h_mpv_chnl_dist_uiuc_1 = new TH1D("", "", 80, 0, 800);
-  TH1D *h_mpv_chnl_dist_uiuc_2 = new TH1D("", "", 80, 0, 800);
-  TH1D *h_mpv_chnl_dist_china_sg = new TH1D("", "", 80, 0, 800);
-  TH1D *h_mpv_chnl_dist_china_k = new TH1D("", "", 80, 0, 800);
-
-  THStack *hs_fiber_count_block_dist = new THStack("hs_fiber_count_block_dist", "Distribution of EMCal Block Fiber Count;Fiber Count [%];Count [Blocks]");
-  TH1D *h_fiber_count_block_dist_uiuc = new TH1D("", "", 80, 95, 101);
-  TH1D *h_fiber_count_block_dist_fudan = new TH1D("", "", 80, 95, 101);
-  TH1D *h_fiber_count_block_dist_ciae = new TH1D("", "", 80, 95, 101);
-  
-  THStack *hs_fiber_count_tower_dist = new THStack("hs_fiber_count_tower_dist", "Distribution of EMCal Tower Fiber Count;Fiber Count [%];Count [Towers]");
-  TH1D *h_fiber_count_tower_dist_uiuc = new TH1D("", "", 80, 90, 105);
-  TH1D *h_fiber_count_tower_dist_fudan = new TH1D("", "", 80, 90, 105);
-  TH1D *h_fiber_count_tower_dist_ciae = new TH1D("", "", 80, 90, 105);
-  
-  THStack *hs_density_dist = new THStack("hs_density_dist", "Distribution of EMCal Block Density;Density [g/mL];Count [Blocks]");
-  TH1D *h_density_dist_uiuc = new TH1D("", "", 30, 8, 11);
-  TH1D *h_density_dist_fudan = new TH1D("", "", 30, 8, 11);
-  TH1D *h_density_dist_ciae = new TH1D("", "", 30, 8, 11);
-  
-  THStack *hs_scint_ratio_dist = new THStack("hs_scint_ratio_dist", "Distribution of EMCal Block Scintillation Ratio;Scintillation Ratio;Count [Blocks]");
-  TH1D *h_scint_ratio_dist_uiuc = new TH1D("", "", 80, 0, 4);
-  TH1D *h_scint_ratio_dist_fudan = new TH1D("", "", 80, 0, 4);
-  TH1D *h_scint_ratio_dist_ciae = new TH1D("", "", 80, 0, 4);
+void draw_value_colz(const PlotContext &ctx, const ValueMaps &maps, const PlotConfig &cfg, const std::vector<Block> *dbn_blocks = nullptr) {
+  if (ctx.raster && !dbn_blocks) {
+    save_map_png(maps.h_pseudo, false, "caroline", value_colz_output(ctx, cfg, false), ctx.style.palette);
+    return;
+  }
+  std::string file_name = Form("plot_colz_%s%s.pdf", dbn_blocks ? "dbn_" : "", cfg.file_name.c_str());
+  TCanvas *canvas = ctx.draw(dbn_blocks ? 1200 : 700, 500, [&](TCanvas *c) {
+    c->SetRightMargin(0.125);
+    c->SetGrid();
+    maps.h_pseudo->Draw("COLZ0");
+    plot_sector_and_block_labels();
+    if (dbn_blocks) {
+      // dbns (one primitive for all blocks, owned by the canvas)
+      LabelLayer *dbn_labels = make_dbn_labels(*dbn_blocks);
+      dbn_labels->SetBit(TObject::kCanDelete);
+      dbn_labels->Draw();
+    }
+  }, file_name);
+  ctx.close(canvas);
+}
 
+/**
+ * @brief Output files of a 3D view of a value.
+ * 
+ * @param view "LEGO" (one file) or a LEGO1 coordinate system, "CYL" or "PSR" (front and back files).
+ */
+std::vector<std::string> value_3d_outputs(const PlotContext &ctx, const PlotConfig &cfg, const std::string &view) {
+  if (view == "LEGO") {
+    return {ctx.path(Form("plot_lego_%s.png", cfg.file_name.c_str()))};
+  }
+  std::string prefix = view == "CYL" ? "plot_cyl_" : "plot_psr_";
+  return {ctx.path(prefix + cfg.file_name + "_front.png"), ctx.path(prefix + cfg.file_name + "_back.png")};
+}
 
-  std::map<std::string, int> fiber_type_counter;
-  std::map<std::string, int> fiber_batch_counter;
-  std::set<std::string> fiber_batch_set;
-  std::map<int, int> fiber_batch_number_counter;
-  std::set<int> fiber_batch_number_set;
+/**
+ * @brief Draw and save a 3D view of a value (see value_3d_outputs), at image scaling 2.
+ * 
+ * @param ctx 
+ * @param maps 
+ * @param cfg 
+ * @param view "LEGO", "CYL" or "PSR".
+ */
+void draw_value_3d(const PlotContext &ctx, const ValueMaps &maps, const PlotConfig &cfg, const std::string &view) {
+  PlotContext ctx_3d = ctx;
+  ctx_3d.style.image_scaling = 2.0;
+  TCanvas *canvas;
+  if (view == "LEGO") {
+    canvas = ctx_3d.draw(900, 500, [&](TCanvas *) {
+      maps.h_true->Draw("LEGO2 0");
+    }, Form("plot_lego_%s.png", cfg.file_name.c_str()));
+  } else {
+    std::string prefix = view == "CYL" ? "plot_cyl_" : "plot_psr_";
+    canvas = ctx_3d.draw(900, 500, [&](TCanvas *c) {
+      maps.h_true->Draw(("LEGO1 " + view + " 0").c_str());
+      ctx_3d.save(c, prefix + cfg.file_name + "_front.png");
+      c->SetPhi(c->GetPhi() + 180);
+      ctx_3d.save(c, prefix + cfg.file_name + "_back.png");
+    });
+  }
+  ctx.close(canvas);
+}
 
-  for (Block &block : all_blocks) {
-    if (fiber_type_counter.find(block.fiber_type) == fiber_type_counter.end()) {
-      fiber_type_counter[block.fiber_type] = 1;
-    } else {
-      fiber_type_counter[block.fiber_type]++;
+/**
+ * @brief Plots EMCal plots for a single value (e.g., density).
+ * 
+ * @param ctx plotting context (style, palette, output directory; raster writes only the flat map, as PNG through the
+ *    raster renderer, without the DBN overlay or 3D views).
+ * @param all_blocks all blocks in the EMCal.
+ * @param cfg plot configuration for the value to plot.
+ */
+void plot_helper(const PlotContext &ctx, std::vector<Block> all_blocks, PlotConfig cfg) {
+  ScopedTimer maps_timer("plot_helper: value maps", cfg.file_name.c_str());
+  ValueMaps maps = make_value_maps(ctx, all_blocks, cfg, cfg.get_value(BlockTable(all_blocks)));
+  RootArena plot_arena;   // the maps, also if a drawing throws
+  plot_arena.adopt(maps.h_pseudo);
+  plot_arena.adopt(maps.h_true);
+  maps_timer.stop();
+  {
+    ScopedTimer timer("plot_helper: colz", cfg.file_name.c_str());
+    draw_value_colz(ctx, maps, cfg);
+  }
+  if (!ctx.raster) {
+    // the DBN overlay and the 3D views need ROOT's renderer
+    {
+      ScopedTimer timer("plot_helper: colz dbn", cfg.file_name.c_str());
+      draw_value_colz(ctx, maps, cfg, &all_blocks);
     }
-    if (block.fiber_batch.valid) {
-      fiber_batch_set.insert(block.fiber_batch.str);
-      if (fiber_batch_counter.find(block.fiber_batch.str) == fiber_batch_counter.end()) {
-        fiber_batch_counter[block.fiber_batch.str] = 1;
-      } else {
-        fiber_batch_counter[block.fiber_batch.str]++;
-      }
-      fiber_batch_number_set.insert(block.fiber_batch.batch_number);
-      if (fiber_batch_number_counter.find(block.fiber_batch.batch_number) == fiber_batch_number_counter.end()) {
-        fiber_batch_number_counter[block.fiber_batch.batch_number] = 1;
-      } else {
-        fiber_batch_number_counter[block.fiber_batch.batch_number]++;
-      }
+    const std::pair<const char*, const char*> views[] = {{"LEGO", "plot_helper: lego"}, {"CYL", "plot_helper: cyl"}, {"PSR", "plot_helper: psr"}};
+    for (const auto &view : views) {
+      ScopedTimer timer(view.second, cfg.file_name.c_str());
+      draw_value_3d(ctx, maps, cfg, view.first);
     }
   }
+}
 
-  std::vector<std::string> fiber_batch_list;
-  for (const std::string &x : fiber_batch_set) {
-    fiber_batch_list.push_back(x);
+/**
+ * @brief MPV categories: UIUC blocks by fiber batch range (16-B was the last batch used in sectors 1-12, 21-A the first
+ *    used in sectors 13-64), Chinese blocks by (compressed) fiber type.
+ */
+const HistSplit mpv_split = {
+  {"UIUC S1-12", kBlue, nullptr, "vendor == UIUC && fiber_batch in (-inf, 16-B]"},
+  {"UIUC S13-64", kOrange + 7, nullptr, "vendor == UIUC && fiber_batch in [21-A, inf)"},
+  {"China SG", kRed, nullptr, "vendor != UIUC && fiber_type_compressed == SG"},
+  {"China K", kGreen, nullptr, "vendor != UIUC && fiber_type_compressed == K"},
+};
+
+/**
+ * @brief Cut of the histograms split by mpv_split: UIUC blocks without a (valid) fiber batch have no category and are
+ *    left out, so only blocks with a batch between the ranges or an unknown fiber type count as unmatched.
+ */
+const std::string mpv_split_cut = "vendor != UIUC || fiber_batch in (-inf, inf)";
+
+/**
+ * @brief Vendor categories.
+ */
+const HistSplit vendor_split = {
+  {"UIUC", kBlue, nullptr, "vendor == UIUC"},
+  {"Fudan", kRed, nullptr, "vendor == Fudan"},
+  {"CIAE", kGreen, nullptr, "vendor == CIAE"},
+};
+
+/**
+ * @brief Make distribution plots (MPV, fiber count, density, scintillation ratio) and fiber batch/type counts.
+ * 
+ * @param ctx plotting context (style, output directory).
+ * @param all_blocks 
+ * @param n_threads number of threads used to fill the histograms.
+ */
+void make_histograms(const PlotContext &ctx, const std::vector<Block> &all_blocks, unsigned int n_threads = 1) {
+  auto positive = [](double value) { return value > 0; };
+  quantity_getter block_mpv = block_quantity(&Block::mpv);
+  quantity_getter chnl_mpv = channel_quantity(&Block::ch0_mpv, &Block::ch1_mpv, &Block::ch2_mpv, &Block::ch3_mpv);
+  quantity_getter block_fiber_count = block_quantity(&Block::fiber_count);
+  quantity_getter tower_fiber_count = channel_quantity(&Block::fiber_t1_count, &Block::fiber_t2_count, &Block::fiber_t3_count, &Block::fiber_t4_count);
+
+  HistBuilder builder;
+  size_t h_mpv_block_dist = builder.add({"mpv_block_dist", "Distribution of EMCal Block MPV;MPV;Count [Blocks]", block_mpv, positive, 80, 0, 1000, nullptr, false, ""});
+  size_t h_mpv_chnl_dist = builder.add({"mpv_chnl_dist", "Distribution of EMCal Channel MPV;MPV;Count [Channels]", chnl_mpv, positive, 80, 0, 1000, nullptr, false, ""});
+  size_t h_fiber_count_block_dist = builder.add({"fiber_count_block_dist", "Distribution of EMCal Block Fiber Count;Fiber Count [%];Count [Block]", block_fiber_count, positive, 80, 80, 120, nullptr, false, ""});
+  size_t h_fiber_count_tower_dist = builder.add({"fiber_count_tower_dist", "Distribution of EMCal Tower Fiber Count;Fiber Count [%];Count [Towers]", tower_fiber_count, positive, 80, 80, 120, nullptr, false, ""});
+
+  size_t hs_mpv_block_dist = builder.add({"mpv_block_dist", "Distribution of EMCal Block MPV;MPV;Count [Blocks]", block_mpv, positive, 80, 0, 800, &mpv_split, true, mpv_split_cut});
+  size_t hs_mpv_chnl_dist = builder.add({"mpv_chnl_dist", "Distribution of EMCal Channel MPV;MPV;Count [Channels]", chnl_mpv, positive, 80, 0, 800, &mpv_split, true, mpv_split_cut});
+  size_t hs_fiber_count_block_dist = builder.add({"fiber_count_block_dist", "Distribution of EMCal Block Fiber Count;Fiber Count [%];Count [Blocks]", block_fiber_count, positive, 80, 95, 101, &vendor_split, false, ""});
+  size_t hs_fiber_count_tower_dist = builder.add({"fiber_count_tower_dist", "Distribution of EMCal Tower Fiber Count;Fiber Count [%];Count [Towers]", tower_fiber_count, positive, 80, 90, 105, &vendor_split, false, ""});
+  size_t hs_density_dist = builder.add({"density_dist", "Distribution of EMCal Block Density;Density [g/mL];Count [Blocks]", block_quantity(&Block::density), positive, 30, 8, 11, &vendor_split, true, ""});
+  size_t hs_scint_ratio_dist = builder.add({"scint_ratio_dist", "Distribution of EMCal Block Scintillation Ratio;Scintillation Ratio;Count [Blocks]", block_quantity(&Block::scint_ratio), positive, 80, 0, 4, &vendor_split, true, ""});
+
+  size_t fiber_type_counter = builder.add_counter({"fiber_type", [](const Block &block, std::string &key) {
+    key = block.fiber_type;
+    return true;
+  }});
+  size_t fiber_batch_counter = builder.add_counter({"fiber_batch", [](const Block &block, std::string &key) {
+    key = block.fiber_batch.str;
+    return block.fiber_batch.valid;
+  }});
+
+  builder.fill(all_blocks, n_threads);
+
+  for (size_t spec : {hs_mpv_block_dist, hs_mpv_chnl_dist}) {
+    if (builder.n_unmatched(spec) > 0) {
+      std::cout << "PANIC: " << builder.n_unmatched(spec) << " blocks have no MPV category (fiber batch/type)" << std::endl;
+    }
   }
-  std::sort(fiber_batch_list.begin(), fiber_batch_list.end());
-  TH1S *h_fiber_batches = new TH1S("h_fiber_batches", "Distribution of EMCal Fiber Batch; Fiber Batch; Count [Blocks]", fiber_batch_set.size(), 0, fiber_batch_set.size());
-  for (size_t i = 0; i < fiber_batch_set.size(); i++) {
-    h_fiber_batches->SetBinContent(i + 1, fiber_batch_counter.at(fiber_batch_list.at(i)));
+
+  // fiber batches (sorted as strings) and fiber batch numbers (sorted as ints)
+  const std::map<std::string, int> &fiber_batches = builder.counts(fiber_batch_counter);
+  std::map<int, int> fiber_batch_numbers;
+  for (auto const& p : fiber_batches) {
+    fiber_batch_numbers[FiberBatch(p.first).batch_number] += p.second;
   }
-  std::cout << "THERE ARE " << fiber_batch_set.size() << " UNIQUE FIBER BATCHES" << std::endl;
-  
-  std::vector<int> fiber_batch_number_list;
-  for (const int &x : fiber_batch_number_set) {
-    fiber_batch_number_list.push_back(x);
+  TH1S *h_fiber_batches = ctx.hist<TH1S>("h_fiber_batches", "Distribution of EMCal Fiber Batch; Fiber Batch; Count [Blocks]", fiber_batches.size(), 0, fiber_batches.size());
+  int bin = 1;
+  for (auto const& p : fiber_batches) {
+    h_fiber_batches->SetBinContent(bin++, p.second);
   }
-  std::sort(fiber_batch_number_list.begin(), fiber_batch_number_list.end());
-  TH1S *h_fiber_batch_numbers = new TH1S("h_fiber_batch_numbers", "Distribution of EMCal Fiber Batch Number; Fiber Batch Number; Count [Blocks]", fiber_batch_number_set.size(), 0, fiber_batch_number_set.size());
-  for (size_t i = 0; i < fiber_batch_number_set.size(); i++) {
-    h_fiber_batch_numbers->SetBinContent(i + 1, fiber_batch_number_counter.at(fiber_batch_number_list.at(i)));
+  std::cout << "THERE ARE " << fiber_batches.size() << " UNIQUE FIBER BATCHES" << std::endl;
+  TH1S *h_fiber_batch_numbers = ctx.hist<TH1S>("h_fiber_batch_numbers", "Distribution of EMCal Fiber Batch Number; Fiber Batch Number; Count [Blocks]", fiber_batch_numbers.size(), 0, fiber_batch_numbers.size());
+  bin = 1;
+  for (auto const& p : fiber_batch_numbers) {
+    h_fiber_batch_numbers->SetBinContent(bin++, p.second);
   }
-  std::cout << "THERE ARE " << fiber_batch_number_set.size() << " UNIQUE FIBER BATCHES" << std::endl;
+  std::cout << "THERE ARE " << fiber_batch_numbers.size() << " UNIQUE FIBER BATCHES" << std::endl;
 
   printf("FIBER TYPES:\n");
-  for (auto const& p : fiber_type_counter) {
-    printf("\t%s: %i\n", p.first.c_str(), p.second);
-  }
-
   std::map<std::string, int> fiber_type_compressed;
-
-  for (auto const& p : fiber_type_counter) {
+  for (auto const& p : builder.counts(fiber_type_counter)) {
+    printf("\t%s: %i\n", p.first.c_str(), p.second);
     if (fiber_type_compressor.find(p.first) == fiber_type_compressor.end()) {
       throw std::runtime_error(Form("unknown fiber type: '%s'", p.first.c_str()));
     }
-    std::string fiber_type = fiber_type_compressor.at(p.first);
-    if (fiber_type_compressed.find(fiber_type) == fiber_type_compressed.end()) {
-      fiber_type_compressed[fiber_type] = p.second;
-    } else {
-      fiber_type_compressed[fiber_type] += p.second;
-    }
+    fiber_type_compressed[fiber_type_compressor.at(p.first)] += p.second;
   }
-
   printf("COMPRESSED FIBER TYPES:\n");
   for (auto const& p : fiber_type_compressed) {
     printf("\t%s: %i\n", p.first.c_str(), p.second);
   }
 
-  for (Block &block : all_blocks) {
-    auto xy = get_block_loc(block, true_sector_mapping);
-    unsigned int x = 2*xy.first + 1;
-
-    unsigned int y = 2*xy.second + 1;
-
-
-    if (fiber_type_counter.find(block.fiber_type) == fiber_type_counter.end()) {
-      fiber_type_counter[block.fiber_type] = 1;
-    } else {
-      fiber_type_counter[block.fiber_type]++;
-    }
-  }
-
-  for (const Block &block : all_blocks) {
-    std::vector<double> chnl_mpvs = {block.ch0_mpv, block.ch1_mpv, block.ch2_mpv, block.ch3_mpv};
-    std::vector<double> tower_counts = {block.fiber_t1_count, block.fiber_t2_count, block.fiber_t3_count, block.fiber_t4_count};
-    
-    if (block.mpv > 0) {
-      h_mpv_block_dist->Fill(block.mpv);
-    }
-    for (const double &chnl : chnl_mpvs) {
-      if (chnl > 0) {
-        h_mpv_chnl_dist->Fill(chnl);
-      }
-    }
-    
-    if (block.fiber_count > 0) {
-      h_fiber_count_block_dist->Fill(block.fiber_count);
-    }
-    for (const double &tower : tower_counts) {
-      if (tower > 0) {
-        h_fiber_count_tower_dist->Fill(tower);
-      }
-    }
-
-    if (block.dbn[0] != 'F' && block.dbn[0] != 'C') {
-      // UIUC
-      if (block.fiber_batch.valid) {
-        if (block.fiber_batch <= FiberBatch("16-B")) {
-          // "S1-12" 
-          if (block.mpv > 0) {
-            h_mpv_block_dist_uiuc_1->Fill(block.mpv);
-          }
-          for (const double &chnl : chnl_mpvs) {
-            if (chnl > 0) {
-              h_mpv_chnl_dist_uiuc_1->Fill(chnl);
-            }
-          }
-        } else if (block.fiber_batch >= FiberBatch("21-A")) {
-          // "S13-64"
-          if (block.mpv > 0) {
-            h_mpv_block_dist_uiuc_2->Fill(block.mpv);
-          }
-          for (const double &chnl : chnl_mpvs) {
-            if (chnl > 0) {
-              h_mpv_chnl_dist_uiuc_2->Fill(chnl);
-            }
-          }
-        } else {
-          // panic?
-          std::cout << "PANIC: Fiber Batch " << block.fiber_batch.str << std::endl;
-        }
-      }
-      // NOT UIUC
-    } else if (fiber_type_compressor.at(block.fiber_type) == "SG") {
-      if (block.mpv > 0) {
-        h_mpv_block_dist_china_sg->Fill(block.mpv);
-      }
-      for (const double &chnl : chnl_mpvs) {
-        if (chnl > 0) {
-          h_mpv_chnl_dist_china_sg->Fill(chnl);
-        }
-      }
-    } else if (fiber_type_compressor.at(block.fiber_type) == "K") {
-      if (block.mpv > 0) {
-        h_mpv_block_dist_china_k->Fill(block.mpv);
-      }
-      for (const double &chnl : chnl_mpvs) {
-        if (chnl > 0) {
-          h_mpv_chnl_dist_china_k->Fill(chnl);
-        }
-      }
-    } else {
-      // panic?
-      std::cout << "PANIC: Fiber Type " << block.fiber_type << std::endl;
-    }
-    
-    if (block.dbn[0] != 'F' && block.dbn[0] != 'C') {
-      // UIUC
-      if (block.fiber_count > 0) {
-        h_fiber_count_block_dist_uiuc->Fill(block.fiber_count);
-      }
-      for (const double &tower : tower_counts) {
-        if (tower > 0) {
-          h_fiber_count_tower_dist_uiuc->Fill(tower);
-        }
-      }
-      if (block.density > 0) {
-        h_density_dist_uiuc->Fill(block.density);
-      }
-      if (block.scint_ratio > 0) {
-        h_scint_ratio_dist_uiuc->Fill(block.scint_ratio);
-      }
-    } else if (block.dbn[0] == 'F') {
-      // FUDAN
-      if (block.fiber_count > 0) {
-        h_fiber_count_block_dist_fudan->Fill(block.fiber_count);
-      }
-      for (const double &tower : tower_counts) {
-        if (tower > 0) {
-          h_fiber_count_tower_dist_fudan->Fill(tower);
-        }
-      }
-      if (block.density > 0) {
-        h_density_dist_fudan->Fill(block.density);
-      }
-      if (block.scint_ratio > 0) {
-        h_scint_ratio_dist_fudan->Fill(block.scint_ratio);
-      }
-    } else if (block.dbn[0] == 'C') {
-      // CIAE
-      if (block.fiber_count > 0) {
-        h_fiber_count_block_dist_ciae->Fill(block.fiber_count);
-      }
-      for (const double &tower : tower_counts) {
-        if (tower > 0) {
-          h_fiber_count_tower_dist_ciae->Fill(tower);
-        }
-      }
-      if (block.density > 0) {
-        h_density_dist_ciae->Fill(block.density);
-      }
-      if (block.scint_ratio > 0) {
-        h_scint_ratio_dist_ciae->Fill(block.scint_ratio);
-      }
-    } else {
-      // panic?
-      std::cout << "PANIC: DBN " << block.dbn << std::endl;
-    }
-  }
-
-  h_mpv_block_dist_uiuc_1->Fit("gaus");
-  h_mpv_block_dist_uiuc_2->Fit("gaus");
-  h_mpv_block_dist_china_sg->Fit("gaus");
-  h_mpv_block_dist_china_k->Fit("gaus");
-  
-  h_mpv_chnl_dist_uiuc_1->Fit("gaus");
-  h_mpv_chnl_dist_uiuc_2->Fit("gaus");
-  h_mpv_chnl_dist_china_sg->Fit("gaus");
-  h_mpv_chnl_dist_china_k->Fit("gaus");
-
-  h_mpv_block_dist_uiuc_1->SetLineColorAlpha(kBlue, 1);
-  h_mpv_block_dist_uiuc_1->SetLineWidth(1.0);
-  h_mpv_block_dist_uiuc_1->SetFillColorAlpha(kBlue, 0.3);
-  // h_mpv_block_dist_uiuc->SetFillStyle(3354);
-  h_mpv_block_dist_uiuc_1->GetFunction("gaus")->SetLineColor(kBlue);
-  h_mpv_block_dist_uiuc_1->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_block_dist_uiuc_1->GetFunction("gaus")->SetLineStyle(kDashed);
-  
-  h_mpv_block_dist_uiuc_2->SetLineColorAlpha(kOrange + 7, 1);
-  h_mpv_block_dist_uiuc_2->SetLineWidth(1.0);
-  h_mpv_block_dist_uiuc_2->SetFillColorAlpha(kOrange + 7, 0.3);
-  // h_mpv_block_dist_uiuc->SetFillStyle(3354);
-  h_mpv_block_dist_uiuc_2->GetFunction("gaus")->SetLineColor(kOrange + 7);
-  h_mpv_block_dist_uiuc_2->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_block_dist_uiuc_2->GetFunction("gaus")->SetLineStyle(kDashed);
-  
-  h_mpv_block_dist_china_sg->SetLineColorAlpha(kRed, 1);
-  h_mpv_block_dist_china_sg->SetLineWidth(1.0);
-  h_mpv_block_dist_china_sg->SetFillColorAlpha(kRed, 0.3);
-  // h_mpv_block_dist_china_sg->SetFillStyle(3354);
-  h_mpv_block_dist_china_sg->GetFunction("gaus")->SetLineColor(kRed);
-  h_mpv_block_dist_china_sg->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_block_dist_china_sg->GetFunction("gaus")->SetLineStyle(kDashed);
-  
-  h_mpv_block_dist_china_k->SetLineColorAlpha(kGreen, 1);
-  h_mpv_block_dist_china_k->SetLineWidth(1.0);
-  h_mpv_block_dist_china_k->SetFillColorAlpha(kGreen, 0.3);
-  // h_mpv_block_dist_china_k->SetFillStyle(3354);
-  h_mpv_block_dist_china_k->GetFunction("gaus")->SetLineColor(kGreen);
-  h_mpv_block_dist_china_k->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_block_dist_china_k->GetFunction("gaus")->SetLineStyle(kDashed);
-  
-  h_mpv_chnl_dist_uiuc_1->SetLineColorAlpha(kBlue, 1);
-  h_mpv_chnl_dist_uiuc_1->SetLineWidth(1.0);
-  h_mpv_chnl_dist_uiuc_1->SetFillColorAlpha(kBlue, 0.3);
-  // h_mpv_chnl_dist_uiuc->SetFillStyle(3354);
-  h_mpv_chnl_dist_uiuc_1->GetFunction("gaus")->SetLineColor(kBlue);
-  h_mpv_chnl_dist_uiuc_1->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_chnl_dist_uiuc_1->GetFunction("gaus")->SetLineStyle(kDashed);
-  
-  h_mpv_chnl_dist_uiuc_2->SetLineColorAlpha(kOrange + 7, 1);
-  h_mpv_chnl_dist_uiuc_2->SetLineWidth(1.0);
-  h_mpv_chnl_dist_uiuc_2->SetFillColorAlpha(kOrange + 7, 0.3);
-  // h_mpv_chnl_dist_uiuc->SetFillStyle(3354);
-  h_mpv_chnl_dist_uiuc_2->GetFunction("gaus")->SetLineColor(kOrange + 7);
-  h_mpv_chnl_dist_uiuc_2->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_chnl_dist_uiuc_2->GetFunction("gaus")->SetLineStyle(kDashed);
-  
-  h_mpv_chnl_dist_china_sg->SetLineColorAlpha(kRed, 1);
-  h_mpv_chnl_dist_china_sg->SetLineWidth(1.0);
-  h_mpv_chnl_dist_china_sg->SetFillColorAlpha(kRed, 0.3);
-  // h_mpv_chnl_dist_china_sg->SetFillStyle(3354);
-  h_mpv_chnl_dist_china_sg->GetFunction("gaus")->SetLineColor(kRed);
-  h_mpv_chnl_dist_china_sg->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_chnl_dist_china_sg->GetFunction("gaus")->SetLineStyle(kDashed);
-  
-  h_mpv_chnl_dist_china_k->SetLineColorAlpha(kGreen, 1);
-  h_mpv_chnl_dist_china_k->SetLineWidth(1.0);
-  h_mpv_chnl_dist_china_k->SetFillColorAlpha(kGreen, 0.3);
-  // h_mpv_chnl_dist_china_k->SetFillStyle(3354);
-  h_mpv_chnl_dist_china_k->GetFunction("gaus")->SetLineColor(kGreen);
-  h_mpv_chnl_dist_china_k->GetFunction("gaus")->SetLineWidth(2.0);
-  h_mpv_chnl_dist_china_k->GetFunction("gaus")->SetLineStyle(kDashed);
-
-  hs_mpv_block_dist->Add(h_mpv_block_dist_uiuc_1);
-  hs_mpv_block_dist->Add(h_mpv_block_dist_uiuc_2);
-  hs_mpv_block_dist->Add(h_mpv_block_dist_china_sg);
-  hs_mpv_block_dist->Add(h_mpv_block_dist_china_k);
-  
-  hs_mpv_chnl_dist->Add(h_mpv_chnl_dist_uiuc_1);
-  hs_mpv_chnl_dist->Add(h_mpv_chnl_dist_uiuc_2);
-  hs_mpv_chnl_dist->Add(h_mpv_chnl_dist_china_sg);
-  hs_mpv_chnl_dist->Add(h_mpv_chnl_dist_china_k);
-  
-  TLegend *hs_mpv_leg = new TLegend(.7, .7, .85, .85);
-  hs_mpv_leg->AddEntry(h_mpv_block_dist_uiuc_1, "UIUC S1-12", "f");
-  hs_mpv_leg->AddEntry(h_mpv_block_dist_uiuc_2, "UIUC S13-64", "f");
-  hs_mpv_leg->AddEntry(h_mpv_block_dist_china_sg, "China SG", "f");
-  hs_mpv_leg->AddEntry(h_mpv_block_dist_china_k, "China K", "f");
-  
-  TCanvas *cs_mpv_block_dist = new TCanvas();
-  hs_mpv_block_dist->Draw("NOSTACKB");
-  hs_mpv_leg->Draw();
-  TPaveStats *pt_mpv_block_dist = new TPaveStats(0.65, 0.2, 0.875, 0.65, "NDC");
-  pt_mpv_block_dist->SetTextFont(42);
-  pt_mpv_block_dist->AddText("EMCal Block MPV")->SetTextFont(62);
-  pt_mpv_block_dist->AddText("UIUC S1-12")->SetTextFont(62);
-  pt_mpv_block_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_block_dist_uiuc_1->GetFunction("gaus")->GetParameter(1), h_mpv_block_dist_uiuc_1->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_block_dist->AddText(Form("Mean = %7.3f", h_mpv_block_dist_uiuc_1->GetMean()));
-  pt_mpv_block_dist->AddText("UIUC S13-64")->SetTextFont(62);
-  pt_mpv_block_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_block_dist_uiuc_2->GetFunction("gaus")->GetParameter(1), h_mpv_block_dist_uiuc_2->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_block_dist->AddText(Form("Mean = %7.3f", h_mpv_block_dist_uiuc_2->GetMean()));
-  pt_mpv_block_dist->AddText("China SG")->SetTextFont(62);
-  pt_mpv_block_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_block_dist_china_sg->GetFunction("gaus")->GetParameter(1), h_mpv_block_dist_china_sg->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_block_dist->AddText(Form("Mean = %7.3f", h_mpv_block_dist_china_sg->GetMean()));
-  pt_mpv_block_dist->AddText("China K")->SetTextFont(62);
-  pt_mpv_block_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_block_dist_china_k->GetFunction("gaus")->GetParameter(1), h_mpv_block_dist_china_k->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_block_dist->AddText(Form("Mean = %7.3f", h_mpv_block_dist_china_k->GetMean()));
-  pt_mpv_block_dist->SetFillColorAlpha(0, 0);
-  pt_mpv_block_dist->SetTextAlign(12);
-  pt_mpv_block_dist->SetTextSize(0.02);
-  pt_mpv_block_dist->SetShadowColor(kWhite);
-  pt_mpv_block_dist->Draw();
-  cs_mpv_block_dist->SaveAs("emcal_plots/mpv_block_dist.pdf");
-
-  TCanvas *cs_mpv_chnl_dist = new TCanvas();
-  hs_mpv_chnl_dist->Draw("NOSTACKB");
-  hs_mpv_leg->Draw();
-  TPaveStats *pt_mpv_chnl_dist = new TPaveStats(0.65, 0.2, 0.875, 0.65, "NDC");
-  pt_mpv_chnl_dist->SetTextFont(42);
-  pt_mpv_chnl_dist->AddText("EMCal Channel MPV")->SetTextFont(62);
-  pt_mpv_chnl_dist->AddText("UIUC S1-12")->SetTextFont(62);
-  pt_mpv_chnl_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_chnl_dist_uiuc_1->GetFunction("gaus")->GetParameter(1), h_mpv_chnl_dist_uiuc_1->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_chnl_dist->AddText(Form("Mean = %7.3f", h_mpv_chnl_dist_uiuc_1->GetMean()));
-  pt_mpv_chnl_dist->AddText("UIUC S13-64")->SetTextFont(62);
-  pt_mpv_chnl_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_chnl_dist_uiuc_2->GetFunction("gaus")->GetParameter(1), h_mpv_chnl_dist_uiuc_2->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_chnl_dist->AddText(Form("Mean = %7.3f", h_mpv_chnl_dist_uiuc_2->GetMean()));
-  pt_mpv_chnl_dist->AddText("China SG")->SetTextFont(62);
-  pt_mpv_chnl_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_chnl_dist_china_sg->GetFunction("gaus")->GetParameter(1), h_mpv_chnl_dist_china_sg->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_chnl_dist->AddText(Form("Mean = %7.3f", h_mpv_chnl_dist_china_sg->GetMean()));
-  pt_mpv_chnl_dist->AddText("China K")->SetTextFont(62);
-  pt_mpv_chnl_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_mpv_chnl_dist_china_k->GetFunction("gaus")->GetParameter(1), h_mpv_chnl_dist_china_k->GetFunction("gaus")->GetParError(1)));
-  pt_mpv_chnl_dist->AddText(Form("Mean = %7.3f", h_mpv_chnl_dist_china_k->GetMean()));
-  pt_mpv_chnl_dist->SetFillColorAlpha(0, 0);
-  pt_mpv_chnl_dist->SetTextAlign(12);
-  pt_mpv_chnl_dist->SetTextSize(0.02);
-  pt_mpv_chnl_dist->SetShadowColor(kWhite);
-  pt_mpv_chnl_dist->Draw();
-  cs_mpv_block_dist->SaveAs("emcal_plots/mpv_block_dist.pdf");
-  cs_mpv_chnl_dist->SaveAs("emcal_plots/mpv_chnl_dist.pdf");
-
-  h_fiber_count_block_dist_uiuc->SetLineColorAlpha(kBlue, 1);
-  h_fiber_count_block_dist_uiuc->SetLineWidth(1.0);
-  h_fiber_count_block_dist_uiuc->SetFillColorAlpha(kBlue, 0.3);
-  // h_fiber_count_block_dist_uiuc->SetFillStyle(3354);
-
-  h_fiber_count_block_dist_fudan->SetLineColorAlpha(kRed, 1);
-  h_fiber_count_block_dist_fudan->SetLineWidth(1.0);
-  h_fiber_count_block_dist_fudan->SetFillColorAlpha(kRed, 0.3);
-  // h_fiber_count_block_dist_fudan->SetFillStyle(3354);
-
-  h_fiber_count_block_dist_ciae->SetLineColorAlpha(kGreen, 1);
-  h_fiber_count_block_dist_ciae->SetLineWidth(1.0);
-  h_fiber_count_block_dist_ciae->SetFillColorAlpha(kGreen, 0.3);
-  // h_fiber_count_block_dist_ciae->SetFillStyle(3354);
-
-  h_fiber_count_tower_dist_uiuc->SetLineColorAlpha(kBlue, 1);
-  h_fiber_count_tower_dist_uiuc->SetLineWidth(1.0);
-  h_fiber_count_tower_dist_uiuc->SetFillColorAlpha(kBlue, 0.3);
-  // h_fiber_count_tower_dist_uiuc->SetFillStyle(3354);
-
-  h_fiber_count_tower_dist_fudan->SetLineColorAlpha(kRed, 1);
-  h_fiber_count_tower_dist_fudan->SetLineWidth(1.0);
-  h_fiber_count_tower_dist_fudan->SetFillColorAlpha(kRed, 0.3);
-  // h_fiber_count_tower_dist_fudan->SetFillStyle(3354);
-
-  h_fiber_count_tower_dist_ciae->SetLineColorAlpha(kGreen, 1);
-  h_fiber_count_tower_dist_ciae->SetLineWidth(1.0);
-  h_fiber_count_tower_dist_ciae->SetFillColorAlpha(kGreen, 0.3);
-  // h_fiber_count_tower_dist_ciae->SetFillStyle(3354);
-
-  h_density_dist_uiuc->Fit("gaus");
-  h_density_dist_fudan->Fit("gaus");
-  h_density_dist_ciae->Fit("gaus");
-  h_scint_ratio_dist_uiuc->Fit("gaus");
-  h_scint_ratio_dist_fudan->Fit("gaus");
-  h_scint_ratio_dist_ciae->Fit("gaus");
-
-  h_density_dist_uiuc->SetLineColorAlpha(kBlue, 1);
-  h_density_dist_uiuc->SetLineWidth(1.0);
-  h_density_dist_uiuc->SetFillColorAlpha(kBlue, 0.3);
-  // h_density_dist_uiuc->SetFillStyle(3354);
-  h_density_dist_uiuc->GetFunction("gaus")->SetLineColor(kBlue);
-  h_density_dist_uiuc->GetFunction("gaus")->SetLineWidth(2.0);
-  h_density_dist_uiuc->GetFunction("gaus")->SetLineStyle(kDashed);
-
-  h_density_dist_fudan->SetLineColorAlpha(kRed, 1);
-  h_density_dist_fudan->SetLineWidth(1.0);
-  h_density_dist_fudan->SetFillColorAlpha(kRed, 0.3);
-  // h_density_dist_fudan->SetFillStyle(3354);
-  h_density_dist_fudan->GetFunction("gaus")->SetLineColor(kRed);
-  h_density_dist_fudan->GetFunction("gaus")->SetLineWidth(2.0);
-  h_density_dist_fudan->GetFunction("gaus")->SetLineStyle(kDashed);
-
-  h_density_dist_ciae->SetLineColorAlpha(kGreen, 1);
-  h_density_dist_ciae->SetLineWidth(1.0);
-  h_density_dist_ciae->SetFillColorAlpha(kGreen, 0.3);
-  // h_density_dist_ciae->SetFillStyle(3354);
-  h_density_dist_ciae->GetFunction("gaus")->SetLineColor(kGreen);
-  h_density_dist_ciae->GetFunction("gaus")->SetLineWidth(2.0);
-  h_density_dist_ciae->GetFunction("gaus")->SetLineStyle(kDashed);
-
-  h_scint_ratio_dist_uiuc->SetLineColorAlpha(kBlue, 1);
-  h_scint_ratio_dist_uiuc->SetLineWidth(1.0);
-  h_scint_ratio_dist_uiuc->SetFillColorAlpha(kBlue, 0.3);
-  // h_scint_ratio_dist_uiuc->SetFillStyle(3354);
-  h_scint_ratio_dist_uiuc->GetFunction("gaus")->SetLineColor(kBlue);
-  h_scint_ratio_dist_uiuc->GetFunction("gaus")->SetLineWidth(2.0);
-  h_scint_ratio_dist_uiuc->GetFunction("gaus")->SetLineStyle(kDashed);
-
-  h_scint_ratio_dist_fudan->SetLineColorAlpha(kRed, 1);
-  h_scint_ratio_dist_fudan->SetLineWidth(1.0);
-  h_scint_ratio_dist_fudan->SetFillColorAlpha(kRed, 0.3);
-  // h_scint_ratio_dist_fudan->SetFillStyle(3354);
-  h_scint_ratio_dist_fudan->GetFunction("gaus")->SetLineColor(kRed);
-  h_scint_ratio_dist_fudan->GetFunction("gaus")->SetLineWidth(2.0);
-  h_scint_ratio_dist_fudan->GetFunction("gaus")->SetLineStyle(kDashed);
-
-  h_scint_ratio_dist_ciae->SetLineColorAlpha(kGreen, 1);
-  h_scint_ratio_dist_ciae->SetLineWidth(1.0);
-  h_scint_ratio_dist_ciae->SetFillColorAlpha(kGreen, 0.3);
-  // h_scint_ratio_dist_ciae->SetFillStyle(3354);
-  h_scint_ratio_dist_ciae->GetFunction("gaus")->SetLineColor(kGreen);
-  h_scint_ratio_dist_ciae->GetFunction("gaus")->SetLineWidth(2.0);
-  h_scint_ratio_dist_ciae->GetFunction("gaus")->SetLineStyle(kDashed);
-
-  hs_fiber_count_block_dist->Add(h_fiber_count_block_dist_uiuc);
-  hs_fiber_count_block_dist->Add(h_fiber_count_block_dist_fudan);
-  hs_fiber_count_block_dist->Add(h_fiber_count_block_dist_ciae);
-
-  hs_fiber_count_tower_dist->Add(h_fiber_count_tower_dist_uiuc);
-  hs_fiber_count_tower_dist->Add(h_fiber_count_tower_dist_fudan);
-  hs_fiber_count_tower_dist->Add(h_fiber_count_tower_dist_ciae);
-  
-  hs_density_dist->Add(h_density_dist_uiuc);
-  hs_density_dist->Add(h_density_dist_fudan);
-  hs_density_dist->Add(h_density_dist_ciae);
-  
-  hs_scint_ratio_dist->Add(h_scint_ratio_dist_uiuc);
-  hs_scint_ratio_dist->Add(h_scint_ratio_dist_fudan);
-  hs_scint_ratio_dist->Add(h_scint_ratio_dist_ciae);
-  
-  TLegend *hs_fiber_count_leg = new TLegend(.15, .7, .3, .85);
-  hs_fiber_count_leg->AddEntry(h_fiber_count_block_dist_uiuc, "UIUC", "f");
-  hs_fiber_count_leg->AddEntry(h_fiber_count_block_dist_fudan, "Fudan", "f");
-  hs_fiber_count_leg->AddEntry(h_fiber_count_block_dist_ciae, "CIAE", "f");
-  
-  TCanvas *cs_fiber_count_block_dist = new TCanvas();
-  hs_fiber_count_block_dist->Draw("NOSTACKB");
-  hs_fiber_count_leg->Draw();
-  TPaveStats *pt_fiber_count_block_dist = new TPaveStats(0.15, 0.45, 0.35, 0.65, "NDC");
-  pt_fiber_count_block_dist->SetTextFont(42);
-  pt_fiber_count_block_dist->AddText("EMCal Block Fiber Count")->SetTextFont(62);
-  pt_fiber_count_block_dist->AddText("UIUC")->SetTextFont(62);
-  pt_fiber_count_block_dist->AddText(Form("Mean = %7.3f", h_fiber_count_block_dist_uiuc->GetMean()));
-  pt_fiber_count_block_dist->AddText("Fudan")->SetTextFont(62);
-  pt_fiber_count_block_dist->AddText(Form("Mean = %7.3f", h_fiber_count_block_dist_fudan->GetMean()));
-  pt_fiber_count_block_dist->AddText("CIAE")->SetTextFont(62);
-  pt_fiber_count_block_dist->AddText(Form("Mean = %7.3f", h_fiber_count_block_dist_ciae->GetMean()));
-  pt_fiber_count_block_dist->SetFillColorAlpha(0, 0);
-  pt_fiber_count_block_dist->SetTextAlign(12);
-  pt_fiber_count_block_dist->SetTextSize(0.02);
-  pt_fiber_count_block_dist->SetShadowColor(kWhite);
-  pt_fiber_count_block_dist->Draw();
-  cs_fiber_count_block_dist->SaveAs("emcal_plots/fiber_count_block_dist.pdf");
-  
-  TCanvas *cs_fiber_count_tower_dist = new TCanvas();
-  hs_fiber_count_tower_dist->Draw("NOSTACKB");
-  hs_fiber_count_leg->Draw();
-  TPaveStats *pt_fiber_count_tower_dist = new TPaveStats(0.15, 0.45, 0.35, 0.65, "NDC");
-  pt_fiber_count_tower_dist->SetTextFont(42);
-  pt_fiber_count_tower_dist->AddText("EMCal Tower Fiber Count")->SetTextFont(62);
-  pt_fiber_count_tower_dist->AddText("UIUC")->SetTextFont(62);
-  pt_fiber_count_tower_dist->AddText(Form("Mean = %7.3f", h_fiber_count_tower_dist_uiuc->GetMean()));
-  pt_fiber_count_tower_dist->AddText("Fudan")->SetTextFont(62);
-  pt_fiber_count_tower_dist->AddText(Form("Mean = %7.3f", h_fiber_count_tower_dist_fudan->GetMean()));
-  pt_fiber_count_tower_dist->AddText("CIAE")->SetTextFont(62);
-  pt_fiber_count_tower_dist->AddText(Form("Mean = %7.3f", h_fiber_count_tower_dist_ciae->GetMean()));
-  pt_fiber_count_tower_dist->SetFillColorAlpha(0, 0);
-  pt_fiber_count_tower_dist->SetTextAlign(12);
-  pt_fiber_count_tower_dist->SetTextSize(0.02);
-  pt_fiber_count_tower_dist->SetShadowColor(kWhite);
-  pt_fiber_count_tower_dist->Draw();
-  cs_fiber_count_tower_dist->SaveAs("emcal_plots/fiber_count_tower_dist.pdf");
-
-  TCanvas *cs_density_dist = new TCanvas();
-  hs_density_dist->Draw("NOSTACKB");
-  hs_fiber_count_leg->Draw();
-  TPaveStats *pt_density_dist = new TPaveStats(0.65, 0.55, 0.875, 0.875, "NDC");
-  pt_density_dist->SetTextFont(42);
-  pt_density_dist->AddText("EMCal Block Density")->SetTextFont(62);
-  pt_density_dist->AddText("UIUC")->SetTextFont(62);
-  pt_density_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_density_dist_uiuc->GetFunction("gaus")->GetParameter(1), h_density_dist_uiuc->GetFunction("gaus")->GetParError(1)));
-  pt_density_dist->AddText(Form("Mean = %7.3f", h_density_dist_uiuc->GetMean()));
-  pt_density_dist->AddText("Fudan")->SetTextFont(62);
-  pt_density_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_density_dist_fudan->GetFunction("gaus")->GetParameter(1), h_density_dist_fudan->GetFunction("gaus")->GetParError(1)));
-  pt_density_dist->AddText(Form("Mean = %7.3f", h_density_dist_fudan->GetMean()));
-  pt_density_dist->AddText("CIAE")->SetTextFont(62);
-  pt_density_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_density_dist_ciae->GetFunction("gaus")->GetParameter(1), h_density_dist_ciae->GetFunction("gaus")->GetParError(1)));
-  pt_density_dist->AddText(Form("Mean = %7.3f", h_density_dist_ciae->GetMean()));
-  pt_density_dist->SetFillColorAlpha(0, 0);
-  pt_density_dist->SetTextAlign(12);
-  pt_density_dist->SetTextSize(0.02);
-  pt_density_dist->SetShadowColor(kWhite);
-  pt_density_dist->Draw();
-  cs_mpv_block_dist->SaveAs("emcal_plots/mpv_block_dist.pdf");
-  cs_density_dist->SaveAs("emcal_plots/density_dist.pdf");
-
-  TCanvas *cs_scint_ratio_dist = new TCanvas();
-  hs_scint_ratio_dist->Draw("NOSTACKB");
-  hs_fiber_count_leg->Draw();
-  TPaveStats *pt_scint_ratio_dist = new TPaveStats(0.65, 0.55, 0.875, 0.875, "NDC");
-  pt_scint_ratio_dist->SetTextFont(42);
-  pt_scint_ratio_dist->AddText("EMCal Block Scintillation Ratio")->SetTextFont(62);
-  pt_scint_ratio_dist->AddText("UIUC")->SetTextFont(62);
-  pt_scint_ratio_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_scint_ratio_dist_uiuc->GetFunction("gaus")->GetParameter(1), h_scint_ratio_dist_uiuc->GetFunction("gaus")->GetParError(1)));
-  pt_scint_ratio_dist->AddText(Form("Mean = %7.3f", h_scint_ratio_dist_uiuc->GetMean()));
-  pt_scint_ratio_dist->AddText("Fudan")->SetTextFont(62);
-  pt_scint_ratio_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_scint_ratio_dist_fudan->GetFunction("gaus")->GetParameter(1), h_scint_ratio_dist_fudan->GetFunction("gaus")->GetParError(1)));
-  pt_scint_ratio_dist->AddText(Form("Mean = %7.3f", h_scint_ratio_dist_fudan->GetMean()));
-  pt_scint_ratio_dist->AddText("CIAE")->SetTextFont(62);
-  pt_scint_ratio_dist->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", h_scint_ratio_dist_ciae->GetFunction("gaus")->GetParameter(1), h_scint_ratio_dist_ciae->GetFunction("gaus")->GetParError(1)));
-  pt_scint_ratio_dist->AddText(Form("Mean = %7.3f", h_scint_ratio_dist_ciae->GetMean()));
-  pt_scint_ratio_dist->SetFillColorAlpha(0, 0);
-  pt_scint_ratio_dist->SetTextAlign(12);
-  pt_scint_ratio_dist->SetTextSize(0.02);
-  pt_scint_ratio_dist->SetShadowColor(kWhite);
-  pt_scint_ratio_dist->Draw();
-  cs_scint_ratio_dist->SaveAs("emcal_plots/scint_ratio_dist.pdf");
-
-
-  TFile *chnl_dists_file = new TFile("emcal_plots/histograms.root", "RECREATE");
-  chnl_dists_file->WriteObject(h_mpv_block_dist, "h_mpv_block_dist");
-  chnl_dists_file->WriteObject(h_mpv_chnl_dist, "h_mpv_chnl_dist");
-  chnl_dists_file->WriteObject(h_fiber_count_block_dist, "h_fiber_count_block_dist");
-  chnl_dists_file->WriteObject(h_fiber_count_tower_dist, "h_fiber_count_tower_dist");
-  chnl_dists_file->WriteObject(hs_mpv_block_dist, "hs_mpv_block_dist");
-  chnl_dists_file->WriteObject(hs_mpv_chnl_dist, "hs_mpv_chnl_dist");
-  chnl_dists_file->WriteObject(hs_fiber_count_block_dist, "hs_fiber_count_block_dist");
-  chnl_dists_file->WriteObject(hs_fiber_count_tower_dist, "hs_fiber_count_tower_dist");
-  chnl_dists_file->WriteObject(hs_density_dist, "hs_density_dist");
-  chnl_dists_file->WriteObject(hs_scint_ratio_dist, "hs_scint_ratio_dist");
+  builder.save_stack(hs_mpv_block_dist, {"EMCal Block MPV", {.7, .7, .85, .85}, {0.65, 0.2, 0.875, 0.65}}, ctx, "mpv_block_dist.pdf");
+  builder.save_stack(hs_mpv_chnl_dist, {"EMCal Channel MPV", {.7, .7, .85, .85}, {0.65, 0.2, 0.875, 0.65}}, ctx, "mpv_chnl_dist.pdf");
+  builder.save_stack(hs_fiber_count_block_dist, {"EMCal Block Fiber Count", {.15, .7, .3, .85}, {0.15, 0.45, 0.35, 0.65}}, ctx, "fiber_count_block_dist.pdf");
+  builder.save_stack(hs_fiber_count_tower_dist, {"EMCal Tower Fiber Count", {.15, .7, .3, .85}, {0.15, 0.45, 0.35, 0.65}}, ctx, "fiber_count_tower_dist.pdf");
+  builder.save_stack(hs_density_dist, {"EMCal Block Density", {.15, .7, .3, .85}, {0.65, 0.55, 0.875, 0.875}}, ctx, "density_dist.pdf");
+  builder.save_stack(hs_scint_ratio_dist, {"EMCal Block Scintillation Ratio", {.15, .7, .3, .85}, {0.65, 0.55, 0.875, 0.875}}, ctx, "scint_ratio_dist.pdf");
+
+  TFile *chnl_dists_file = new TFile(ctx.path("histograms.root").c_str(), "RECREATE");
+  chnl_dists_file->WriteObject(builder.hist(h_mpv_block_dist), "h_mpv_block_dist");
+  chnl_dists_file->WriteObject(builder.hist(h_mpv_chnl_dist), "h_mpv_chnl_dist");
+  chnl_dists_file->WriteObject(builder.hist(h_fiber_count_block_dist), "h_fiber_count_block_dist");
+  chnl_dists_file->WriteObject(builder.hist(h_fiber_count_tower_dist), "h_fiber_count_tower_dist");
+  chnl_dists_file->WriteObject(builder.stack(hs_mpv_block_dist), "hs_mpv_block_dist");
+  chnl_dists_file->WriteObject(builder.stack(hs_mpv_chnl_dist), "hs_mpv_chnl_dist");
+  chnl_dists_file->WriteObject(builder.stack(hs_fiber_count_block_dist), "hs_fiber_count_block_dist");
+  chnl_dists_file->WriteObject(builder.stack(hs_fiber_count_tower_dist), "hs_fiber_count_tower_dist");
+  chnl_dists_file->WriteObject(builder.stack(hs_density_dist), "hs_density_dist");
+  chnl_dists_file->WriteObject(builder.stack(hs_scint_ratio_dist), "hs_scint_ratio_dist");
   chnl_dists_file->WriteObject(h_fiber_batches, "h_fiber_batches");
   chnl_dists_file->WriteObject(h_fiber_batch_numbers, "h_fiber_batch_numbers");
+  chnl_dists_file->Close();
 } 
 
 /**
@@ -1139,6 +638,8 @@ void make_histograms(std::vector<Block> all_blocks) {
  * 
  * @param channel_lvl 
  * @param mode 
+ * @param c canvas to draw on (its own coordinates are used, not gPad)
+ * @param h 
  */
 void draw_axes(bool channel_lvl, std::string mode, TCanvas* c, TH2D *h) {
     if (mode == "caroline") {
@@ -1185,11 +686,11 @@ void draw_axes(bool channel_lvl, std::string mode, TCanvas* c, TH2D *h) {
         h->GetXaxis()->SetTickLength(0);
 
         // draw axes separately (since they don't match the gridlines, which are sector boundaries)
-        gPad->Update();
-        TGaxis *x_axis = new TGaxis(gPad->GetUxmin(),
-                                      gPad->GetUymin(),
-                                      gPad->GetUxmax(),
-                                      gPad->GetUymin(),
+        c->Update();
+        TGaxis *x_axis = new TGaxis(c->GetUxmin(),
+                                      c->GetUymin(),
+                                      c->GetUxmax(),
+                                      c->GetUymin(),
                                       -4,
                                       256 - 4,
                                       16 + 4*100,"N+");            
@@ -1200,11 +701,11 @@ void draw_axes(bool channel_lvl, std::string mode, TCanvas* c, TH2D *h) {
 
         h->GetYaxis()->SetLabelOffset(999.0);
         h->GetYaxis()->SetTickLength(0);
-        gPad->Update();
-        TGaxis *y_axis = new TGaxis(gPad->GetUxmin(),
-                                        gPad->GetUymin(),
-                                        gPad->GetUxmin(),
-                                        gPad->GetUymax(),
+        c->Update();
+        TGaxis *y_axis = new TGaxis(c->GetUxmin(),
+                                        c->GetUymin(),
+                                        c->GetUxmin(),
+                                        c->GetUymax(),
                                         -48,
                                         48,
                                         12 + 2*100,"N-");            
@@ -1229,11 +730,11 @@ void draw_axes(bool channel_lvl, std::string mode, TCanvas* c, TH2D *h) {
         h->GetXaxis()->SetTickLength(0);
 
         // draw axes separately (since they don't match the gridlines, which are sector boundaries)
-        gPad->Update();
-        TGaxis *x_axis = new TGaxis(gPad->GetUxmin(),
-                                      gPad->GetUymin(),
-                                      gPad->GetUxmax(),
-                                      gPad->GetUymin(),
+        c->Update();
+        TGaxis *x_axis = new TGaxis(c->GetUxmin(),
+                                      c->GetUymin(),
+                                      c->GetUxmax(),
+                                      c->GetUymin(),
                                       -2,
                                       128 - 2,
                                       16 + 4*100,"N+");            
@@ -1244,11 +745,11 @@ void draw_axes(bool channel_lvl, std::string mode, TCanvas* c, TH2D *h) {
 
         h->GetYaxis()->SetLabelOffset(999.0);
         h->GetYaxis()->SetTickLength(0);
-        gPad->Update();
-        TGaxis *y_axis = new TGaxis(gPad->GetUxmin(),
-                                        gPad->GetUymin(),
-                                        gPad->GetUxmin(),
-                                        gPad->GetUymax(),
+        c->Update();
+        TGaxis *y_axis = new TGaxis(c->GetUxmin(),
+                                        c->GetUymin(),
+                                        c->GetUxmin(),
+                                        c->GetUymax(),
                                         -24,
                                         24,
                                         12 + 2*100,"N-");            
@@ -1265,16 +766,44 @@ void draw_axes(bool channel_lvl, std::string mode, TCanvas* c, TH2D *h) {
   }
 
 /**
- * @brief Plots EMCal fiber count over towers and MPV over channels.
+ * @brief Output file names (without extension) of the maps made by make_channel_maps and make_block_maps, in order.
+ */
+const std::vector<std::string> channel_map_names = {"mpv_chnl_map", "fiber_count_tower_map"};
+const std::vector<std::string> block_map_names = {"mpv_block_map", "fiber_count_block_map", "density_map", "scint_ratio_map"};
+
+/**
+ * @brief Output file of a map: PNG if the context renders raster maps, PDF otherwise.
+ */
+std::string map_output(const PlotContext &ctx, const std::string &name) {
+  return ctx.path(name + (ctx.raster ? ".png" : ".pdf"));
+}
+
+/**
+ * @brief Draw and save one map (see map_output) with the axes and labels of a draw_axes mode.
  * 
- * @param all_blocks all blocks in the EMCal.
- * @param drop_low_rap_edge whether to exclude low rapidity edge like all other edges (TRUE, better for calibration)
- *    or keep it (plot it) (FALSE, default behavior of h_allblocks)
+ * @param ctx 
+ * @param h 
+ * @param channel_lvl 
+ * @param mode "tim" or "caroline" (see draw_axes).
+ * @param name output file name without extension.
  */
-void plot_channel_lvl(std::vector<Block> all_blocks, std::string mode) {
-  gStyle->SetOptStat(0);
-  gStyle->SetLineScalePS(0.5);
+void draw_map(const PlotContext &ctx, TH2D *h, bool channel_lvl, std::string mode, const std::string &name) {
+  if (ctx.raster) {
+    save_map_png(h, channel_lvl, mode, map_output(ctx, name), ctx.style.palette);
+  } else {
+    TCanvas *canvas = ctx.draw(700, 500, [&](TCanvas *c) { draw_axes(channel_lvl, mode, c, h); }, name + ".pdf");
+    ctx.close(canvas);
+  }
+}
 
+/**
+ * @brief Fill the EMCal MPV over channels and fiber count over towers maps.
+ * 
+ * @param ctx plotting context.
+ * @param all_blocks all blocks in the EMCal.
+ * @return maps in the order of channel_map_names
+ */
+std::vector<TH2D*> make_channel_maps(const PlotContext &ctx, const std::vector<Block> &all_blocks) {
   // in Tim's html, we are looking down at the narrow end of the block and blocks are arranged by 1-based number as below:
   // (D) 01 05 09 ...
   // (C) 02 06 10 ...
@@ -1333,10 +862,10 @@ void plot_channel_lvl(std::vector<Block> all_blocks, std::string mode) {
   //  2 4      4 3          1 2
   //  1 3      2 1          3 4
   
-  TH2D *h_chnl_mpv = new TH2D("", "sPHENIX EMCal Channel MPV;#phi [Channels];#eta [Channels];MPV", 256, 0, 256, 96, 0, 96);
-  TH2D *h_chnl_fiber = new TH2D("", "sPHENIX EMCal Tower Fiber Count;#phi [Towers];#eta [Towers];Fiber Count [%]", 256, 0, 256, 96, 0, 96);
+  TH2D *h_chnl_mpv = ctx.hist<TH2D>("h_chnl_mpv", "sPHENIX EMCal Channel MPV;#phi [Channels];#eta [Channels];MPV", 256, 0, 256, 96, 0, 96);
+  TH2D *h_chnl_fiber = ctx.hist<TH2D>("h_chnl_fiber", "sPHENIX EMCal Tower Fiber Count;#phi [Towers];#eta [Towers];Fiber Count [%]", 256, 0, 256, 96, 0, 96);
 
-  for (Block &block : all_blocks) {
+  for (const Block &block : all_blocks) {
     auto xy = get_block_loc(block, true_sector_mapping);
     unsigned int x = 2*xy.first + 1;
     unsigned int y = 2*xy.second + 1;
@@ -1411,28 +940,42 @@ void plot_channel_lvl(std::vector<Block> all_blocks, std::string mode) {
     // printf("sector %2d block %2d:\n\tch0: %f\n\tch1: %f\n\tch2: %f\n\tch3: %f\n", block.sector, block.block_number, ch0, ch1, ch2, ch3);
   }
 
-  TCanvas *c_chnl_mpv = new TCanvas();
   h_chnl_mpv->SetMaximum(800);
-  draw_axes(true, mode, c_chnl_mpv, h_chnl_mpv);
-  c_chnl_mpv->SaveAs("emcal_plots/mpv_chnl_map.pdf");
-  
-  TCanvas *c_chnl_fiber = new TCanvas();
   h_chnl_fiber->SetMinimum(94);
   h_chnl_fiber->SetMaximum(104);
-  draw_axes(true, mode, c_chnl_fiber, h_chnl_fiber);
-  c_chnl_fiber->SaveAs("emcal_plots/fiber_count_tower_map.pdf");
+  return {h_chnl_mpv, h_chnl_fiber};
 }
 
-void plot_block_lvl(std::vector<Block> all_blocks, std::string mode) {
-  gStyle->SetOptStat(0);
-  gStyle->SetLineScalePS(0.5);
-  
-  TH2D *h_block_mpv = new TH2D("", "sPHENIX EMCal Block MPV;#phi [Blocks];#eta [Blocks];MPV", 128, 0, 128, 48, 0, 48);
-  TH2D *h_block_fiber = new TH2D("", "sPHENIX EMCal Block Fiber Count;#phi [Blocks];#eta [Blocks];Fiber Count [%]", 128, 0, 128, 48, 0, 48);
-  TH2D *h_block_density = new TH2D("", "sPHENIX EMCal Block Density;#phi [Blocks];#eta [Blocks];Density [g/mL]", 128, 0, 128, 48, 0, 48);
-  TH2D *h_block_scint_ratio = new TH2D("", "sPHENIX EMCal Block Scintillation Ratio;#phi [Blocks];#eta [Blocks];Scintillation Ratio", 128, 0, 128, 48, 0, 48);
+/**
+ * @brief Plots EMCal fiber count over towers and MPV over channels.
+ * 
+ * @param ctx plotting context (style, palette, output directory; raster writes PNGs through the raster renderer
+ *    instead of PDFs through TCanvas).
+ * @param all_blocks all blocks in the EMCal.
+ * @param mode "tim" or "caroline" (see draw_axes).
+ */
+void plot_channel_lvl(const PlotContext &ctx, std::vector<Block> all_blocks, std::string mode) {
+  std::vector<TH2D*> maps = make_channel_maps(ctx, all_blocks);
+  for (size_t i = 0; i < maps.size(); i++) {
+    draw_map(ctx, maps[i], true, mode, channel_map_names[i]);
+    delete maps[i];
+  }
+}
+
+/**
+ * @brief Fill the EMCal MPV, fiber count, density and scintillation ratio over blocks maps.
+ * 
+ * @param ctx plotting context.
+ * @param all_blocks all blocks in the EMCal.
+ * @return maps in the order of block_map_names
+ */
+std::vector<TH2D*> make_block_maps(const PlotContext &ctx, const std::vector<Block> &all_blocks) {
+  TH2D *h_block_mpv = ctx.hist<TH2D>("h_block_mpv", "sPHENIX EMCal Block MPV;#phi [Blocks];#eta [Blocks];MPV", 128, 0, 128, 48, 0, 48);
+  TH2D *h_block_fiber = ctx.hist<TH2D>("h_block_fiber", "sPHENIX EMCal Block Fiber Count;#phi [Blocks];#eta [Blocks];Fiber Count [%]", 128, 0, 128, 48, 0, 48);
+  TH2D *h_block_density = ctx.hist<TH2D>("h_block_density", "sPHENIX EMCal Block Density;#phi [Blocks];#eta [Blocks];Density [g/mL]", 128, 0, 128, 48, 0, 48);
+  TH2D *h_block_scint_ratio = ctx.hist<TH2D>("h_block_scint_ratio", "sPHENIX EMCal Block Scintillation Ratio;#phi [Blocks];#eta [Blocks];Scintillation Ratio", 128, 0, 128, 48, 0, 48);
   
-  for (Block &block : all_blocks) {
+  for (const Block &block : all_blocks) {
     auto xy = get_block_loc(block, true_sector_mapping);
     unsigned int x = xy.first + 1;
     unsigned int y = xy.second + 1;
@@ -1456,224 +999,224 @@ void plot_block_lvl(std::vector<Block> all_blocks, std::string mode) {
     // printf("sector %2d block %2d:\n\tch0: %f\n\tch1: %f\n\tch2: %f\n\tch3: %f\n", block.sector, block.block_number, ch0, ch1, ch2, ch3);
   }
 
-  TCanvas *c_block_mpv = new TCanvas();
-  draw_axes(false, mode, c_block_mpv, h_block_mpv);
-  c_block_mpv->SaveAs("emcal_plots/mpv_block_map.pdf");
-  
-  TCanvas *c_block_fiber = new TCanvas();
-  draw_axes(false, mode, c_block_fiber, h_block_fiber);
-  c_block_fiber->SaveAs("emcal_plots/fiber_count_block_map.pdf");
-
-  TCanvas *c_block_density = new TCanvas();
-  draw_axes(false, mode, c_block_density, h_block_density);
-  c_block_density->SaveAs("emcal_plots/density_map.pdf");
-
-  TCanvas *c_block_scint_ratio = new TCanvas();
   h_block_scint_ratio->SetMaximum(3);
-  draw_axes(false, mode, c_block_scint_ratio, h_block_scint_ratio);
-  c_block_scint_ratio->SaveAs("emcal_plots/scint_ratio_map.pdf");
+  return {h_block_mpv, h_block_fiber, h_block_density, h_block_scint_ratio};
 }
 
 /**
- * @brief Body of macro (called when macro is executed). 
+ * @brief Plots EMCal MPV, fiber count, density and scintillation ratio over blocks.
+ * 
+ * @param ctx plotting context (style, palette, output directory; raster writes PNGs through the raster renderer
+ *    instead of PDFs through TCanvas).
+ * @param all_blocks all blocks in the EMCal.
+ * @param mode "tim" or "caroline" (see draw_axes).
  */
-void plot() {
-  check_sector_mapping(pseudo_sector_mapping);
-  check_sector_mapping(true_sector_mapping);
-
-  std::vector<Block> all_blocks;
-  std::fstream database;
-  database.open("files/sPHENIX_EMCal_blocks - dbn_mpv.csv", std::ios::in);
-  std::string line, word;
-  int line_num = 1;
-  std::cout << "reading 'new database'" << std::endl;
-  while (std::getline(database, line)) {
-    if (line_num == 1) {
-      line_num++;
-      continue;
-    }
-    std::stringstream csvStream(line);
-    unsigned int sector;
-    unsigned int block_number;
-    std::string dbn;
-    double mpv;
-    double mpv_err;
-    double ch0_mpv;
-    double ch0_mpv_err;
-    double ch1_mpv;
-    double ch1_mpv_err;
-    double ch2_mpv;
-    double ch2_mpv_err;
-    double ch3_mpv;
-    double ch3_mpv_err;
-    double density;
-    double fiber_count;
-    double fiber_t1_count;
-    double fiber_t2_count;
-    double fiber_t3_count;
-    double fiber_t4_count;
-    double scint_ratio;
-    std::string fiber_type;
-    std::string fiber_batch;
-    std::string w_powder;
-
-    std::string tmp;
-
-    std::getline(csvStream, tmp, ',');
-    std::istringstream(tmp) >> sector;
-
-    std::getline(csvStream, tmp, ',');
-    std::istringstream(tmp) >> block_number;
-
-    std::getline(csvStream, tmp, ',');
-    std::istringstream(tmp) >> dbn;
-    // printf("DBN WAS '%s'\n", dbn.c_str());
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      mpv = -1;
-    } else {
-      std::istringstream(tmp) >> mpv;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      mpv_err = -1;
-    } else {
-      std::istringstream(tmp) >> mpv_err;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch0_mpv = -1;
-    } else {
-      std::istringstream(tmp) >> ch0_mpv;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch0_mpv_err = -1;
-    } else {
-      std::istringstream(tmp) >> ch0_mpv_err;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch1_mpv = -1;
-    } else {
-      std::istringstream(tmp) >> ch1_mpv;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch1_mpv_err = -1;
-    } else {
-      std::istringstream(tmp) >> ch1_mpv_err;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch2_mpv = -1;
-    } else {
-      std::istringstream(tmp) >> ch2_mpv;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch2_mpv_err = -1;
-    } else {
-      std::istringstream(tmp) >> ch2_mpv_err;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch3_mpv = -1;
-    } else {
-      std::istringstream(tmp) >> ch3_mpv;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      ch3_mpv_err = -1;
-    } else {
-      std::istringstream(tmp) >> ch3_mpv_err;
-    }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      density = -1;
-    } else {
-      std::istringstream(tmp) >> density;
-    }
+void plot_block_lvl(const PlotContext &ctx, std::vector<Block> all_blocks, std::string mode) {
+  std::vector<TH2D*> maps = make_block_maps(ctx, all_blocks);
+  for (size_t i = 0; i < maps.size(); i++) {
+    draw_map(ctx, maps[i], false, mode, block_map_names[i]);
+    delete maps[i];
+  }
+}
 
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      fiber_count = -1;
-    } else {
-      std::istringstream(tmp) >> fiber_count;
-    }
+/**
+ * @brief Fingerprint of the slice of the block table an output shows: the location and some values of every block.
+ * 
+ * @param all_blocks 
+ * @param add_values adds the values of a block the output shows.
+ */
+Fingerprint block_slice(const std::vector<Block> &all_blocks, const std::function<void(Fingerprint &fp, const Block &block)> &add_values) {
+  Fingerprint fp;
+  for (const Block &block : all_blocks) {
+    fp.add(block.sector).add(block.block_number);
+    add_values(fp, block);
+  }
+  return fp;
+}
 
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      fiber_t1_count = -1;
-    } else {
-      std::istringstream(tmp) >> fiber_t1_count;
+/**
+ * @brief Add the jobs of plot() to a job graph: one job per output file (or per canvas, for the front/back 3D views),
+ *    after a local job filling the maps they draw. Each job's fingerprint covers the plotting sources, the context's
+ *    style, the sector mapping, its configuration and only the columns of the block table it shows.
+ * 
+ * @param graph 
+ * @param ctx plotting context.
+ * @param all_blocks all blocks in the EMCal (must outlive the graph's run).
+ * @param cfgs value plot configurations (must outlive the graph's run).
+ * @param mode "tim" or "caroline" (see draw_axes) for the channel- and block-level maps.
+ * @param sources fingerprint of the plotting code.
+ */
+void add_plot_jobs(JobGraph &graph, const PlotContext &ctx, const std::vector<Block> &all_blocks, const std::vector<PlotConfig> &cfgs, std::string mode, const Fingerprint &sources) {
+  Fingerprint style = sources;
+  style.add(ctx.style.opt_stat).add(ctx.style.line_scale_ps).add(ctx.style.image_scaling).add(static_cast<int>(ctx.style.palette)).add(ctx.raster);
+
+  std::vector<std::string> histogram_outputs;
+  for (const char *name : {"mpv_block_dist.pdf", "mpv_chnl_dist.pdf", "fiber_count_block_dist.pdf", "fiber_count_tower_dist.pdf",
+                           "density_dist.pdf", "scint_ratio_dist.pdf", "histograms.root"}) {
+    histogram_outputs.push_back(ctx.path(name));
+  }
+  Fingerprint distributions = block_slice(all_blocks, [](Fingerprint &fp, const Block &block) {
+    fp.add(block.dbn).add(block.mpv).add(block.ch0_mpv).add(block.ch1_mpv).add(block.ch2_mpv).add(block.ch3_mpv);
+    fp.add(block.fiber_count).add(block.fiber_t1_count).add(block.fiber_t2_count).add(block.fiber_t3_count).add(block.fiber_t4_count);
+    fp.add(block.density).add(block.scint_ratio).add(block.fiber_type).add(block.fiber_batch.str);
+  });
+  graph.add({"distributions", histogram_outputs, {}, [&ctx, &all_blocks]() { make_histograms(ctx, all_blocks); }, false,
+             Fingerprint(style).add(distributions).hex()});
+
+  // values of each map, in the order of channel_map_names and block_map_names
+  const std::vector<std::vector<double Block::*>> channel_map_values = {
+    {&Block::ch0_mpv, &Block::ch1_mpv, &Block::ch2_mpv, &Block::ch3_mpv},
+    {&Block::fiber_t1_count, &Block::fiber_t2_count, &Block::fiber_t3_count, &Block::fiber_t4_count}
+  };
+  const std::vector<std::vector<double Block::*>> block_map_values = {{&Block::mpv}, {&Block::fiber_count}, {&Block::density}, {&Block::scint_ratio}};
+  for (bool channel_lvl : {true, false}) {
+    // the maps are deleted with the graph's last reference to them, after the jobs drawing them
+    std::shared_ptr<std::vector<TH2D*>> maps(new std::vector<TH2D*>(), [](std::vector<TH2D*> *maps) {
+      for (TH2D *h : *maps) {
+        delete h;
+      }
+      delete maps;
+    });
+    size_t fill = graph.add({channel_lvl ? "fill channel maps" : "fill block maps", {}, {}, [&ctx, &all_blocks, maps, channel_lvl]() {
+      *maps = channel_lvl ? make_channel_maps(ctx, all_blocks) : make_block_maps(ctx, all_blocks);
+    }, true, ""});
+    const std::vector<std::string> &names = channel_lvl ? channel_map_names : block_map_names;
+    for (size_t i = 0; i < names.size(); i++) {
+      const std::vector<double Block::*> &values = (channel_lvl ? channel_map_values : block_map_values)[i];
+      Fingerprint fp = Fingerprint(style).add(true_sector_mapping).add(mode).add(channel_lvl);
+      fp.add(block_slice(all_blocks, [&values](Fingerprint &fp, const Block &block) {
+        for (double Block::*value : values) {
+          fp.add(block.*value);
+        }
+      }));
+      graph.add({names[i], {map_output(ctx, names[i])}, {fill}, [&ctx, maps, channel_lvl, mode, &names, i]() {
+        draw_map(ctx, maps->at(i), channel_lvl, mode, names[i]);
+      }, false, fp.hex()});
     }
+  }
 
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      fiber_t2_count = -1;
-    } else {
-      std::istringstream(tmp) >> fiber_t2_count;
+  BlockTable table(all_blocks);
+  for (const PlotConfig &cfg : cfgs) {
+    auto values = std::make_shared<const BlockValues>(cfg.get_value(table));
+    std::shared_ptr<ValueMaps> maps(new ValueMaps{nullptr, nullptr}, [](ValueMaps *maps) {
+      delete maps->h_pseudo;
+      delete maps->h_true;
+      delete maps;
+    });
+    size_t fill = graph.add({"fill " + cfg.file_name + " maps", {}, {}, [&ctx, &all_blocks, &cfg, values, maps]() {
+      *maps = make_value_maps(ctx, all_blocks, cfg, *values);
+    }, true, ""});
+    // the selected values (so a new cut or value expression only changes the plots it selects differently)
+    Fingerprint value_fp = Fingerprint(style).add(cfg.title).add(cfg.units).add(cfg.plot_min).add(cfg.plot_max).add(cfg.color);
+    size_t row = 0;
+    value_fp.add(block_slice(all_blocks, [&values, &row](Fingerprint &fp, const Block &) {
+      bool selected = is_selected(values->selected, row);
+      fp.add(selected).add(selected ? values->values[row] : 0.0);
+      row++;
+    }));
+    Fingerprint pseudo_fp = Fingerprint(value_fp).add(pseudo_sector_mapping);
+    graph.add({"colz " + cfg.file_name, {value_colz_output(ctx, cfg, false)}, {fill}, [&ctx, &cfg, maps]() {
+      draw_value_colz(ctx, *maps, cfg);
+    }, false, pseudo_fp.hex()});
+    if (ctx.raster) {
+      // the DBN overlay and the 3D views need ROOT's renderer
+      continue;
     }
-
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      fiber_t3_count = -1;
-    } else {
-      std::istringstream(tmp) >> fiber_t3_count;
+    Fingerprint dbn_fp = block_slice(all_blocks, [](Fingerprint &fp, const Block &block) { fp.add(block.dbn); });
+    graph.add({"colz dbn " + cfg.file_name, {value_colz_output(ctx, cfg, true)}, {fill}, [&ctx, &all_blocks, &cfg, maps]() {
+      draw_value_colz(ctx, *maps, cfg, &all_blocks);
+    }, false, Fingerprint(pseudo_fp).add(dbn_fp).hex()});
+    for (std::string view : {"LEGO", "CYL", "PSR"}) {
+      graph.add({view + " " + cfg.file_name, value_3d_outputs(ctx, cfg, view), {fill}, [&ctx, &cfg, maps, view]() {
+        draw_value_3d(ctx, *maps, cfg, view);
+      }, false, Fingerprint(value_fp).add(true_sector_mapping).add(view).hex()});
     }
+  }
+}
 
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      fiber_t4_count = -1;
-    } else {
-      std::istringstream(tmp) >> fiber_t4_count;
+/**
+ * @brief Plot all outputs of plot() from a block table, re-rendering only outputs whose fingerprint changed.
+ * 
+ * @param all_blocks all blocks in the EMCal.
+ * @param cut optional expression (see includes/expr.h) restricting the blocks drawn in the value maps, e.g. "vendor == UIUC".
+ * @param raster render the maps headless to PNG (includes/raster.h) instead of through TCanvas.
+ * @param palette palette of the maps: "bird", "rainbow", "viridis" or "grayscale".
+ * @param n_workers number of plots rendered concurrently; 1 renders every plot in the calling thread.
+ * @param fork_workers render in forked processes (run ROOT in batch mode) instead of threads of this process.
+ * @param force re-render every plot. Otherwise plots made (see emcal_plots/.fingerprints) from the same plotting
+ *    sources, style and block table values (after the cut) are skipped and listed in the report.
+ */
+void plot_blocks(const std::vector<Block> &all_blocks, std::string cut = "", bool raster = false, std::string palette = "bird", unsigned int n_workers = 1, bool fork_workers = false, bool force = false) {
+  std::string extra_cut = cut.empty() ? "" : " && (" + cut + ")";
+  std::vector<PlotConfig> cfgs = {
+    {
+      "mpv", "MPV", "", expr_value_getter("mpv", "mpv > 0" + extra_cut),
+      0.0,
+      800.0,
+      kAzure + 6
+    },
+    {
+      "scint_ratio", "Scintillation Ratio", "", expr_value_getter("scint_ratio", "scint_ratio > 0" + extra_cut),
+      0.5,
+      3.0,
+      kBlue - 9
+    },
+    {
+      "fiber_count", "Fiber Count", " [%]", expr_value_getter("fiber_count", "fiber_count > 0" + extra_cut),
+      96.0,
+      100.0,
+      kGreen - 9
+    },
+    {
+      "density", "Density", " [g/mL]", expr_value_getter("density", "density > 0" + extra_cut),
+      8.4,
+      10.0,
+      kRed - 9
     }
+  };
 
-    std::getline(csvStream, tmp, ',');
-    if (tmp == "") {
-      scint_ratio = -1;
-    } else {
-      std::istringstream(tmp) >> scint_ratio;
+  PlotStyle style = DEFAULT_PLOT_STYLE;
+  style.palette = parse_palette(palette);
+  PlotContext ctx("emcal_plots", "", style, raster);
+  // a single worker draws in this thread (see JobGraph::run), so an interactive session keeps its canvases
+  if (n_workers > 1) {
+    gROOT->SetBatch(true);
+    if (!fork_workers) {
+      ROOT::EnableThreadSafety();
     }
+  }
+  FingerprintStore fingerprints("emcal_plots/.fingerprints");
+  Fingerprint sources;
+  for (const char *source : {"emcal_plots/plot.cpp", "includes/blocks.cpp", "includes/expr.cpp", "includes/hist_spec.cpp",
+                             "includes/plot_context.cpp", "includes/label_layer.cpp", "includes/raster.cpp"}) {
+    sources.add(fingerprints.source_digest(source));
+  }
+  JobGraph graph({}, &fingerprints);
+  add_plot_jobs(graph, ctx, all_blocks, cfgs, "tim", sources);
+  ScopedTimer timer("plot: render jobs");
+  graph.run(n_workers, fork_workers ? JobExecutor::PROCESSES : JobExecutor::THREADS, force);
+  timer.stop();
+  graph.print_report();
+}
 
-    std::getline(csvStream, tmp, ',');
-    std::istringstream(tmp) >> fiber_type;
-
-    std::getline(csvStream, tmp, ',');
-    std::istringstream(tmp) >> fiber_batch;
-
-    std::getline(csvStream, tmp);
-    if (tmp == "" || tmp == "\r") {
-      // if (tmp == "") {
-      //   printf("EMPTY STRING\n");
-      // }  else {
-      //   printf("CARRIAGE RETURN\n");
-      // }
-      w_powder = "";
-    } else {
-      std::istringstream(tmp) >> w_powder;
-    }
+/**
+ * @brief Body of macro (called when macro is executed): plot_blocks of the block database.
+ * 
+ * @param cut see plot_blocks.
+ * @param raster see plot_blocks.
+ * @param palette see plot_blocks.
+ * @param n_workers see plot_blocks.
+ * @param fork_workers see plot_blocks.
+ * @param force see plot_blocks.
+ */
+void plot(std::string cut = "", bool raster = false, std::string palette = "bird", unsigned int n_workers = 1, bool fork_workers = false, bool force = false) {
+  check_sector_mapping(pseudo_sector_mapping);
+  check_sector_mapping(true_sector_mapping);
 
-    all_blocks.push_back({
-      sector, block_number, dbn, mpv, mpv_err,
-      ch0_mpv, ch0_mpv_err, ch1_mpv, ch1_mpv_err, ch2_mpv, ch2_mpv_err, ch3_mpv, ch3_mpv_err,
-      density, fiber_count, fiber_t1_count, fiber_t2_count, fiber_t3_count, fiber_t4_count, scint_ratio, fiber_type, fiber_batch, w_powder
-    });
-    // printf("sector %2d block %2d mpv %f +/- %f\n", sector, block_number, mpv, mpv_err);
-    line_num++;
-  }
+  std::cout << "reading 'new database'" << std::endl;
+  ScopedTimer read_timer("plot: read block database");
+  std::vector<Block> all_blocks = read_block_database("files/sPHENIX_EMCal_blocks - dbn_mpv.csv");
+  read_timer.stop();
 
   // TEST SOME THINGS 
   // std::vector<std::string> BASIC_BATCHES;
@@ -1706,49 +1249,6 @@ void plot() {
   // }
   // std::cout << std::endl;
   
-  std::vector<PlotConfig> cfgs = {
-    {
-      "mpv", "MPV", "", [](Block block){
-        double value = block.mpv;
-        return std::make_pair(value > 0, value);
-      },
-      0.0,
-      800.0,
-      kAzure + 6
-    },
-    {
-      "scint_ratio", "Scintillation Ratio", "", [](Block block){
-        double value = block.scint_ratio;
-        return std::make_pair(value > 0, value);
-      },
-      0.5,
-      3.0,
-      kBlue - 9
-    },
-    {
-      "fiber_count", "Fiber Count", " [%]", [](Block block){
-        double value = block.fiber_count;
-        return std::make_pair(value > 0, value);
-      },
-      96.0,
-      100.0,
-      kGreen - 9
-    },
-    {
-      "density", "Density", " [g/mL]", [](Block block){
-        double value = block.density;
-        return std::make_pair(value > 0, value);
-      },
-      8.4,
-      10.0,
-      kRed - 9
-    }
-  };
-
-  make_histograms(all_blocks);
-  plot_channel_lvl(all_blocks, "tim");
-  plot_block_lvl(all_blocks, "tim");
-  for (const PlotConfig& cfg : cfgs) {
-    plot_helper(all_blocks, cfg);
-  }
+  plot_blocks(all_blocks, cut, raster, palette, n_workers, fork_workers, force);
+  Profiler::instance().finish();
 }
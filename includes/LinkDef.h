@@ -0,0 +1,142 @@
+// Selection of the ROOT dictionary of libEmcalCalib (see cli/README.md): the types and functions the macros use
+// interactively once the library is loaded.
+#ifdef __CLING__
+
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+#pragma link C++ nestedclasses;
+
+// geometry and block database
+#pragma link C++ class FiberBatch+;
+#pragma link C++ struct Block+;
+#pragma link C++ class std::vector<Block>+;
+#pragma link C++ enum Vendor;
+#pragma link C++ function block_vendor;
+#pragma link C++ function vendor_name;
+#pragma link C++ function read_block_database;
+#pragma link C++ function write_block_database;
+#pragma link C++ function block_to_channel;
+#pragma link C++ function channel_to_block;
+#pragma link C++ function perimeter_channels;
+
+// physics runs and MPVs
+#pragma link C++ function read_physics_runs;
+#pragma link C++ function get_physics_runs;
+#pragma link C++ function get_dbns;
+#pragma link C++ function read_run_chnl_mpv;
+#pragma link C++ function get_chnl_mpv_with_err;
+#pragma link C++ function calculate_block_mpv_with_err;
+#pragma link C++ function set_block_mpvs;
+#pragma link C++ function read_run_sp_gaps;
+#pragma link C++ function get_sp_gaps;
+#pragma link C++ function write_map_to_file;
+#pragma link C++ function write_mpv_ib;
+#pragma link C++ function write_sp_gap_ib;
+#pragma link C++ function write_calib_table;
+
+// I/O
+#pragma link C++ class Fingerprint;
+#pragma link C++ class FingerprintStore;
+#pragma link C++ function content_digest;
+#pragma link C++ struct FetchedFile+;
+#pragma link C++ struct RunFetch+;
+#pragma link C++ class RunFetcher;
+#pragma link C++ function run_folder_name;
+#pragma link C++ function make_directory;
+#pragma link C++ struct ExtractResult+;
+#pragma link C++ function extract_histograms;
+#pragma link C++ function extract_runs;
+#pragma link C++ function print_extract_report;
+#pragma link C++ function benchmark_extraction;
+#pragma link C++ class CalibTable;
+#pragma link C++ class RawEventFile;
+#pragma link C++ class RawEventWriter;
+#pragma link C++ struct AdcIngestConfig;
+#pragma link C++ struct AdcIngestResult+;
+#pragma link C++ function build_adc_hists;
+#pragma link C++ function channel_peak_hist;
+#pragma link C++ function ingest_raw_events;
+#pragma link C++ function write_synthetic_raw_events;
+#pragma link C++ enum AmplitudeMethod;
+#pragma link C++ struct WaveformConfig;
+#pragma link C++ class WaveformKernel;
+#pragma link C++ function pulse_template;
+#pragma link C++ function pulse_templates;
+#pragma link C++ function reference_amplitudes;
+#pragma link C++ function synthetic_waveforms;
+#pragma link C++ function benchmark_waveform_kernel;
+
+// statistics and run comparison
+#pragma link C++ class RunningStats+;
+#pragma link C++ class HierarchicalStats;
+#pragma link C++ class GroupBy;
+#pragma link C++ class CorrelationEngine;
+#pragma link C++ struct RunHists;
+#pragma link C++ struct RunComparison;
+#pragma link C++ function read_run_hists;
+#pragma link C++ function compare_run_batch;
+#pragma link C++ function write_run_comparison_csv;
+
+// fit telemetry
+#pragma link C++ enum FitSeed;
+#pragma link C++ struct FitTelemetry+;
+#pragma link C++ class std::vector<FitTelemetry>+;
+#pragma link C++ class FitClock;
+#pragma link C++ function fit_seed_name;
+#pragma link C++ function fit_telemetry;
+#pragma link C++ function write_fit_telemetry_csv;
+#pragma link C++ function read_fit_telemetry_csv;
+#pragma link C++ function slowest_fits;
+#pragma link C++ function print_fit_costs;
+#pragma link C++ function save_fit_cost_plots;
+
+// single pixel fits and the histogram service
+#pragma link C++ struct SinglePixelFit+;
+#pragma link C++ function sp_fit_function;
+#pragma link C++ function fit_single_pixels;
+#pragma link C++ struct HistSlice+;
+#pragma link C++ class HistService;
+#pragma link C++ class HistClient;
+
+// MIP fits
+#pragma link C++ function langaus_function;
+#pragma link C++ class LandauGauss;
+#pragma link C++ struct MipFitConfig;
+#pragma link C++ struct MipFit+;
+#pragma link C++ class std::vector<MipFit>+;
+#pragma link C++ struct MipDiff;
+#pragma link C++ struct MipRunResult+;
+#pragma link C++ function fit_mip;
+#pragma link C++ function fit_mip_spectra;
+#pragma link C++ function mip_fit_hist;
+#pragma link C++ function write_mip_fits_csv;
+#pragma link C++ function diff_mip_fits;
+#pragma link C++ function write_mip_diff_csv;
+#pragma link C++ function print_mip_diff;
+#pragma link C++ function fit_run_mips;
+
+// profiling and tracing
+#pragma link C++ struct StageTime+;
+#pragma link C++ class Profiler;
+#pragma link C++ class ScopedTimer;
+#pragma link C++ function profiling;
+#pragma link C++ function tracing;
+#pragma link C++ function profile_count;
+#pragma link C++ function trace_counter;
+
+// object ownership
+#pragma link C++ class RootArena;
+#pragma link C++ class RootPool<TF1>;
+#pragma link C++ class RootPool<TH1>;
+#pragma link C++ typedef TF1Pool;
+#pragma link C++ typedef TH1Pool;
+#pragma link C++ function reset_tf1;
+#pragma link C++ function reset_th1;
+
+// plotting
+#pragma link C++ class PlotContext;
+#pragma link C++ class LabelLayer;
+#pragma link C++ class RasterImage;
+
+#endif
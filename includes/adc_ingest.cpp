@@ -0,0 +1,261 @@
+#include "adc_ingest.h"
+
+/**
+ * @brief Counts of one filling thread: n_bins + 2 bins per channel (underflow and overflow included) and the moments
+ *    of the in-range fills, as TH1 keeps them.
+ */
+typedef struct AdcPartial {
+  std::vector<double> counts;     // [channel*(n_bins + 2) + bin]
+  std::vector<double> moments;    // [channel*3 + (sum w, sum wx, sum wx^2)]
+  uint64_t n_accepted = 0;
+} AdcPartial;
+
+static bool accept_event(const RawEvent &event, const AdcIngestConfig &config, bool count_hits) {
+  if (config.trigger_mask != 0 && (event.trigger & config.trigger_mask) == 0) {
+    return false;
+  }
+  if (count_hits) {
+    int n_hits = 0;
+    for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+      n_hits += event.adc[ch] > config.hit_threshold;
+    }
+    if (n_hits < config.min_hit_channels || n_hits > config.max_hit_channels) {
+      return false;
+    }
+  }
+  return !config.event_cut || config.event_cut(event);
+}
+
+/**
+ * @brief Fill events [begin, end) into a thread's partial counts. Bins are found by arithmetic on the fixed binning
+ *    (no TH1::Fill), so the loop is bound by the reading of the events.
+ */
+static void fill_adc_range(const RawEvent *events, size_t begin, size_t end, const AdcIngestConfig &config, AdcPartial &partial) {
+  ScopedTimer timer("adc ingest: fill events");
+  timer.arg("events", end - begin);
+  const int stride = config.n_bins + 2;
+  const double scale = config.n_bins/(config.x_max - config.x_min);
+  const bool count_hits = config.min_hit_channels > 0 || config.max_hit_channels < (int) RAW_N_CHANNELS;
+  partial.counts.assign((size_t) RAW_N_CHANNELS*stride, 0);
+  partial.moments.assign(3*RAW_N_CHANNELS, 0);
+  for (size_t e = begin; e < end; e++) {
+    const RawEvent &event = events[e];
+    if (!accept_event(event, config, count_hits)) {
+      continue;
+    }
+    partial.n_accepted++;
+    double *counts = partial.counts.data();
+    double *moments = partial.moments.data();
+    for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++, counts += stride, moments += 3) {
+      double x = event.adc[ch];
+      if (!(x >= config.x_min)) {   // NaN too
+        counts[0]++;
+      } else if (x >= config.x_max) {
+        counts[stride - 1]++;
+      } else {
+        counts[std::min(config.n_bins, 1 + (int) ((x - config.x_min)*scale))]++;
+        moments[0]++;
+        moments[1] += x;
+        moments[2] += x*x;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Fill the ADC histogram of every channel (h_alladc_<channel>, detached from any directory, owned by the
+ *    caller) from a raw-event file, n_threads contiguous ranges of events at a time into thread-local counts which are
+ *    merged in thread order, so the result does not depend on scheduling. Throws std::runtime_error on a bad binning.
+ *
+ * @param file
+ * @param config binning, event cuts and threads.
+ * @param result filled with the event counts and the fill time.
+ * @return std::vector<TH1D*> RAW_N_CHANNELS histograms.
+ */
+std::vector<TH1D*> build_adc_hists(const RawEventFile &file, const AdcIngestConfig &config, AdcIngestResult &result) {
+  if (config.n_bins < 1 || !(config.x_max > config.x_min)) {
+    throw std::runtime_error(Form("bad ADC binning: %d bins in [%g, %g)", config.n_bins, config.x_min, config.x_max));
+  }
+  if (config.n_threads < 1) {
+    throw std::runtime_error("n_threads should be >= 1");
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const size_t n_events = file.size();
+  unsigned int n_threads = std::max<size_t>(1, std::min<size_t>(config.n_threads, n_events/1024));
+  std::vector<AdcPartial> partials(n_threads);
+  if (n_threads == 1) {
+    fill_adc_range(file.events(), 0, n_events, config, partials[0]);
+  } else {
+    std::vector<std::thread> threads;
+    size_t chunk = (n_events + n_threads - 1)/n_threads;
+    for (unsigned int t = 0; t < n_threads; t++) {
+      size_t begin = std::min(n_events, t*chunk);
+      size_t end = std::min(n_events, begin + chunk);
+      threads.emplace_back(fill_adc_range, file.events(), begin, end, std::cref(config), std::ref(partials[t]));
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  ScopedTimer merge_timer("adc ingest: merge");
+  AdcPartial &sum = partials[0];
+  for (unsigned int t = 1; t < n_threads; t++) {
+    for (size_t i = 0; i < sum.counts.size(); i++) {
+      sum.counts[i] += partials[t].counts[i];
+    }
+    for (size_t i = 0; i < sum.moments.size(); i++) {
+      sum.moments[i] += partials[t].moments[i];
+    }
+    sum.n_accepted += partials[t].n_accepted;
+  }
+  const int stride = config.n_bins + 2;
+  std::vector<TH1D*> hists(RAW_N_CHANNELS);
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    TH1D *h = new TH1D(Form("h_alladc_%u", ch), Form("h_alladc_%u", ch), config.n_bins, config.x_min, config.x_max);
+    h->SetDirectory(nullptr);
+    for (int bin = 0; bin < stride; bin++) {
+      h->SetBinContent(bin, sum.counts[(size_t) ch*stride + bin]);
+    }
+    // unit weights: sum w^2 = sum w
+    double stats[4] = {sum.moments[3*ch], sum.moments[3*ch], sum.moments[3*ch + 1], sum.moments[3*ch + 2]};
+    h->PutStats(stats);
+    h->SetEntries(sum.n_accepted);
+    hists[ch] = h;
+  }
+  merge_timer.stop();
+
+  result.run = file.header().run;
+  result.n_events = n_events;
+  result.n_accepted = sum.n_accepted;
+  result.bytes = file.bytes();
+  result.fill_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return hists;
+}
+
+/**
+ * @brief Per-channel peak positions in the layout of h_allchannels (bin channel + 1: position, error), named
+ *    INGEST_PEAK_HIST. The position is the maximum of the spectrum above peak_min, refined by a parabola through the
+ *    maximum bin and its neighbours; the error is the bin width over sqrt(12). This is a fit-free estimate of the MPV,
+ *    to check the spectra, not a calibration: fit them for that (see fit_run_mips). Empty channels get 0 +- 0.
+ *
+ * @param adc_hists of build_adc_hists.
+ * @param peak_min ADC; the pedestal and single pixel peaks lie below it.
+ * @return TH1D* INGEST_PEAK_HIST, detached, owned by the caller.
+ */
+TH1D *channel_peak_hist(const std::vector<TH1D*> &adc_hists, double peak_min) {
+  TH1D *peaks = new TH1D(INGEST_PEAK_HIST, INGEST_PEAK_HIST, adc_hists.size(), -0.5, adc_hists.size() - 0.5);
+  peaks->SetDirectory(nullptr);
+  for (size_t ch = 0; ch < adc_hists.size(); ch++) {
+    const TH1D *h = adc_hists[ch];
+    int n_bins = h->GetNbinsX();
+    int max_bin = -1;
+    double max = 0;
+    for (int bin = 1; bin <= n_bins; bin++) {
+      if (h->GetBinCenter(bin) >= peak_min && h->GetBinContent(bin) > max) {
+        max = h->GetBinContent(bin);
+        max_bin = bin;
+      }
+    }
+    if (max_bin < 0) {
+      continue;
+    }
+    double width = h->GetBinWidth(max_bin);
+    double position = h->GetBinCenter(max_bin);
+    if (max_bin > 1 && max_bin < n_bins) {
+      double left = h->GetBinContent(max_bin - 1);
+      double right = h->GetBinContent(max_bin + 1);
+      double curvature = left - 2*max + right;
+      if (curvature < 0) {
+        position += 0.5*width*(left - right)/curvature;
+      }
+    }
+    peaks->SetBinContent(ch + 1, position);
+    peaks->SetBinError(ch + 1, width/std::sqrt(12.0));
+  }
+  return peaks;
+}
+
+/**
+ * @brief Build the histograms of a raw-event file and write them as the QA output of its run,
+ *    "<runs_dir>/qa_output_000<run>/histograms.root": h_alladc_<channel> (read by fit_all_runs, the single pixel
+ *    fits and fit_run_mips) and INGEST_PEAK_HIST (see channel_peak_hist). There is no h_allchannels: mpv_dbn reads
+ *    the MPVs of the ingested runs from the mip_fits.root of fit_run_mips. The file is written to a temporary file and
+ *    renamed. Throws std::runtime_error on failure.
+ *
+ * @param raw_file
+ * @param runs_dir e.g. "ingest_runs"; not a directory of fetched QA output (physics_runs), whose files it would
+ *    replace.
+ * @param config
+ * @return AdcIngestResult
+ */
+AdcIngestResult ingest_raw_events(const std::string &raw_file, const std::string &runs_dir, const AdcIngestConfig &config) {
+  ScopedTimer timer("adc ingest: run");
+  RawEventFile file(raw_file);
+  AdcIngestResult result = {};
+  std::vector<TH1D*> hists = build_adc_hists(file, config, result);
+  TH1D *peaks = channel_peak_hist(hists, config.peak_min);
+
+  ScopedTimer write_timer("adc ingest: write histograms");
+  std::string run_dir = runs_dir + "/" + run_folder_name(result.run);
+  make_directory(runs_dir);
+  make_directory(run_dir);
+  result.output = run_dir + "/histograms.root";
+  std::string tmp_name = result.output + ".tmp";
+  TFile *outfile = TFile::Open(tmp_name.c_str(), "RECREATE");
+  bool ok = outfile && !outfile->IsZombie();
+  for (size_t ch = 0; ok && ch < hists.size(); ch++) {
+    ok = outfile->WriteTObject(hists[ch], hists[ch]->GetName()) > 0;
+  }
+  ok = ok && outfile->WriteTObject(peaks, peaks->GetName()) > 0;
+  if (outfile) {
+    outfile->Close();
+  }
+  delete outfile;
+  for (TH1D *h : hists) {
+    delete h;
+  }
+  delete peaks;
+  if (!ok || rename(tmp_name.c_str(), result.output.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("unable to write '%s'", result.output.c_str()));
+  }
+  write_timer.stop();
+  printf("run %d: %lu/%lu events (%.1f MB) filled in %.3f s (%.2f GB/s) -> %s\n", result.run,
+         (unsigned long) result.n_accepted, (unsigned long) result.n_events, result.bytes/1e6, result.fill_time,
+         result.bytes/1e9/std::max(1e-9, result.fill_time), result.output.c_str());
+  return result;
+}
+
+/**
+ * @brief Write a raw-event file of simulated cosmics, to exercise the ingest without DAQ data: every channel gets
+ *    pedestal noise, and each event a few channels crossed by a muon (Landau, MPV 100-160 ADC by channel).
+ *
+ * @param file_name
+ * @param run
+ * @param n_events
+ * @param seed
+ */
+void write_synthetic_raw_events(const std::string &file_name, int run, uint64_t n_events, unsigned int seed) {
+  TRandom3 random(seed);
+  float mpv[RAW_N_CHANNELS];
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    mpv[ch] = 100 + 60*random.Uniform();
+  }
+  RawEventWriter writer(file_name, run);
+  RawEvent event;
+  for (uint64_t e = 0; e < n_events; e++) {
+    event.event = e;
+    event.trigger = 1;
+    for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+      event.adc[ch] = random.Gaus(0, 1.5);
+    }
+    int n_hits = 1 + (int) (random.Uniform()*8);
+    for (int h = 0; h < n_hits; h++) {
+      uint32_t ch = std::min(RAW_N_CHANNELS - 1, (uint32_t) (random.Uniform()*RAW_N_CHANNELS));
+      event.adc[ch] += random.Landau(mpv[ch], 0.1*mpv[ch]);
+    }
+    writer.write(event);
+  }
+  writer.close();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TFile.h>
+#include <TH1D.h>
+#include <TRandom3.h>
+#include <TString.h>
+
+#include "raw_event.h"
+#include "run_fetch.h"
+#include "profiler.h"
+
+/**
+ * @brief Name of the fit-free peak positions written by ingest_raw_events (see channel_peak_hist); not h_allchannels,
+ *    which readers of the QA output take as fitted MPVs.
+ */
+const char *const INGEST_PEAK_HIST = "h_peakpos";
+
+/**
+ * @brief Binning and event selection of the per-channel ADC histograms built from a raw-event file. The defaults
+ *    reproduce the binning of the QA output's h_alladc_<channel> and accept every event.
+ */
+typedef struct AdcIngestConfig {
+  int n_bins = 501;
+  double x_min = -0.5;
+  double x_max = 500.5;
+  uint32_t trigger_mask = 0;      // events with any of these trigger bits; 0 accepts every trigger
+  float hit_threshold = 5;        // ADC; a channel above it is hit
+  int min_hit_channels = 0;       // events with fewer hit channels are skipped
+  int max_hit_channels = RAW_N_CHANNELS;    // events with more hit channels (showers) are skipped
+  std::function<bool(const RawEvent &)> event_cut;  // further cut, if set
+  double peak_min = 50;           // ADC; low edge of the peak search of INGEST_PEAK_HIST
+  unsigned int n_threads = 1;
+} AdcIngestConfig;
+
+typedef struct AdcIngestResult {
+  int run;
+  uint64_t n_events;        // in the raw-event file
+  uint64_t n_accepted;      // passing the event cuts
+  size_t bytes;             // of the raw-event file
+  double fill_time;         // s, of the histogram filling
+  std::string output;       // histograms.root written (empty for build_adc_hists)
+} AdcIngestResult;
+
+std::vector<TH1D*> build_adc_hists(const RawEventFile &file, const AdcIngestConfig &config, AdcIngestResult &result);
+TH1D *channel_peak_hist(const std::vector<TH1D*> &adc_hists, double peak_min);
+AdcIngestResult ingest_raw_events(const std::string &raw_file, const std::string &runs_dir, const AdcIngestConfig &config);
+void write_synthetic_raw_events(const std::string &file_name, int run, uint64_t n_events, unsigned int seed = 4357);
+
+#ifndef EMCAL_LIBRARY
+#include "adc_ingest.cpp"
+#endif
@@ -0,0 +1,330 @@
+#include "aggregate.h"
+
+#include <algorithm>
+
+/**
+ * @brief Parse an attribute name (e.g., "fiber_batch", "sector", "vop") as used in macros.
+ * 
+ * @param name 
+ * @return GroupAttr 
+ */
+GroupAttr parse_group_attr(const std::string &name) {
+  static const std::map<std::string, GroupAttr> names = {
+    {"sector", GroupAttr::SECTOR},
+    {"ib", GroupAttr::IB},
+    {"vendor", GroupAttr::VENDOR},
+    {"fiber_type", GroupAttr::FIBER_TYPE},
+    {"fiber_type_compressed", GroupAttr::FIBER_TYPE_COMPRESSED},
+    {"fiber_batch", GroupAttr::FIBER_BATCH},
+    {"fiber_batch_number", GroupAttr::FIBER_BATCH_NUMBER},
+    {"w_powder", GroupAttr::W_POWDER},
+    {"external", GroupAttr::EXTERNAL},
+  };
+  auto it = names.find(name);
+  if (it == names.end()) {
+    throw std::runtime_error(Form("unknown group attribute '%s'", name.c_str()));
+  }
+  return it->second;
+}
+
+const char *group_attr_name(GroupAttr attr) {
+  switch (attr) {
+    case GroupAttr::SECTOR: return "sector";
+    case GroupAttr::IB: return "ib";
+    case GroupAttr::VENDOR: return "vendor";
+    case GroupAttr::FIBER_TYPE: return "fiber_type";
+    case GroupAttr::FIBER_TYPE_COMPRESSED: return "fiber_type_compressed";
+    case GroupAttr::FIBER_BATCH: return "fiber_batch";
+    case GroupAttr::FIBER_BATCH_NUMBER: return "fiber_batch_number";
+    case GroupAttr::W_POWDER: return "w_powder";
+    case GroupAttr::EXTERNAL: return "external";
+  }
+  return "";
+}
+
+GroupBy::GroupBy(const std::vector<GroupAttr> &attrs) : attrs(attrs) {
+  if (attrs.empty() || attrs.size() > 4) {
+    throw std::runtime_error("GroupBy: expected 1 to 4 attributes");
+  }
+  dictionaries.resize(attrs.size());
+  dictionary_labels.resize(attrs.size());
+}
+
+/**
+ * @brief Supply the column used by GroupAttr::EXTERNAL (one value per block, in block table order; NaN = missing).
+ * 
+ * @param name column name used in labels (e.g., "vop").
+ * @param values 
+ */
+void GroupBy::set_external(const std::string &name, const std::vector<double> &values) {
+  external_name = name;
+  external = values;
+}
+
+uint16_t GroupBy::intern(size_t attr_idx, const std::string &value) {
+  auto &dictionary = dictionaries[attr_idx];
+  auto it = dictionary.find(value);
+  if (it != dictionary.end()) {
+    return it->second;
+  }
+  if (dictionary.size() >= 0xFFFF) {
+    throw std::runtime_error("GroupBy: too many distinct values for one attribute");
+  }
+  uint16_t code = dictionary.size();
+  dictionary[value] = code;
+  dictionary_labels[attr_idx].push_back(value);
+  return code;
+}
+
+/**
+ * @brief Pack the attribute codes of a block into a single 64 bit key (16 bits per attribute).
+ * 
+ * @return false if any attribute is missing for this block (no fiber batch, empty fiber type, ...).
+ */
+bool GroupBy::block_key(const Block &block, size_t block_idx, uint64_t &key) {
+  key = 0;
+  for (size_t i = 0; i < attrs.size(); i++) {
+    uint64_t code;
+    switch (attrs[i]) {
+      case GroupAttr::SECTOR:
+        code = block.sector;
+        break;
+      case GroupAttr::IB:
+        code = (block.block_number - 1)/16;
+        break;
+      case GroupAttr::VENDOR:
+        code = (uint64_t) block_vendor(block);
+        break;
+      case GroupAttr::FIBER_TYPE:
+        if (block.fiber_type.empty()) {
+          return false;
+        }
+        code = intern(i, block.fiber_type);
+        break;
+      case GroupAttr::FIBER_TYPE_COMPRESSED: {
+        const std::string &compressed = fiber_type_compressor.at(block.fiber_type);
+        if (compressed.empty()) {
+          return false;
+        }
+        code = intern(i, compressed);
+        break;
+      }
+      case GroupAttr::FIBER_BATCH:
+        if (!block.fiber_batch.valid) {
+          return false;
+        }
+        code = intern(i, block.fiber_batch.str);
+        break;
+      case GroupAttr::FIBER_BATCH_NUMBER:
+        if (!block.fiber_batch.valid) {
+          return false;
+        }
+        code = block.fiber_batch.batch_number;
+        break;
+      case GroupAttr::W_POWDER:
+        if (block.w_powder.empty()) {
+          return false;
+        }
+        code = intern(i, block.w_powder);
+        break;
+      case GroupAttr::EXTERNAL: {
+        if (block_idx >= external.size()) {
+          throw std::runtime_error("GroupBy: external column is shorter than the block table");
+        }
+        double value = external[block_idx];
+        if (std::isnan(value)) {
+          return false;
+        }
+        code = intern(i, Form("%g", value));
+        break;
+      }
+      default:
+        throw std::runtime_error(Form("GroupBy: unknown attribute %d", (int) attrs[i]));
+    }
+    key |= (code & 0xFFFF) << (16*i);
+  }
+  return true;
+}
+
+/**
+ * @brief Aggregate a quantity over the block table in a single pass.
+ * 
+ * @param all_blocks 
+ * @param quantity e.g., block_quantity(&Block::mpv) or a channel_quantity(...) for channel-level grouping.
+ * @param is_valid values failing this predicate are skipped (default: accept all).
+ * @param cut expression (see expr.h) selecting the blocks to aggregate, e.g. "vendor == UIUC"; "" keeps every block.
+ */
+void GroupBy::aggregate(const std::vector<Block> &all_blocks, const quantity_getter &quantity, const std::function<bool(double)> &is_valid, const std::string &cut) {
+  group_index.clear();
+  group_keys.clear();
+  groups.clear();
+  all = RunningStats();
+  block_group = std::vector<int>(all_blocks.size(), -1);
+  Selection selection;
+  if (!cut.empty()) {
+    selection = Expr::compile(cut).select(BlockTable(all_blocks));
+  }
+  double values[4];
+  for (size_t b = 0; b < all_blocks.size(); b++) {
+    const Block &block = all_blocks[b];
+    uint64_t key;
+    if ((!cut.empty() && !is_selected(selection, b)) || !block_key(block, b, key)) {
+      continue;
+    }
+    auto it = group_index.find(key);
+    size_t group;
+    if (it == group_index.end()) {
+      group = groups.size();
+      group_index[key] = group;
+      group_keys.push_back(key);
+      groups.emplace_back();
+    } else {
+      group = it->second;
+    }
+    block_group[b] = group;
+    int n = quantity(block, values);
+    for (int v = 0; v < n; v++) {
+      if (!is_valid || is_valid(values[v])) {
+        groups[group].add(values[v]);
+        all.add(values[v]);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Label of one attribute of a group's key (e.g., "2-A" for a fiber batch).
+ */
+std::string GroupBy::key_label(size_t group, size_t attr_idx) const {
+  uint64_t code = (group_keys.at(group) >> (16*attr_idx)) & 0xFFFF;
+  switch (attrs.at(attr_idx)) {
+    case GroupAttr::SECTOR:
+    case GroupAttr::IB:
+    case GroupAttr::FIBER_BATCH_NUMBER:
+      return std::to_string(code);
+    case GroupAttr::VENDOR:
+      return vendor_name((Vendor) code);
+    default:
+      return dictionary_labels[attr_idx].at(code);
+  }
+}
+
+/**
+ * @brief Full label of a group, e.g. "fiber_batch=2-A, vendor=UIUC".
+ */
+std::string GroupBy::label(size_t group) const {
+  std::string s;
+  for (size_t i = 0; i < attrs.size(); i++) {
+    if (i > 0) {
+      s += ", ";
+    }
+    s += attrs[i] == GroupAttr::EXTERNAL && !external_name.empty() ? external_name : group_attr_name(attrs[i]);
+    s += "=" + key_label(group, i);
+  }
+  return s;
+}
+
+/**
+ * @brief Find a group by the labels of its key (one per attribute, in attribute order).
+ * 
+ * @return int group index, or -1 if no such group.
+ */
+int GroupBy::find(const std::vector<std::string> &key_labels) const {
+  if (key_labels.size() != attrs.size()) {
+    throw std::runtime_error("GroupBy::find: expected one label per attribute");
+  }
+  for (size_t group = 0; group < groups.size(); group++) {
+    bool match = true;
+    for (size_t i = 0; i < attrs.size() && match; i++) {
+      match = key_label(group, i) == key_labels[i];
+    }
+    if (match) {
+      return group;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Correction factor of each group, i.e. (reference mean) / (group mean).
+ * 
+ * @param reference_group group to normalize to, or -1 to normalize to the mean over all groups.
+ * @return std::vector<double> one factor per group (NaN for empty groups).
+ */
+std::vector<double> GroupBy::correction_factors(int reference_group) const {
+  double reference = reference_group < 0 ? all.mean() : groups.at(reference_group).mean();
+  std::vector<double> factors(groups.size());
+  for (size_t group = 0; group < groups.size(); group++) {
+    factors[group] = groups[group].count() > 0 ? reference/groups[group].mean() : std::numeric_limits<double>::quiet_NaN();
+  }
+  return factors;
+}
+
+/**
+ * @brief Group indices sorted by key (numerically for numeric attributes, FiberBatch order for fiber batches).
+ */
+std::vector<size_t> GroupBy::sorted_groups() const {
+  std::vector<size_t> order(groups.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    for (size_t i = 0; i < attrs.size(); i++) {
+      uint64_t code_a = (group_keys[a] >> (16*i)) & 0xFFFF;
+      uint64_t code_b = (group_keys[b] >> (16*i)) & 0xFFFF;
+      if (code_a == code_b) {
+        continue;
+      }
+      switch (attrs[i]) {
+        case GroupAttr::SECTOR:
+        case GroupAttr::IB:
+        case GroupAttr::VENDOR:
+        case GroupAttr::FIBER_BATCH_NUMBER:
+          return code_a < code_b;
+        case GroupAttr::FIBER_BATCH:
+          return FiberBatch(dictionary_labels[i][code_a]) < FiberBatch(dictionary_labels[i][code_b]);
+        default:
+          return dictionary_labels[i][code_a] < dictionary_labels[i][code_b];
+      }
+    }
+    return false;
+  });
+  return order;
+}
+
+/**
+ * @brief Print one line per group: count, mean, median, sigma and correction factor.
+ */
+void GroupBy::print(int reference_group) const {
+  std::vector<double> factors = correction_factors(reference_group);
+  printf("%-40s %6s %10s %10s %10s %10s\n", "group", "n", "mean", "median", "sigma", "factor");
+  for (size_t group : sorted_groups()) {
+    const RunningStats &s = groups[group];
+    printf("%-40s %6ld %10.3f %10.3f %10.3f %10.4f\n", label(group).c_str(), s.count(), s.mean(), s.median(), s.std_dev(), factors[group]);
+  }
+  printf("%-40s %6ld %10.3f %10.3f %10.3f\n", "(all)", all.count(), all.mean(), all.median(), all.std_dev());
+}
+
+/**
+ * @brief Write one row per group: key attributes, count, mean, median, sigma and correction factor.
+ */
+void GroupBy::write_csv(const std::string &file_name, int reference_group) const {
+  FILE *outfile = fopen(file_name.c_str(), "w+");
+  if (!outfile) {
+    throw std::runtime_error(Form("unable to open %s for writing", file_name.c_str()));
+  }
+  for (size_t i = 0; i < attrs.size(); i++) {
+    fprintf(outfile, "%s, ", attrs[i] == GroupAttr::EXTERNAL && !external_name.empty() ? external_name.c_str() : group_attr_name(attrs[i]));
+  }
+  fprintf(outfile, "n, mean, median, sigma, correction_factor");
+  std::vector<double> factors = correction_factors(reference_group);
+  for (size_t group : sorted_groups()) {
+    const RunningStats &s = groups[group];
+    fprintf(outfile, "\n");
+    for (size_t i = 0; i < attrs.size(); i++) {
+      fprintf(outfile, "%s, ", key_label(group, i).c_str());
+    }
+    fprintf(outfile, "%ld, %f, %f, %f, %f", s.count(), s.mean(), s.median(), s.std_dev(), factors[group]);
+  }
+  fclose(outfile);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <functional>
+#include <stdexcept>
+
+#include "mpv_dbn.h"
+#include "blocks.h"
+#include "hist_spec.h"
+
+/**
+ * @brief Block attributes a block table can be grouped by. EXTERNAL groups by a per-block column supplied
+ *    separately (e.g., VOP, which is not part of the block database).
+ */
+enum class GroupAttr {
+  SECTOR,
+  IB,
+  VENDOR,
+  FIBER_TYPE,
+  FIBER_TYPE_COMPRESSED,
+  FIBER_BATCH,
+  FIBER_BATCH_NUMBER,
+  W_POWDER,
+  EXTERNAL
+};
+
+GroupAttr parse_group_attr(const std::string &name);
+const char *group_attr_name(GroupAttr attr);
+
+/**
+ * @brief Hash aggregation of a per-block (or per-channel) quantity over any combination of (up to 4) block attributes.
+ *    Groups, their RunningStats and correction factors relative to a reference group are computed in one pass.
+ */
+class GroupBy {
+  public:
+  GroupBy(const std::vector<GroupAttr> &attrs);
+  void set_external(const std::string &name, const std::vector<double> &values);
+  void aggregate(const std::vector<Block> &all_blocks, const quantity_getter &quantity, const std::function<bool(double)> &is_valid = nullptr, const std::string &cut = "");
+
+  size_t n_groups() const { return groups.size(); }
+  std::string label(size_t group) const;
+  std::string key_label(size_t group, size_t attr_idx) const;
+  int find(const std::vector<std::string> &key_labels) const;
+  int group_of(size_t block_idx) const { return block_group.at(block_idx); }
+  const RunningStats &stats(size_t group) const { return groups.at(group); }
+  const RunningStats &overall() const { return all; }
+
+  std::vector<double> correction_factors(int reference_group = -1) const;
+  std::vector<size_t> sorted_groups() const;
+  void print(int reference_group = -1) const;
+  void write_csv(const std::string &file_name, int reference_group = -1) const;
+
+  private:
+  bool block_key(const Block &block, size_t block_idx, uint64_t &key);
+  uint16_t intern(size_t attr_idx, const std::string &value);
+
+  std::vector<GroupAttr> attrs;
+  std::string external_name;
+  std::vector<double> external;
+  std::vector<std::unordered_map<std::string, uint16_t>> dictionaries;
+  std::vector<std::vector<std::string>> dictionary_labels;
+  std::unordered_map<uint64_t, size_t> group_index;
+  std::vector<uint64_t> group_keys;
+  std::vector<RunningStats> groups;
+  std::vector<int> block_group;
+  RunningStats all;
+};
+
+#ifndef EMCAL_LIBRARY
+#include "aggregate.cpp"
+#endif
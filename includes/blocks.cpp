@@ -0,0 +1,216 @@
+#include "blocks.h"
+
+FiberBatch::FiberBatch(std::string fiber_batch) : str(fiber_batch) {
+  if (fiber_batch == "" || std::find(FIBER_BATCH_TREAT_EMPTY.begin(), FIBER_BATCH_TREAT_EMPTY.end(), fiber_batch) != FIBER_BATCH_TREAT_EMPTY.end()) {
+    valid = false;
+    batch_number = -1;
+    batch_letter = 'X';
+    return;
+  } else {
+    valid = true;
+    // REALLY valid if the constructor exits without throwing a runtime_error...
+  }
+  size_t dash_pos = fiber_batch.find('-');
+  if (dash_pos == std::string::npos) {
+    throw std::runtime_error(Form("unable to locate '-' in fiber batch: %s", fiber_batch.c_str()));
+  }
+  std::string numeric = fiber_batch.substr(0, dash_pos);
+  std::string alpha = fiber_batch.substr(dash_pos + 1, fiber_batch.length() - dash_pos);
+  // check numeric is numeric
+  for (const char &x: numeric) {
+    if (!isdigit(x)) {
+      throw std::runtime_error(Form("fiber type lhs contains a non-numeric character: %s", fiber_batch.c_str()));
+    }
+  }
+  batch_number = std::stoi(numeric);
+  // check alpha is exactly one character
+  if (alpha.length() != 1) {
+    throw std::runtime_error(Form("fiber type rhs contained more than one character: %s", fiber_batch.c_str()));
+  }
+  // check alpha is alpha and is uppercase
+  for (const char &x: alpha) {
+    if (!isalpha(x) || x != toupper(x)) {
+      throw std::runtime_error(Form("fiber type rhs contains a non-letter or is not uppercase: %s", fiber_batch.c_str()));
+    }
+  }
+  batch_letter = alpha[0];
+}
+
+/**
+ * @brief Get the vendor of a block from its DBN (F... = Fudan, C... = CIAE, otherwise UIUC).
+ * 
+ * @param block 
+ * @return Vendor 
+ */
+Vendor block_vendor(const Block &block) {
+  if (block.dbn.empty()) {
+    return Vendor::UIUC;
+  }
+  switch (block.dbn[0]) {
+    case 'F':
+      return Vendor::FUDAN;
+    case 'C':
+      return Vendor::CIAE;
+    default:
+      return Vendor::UIUC;
+  }
+}
+
+/**
+ * @brief Get the display name of a vendor (e.g., for legends).
+ * 
+ * @param vendor 
+ * @return const char* 
+ */
+const char *vendor_name(Vendor vendor) {
+  switch (vendor) {
+    case Vendor::UIUC:
+      return "UIUC";
+    case Vendor::FUDAN:
+      return "Fudan";
+    case Vendor::CIAE:
+      return "CIAE";
+  }
+  return "";
+}
+
+/**
+ * @brief Parse a single csv cell as a double. Empty cells are stored as -1.
+ * 
+ * @param csv_stream stream positioned at the start of the cell.
+ * @return double 
+ */
+static double read_block_cell(std::stringstream &csv_stream) {
+  std::string tmp;
+  std::getline(csv_stream, tmp, ',');
+  if (tmp == "") {
+    return -1;
+  }
+  double value;
+  std::istringstream(tmp) >> value;
+  return value;
+}
+
+/**
+ * @brief Read the merged block database (one row per block).
+ * 
+ * NOTE: expects the column layout of "files/sPHENIX_EMCal_blocks - dbn_mpv.csv".
+ * 
+ * @param file_name path to the database csv.
+ * @return std::vector<Block> all blocks in the file, in file order.
+ */
+std::vector<Block> read_block_database(const std::string &file_name) {
+  std::vector<Block> all_blocks;
+  std::fstream database;
+  database.open(file_name, std::ios::in);
+  if (!database.is_open()) {
+    throw std::runtime_error(Form("unable to open block database '%s'", file_name.c_str()));
+  }
+  std::string line;
+  int line_num = 1;
+  while (std::getline(database, line)) {
+    if (line_num == 1) {
+      line_num++;
+      continue;
+    }
+    std::stringstream csvStream(line);
+    unsigned int sector;
+    unsigned int block_number;
+    std::string dbn;
+    std::string fiber_type;
+    std::string fiber_batch;
+    std::string w_powder;
+
+    std::string tmp;
+
+    std::getline(csvStream, tmp, ',');
+    std::istringstream(tmp) >> sector;
+
+    std::getline(csvStream, tmp, ',');
+    std::istringstream(tmp) >> block_number;
+
+    std::getline(csvStream, tmp, ',');
+    std::istringstream(tmp) >> dbn;
+
+    double mpv = read_block_cell(csvStream);
+    double mpv_err = read_block_cell(csvStream);
+    double ch0_mpv = read_block_cell(csvStream);
+    double ch0_mpv_err = read_block_cell(csvStream);
+    double ch1_mpv = read_block_cell(csvStream);
+    double ch1_mpv_err = read_block_cell(csvStream);
+    double ch2_mpv = read_block_cell(csvStream);
+    double ch2_mpv_err = read_block_cell(csvStream);
+    double ch3_mpv = read_block_cell(csvStream);
+    double ch3_mpv_err = read_block_cell(csvStream);
+    double density = read_block_cell(csvStream);
+    double fiber_count = read_block_cell(csvStream);
+    double fiber_t1_count = read_block_cell(csvStream);
+    double fiber_t2_count = read_block_cell(csvStream);
+    double fiber_t3_count = read_block_cell(csvStream);
+    double fiber_t4_count = read_block_cell(csvStream);
+    double scint_ratio = read_block_cell(csvStream);
+
+    std::getline(csvStream, tmp, ',');
+    std::istringstream(tmp) >> fiber_type;
+
+    std::getline(csvStream, tmp, ',');
+    std::istringstream(tmp) >> fiber_batch;
+
+    std::getline(csvStream, tmp);
+    if (tmp == "" || tmp == "\r") {
+      w_powder = "";
+    } else {
+      std::istringstream(tmp) >> w_powder;
+    }
+
+    all_blocks.push_back({
+      sector, block_number, dbn, mpv, mpv_err,
+      ch0_mpv, ch0_mpv_err, ch1_mpv, ch1_mpv_err, ch2_mpv, ch2_mpv_err, ch3_mpv, ch3_mpv_err,
+      density, fiber_count, fiber_t1_count, fiber_t2_count, fiber_t3_count, fiber_t4_count, scint_ratio, fiber_type, fiber_batch, w_powder
+    });
+    line_num++;
+  }
+  return all_blocks;
+}
+
+/**
+ * @brief Write a numeric cell of the block database (see read_block_database): -1 as an empty cell, else with 10
+ *    significant digits (which keeps the spreadsheet values as they are).
+ */
+static void write_block_cell(FILE *outfile, double value) {
+  if (value == -1) {
+    fprintf(outfile, ",");
+  } else {
+    fprintf(outfile, ",%.10g", value);
+  }
+}
+
+/**
+ * @brief Write blocks in the layout read by read_block_database (CRLF line endings, like the spreadsheet export). The
+ *    file is written to "<file_name>.tmp" and renamed, so readers never see a partial database.
+ * 
+ * @param file_name e.g. "files/sPHENIX_EMCal_blocks - dbn_mpv.csv".
+ * @param all_blocks
+ */
+void write_block_database(const std::string &file_name, const std::vector<Block> &all_blocks) {
+  std::string tmp_name = file_name + ".tmp";
+  FILE *outfile = fopen(tmp_name.c_str(), "w");
+  if (!outfile) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", tmp_name.c_str()));
+  }
+  fprintf(outfile, "sector,block,dbn,mpv,mpv_err,ch0_mpv,ch0_mpv_err,ch1_mpv,ch1_mpv_err,ch2_mpv,ch2_mpv_err,ch3_mpv,ch3_mpv_err,"
+                   "density,fiber_count,fiber_t1,fiber_t2,fiber_t3,fiber_t4,scint_ratio,fiber_type,fiber_batch,w_powder");
+  for (const Block &block : all_blocks) {
+    fprintf(outfile, "\r\n%u,%u,%s", block.sector, block.block_number, block.dbn.c_str());
+    for (double value : {block.mpv, block.mpv_err, block.ch0_mpv, block.ch0_mpv_err, block.ch1_mpv, block.ch1_mpv_err,
+                         block.ch2_mpv, block.ch2_mpv_err, block.ch3_mpv, block.ch3_mpv_err, block.density, block.fiber_count,
+                         block.fiber_t1_count, block.fiber_t2_count, block.fiber_t3_count, block.fiber_t4_count, block.scint_ratio}) {
+      write_block_cell(outfile, value);
+    }
+    fprintf(outfile, ",%s,%s,%s", block.fiber_type.c_str(), block.fiber_batch.str.c_str(), block.w_powder.c_str());
+  }
+  if (fclose(outfile) != 0 || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("unable to write block database '%s'", file_name.c_str()));
+  }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TSystem.h>
+
+/**
+ * @brief list of fiber batches to treat as if they were empty (e.g., we don't have fiber batch information about the block)
+ */
+const std::vector<std::string> FIBER_BATCH_TREAT_EMPTY = {"0", "none"};
+
+/**
+ * @brief Maps every fiber type string found in the database to its base fiber type ("K" or "SG"; "" if unknown/mixed).
+ */
+const std::map<std::string, std::string> fiber_type_compressor = {
+  {"", ""},
+  {"I-K", "K"},
+  {"K", "K"},
+  {"P-SG", "SG"},
+  {"PSG+IK+K", ""},
+  {"SG", "SG"},
+  {"SG-B", "SG"},
+  {"SG47", "SG"},
+};
+
+class FiberBatch {
+  public:
+  FiberBatch(std::string fiber_batch);
+  bool operator ==(const FiberBatch &rhs) const {
+    return batch_number == rhs.batch_number && batch_letter == rhs.batch_letter;
+  }
+  bool operator !=(const FiberBatch &rhs) const {
+    return !(*this == rhs); 
+  }
+  bool operator <(const FiberBatch &rhs) const {
+    if (batch_number < rhs.batch_number) {
+      return true;
+    } else if (batch_number == rhs.batch_number && batch_letter < rhs.batch_letter) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+  bool operator >(const FiberBatch &rhs) const {
+    return !(*this < rhs);
+  }
+  bool operator <=(const FiberBatch &rhs) const {
+    return (*this < rhs) || (*this == rhs);
+  }
+  bool operator >=(const FiberBatch &rhs) const {
+    return (*this > rhs) || (*this == rhs);
+  }
+
+  bool valid;
+  std::string str;
+  int batch_number;
+  char batch_letter;
+};
+
+/**
+ * @brief Struct that packages all information associated with a block.
+ */
+typedef struct Block {
+  unsigned int sector;
+  unsigned int block_number;
+  std::string dbn;
+  double mpv;
+  double mpv_err;
+  double ch0_mpv;
+  double ch0_mpv_err;
+  double ch1_mpv;
+  double ch1_mpv_err;
+  double ch2_mpv;
+  double ch2_mpv_err;
+  double ch3_mpv;
+  double ch3_mpv_err;
+  double density;
+  double fiber_count;
+  double fiber_t1_count;
+  double fiber_t2_count;
+  double fiber_t3_count;
+  double fiber_t4_count;
+  double scint_ratio;
+  std::string fiber_type;
+  FiberBatch fiber_batch;
+  std::string w_powder;
+} Block;
+
+/**
+ * @brief Manufacturer of a block, as encoded by the first character of its DBN.
+ */
+enum class Vendor {
+  UIUC,
+  FUDAN,
+  CIAE
+};
+
+Vendor block_vendor(const Block &block);
+const char *vendor_name(Vendor vendor);
+std::vector<Block> read_block_database(const std::string &file_name);
+void write_block_database(const std::string &file_name, const std::vector<Block> &all_blocks);
+
+#ifndef EMCAL_LIBRARY
+#include "blocks.cpp"
+#endif
@@ -0,0 +1,166 @@
+#pragma once
+
+/**
+ * Binary per-tower calibration table: a 64 byte header followed by one 16 byte record per tower, indexed by global
+ * tower id (see calib_tower_id). Records start on a cache line and four fit in each line. All values are
+ * little-endian; the structs are read and written as is, so the code compiles only for little-endian hosts.
+ *
+ * This header is self-contained (no ROOT, no .cpp) so downstream consumers can copy it as is. The exporter is
+ * write_calib_table() in mpv_dbn.cpp.
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char CALIB_MAGIC[8] = {'E', 'M', 'C', 'A', 'L', 'C', 'A', 'L'};
+const uint32_t CALIB_VERSION = 2;    // 2: the checksum covers the header
+const uint32_t CALIB_SECTORS = 64;
+const uint32_t CALIB_CHANNELS_PER_SECTOR = 384;
+const uint32_t CALIB_N_TOWERS = CALIB_SECTORS*CALIB_CHANNELS_PER_SECTOR;
+
+/**
+ * @brief Status flags of a tower (bitwise or). A tower with CALIB_BAD set has correction 1. CALIB_NO_DATA and
+ *    CALIB_OUT_OF_RANGE are exclusive: an MPV <= 0 is missing, never out of range.
+ */
+enum CalibStatus : uint32_t {
+  CALIB_OK = 0,
+  CALIB_NO_DATA = 1 << 0,      // no run / no MPV for the tower (MPV <= 0)
+  CALIB_OUT_OF_RANGE = 1 << 1, // MPV > 0 outside (MPV_CUTOFF_LOW, MPV_CUTOFF_HIGH)
+  CALIB_PERIMETER = 1 << 2,    // sector perimeter tower (informational: correction is still valid)
+  CALIB_NO_DBN = 1 << 3,       // block not in the DBN map
+};
+
+/**
+ * @brief Flags which make a tower's correction unusable.
+ */
+const uint32_t CALIB_BAD = CALIB_NO_DATA | CALIB_OUT_OF_RANGE;
+
+typedef struct alignas(64) CalibHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;   // bytes before the first record
+  uint32_t record_size;   // sizeof(TowerCalib)
+  uint32_t n_towers;
+  double reference_mpv;   // correction = reference_mpv / mpv
+  uint64_t checksum;      // calib_checksum of the header (with checksum 0) and the records
+  int64_t created;        // unix time
+  uint8_t reserved[16];
+} CalibHeader;
+
+typedef struct TowerCalib {
+  float correction;
+  float correction_err;
+  float mpv;
+  uint32_t status;
+} TowerCalib;
+
+static_assert(sizeof(CalibHeader) == 64, "CalibHeader must be one cache line");
+static_assert(sizeof(TowerCalib) == 16, "TowerCalib must be 16 bytes");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "calibration tables are read and written as host structs, which must be little-endian");
+
+/**
+ * @brief Global tower id of a channel.
+ *
+ * @param sector 0-based sector.
+ * @param channel 0-based channel (h_allchannels numbering).
+ */
+inline uint32_t calib_tower_id(uint32_t sector, uint32_t channel) {
+  return sector*CALIB_CHANNELS_PER_SECTOR + channel;
+}
+
+/**
+ * @brief FNV-1a over 64 bit words (n_bytes is a multiple of 8).
+ */
+inline uint64_t calib_hash_words(const void *data, size_t n_bytes, uint64_t hash = 14695981039346656037ULL) {
+  for (size_t i = 0; i < n_bytes/sizeof(uint64_t); i++) {
+    uint64_t word;
+    memcpy(&word, static_cast<const char*>(data) + i*sizeof(uint64_t), sizeof(uint64_t));
+    hash ^= word;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief Checksum of a table: calib_hash_words over the header, with its checksum field taken as 0, then the records.
+ */
+inline uint64_t calib_checksum(const CalibHeader &header, const TowerCalib *records, size_t n_towers) {
+  CalibHeader unsummed = header;
+  unsummed.checksum = 0;
+  return calib_hash_words(records, n_towers*sizeof(TowerCalib), calib_hash_words(&unsummed, sizeof(unsummed)));
+}
+
+/**
+ * @brief Read-only, memory-mapped calibration table. Throws std::runtime_error if the file is missing, of another
+ *    version or size, or fails its checksum.
+ */
+class CalibTable {
+  public:
+  explicit CalibTable(const std::string &file_name, bool verify_checksum = true) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("unable to open calibration table '" + file_name + "'");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CalibHeader)) {
+      close(fd);
+      throw std::runtime_error("calibration table '" + file_name + "' is truncated");
+    }
+    length = st.st_size;
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      throw std::runtime_error("unable to mmap calibration table '" + file_name + "'");
+    }
+    base = static_cast<const char*>(mapped);
+    const CalibHeader &h = header();
+    std::string error;
+    if (memcmp(h.magic, CALIB_MAGIC, sizeof(CALIB_MAGIC)) != 0) {
+      error = "is not a calibration table";
+    } else if (h.version != CALIB_VERSION) {
+      error = "has unsupported version " + std::to_string(h.version);
+    } else if (h.record_size != sizeof(TowerCalib) || h.header_size % 64 != 0 || h.n_towers != CALIB_N_TOWERS
+               || length < (size_t) h.header_size + (size_t) h.n_towers*h.record_size) {
+      error = "has an unexpected layout";
+    } else if (verify_checksum && calib_checksum(h, records(), h.n_towers) != h.checksum) {
+      error = "fails its checksum";
+    }
+    if (!error.empty()) {
+      munmap(const_cast<char*>(base), length);
+      throw std::runtime_error("calibration table '" + file_name + "' " + error);
+    }
+  }
+  ~CalibTable() {
+    munmap(const_cast<char*>(base), length);
+  }
+  CalibTable(const CalibTable &) = delete;
+  CalibTable &operator=(const CalibTable &) = delete;
+
+  const CalibHeader &header() const { return *reinterpret_cast<const CalibHeader*>(base); }
+  const TowerCalib *records() const { return reinterpret_cast<const TowerCalib*>(base + header().header_size); }
+  size_t size() const { return header().n_towers; }
+  const TowerCalib &operator[](uint32_t tower_id) const { return records()[tower_id]; }
+  const TowerCalib &at(uint32_t sector, uint32_t channel) const { return records()[calib_tower_id(sector, channel)]; }
+
+  /**
+   * @brief Multiply per-tower values (indexed by tower id, size() entries) by their corrections in place.
+   */
+  void apply(double *values) const {
+    const TowerCalib *r = records();
+    for (size_t i = 0; i < size(); i++) {
+      values[i] *= r[i].correction;
+    }
+  }
+
+  private:
+  const char *base = nullptr;
+  size_t length = 0;
+};
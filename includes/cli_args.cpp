@@ -0,0 +1,126 @@
+#include "cli_args.h"
+
+/**
+ * @brief
+ *
+ * @param program e.g. "emcal-plot"
+ * @param description one line printed with the usage.
+ */
+CliArgs::CliArgs(const std::string &program, const std::string &description) : program(program), description(description) {
+  flag("--help", "print this help");
+}
+
+/**
+ * @brief Add an option taking a value.
+ *
+ * @param name e.g. "--workers"
+ * @param default_value value if the option is not given.
+ * @param help
+ */
+void CliArgs::option(const std::string &name, const std::string &default_value, const std::string &help) {
+  options.push_back({name, default_value, help, false});
+}
+
+/**
+ * @brief Add an option without value (is_set tells whether it was given).
+ */
+void CliArgs::flag(const std::string &name, const std::string &help) {
+  options.push_back({name, "", help, true});
+}
+
+/**
+ * @brief Accept positional arguments (anything not starting with "--"), e.g. a command and its arguments.
+ *
+ * @param usage shown after the options in the usage, e.g. "<command> [<argument>...]".
+ */
+void CliArgs::arguments(const std::string &usage) {
+  positional_usage = usage;
+}
+
+CliArgs::Option &CliArgs::find(const std::string &name) {
+  for (Option &opt : options) {
+    if (opt.name == name) {
+      return opt;
+    }
+  }
+  throw std::runtime_error(Form("unknown option '%s' (see --help)", name.c_str()));
+}
+
+const CliArgs::Option &CliArgs::find(const std::string &name) const {
+  return const_cast<CliArgs*>(this)->find(name);
+}
+
+/**
+ * @brief Parse the command line. Throws std::runtime_error on unknown options or missing values.
+ *
+ * @return false if the usage was printed (--help) and the program should exit.
+ */
+bool CliArgs::parse(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (!positional_usage.empty() && arg.rfind("--", 0) != 0) {
+      positional.push_back(arg);
+      continue;
+    }
+    std::string value;
+    size_t eq = arg.find('=');
+    bool has_value = arg.rfind("--", 0) == 0 && eq != std::string::npos;
+    if (has_value) {
+      // --name=value
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    }
+    Option &opt = find(arg);
+    if (opt.is_flag) {
+      if (has_value) {
+        throw std::runtime_error(Form("option '%s' takes no value", arg.c_str()));
+      }
+      opt.value = "1";
+    } else if (has_value) {
+      opt.value = value;
+    } else if (i + 1 < argc) {
+      opt.value = argv[++i];
+    } else {
+      throw std::runtime_error(Form("option '%s' needs a value", arg.c_str()));
+    }
+  }
+  if (is_set("--help")) {
+    print_usage(stdout);
+    return false;
+  }
+  return true;
+}
+
+std::string CliArgs::get(const std::string &name) const {
+  return find(name).value;
+}
+
+/**
+ * @brief Value of an option as an integer; throws std::runtime_error if it is not one.
+ */
+int CliArgs::get_int(const std::string &name) const {
+  std::string value = get(name);
+  char *end = nullptr;
+  long n = strtol(value.c_str(), &end, 10);
+  if (value.empty() || *end != '\0') {
+    throw std::runtime_error(Form("option '%s' needs an integer, got '%s'", name.c_str(), value.c_str()));
+  }
+  return static_cast<int>(n);
+}
+
+bool CliArgs::is_set(const std::string &name) const {
+  return find(name).value == "1";
+}
+
+void CliArgs::print_usage(FILE *out) const {
+  fprintf(out, "usage: %s [options]%s%s\n%s\n\noptions:\n", program.c_str(), positional_usage.empty() ? "" : " ",
+          positional_usage.c_str(), description.c_str());
+  for (const Option &opt : options) {
+    std::string name = opt.is_flag ? opt.name : opt.name + " <value>";
+    fprintf(out, "  %-24s %s", name.c_str(), opt.help.c_str());
+    if (!opt.is_flag && !opt.value.empty()) {
+      fprintf(out, " (default: %s)", opt.value.c_str());
+    }
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+#include <TString.h>
+
+/**
+ * @brief Command line options of the emcal-* executables: "--name value" options with defaults and "--name" flags, and
+ *    positional arguments if enabled (see arguments). Unknown options and missing values are errors; "--help" prints
+ *    the usage.
+ */
+class CliArgs {
+  public:
+  CliArgs(const std::string &program, const std::string &description);
+  void option(const std::string &name, const std::string &default_value, const std::string &help);
+  void flag(const std::string &name, const std::string &help);
+  void arguments(const std::string &usage);
+  bool parse(int argc, char **argv);
+
+  std::string get(const std::string &name) const;
+  int get_int(const std::string &name) const;
+  bool is_set(const std::string &name) const;
+  const std::vector<std::string> &get_arguments() const { return positional; }
+  void print_usage(FILE *out) const;
+
+  private:
+  typedef struct Option {
+    std::string name;
+    std::string value;    // default until parsed; "1" for a set flag
+    std::string help;
+    bool is_flag;
+  } Option;
+
+  Option &find(const std::string &name);
+  const Option &find(const std::string &name) const;
+
+  std::string program;
+  std::string description;
+  std::vector<Option> options;
+  std::string positional_usage;   // "" if positional arguments are not accepted
+  std::vector<std::string> positional;
+};
+
+#ifndef EMCAL_LIBRARY
+#include "cli_args.cpp"
+#endif
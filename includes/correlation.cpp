@@ -0,0 +1,340 @@
+#include "correlation.h"
+
+/**
+ * @brief Add an attribute column.
+ *
+ * @param name column name used in outputs.
+ * @param value expression for the value (see expr.h), e.g. "mpv" or "ch0_mpv / mpv".
+ * @param valid expression selecting the rows where the value is valid; "" means "value > 0" (missing database
+ *    entries are stored as -1).
+ */
+void CorrelationEngine::add_column(const std::string &name, const std::string &value, const std::string &valid) {
+  Column column;
+  column.value = Expr::compile(value);
+  column.valid = Expr::compile(valid.empty() ? "(" + value + ") > 0" : valid);
+  names.push_back(name);
+  columns.push_back(column);
+}
+
+/**
+ * @brief Add a column which is not part of the block table (e.g., VOP or single-pixel gap), one value per row of the
+ *    table passed to compute(). Values <= 0 or NaN are invalid.
+ *
+ * @param name
+ * @param values
+ */
+void CorrelationEngine::add_external(const std::string &name, const std::vector<double> &values) {
+  Column column;
+  column.external = values;
+  names.push_back(name);
+  columns.push_back(column);
+}
+
+int CorrelationEngine::column_index(const std::string &name) const {
+  auto it = std::find(names.begin(), names.end(), name);
+  return it == names.end() ? -1 : it - names.begin();
+}
+
+const PairMoments &CorrelationEngine::pair(const std::vector<std::vector<PairMoments>> &m, size_t group, size_t i, size_t j) const {
+  if (i > j) {
+    std::swap(i, j);
+  }
+  return m.at(group).at(i*n_columns() + j);
+}
+
+double CorrelationEngine::correlation(const PairMoments &m) {
+  if (m.n < 2) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  double cxx = m.sxx - m.sx*m.sx/m.n;
+  double cyy = m.syy - m.sy*m.sy/m.n;
+  double cxy = m.sxy - m.sx*m.sy/m.n;
+  if (cxx <= 0 || cyy <= 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return cxy / std::sqrt(cxx*cyy);
+}
+
+/**
+ * @brief Mean of column i over the rows where both i and j are valid.
+ */
+double CorrelationEngine::mean(size_t group, size_t i, size_t j) const {
+  const PairMoments &m = pair(moments, group, i, j);
+  if (m.n < 1) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return i <= j ? m.kx + m.sx/m.n : m.ky + m.sy/m.n;
+}
+
+double CorrelationEngine::covariance(size_t group, size_t i, size_t j) const {
+  const PairMoments &m = pair(moments, group, i, j);
+  if (m.n < 2) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return (m.sxy - m.sx*m.sy/m.n) / (m.n - 1);
+}
+
+/**
+ * @brief Fractional ranks (1-based, ties get their average rank) of the valid values; NaN elsewhere.
+ */
+std::vector<double> CorrelationEngine::ranks(const std::vector<double> &values, const std::vector<char> &valid) {
+  std::vector<size_t> order;
+  for (size_t r = 0; r < values.size(); r++) {
+    if (valid[r]) {
+      order.push_back(r);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&values](size_t a, size_t b) { return values[a] < values[b]; });
+  std::vector<double> result(values.size(), std::numeric_limits<double>::quiet_NaN());
+  for (size_t first = 0; first < order.size();) {
+    size_t last = first;
+    while (last + 1 < order.size() && values[order[last + 1]] == values[order[first]]) {
+      last++;
+    }
+    double rank = 0.5*(first + last) + 1;
+    for (size_t k = first; k <= last; k++) {
+      result[order[k]] = rank;
+    }
+    first = last + 1;
+  }
+  return result;
+}
+
+/**
+ * @brief Accumulate the pair moments of all column pairs, per group, in a single pass over the rows. Rows are visited
+ *    group by group in chunks; within a chunk every column is loaded once (shifted, invalid entries zeroed) and every
+ *    pair is reduced with a branch-free loop.
+ *
+ * @param data [column][row] values (rank data for Spearman); validity is taken from the valid masks.
+ * @param out [group][i*n_columns + j]
+ */
+void CorrelationEngine::accumulate(const std::vector<std::vector<double>> &data, std::vector<std::vector<PairMoments>> &out) const {
+  const size_t CHUNK = 256;
+  size_t n_cols = columns.size();
+  size_t n_rows = groups.size();
+  std::vector<double> shift(n_cols, 0);
+  for (size_t c = 0; c < n_cols; c++) {
+    for (size_t r = 0; r < n_rows; r++) {
+      if (valid[c][r]) {
+        shift[c] = data[c][r];
+        break;
+      }
+    }
+  }
+  for (std::vector<PairMoments> &group_moments : out) {
+    for (size_t i = 0; i < n_cols; i++) {
+      for (size_t j = i; j < n_cols; j++) {
+        group_moments[i*n_cols + j] = {0, 0, 0, 0, 0, 0, shift[i], shift[j]};
+      }
+    }
+  }
+
+  // visit rows grouped by group so each chunk belongs to a single group
+  std::vector<size_t> order;
+  for (size_t r = 0; r < n_rows; r++) {
+    if (groups[r] >= 0) {
+      order.push_back(r);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return groups[a] < groups[b]; });
+
+  std::vector<double> x(n_cols*CHUNK);
+  std::vector<double> m(n_cols*CHUNK);
+  for (size_t begin = 0; begin < order.size();) {
+    int group = groups[order[begin]];
+    size_t end = begin;
+    while (end < order.size() && end - begin < CHUNK && groups[order[end]] == group) {
+      end++;
+    }
+    size_t n = end - begin;
+    for (size_t c = 0; c < n_cols; c++) {
+      double *xc = &x[c*CHUNK];
+      double *mc = &m[c*CHUNK];
+      for (size_t k = 0; k < n; k++) {
+        size_t r = order[begin + k];
+        bool ok = valid[c][r];
+        xc[k] = ok ? data[c][r] - shift[c] : 0;
+        mc[k] = ok;
+      }
+    }
+    std::vector<PairMoments> &group_moments = out[group];
+    for (size_t i = 0; i < n_cols; i++) {
+      const double *xi = &x[i*CHUNK];
+      const double *mi = &m[i*CHUNK];
+      for (size_t j = i; j < n_cols; j++) {
+        const double *xj = &x[j*CHUNK];
+        const double *mj = &m[j*CHUNK];
+        double sn = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        for (size_t k = 0; k < n; k++) {
+          double a = xi[k]*mj[k];
+          double b = xj[k]*mi[k];
+          sn += mi[k]*mj[k];
+          sx += a;
+          sy += b;
+          sxx += a*a;
+          syy += b*b;
+          sxy += a*b;
+        }
+        PairMoments &pm = group_moments[i*n_cols + j];
+        pm.n += sn;
+        pm.sx += sx;
+        pm.sy += sy;
+        pm.sxx += sxx;
+        pm.syy += syy;
+        pm.sxy += sxy;
+      }
+    }
+    begin = end;
+  }
+}
+
+/**
+ * @brief Evaluate every column over the table and compute all pair moments.
+ *
+ * @param table
+ * @param row_group group of each row (-1 = skip the row); empty puts every row in group 0.
+ * @param n_groups
+ */
+void CorrelationEngine::compute(const BlockTable &table, const std::vector<int> &row_group, size_t n_groups) {
+  size_t n_rows = table.size();
+  size_t n_cols = columns.size();
+  if (!row_group.empty() && row_group.size() != n_rows) {
+    throw std::runtime_error(Form("CorrelationEngine: %zu row groups for %zu rows", row_group.size(), n_rows));
+  }
+  groups = row_group.empty() ? std::vector<int>(n_rows, 0) : row_group;
+  for (int group : groups) {
+    if (group >= (int) n_groups) {
+      throw std::runtime_error(Form("CorrelationEngine: group %d out of range (%zu groups)", group, n_groups));
+    }
+  }
+
+  values.assign(n_cols, {});
+  valid.assign(n_cols, {});
+  for (size_t c = 0; c < n_cols; c++) {
+    const Column &column = columns[c];
+    valid[c].resize(n_rows);
+    if (column.value.empty()) {
+      if (column.external.size() != n_rows) {
+        throw std::runtime_error(Form("CorrelationEngine: column '%s' has %zu values for %zu rows", names[c].c_str(), column.external.size(), n_rows));
+      }
+      values[c] = column.external;
+      for (size_t r = 0; r < n_rows; r++) {
+        valid[c][r] = values[c][r] > 0;
+      }
+    } else {
+      values[c] = column.value.project(table);
+      Selection selection = column.valid.select(table);
+      for (size_t r = 0; r < n_rows; r++) {
+        valid[c][r] = is_selected(selection, r) && std::isfinite(values[c][r]);
+      }
+    }
+  }
+
+  moments.assign(n_groups, std::vector<PairMoments>(n_cols*n_cols));
+  accumulate(values, moments);
+
+  // Spearman = Pearson on ranks, ranked within each group
+  std::vector<std::vector<double>> rank_values(n_cols, std::vector<double>(n_rows));
+  for (size_t c = 0; c < n_cols; c++) {
+    for (size_t g = 0; g < n_groups; g++) {
+      std::vector<char> in_group(n_rows);
+      for (size_t r = 0; r < n_rows; r++) {
+        in_group[r] = valid[c][r] && groups[r] == (int) g;
+      }
+      std::vector<double> group_ranks = ranks(values[c], in_group);
+      for (size_t r = 0; r < n_rows; r++) {
+        if (in_group[r]) {
+          rank_values[c][r] = group_ranks[r];
+        }
+      }
+    }
+  }
+  rank_moments.assign(n_groups, std::vector<PairMoments>(n_cols*n_cols));
+  accumulate(rank_values, rank_moments);
+}
+
+/**
+ * @brief Write every pair (and group) as one csv row: group, column_a, column_b, n, mean_a, mean_b, covariance,
+ *    pearson, spearman.
+ *
+ * @param file_name
+ * @param group_labels label of each group ("all" if not given).
+ */
+void CorrelationEngine::write_csv(const std::string &file_name, const std::vector<std::string> &group_labels) const {
+  FILE *file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", file_name.c_str()));
+  }
+  fprintf(file, "group, column_a, column_b, n, mean_a, mean_b, covariance, pearson, spearman\n");
+  for (size_t g = 0; g < n_groups(); g++) {
+    std::string label = g < group_labels.size() ? group_labels[g] : "all";
+    for (size_t i = 0; i < n_columns(); i++) {
+      for (size_t j = i + 1; j < n_columns(); j++) {
+        fprintf(file, "%s, %s, %s, %.0f, %f, %f, %f, %f, %f\n", label.c_str(), names[i].c_str(), names[j].c_str(),
+          n(g, i, j), mean(g, i, j), mean(g, j, i), covariance(g, i, j), pearson(g, i, j), spearman(g, i, j));
+      }
+    }
+  }
+  fclose(file);
+}
+
+/**
+ * @brief The correlation matrix of a group as a 2D histogram (axis labels = column names), e.g. to draw with "COLZ TEXT".
+ *
+ * @param group
+ * @param use_spearman Spearman instead of Pearson.
+ * @return TH2D* (caller owns)
+ */
+TH2D *CorrelationEngine::matrix_hist(size_t group, bool use_spearman) const {
+  int n_cols = n_columns();
+  TH2D *h = new TH2D(Form("h_%s_%zu", use_spearman ? "spearman" : "pearson", group), use_spearman ? "Spearman Correlation" : "Pearson Correlation", n_cols, 0, n_cols, n_cols, 0, n_cols);
+  h->SetDirectory(nullptr);
+  for (int i = 0; i < n_cols; i++) {
+    h->GetXaxis()->SetBinLabel(i + 1, names[i].c_str());
+    h->GetYaxis()->SetBinLabel(i + 1, names[i].c_str());
+    for (int j = 0; j < n_cols; j++) {
+      double r = use_spearman ? spearman(group, i, j) : pearson(group, i, j);
+      h->SetBinContent(i + 1, j + 1, std::isnan(r) ? 0 : r);
+    }
+  }
+  h->SetMinimum(-1);
+  h->SetMaximum(1);
+  return h;
+}
+
+/**
+ * @brief 2D density (scatter) histogram of column j vs column i over rows where both are valid, as of the last compute().
+ *
+ * @param i x column
+ * @param j y column
+ * @param group only rows of this group (-1 = every row in any group).
+ * @param n_bins bins per axis; ranges span the valid values.
+ * @return TH2D* (caller owns)
+ */
+TH2D *CorrelationEngine::density_hist(size_t i, size_t j, int group, int n_bins) const {
+  double x_min = INFINITY, x_max = -INFINITY, y_min = INFINITY, y_max = -INFINITY;
+  std::vector<size_t> rows;
+  for (size_t r = 0; r < groups.size(); r++) {
+    if (valid.at(i)[r] && valid.at(j)[r] && groups[r] >= 0 && (group < 0 || groups[r] == group)) {
+      rows.push_back(r);
+      x_min = std::min(x_min, values[i][r]);
+      x_max = std::max(x_max, values[i][r]);
+      y_min = std::min(y_min, values[j][r]);
+      y_max = std::max(y_max, values[j][r]);
+    }
+  }
+  if (rows.empty()) {
+    x_min = y_min = 0;
+    x_max = y_max = 1;
+  }
+  // pad so the maxima fall inside the last bin
+  double x_pad = 0.01*(x_max - x_min) + 1e-9;
+  double y_pad = 0.01*(y_max - y_min) + 1e-9;
+  TH2D *h = new TH2D(Form("h_%s_vs_%s_%d", names[j].c_str(), names[i].c_str(), group), Form("%s vs %s;%s;%s", names[j].c_str(), names[i].c_str(), names[i].c_str(), names[j].c_str()),
+    n_bins, x_min - x_pad, x_max + x_pad, n_bins, y_min - y_pad, y_max + y_pad);
+  h->SetDirectory(nullptr);
+  for (size_t r : rows) {
+    h->Fill(values[i][r], values[j][r]);
+  }
+  return h;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TH2D.h>
+
+#include "expr.h"
+
+/**
+ * @brief Pairwise co-moment sums of two columns over the rows where both are valid. Values are shifted by a per-column
+ *    constant (kx, ky: first valid value) before summing, which keeps the one-pass sums numerically stable.
+ */
+typedef struct PairMoments {
+  double n;
+  double sx, sy;
+  double sxx, syy, sxy;
+  double kx, ky;
+} PairMoments;
+
+/**
+ * @brief Pearson/Spearman correlation and covariance matrices of block attributes, computed in one pass over the
+ *    block table (and one more over the ranks for Spearman). Each column has its own validity mask; every pair uses
+ *    the rows valid in both columns (pairwise deletion). Rows can be split into groups (e.g., by vendor).
+ *    NOTE: ranks are taken over each column's own valid values (per group), so where two validity masks differ the
+ *    Spearman coefficient differs slightly from re-ranking the common rows.
+ */
+class CorrelationEngine {
+  public:
+  void add_column(const std::string &name, const std::string &value, const std::string &valid = "");
+  void add_external(const std::string &name, const std::vector<double> &values);
+  void compute(const BlockTable &table, const std::vector<int> &row_group = {}, size_t n_groups = 1);
+
+  size_t n_columns() const { return names.size(); }
+  size_t n_groups() const { return moments.size(); }
+  int column_index(const std::string &name) const;
+  const std::string &column_name(size_t col) const { return names.at(col); }
+  double n(size_t group, size_t i, size_t j) const { return pair(moments, group, i, j).n; }
+  double mean(size_t group, size_t i, size_t j) const;
+  double covariance(size_t group, size_t i, size_t j) const;
+  double pearson(size_t group, size_t i, size_t j) const { return correlation(pair(moments, group, i, j)); }
+  double spearman(size_t group, size_t i, size_t j) const { return correlation(pair(rank_moments, group, i, j)); }
+
+  void write_csv(const std::string &file_name, const std::vector<std::string> &group_labels = {}) const;
+  TH2D *matrix_hist(size_t group, bool use_spearman = false) const;
+  TH2D *density_hist(size_t i, size_t j, int group = -1, int n_bins = 50) const;
+
+  private:
+  typedef struct Column {
+    Expr value;
+    Expr valid;
+    std::vector<double> external;
+  } Column;
+
+  static double correlation(const PairMoments &m);
+  const PairMoments &pair(const std::vector<std::vector<PairMoments>> &m, size_t group, size_t i, size_t j) const;
+  static std::vector<double> ranks(const std::vector<double> &values, const std::vector<char> &valid);
+  void accumulate(const std::vector<std::vector<double>> &data, std::vector<std::vector<PairMoments>> &out) const;
+
+  std::vector<std::string> names;
+  std::vector<Column> columns;
+  std::vector<std::vector<double>> values; // [column][row], as of the last compute()
+  std::vector<std::vector<char>> valid;    // [column][row]
+  std::vector<int> groups;                 // [row], -1 = row not in any group
+  std::vector<std::vector<PairMoments>> moments;      // [group][i*n_columns + j], i <= j
+  std::vector<std::vector<PairMoments>> rank_moments; // same, on ranks
+};
+
+#ifndef EMCAL_LIBRARY
+#include "correlation.cpp"
+#endif
@@ -0,0 +1,560 @@
+#include "expr.h"
+
+/**
+ * @brief Names of the BlockTable columns, as used in expressions. Indexed by BlockColumn.
+ */
+static const char *BLOCK_COLUMN_NAMES[N_BLOCK_COLUMNS] = {
+  "sector", "block", "ib",
+  "mpv", "mpv_err",
+  "ch0_mpv", "ch0_mpv_err", "ch1_mpv", "ch1_mpv_err", "ch2_mpv", "ch2_mpv_err", "ch3_mpv", "ch3_mpv_err",
+  "density", "fiber_count", "fiber_t1_count", "fiber_t2_count", "fiber_t3_count", "fiber_t4_count", "scint_ratio",
+  "fiber_batch", "fiber_batch_number",
+  "vendor", "fiber_type", "fiber_type_compressed", "w_powder", "dbn",
+};
+
+/**
+ * @brief Process-wide string pools of the string columns; a string's code is its index in the pool. Codes are never
+ *    reused, so an expression compiled once stays valid for every table built afterwards.
+ */
+static std::map<std::string, double> &string_pool(int col) {
+  static std::map<std::string, double> pools[N_BLOCK_COLUMNS];
+  return pools[col];
+}
+
+int BlockTable::column_index(const std::string &name) {
+  for (int col = 0; col < N_BLOCK_COLUMNS; col++) {
+    if (name == BLOCK_COLUMN_NAMES[col]) {
+      return col;
+    }
+  }
+  return -1;
+}
+
+const char *BlockTable::column_name(int col) {
+  return BLOCK_COLUMN_NAMES[col];
+}
+
+bool BlockTable::is_string_column(int col) {
+  return col >= COL_VENDOR;
+}
+
+/**
+ * @brief Get the code of a string in the pool of a string column, adding it if needed. Vendors are case-insensitive.
+ *
+ * @param col string column
+ * @param value
+ * @return double
+ */
+double BlockTable::intern(int col, const std::string &value) {
+  std::string key = value;
+  if (col == COL_VENDOR) {
+    std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+  }
+  static std::mutex pool_mutex;
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  std::map<std::string, double> &pool = string_pool(col);
+  auto it = pool.find(key);
+  if (it != pool.end()) {
+    return it->second;
+  }
+  double code = pool.size();
+  pool[key] = code;
+  return code;
+}
+
+/**
+ * @brief Order-preserving numeric value of a fiber batch (e.g., 21-A < 21-B < 22-A); NaN if the batch is not valid.
+ *
+ * @param fiber_batch
+ * @return double
+ */
+double BlockTable::fiber_batch_ordinal(const FiberBatch &fiber_batch) {
+  if (!fiber_batch.valid) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return 26.0*fiber_batch.batch_number + (fiber_batch.batch_letter - 'A');
+}
+
+BlockTable::BlockTable(const std::vector<Block> &all_blocks) : n_rows(all_blocks.size()) {
+  for (std::vector<double> &column : columns) {
+    column.resize(n_rows);
+  }
+  for (size_t row = 0; row < n_rows; row++) {
+    set_row(row, all_blocks[row]);
+  }
+}
+
+void BlockTable::set_row(size_t row, const Block &block) {
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  columns[COL_SECTOR][row] = block.sector;
+  columns[COL_BLOCK][row] = block.block_number;
+  columns[COL_IB][row] = (block.block_number - 1) / 16;
+  columns[COL_MPV][row] = block.mpv;
+  columns[COL_MPV_ERR][row] = block.mpv_err;
+  columns[COL_CH0_MPV][row] = block.ch0_mpv;
+  columns[COL_CH0_MPV_ERR][row] = block.ch0_mpv_err;
+  columns[COL_CH1_MPV][row] = block.ch1_mpv;
+  columns[COL_CH1_MPV_ERR][row] = block.ch1_mpv_err;
+  columns[COL_CH2_MPV][row] = block.ch2_mpv;
+  columns[COL_CH2_MPV_ERR][row] = block.ch2_mpv_err;
+  columns[COL_CH3_MPV][row] = block.ch3_mpv;
+  columns[COL_CH3_MPV_ERR][row] = block.ch3_mpv_err;
+  columns[COL_DENSITY][row] = block.density;
+  columns[COL_FIBER_COUNT][row] = block.fiber_count;
+  columns[COL_FIBER_T1_COUNT][row] = block.fiber_t1_count;
+  columns[COL_FIBER_T2_COUNT][row] = block.fiber_t2_count;
+  columns[COL_FIBER_T3_COUNT][row] = block.fiber_t3_count;
+  columns[COL_FIBER_T4_COUNT][row] = block.fiber_t4_count;
+  columns[COL_SCINT_RATIO][row] = block.scint_ratio;
+  columns[COL_FIBER_BATCH][row] = fiber_batch_ordinal(block.fiber_batch);
+  columns[COL_FIBER_BATCH_NUMBER][row] = block.fiber_batch.valid ? block.fiber_batch.batch_number : nan;
+  columns[COL_VENDOR][row] = intern(COL_VENDOR, vendor_name(block_vendor(block)));
+  columns[COL_FIBER_TYPE][row] = intern(COL_FIBER_TYPE, block.fiber_type);
+  auto compressed = fiber_type_compressor.find(block.fiber_type);
+  columns[COL_FIBER_TYPE_COMPRESSED][row] = intern(COL_FIBER_TYPE_COMPRESSED, compressed == fiber_type_compressor.end() ? "" : compressed->second);
+  columns[COL_W_POWDER][row] = intern(COL_W_POWDER, block.w_powder);
+  columns[COL_DBN][row] = intern(COL_DBN, block.dbn);
+}
+
+size_t count_selected(const Selection &selection) {
+  size_t n = 0;
+  for (uint64_t word : selection) {
+    n += __builtin_popcountll(word);
+  }
+  return n;
+}
+
+/**
+ * @brief Rows are evaluated EXPR_CHUNK at a time, so every node works on short arrays that stay in cache.
+ */
+const size_t EXPR_CHUNK = 256;
+
+/**
+ * @brief Node of a compiled expression. eval writes the node's value for rows [begin, begin + n) into out
+ *    (booleans are 0/1; comparisons involving NaN are false).
+ */
+class ExprNode {
+  public:
+  virtual ~ExprNode() {}
+  virtual void eval(const BlockTable &table, size_t begin, size_t n, double *out) const = 0;
+};
+
+class ConstNode : public ExprNode {
+  public:
+  ConstNode(double value) : value(value) {}
+  void eval(const BlockTable &, size_t, size_t n, double *out) const override {
+    std::fill(out, out + n, value);
+  }
+  double value;
+};
+
+class ColumnNode : public ExprNode {
+  public:
+  ColumnNode(int col) : col(col) {}
+  void eval(const BlockTable &table, size_t begin, size_t n, double *out) const override {
+    std::copy(table.column(col) + begin, table.column(col) + begin + n, out);
+  }
+  int col;
+};
+
+enum class ExprOp {NEG, NOT, ADD, SUB, MUL, DIV, EQ, NE, LT, LE, GT, GE, AND, OR};
+
+class UnaryNode : public ExprNode {
+  public:
+  UnaryNode(ExprOp op, std::shared_ptr<const ExprNode> arg) : op(op), arg(arg) {}
+  void eval(const BlockTable &table, size_t begin, size_t n, double *out) const override {
+    arg->eval(table, begin, n, out);
+    if (op == ExprOp::NEG) {
+      for (size_t i = 0; i < n; i++) out[i] = -out[i];
+    } else {
+      for (size_t i = 0; i < n; i++) out[i] = out[i] == 0;
+    }
+  }
+  ExprOp op;
+  std::shared_ptr<const ExprNode> arg;
+};
+
+class BinaryNode : public ExprNode {
+  public:
+  BinaryNode(ExprOp op, std::shared_ptr<const ExprNode> lhs, std::shared_ptr<const ExprNode> rhs) : op(op), lhs(lhs), rhs(rhs) {}
+  void eval(const BlockTable &table, size_t begin, size_t n, double *out) const override {
+    double r[EXPR_CHUNK];
+    lhs->eval(table, begin, n, out);
+    rhs->eval(table, begin, n, r);
+    switch (op) {
+      case ExprOp::ADD: for (size_t i = 0; i < n; i++) out[i] = out[i] + r[i]; break;
+      case ExprOp::SUB: for (size_t i = 0; i < n; i++) out[i] = out[i] - r[i]; break;
+      case ExprOp::MUL: for (size_t i = 0; i < n; i++) out[i] = out[i] * r[i]; break;
+      case ExprOp::DIV: for (size_t i = 0; i < n; i++) out[i] = out[i] / r[i]; break;
+      case ExprOp::EQ: for (size_t i = 0; i < n; i++) out[i] = out[i] == r[i]; break;
+      case ExprOp::NE: for (size_t i = 0; i < n; i++) out[i] = out[i] != r[i] && out[i] == out[i] && r[i] == r[i]; break;
+      case ExprOp::LT: for (size_t i = 0; i < n; i++) out[i] = out[i] < r[i]; break;
+      case ExprOp::LE: for (size_t i = 0; i < n; i++) out[i] = out[i] <= r[i]; break;
+      case ExprOp::GT: for (size_t i = 0; i < n; i++) out[i] = out[i] > r[i]; break;
+      case ExprOp::GE: for (size_t i = 0; i < n; i++) out[i] = out[i] >= r[i]; break;
+      case ExprOp::AND: for (size_t i = 0; i < n; i++) out[i] = (out[i] != 0) & (r[i] != 0); break;
+      case ExprOp::OR: for (size_t i = 0; i < n; i++) out[i] = (out[i] != 0) | (r[i] != 0); break;
+      default: break;
+    }
+  }
+  ExprOp op;
+  std::shared_ptr<const ExprNode> lhs;
+  std::shared_ptr<const ExprNode> rhs;
+};
+
+class RangeNode : public ExprNode {
+  public:
+  RangeNode(std::shared_ptr<const ExprNode> arg, double low, bool low_closed, double high, bool high_closed)
+    : arg(arg), low(low), high(high), low_closed(low_closed), high_closed(high_closed) {}
+  void eval(const BlockTable &table, size_t begin, size_t n, double *out) const override {
+    arg->eval(table, begin, n, out);
+    for (size_t i = 0; i < n; i++) {
+      double x = out[i];
+      out[i] = (low_closed ? x >= low : x > low) && (high_closed ? x <= high : x < high);
+    }
+  }
+  std::shared_ptr<const ExprNode> arg;
+  double low, high;
+  bool low_closed, high_closed;
+};
+
+/**
+ * @brief Recursive descent parser for Expr (see expr.h for the grammar).
+ */
+class ExprParser {
+  public:
+  ExprParser(const std::string &source) : src(source) {}
+
+  std::shared_ptr<const ExprNode> parse() {
+    Operand result = parse_or();
+    skip_space();
+    if (pos != src.size()) {
+      fail("unexpected input");
+    }
+    return value_of(result);
+  }
+
+  private:
+  /**
+   * @brief Result of parsing a sub-expression. Symbols are kept as text until they meet the string column they are
+   *    compared to, since their code depends on the column.
+   */
+  typedef struct Operand {
+    std::shared_ptr<const ExprNode> node;
+    std::string symbol;
+    int column;
+  } Operand;
+
+  [[noreturn]] void fail(const std::string &what) {
+    throw std::runtime_error(Form("expression error at position %lu (%s): %s", (unsigned long) pos, what.c_str(), src.c_str()));
+  }
+
+  void skip_space() {
+    while (pos < src.size() && isspace((unsigned char) src[pos])) {
+      pos++;
+    }
+  }
+
+  bool accept(const char *token) {
+    skip_space();
+    size_t len = strlen(token);
+    if (src.compare(pos, len, token) == 0) {
+      // don't split "<=" into "<" "=", or read the "in" of "inf" as a keyword
+      if (isalpha((unsigned char) token[0]) && pos + len < src.size() && (isalnum((unsigned char) src[pos + len]) || src[pos + len] == '_')) {
+        return false;
+      }
+      pos += len;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(const char *token) {
+    if (!accept(token)) {
+      fail(Form("expected '%s'", token));
+    }
+  }
+
+  std::shared_ptr<const ExprNode> value_of(const Operand &operand) {
+    if (!operand.node) {
+      fail(Form("unknown column '%s'", operand.symbol.c_str()));
+    }
+    return operand.node;
+  }
+
+  /**
+   * @brief value_of an operand of arithmetic, which must not be a string column (its codes are not numbers).
+   */
+  std::shared_ptr<const ExprNode> number_of(const Operand &operand) {
+    if (operand.column >= 0 && BlockTable::is_string_column(operand.column)) {
+      fail(Form("string column '%s' in arithmetic", BlockTable::column_name(operand.column)));
+    }
+    return value_of(operand);
+  }
+
+  Operand make(std::shared_ptr<const ExprNode> node, int column = -1) {
+    Operand operand;
+    operand.node = node;
+    operand.column = column;
+    return operand;
+  }
+
+  Operand parse_or() {
+    Operand lhs = parse_and();
+    while (accept("||")) {
+      Operand rhs = parse_and();
+      lhs = make(std::make_shared<BinaryNode>(ExprOp::OR, value_of(lhs), value_of(rhs)));
+    }
+    return lhs;
+  }
+
+  Operand parse_and() {
+    Operand lhs = parse_not();
+    while (accept("&&")) {
+      Operand rhs = parse_not();
+      lhs = make(std::make_shared<BinaryNode>(ExprOp::AND, value_of(lhs), value_of(rhs)));
+    }
+    return lhs;
+  }
+
+  Operand parse_not() {
+    skip_space();
+    if (src.compare(pos, 2, "!=") != 0 && accept("!")) {
+      return make(std::make_shared<UnaryNode>(ExprOp::NOT, value_of(parse_not())));
+    }
+    return parse_cmp();
+  }
+
+  Operand parse_cmp() {
+    Operand lhs = parse_sum();
+    if (accept("in")) {
+      if (lhs.column >= 0 && BlockTable::is_string_column(lhs.column)) {
+        fail("'in' needs a numeric column");
+      }
+      bool low_closed = accept("[");
+      if (!low_closed) {
+        expect("(");
+      }
+      double low = parse_bound();
+      expect(",");
+      double high = parse_bound();
+      bool high_closed = accept("]");
+      if (!high_closed) {
+        expect(")");
+      }
+      return make(std::make_shared<RangeNode>(value_of(lhs), low, low_closed, high, high_closed));
+    }
+    static const std::pair<const char *, ExprOp> comparisons[] = {
+      {"==", ExprOp::EQ}, {"!=", ExprOp::NE}, {"<=", ExprOp::LE}, {">=", ExprOp::GE}, {"<", ExprOp::LT}, {">", ExprOp::GT},
+    };
+    for (const auto &cmp : comparisons) {
+      if (accept(cmp.first)) {
+        Operand rhs = parse_sum();
+        bool string_cmp = (lhs.column >= 0 && BlockTable::is_string_column(lhs.column)) || (rhs.column >= 0 && BlockTable::is_string_column(rhs.column));
+        if (string_cmp && cmp.second != ExprOp::EQ && cmp.second != ExprOp::NE) {
+          fail("string columns only support == and !=");
+        }
+        resolve_symbol(lhs, rhs);
+        resolve_symbol(rhs, lhs);
+        if (string_cmp && lhs.column != rhs.column) {
+          // codes of different pools, or a code and a number, never mean the same value
+          const Operand &string_side = lhs.column >= 0 && BlockTable::is_string_column(lhs.column) ? lhs : rhs;
+          fail(Form("string column '%s' can only be compared to a symbol (quote numbers, e.g. \"255\") or to itself",
+                    BlockTable::column_name(string_side.column)));
+        }
+        return make(std::make_shared<BinaryNode>(cmp.second, value_of(lhs), value_of(rhs)));
+      }
+    }
+    return lhs;
+  }
+
+  /**
+   * @brief Turn a symbol compared to a string column into that column's code for it (of that column, for the checks).
+   */
+  void resolve_symbol(Operand &symbol, const Operand &other) {
+    if (!symbol.node && other.column >= 0 && BlockTable::is_string_column(other.column)) {
+      symbol.node = std::make_shared<ConstNode>(BlockTable::intern(other.column, symbol.symbol));
+      symbol.column = other.column;
+    }
+  }
+
+  Operand parse_sum() {
+    Operand lhs = parse_product();
+    while (true) {
+      ExprOp op;
+      if (accept("+")) {
+        op = ExprOp::ADD;
+      } else if (accept("-")) {
+        op = ExprOp::SUB;
+      } else {
+        return lhs;
+      }
+      Operand rhs = parse_product();
+      lhs = make(std::make_shared<BinaryNode>(op, number_of(lhs), number_of(rhs)));
+    }
+  }
+
+  Operand parse_product() {
+    Operand lhs = parse_unary();
+    while (true) {
+      ExprOp op;
+      if (accept("*")) {
+        op = ExprOp::MUL;
+      } else if (accept("/")) {
+        op = ExprOp::DIV;
+      } else {
+        return lhs;
+      }
+      Operand rhs = parse_unary();
+      lhs = make(std::make_shared<BinaryNode>(op, number_of(lhs), number_of(rhs)));
+    }
+  }
+
+  /**
+   * @brief Read a fiber batch literal (digits, '-', one uppercase letter) at pos, if there is one.
+   */
+  bool accept_fiber_batch(double &ordinal) {
+    size_t end = pos;
+    while (end < src.size() && isdigit((unsigned char) src[end])) {
+      end++;
+    }
+    if (end == pos || end + 1 >= src.size() || src[end] != '-' || !isupper((unsigned char) src[end + 1])) {
+      return false;
+    }
+    if (end + 2 < src.size() && (isalnum((unsigned char) src[end + 2]) || src[end + 2] == '_')) {
+      return false;
+    }
+    ordinal = BlockTable::fiber_batch_ordinal(FiberBatch(src.substr(pos, end + 2 - pos)));
+    pos = end + 2;
+    return true;
+  }
+
+  bool accept_infinity() {
+    return accept("inf") || accept("∞");
+  }
+
+  double parse_bound() {
+    skip_space();
+    double sign = accept("-") ? -1 : 1;
+    skip_space();
+    double value;
+    if (accept_infinity()) {
+      return sign*std::numeric_limits<double>::infinity();
+    } else if (accept_fiber_batch(value)) {
+      return sign*value;
+    }
+    char *end;
+    value = strtod(src.c_str() + pos, &end);
+    if (end == src.c_str() + pos) {
+      fail("expected a number, fiber batch or infinity");
+    }
+    pos = end - src.c_str();
+    return sign*value;
+  }
+
+  Operand parse_unary() {
+    skip_space();
+    if (pos >= src.size()) {
+      fail("unexpected end of expression");
+    }
+    if (accept("-")) {
+      return make(std::make_shared<UnaryNode>(ExprOp::NEG, number_of(parse_unary())));
+    }
+    if (accept("(")) {
+      Operand inner = parse_or();
+      expect(")");
+      return inner;
+    }
+    double value;
+    if (accept_fiber_batch(value)) {
+      return make(std::make_shared<ConstNode>(value));
+    }
+    if (accept_infinity()) {
+      return make(std::make_shared<ConstNode>(std::numeric_limits<double>::infinity()));
+    }
+    char c = src[pos];
+    if (isdigit((unsigned char) c) || c == '.') {
+      char *end;
+      value = strtod(src.c_str() + pos, &end);
+      pos = end - src.c_str();
+      return make(std::make_shared<ConstNode>(value));
+    }
+    Operand operand;
+    operand.column = -1;
+    if (c == '"' || c == '\'') {
+      size_t close = src.find(c, pos + 1);
+      if (close == std::string::npos) {
+        fail("unterminated string");
+      }
+      operand.symbol = src.substr(pos + 1, close - pos - 1);
+      pos = close + 1;
+      return operand;
+    }
+    if (isalpha((unsigned char) c) || c == '_') {
+      size_t start = pos;
+      while (pos < src.size() && (isalnum((unsigned char) src[pos]) || src[pos] == '_')) {
+        pos++;
+      }
+      std::string word = src.substr(start, pos - start);
+      int col = BlockTable::column_index(word);
+      if (col >= 0) {
+        return make(std::make_shared<ColumnNode>(col), col);
+      }
+      operand.symbol = word;
+      return operand;
+    }
+    fail(Form("unexpected character '%c'", c));
+  }
+
+  const std::string &src;
+  size_t pos = 0;
+};
+
+/**
+ * @brief Parse an expression. Throws a runtime_error pointing at the offending position if it is malformed.
+ *
+ * @param source e.g., "mpv > 0 && vendor == UIUC && fiber_batch in [21-A, inf)"
+ * @return Expr
+ */
+Expr Expr::compile(const std::string &source) {
+  Expr expr;
+  expr.text = source;
+  expr.root = ExprParser(source).parse();
+  return expr;
+}
+
+/**
+ * @brief Evaluate the expression as a filter on every row of the table.
+ *
+ * @param table
+ * @return Selection bit i is set if row i passes (non-zero value)
+ */
+Selection Expr::select(const BlockTable &table) const {
+  Selection selection((table.size() + 63) / 64, 0);
+  double values[EXPR_CHUNK];
+  for (size_t begin = 0; begin < table.size(); begin += EXPR_CHUNK) {
+    size_t n = std::min(EXPR_CHUNK, table.size() - begin);
+    root->eval(table, begin, n, values);
+    for (size_t i = 0; i < n; i++) {
+      // NaN counts as false
+      if (values[i] != 0 && values[i] == values[i]) {
+        selection[(begin + i)/64] |= uint64_t(1) << ((begin + i)%64);
+      }
+    }
+  }
+  return selection;
+}
+
+/**
+ * @brief Evaluate the expression as a projection on every row of the table.
+ *
+ * @param table
+ * @return std::vector<double> value of each row
+ */
+std::vector<double> Expr::project(const BlockTable &table) const {
+  std::vector<double> values(table.size());
+  for (size_t begin = 0; begin < table.size(); begin += EXPR_CHUNK) {
+    root->eval(table, begin, std::min(EXPR_CHUNK, table.size() - begin), values.data() + begin);
+  }
+  return values;
+}
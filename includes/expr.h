@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <map>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <stdexcept>
+
+#include <TString.h>
+
+#include "blocks.h"
+
+/**
+ * @brief Columns of the block table available to expressions. String-valued columns (vendor, fiber_type, ...) are
+ *    stored as codes into a process-wide string pool, so they can be compared to symbols with == and !=.
+ */
+enum BlockColumn {
+  COL_SECTOR,
+  COL_BLOCK,
+  COL_IB,
+  COL_MPV,
+  COL_MPV_ERR,
+  COL_CH0_MPV,
+  COL_CH0_MPV_ERR,
+  COL_CH1_MPV,
+  COL_CH1_MPV_ERR,
+  COL_CH2_MPV,
+  COL_CH2_MPV_ERR,
+  COL_CH3_MPV,
+  COL_CH3_MPV_ERR,
+  COL_DENSITY,
+  COL_FIBER_COUNT,
+  COL_FIBER_T1_COUNT,
+  COL_FIBER_T2_COUNT,
+  COL_FIBER_T3_COUNT,
+  COL_FIBER_T4_COUNT,
+  COL_SCINT_RATIO,
+  COL_FIBER_BATCH,        // ordinal (26*number + letter), NaN if no fiber batch
+  COL_FIBER_BATCH_NUMBER, // NaN if no fiber batch
+  COL_VENDOR,             // string: UIUC, FUDAN, CIAE
+  COL_FIBER_TYPE,         // string
+  COL_FIBER_TYPE_COMPRESSED, // string: K, SG
+  COL_W_POWDER,           // string
+  COL_DBN,                // string
+  N_BLOCK_COLUMNS
+};
+
+/**
+ * @brief Column-major copy of the block table (one contiguous array of doubles per column).
+ */
+class BlockTable {
+  public:
+  BlockTable() {}
+  BlockTable(const std::vector<Block> &all_blocks);
+  size_t size() const { return n_rows; }
+  const double *column(int col) const { return columns[col].data(); }
+
+  static int column_index(const std::string &name);
+  static const char *column_name(int col);
+  static bool is_string_column(int col);
+  static double intern(int col, const std::string &value);
+  static double fiber_batch_ordinal(const FiberBatch &fiber_batch);
+
+  private:
+  void set_row(size_t row, const Block &block);
+  size_t n_rows = 0;
+  std::vector<double> columns[N_BLOCK_COLUMNS];
+};
+
+/**
+ * @brief One bit per row of a BlockTable.
+ */
+typedef std::vector<uint64_t> Selection;
+
+inline bool is_selected(const Selection &selection, size_t row) {
+  return (selection[row/64] >> (row%64)) & 1;
+}
+size_t count_selected(const Selection &selection);
+
+class ExprNode;
+
+/**
+ * @brief A filter/projection expression over the block table, parsed once and evaluated column-wise in chunks.
+ * 
+ * Grammar (C-like precedence):
+ *   expr    := and ('||' and)*
+ *   and     := not ('&&' not)*
+ *   not     := '!' not | cmp
+ *   cmp     := sum (('=='|'!='|'<'|'<='|'>'|'>=') sum | 'in' range)?
+ *   range   := ('['|'(') bound ',' bound (']'|')')      bound: number, fiber batch, inf, -inf, ∞, -∞
+ *   sum     := product (('+'|'-') product)*
+ *   product := unary (('*'|'/') unary)*
+ *   unary   := '-' unary | number | fiber batch (e.g. 21-A) | column | symbol | "quoted symbol" | '(' expr ')'
+ * 
+ * Example: mpv > 0 && vendor == UIUC && fiber_batch in [21-A, ∞)
+ * Symbols (bare words that are not columns, or quoted strings) may only be compared to string columns, and string
+ * columns only to symbols or to themselves: dbn == 255 is an error, dbn == "255" compares the DBN.
+ */
+class Expr {
+  public:
+  Expr() {}
+  static Expr compile(const std::string &source);
+
+  Selection select(const BlockTable &table) const;
+  std::vector<double> project(const BlockTable &table) const;
+  bool empty() const { return !root; }
+  const std::string &source() const { return text; }
+
+  private:
+  std::string text;
+  std::shared_ptr<const ExprNode> root;
+};
+
+#ifndef EMCAL_LIBRARY
+#include "expr.cpp"
+#endif
@@ -0,0 +1,169 @@
+#include "fingerprint.h"
+
+/**
+ * @brief Hash raw bytes (as 64 bit words, then the remaining bytes). Unlike plain FNV-1a over words (calib_checksum),
+ *    the high bits are folded back after each word, so a change in the high bits of one word changes all later bits.
+ */
+Fingerprint &Fingerprint::add(const void *data, size_t n_bytes) {
+  const char *bytes = reinterpret_cast<const char*>(data);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= n_bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(uint64_t));
+    hash ^= word;
+    hash *= 1099511628211ULL;
+    hash ^= hash >> 32;
+  }
+  for (; i < n_bytes; i++) {
+    hash ^= static_cast<unsigned char>(bytes[i]);
+    hash *= 1099511628211ULL;
+  }
+  return *this;
+}
+
+Fingerprint &Fingerprint::add_tag(char tag) {
+  return add(&tag, 1);
+}
+
+Fingerprint &Fingerprint::add(const std::string &str) {
+  uint64_t length = str.size();
+  add_tag('s').add(&length, sizeof(length));
+  return add(str.data(), str.size());
+}
+
+Fingerprint &Fingerprint::add(double value) {
+  return add_tag('d').add(&value, sizeof(value));
+}
+
+Fingerprint &Fingerprint::add(const std::vector<int> &values) {
+  uint64_t length = values.size();
+  add_tag('v').add(&length, sizeof(length));
+  return add(values.data(), values.size()*sizeof(int));
+}
+
+Fingerprint &Fingerprint::add(const Fingerprint &other) {
+  return add_tag('f').add(&other.hash, sizeof(other.hash));
+}
+
+std::string Fingerprint::hex() const {
+  return Form("%016llx", static_cast<unsigned long long>(hash));
+}
+
+/**
+ * @brief Fingerprint (hex) of a file's content, hashed in chunks of DIGEST_CHUNK_SIZE bytes. Throws std::runtime_error
+ *    if the file cannot be read.
+ */
+std::string content_digest(const std::string &file_name) {
+  FILE *infile = fopen(file_name.c_str(), "rb");
+  if (!infile) {
+    throw std::runtime_error(Form("unable to open '%s' for reading", file_name.c_str()));
+  }
+  Fingerprint fp;
+  std::vector<char> buffer(DIGEST_CHUNK_SIZE);
+  size_t n_read;
+  while ((n_read = fread(buffer.data(), 1, buffer.size(), infile)) > 0) {
+    fp.add(buffer.data(), n_read);
+  }
+  bool ok = !ferror(infile);
+  fclose(infile);
+  if (!ok) {
+    throw std::runtime_error(Form("failed to read '%s'", file_name.c_str()));
+  }
+  return fp.hex();
+}
+
+/**
+ * @brief Load the manifest, if it exists.
+ *
+ * @param manifest e.g. "emcal_plots/.fingerprints"
+ */
+FingerprintStore::FingerprintStore(const std::string &manifest) : manifest(manifest) {
+  FILE *infile = fopen(manifest.c_str(), "r");
+  if (!infile) {
+    return;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), infile)) {
+    line[strcspn(line, "\n")] = '\0';
+    char digest[17];
+    long long size, mtime;
+    int n_chars = 0;
+    if (sscanf(line, "output %16s %n", digest, &n_chars) == 1 && n_chars > 0) {
+      outputs[line + n_chars] = digest;
+    } else if (sscanf(line, "file %lld %lld %16s %n", &size, &mtime, digest, &n_chars) == 3 && n_chars > 0) {
+      files[line + n_chars] = {size, mtime, digest};
+    }
+  }
+  fclose(infile);
+}
+
+/**
+ * @brief Whether an output exists and was recorded with this fingerprint.
+ */
+bool FingerprintStore::unchanged(const std::string &output, const std::string &fingerprint) const {
+  struct stat st;
+  auto it = outputs.find(output);
+  return it != outputs.end() && it->second == fingerprint && stat(output.c_str(), &st) == 0;
+}
+
+/**
+ * @brief Record the fingerprint an output was (just) written with; saved by save().
+ */
+void FingerprintStore::record(const std::string &output, const std::string &fingerprint) {
+  outputs[output] = fingerprint;
+}
+
+/**
+ * @brief Digest of a file's content ("missing" if it does not exist). Files are only read again when their size or
+ *    modification time changed (files modified in the last seconds are not cached, since a second write within the
+ *    same mtime second would go unnoticed).
+ */
+std::string FingerprintStore::file_digest(const std::string &file_name) {
+  struct stat st;
+  if (stat(file_name.c_str(), &st) != 0) {
+    return "missing";
+  }
+  auto it = files.find(file_name);
+  if (it != files.end() && it->second.size == st.st_size && it->second.mtime == st.st_mtime) {
+    return it->second.digest;
+  }
+  std::string digest = content_digest(file_name);
+  if (st.st_mtime < time(nullptr) - 1) {
+    files[file_name] = {static_cast<long long>(st.st_size), static_cast<long long>(st.st_mtime), digest};
+  } else {
+    files.erase(file_name);
+  }
+  return digest;
+}
+
+/**
+ * @brief Digests of a source file and of the header next to it (same name, ".h"; "missing" if there is none), for the
+ *    fingerprint of the outputs the code writes: a header holds defaults, constants and templates that shape them too.
+ */
+std::string FingerprintStore::source_digest(const std::string &source) {
+  std::string header = source.substr(0, source.rfind('.')) + ".h";
+  return file_digest(source) + " " + file_digest(header);
+}
+
+/**
+ * @brief Write the manifest (to a temporary file, then renamed over the old one).
+ */
+void FingerprintStore::save() const {
+  std::string tmp_name = manifest + ".tmp";
+  FILE *outfile = fopen(tmp_name.c_str(), "w");
+  if (!outfile) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", tmp_name.c_str()));
+  }
+  for (const auto &p : outputs) {
+    fprintf(outfile, "output %s %s\n", p.second.c_str(), p.first.c_str());
+  }
+  for (const auto &p : files) {
+    fprintf(outfile, "file %lld %lld %s %s\n", p.second.size, p.second.mtime, p.second.digest.c_str(), p.first.c_str());
+  }
+  bool ok = !ferror(outfile);
+  ok = (fclose(outfile) == 0) && ok;
+  if (!ok || rename(tmp_name.c_str(), manifest.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("failed to write fingerprint manifest '%s'", manifest.c_str()));
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+#include <TString.h>
+
+#include <sys/stat.h>
+
+/**
+ * @brief 64 bit FNV-1a style hash of everything that goes into an output (data, configuration, sources), built incrementally.
+ *    Values are hashed with their type and length, so e.g. ("ab", "c") and ("a", "bc") differ.
+ */
+class Fingerprint {
+  public:
+  Fingerprint &add(const void *data, size_t n_bytes);
+  Fingerprint &add(const std::string &str);
+  Fingerprint &add(double value);
+  Fingerprint &add(const std::vector<int> &values);
+  Fingerprint &add(const Fingerprint &other);
+  uint64_t value() const { return hash; }
+  std::string hex() const;
+
+  private:
+  Fingerprint &add_tag(char tag);
+
+  uint64_t hash = 14695981039346656037ULL;
+};
+
+const size_t DIGEST_CHUNK_SIZE = 1 << 20;   // files are hashed in chunks of this size (see content_digest)
+
+std::string content_digest(const std::string &file_name);
+
+/**
+ * @brief Fingerprints of the outputs written in a directory (the inputs they were made from), and a cache of file content
+ *    digests, kept in a manifest file. An output is unchanged if it exists and was recorded with the same fingerprint.
+ *
+ * NOTE: not thread-safe; JobGraph only uses it from the thread calling run().
+ */
+class FingerprintStore {
+  public:
+  explicit FingerprintStore(const std::string &manifest);
+  bool unchanged(const std::string &output, const std::string &fingerprint) const;
+  void record(const std::string &output, const std::string &fingerprint);
+  std::string file_digest(const std::string &file_name);
+  std::string source_digest(const std::string &source);
+  void save() const;
+
+  private:
+  typedef struct FileDigest {
+    long long size;
+    long long mtime;
+    std::string digest;
+  } FileDigest;
+
+  std::string manifest;
+  std::map<std::string, std::string> outputs;   // output file -> fingerprint it was written with
+  std::map<std::string, FileDigest> files;      // input file -> content digest at (size, mtime)
+};
+
+#ifndef EMCAL_LIBRARY
+#include "fingerprint.cpp"
+#endif
@@ -0,0 +1,213 @@
+#include "fit_telemetry.h"
+
+const char *fit_seed_name(FitSeed seed) {
+  switch (seed) {
+    case FitSeed::FIXED: return "fixed";
+    case FitSeed::PRELIMINARY_FIT: return "preliminary fit";
+    case FitSeed::HISTORY: return "history";
+    case FitSeed::SPECTRUM: return "spectrum";
+  }
+  return "unknown";
+}
+
+static FitSeed parse_fit_seed(const std::string &name) {
+  for (FitSeed seed : {FitSeed::FIXED, FitSeed::PRELIMINARY_FIT, FitSeed::HISTORY, FitSeed::SPECTRUM}) {
+    if (name == fit_seed_name(seed)) {
+      return seed;
+    }
+  }
+  throw std::runtime_error(Form("unknown fit seed '%s'", name.c_str()));
+}
+
+void FitClock::restart() {
+  wall_start = std::chrono::steady_clock::now();
+  cpu_start = thread_cpu_time();
+}
+
+double FitClock::wall_time() const {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+}
+
+double FitClock::cpu_time() const {
+  return thread_cpu_time() - cpu_start;
+}
+
+double FitClock::thread_cpu_time() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+/**
+ * @brief Telemetry of a fit made with TH1::Fit and option "S" (the iterations are not reported).
+ *
+ * @param channel
+ * @param result of the fit (may be empty, e.g. if the fit did not start; the status is then TH1::Fit's).
+ * @param clock started right before the fit.
+ * @param seed
+ * @param seed_time s spent on preliminary fits.
+ * @return FitTelemetry
+ */
+FitTelemetry fit_telemetry(int channel, const TFitResultPtr &result, const FitClock &clock, FitSeed seed, double seed_time) {
+  FitTelemetry fit = {channel, "", (int) result, NAN, 0, -1, -1, clock.wall_time(), clock.cpu_time(), seed_time, seed};
+  const TFitResult *r = result.Get();
+  if (r && !r->IsEmpty()) {
+    fit.minimizer = r->MinimizerType();
+    fit.status = r->Status();
+    fit.edm = r->Edm();
+    fit.n_calls = r->NCalls();
+  }
+  return fit;
+}
+
+/**
+ * @brief Telemetry of the last fit of a ROOT::Fit::Fitter, with the iterations of its minimizer.
+ */
+FitTelemetry fit_telemetry(int channel, const ROOT::Fit::Fitter &fitter, const FitClock &clock, FitSeed seed, double seed_time) {
+  const ROOT::Fit::FitResult &result = fitter.Result();
+  FitTelemetry fit = {channel, result.MinimizerType(), result.Status(), result.Edm(), (int) result.NCalls(), -1, -1,
+                      clock.wall_time(), clock.cpu_time(), seed_time, seed};
+  if (fitter.GetMinimizer()) {
+    fit.n_iterations = fitter.GetMinimizer()->NIterations();
+  }
+  return fit;
+}
+
+void write_fit_telemetry_csv(const std::vector<FitTelemetry> &fits, const std::string &file_name) {
+  FILE *file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", file_name.c_str()));
+  }
+  fprintf(file, "channel, minimizer, status, edm, calls, gradient calls, iterations, wall time [s], cpu time [s], seed time [s], seed\n");
+  for (const FitTelemetry &fit : fits) {
+    fprintf(file, "%d, %s, %d, %g, %d, %d, %d, %f, %f, %f, %s\n", fit.channel, fit.minimizer.c_str(), fit.status, fit.edm,
+            fit.n_calls, fit.n_grad_calls, fit.n_iterations, fit.wall_time, fit.cpu_time, fit.seed_time, fit_seed_name(fit.seed));
+  }
+  fclose(file);
+}
+
+/**
+ * @brief Read a file of write_fit_telemetry_csv, e.g. to summarize the fits of many runs.
+ */
+std::vector<FitTelemetry> read_fit_telemetry_csv(const std::string &file_name) {
+  std::ifstream file(file_name);
+  if (!file) {
+    throw std::runtime_error(Form("unable to open '%s'", file_name.c_str()));
+  }
+  std::vector<FitTelemetry> fits;
+  std::string line;
+  std::getline(file, line);   // header
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields;
+    std::stringstream csv_stream(line);
+    std::string field;
+    while (std::getline(csv_stream, field, ',')) {
+      size_t first = field.find_first_not_of(' ');
+      fields.push_back(first == std::string::npos ? "" : field.substr(first));
+    }
+    if (fields.size() != 11) {
+      throw std::runtime_error(Form("'%s': expected 11 columns in '%s'", file_name.c_str(), line.c_str()));
+    }
+    fits.push_back({std::stoi(fields[0]), fields[1], std::stoi(fields[2]), std::stod(fields[3]), std::stoi(fields[4]),
+                    std::stoi(fields[5]), std::stoi(fields[6]), std::stod(fields[7]), std::stod(fields[8]),
+                    std::stod(fields[9]), parse_fit_seed(fields[10])});
+  }
+  return fits;
+}
+
+/**
+ * @brief The n fits with the longest wall time, longest first.
+ */
+std::vector<FitTelemetry> slowest_fits(const std::vector<FitTelemetry> &fits, size_t n) {
+  std::vector<FitTelemetry> sorted = fits;
+  n = std::min(n, sorted.size());
+  std::partial_sort(sorted.begin(), sorted.begin() + n, sorted.end(), [](const FitTelemetry &a, const FitTelemetry &b) {
+    return a.wall_time > b.wall_time;
+  });
+  sorted.resize(n);
+  return sorted;
+}
+
+/**
+ * @brief Print the cost of a run's fits: totals, wall time and calls per fit (mean, median, max) and the slowest fits.
+ *
+ * @param fits
+ * @param n_slowest fits listed.
+ * @param out
+ */
+void print_fit_costs(const std::vector<FitTelemetry> &fits, size_t n_slowest, FILE *out) {
+  RunningStats wall_ms, calls;
+  double wall_time = 0;
+  double cpu_time = 0;
+  double seed_time = 0;
+  long n_failed = 0;
+  for (const FitTelemetry &fit : fits) {
+    wall_ms.add(1000*fit.wall_time);
+    calls.add(fit.n_calls);
+    wall_time += fit.wall_time;
+    cpu_time += fit.cpu_time;
+    seed_time += fit.seed_time;
+    n_failed += fit.status != 0;
+  }
+  fprintf(out, "%zu fits (%ld not converged): %.3f s wall, %.3f s cpu, %.3f s of preliminary fits\n", fits.size(),
+          n_failed, wall_time, cpu_time, seed_time);
+  if (fits.empty()) {
+    return;
+  }
+  fprintf(out, "  wall time per fit [ms]:   mean %10.3f  median %10.3f  max %10.3f\n", wall_ms.mean(), wall_ms.median(), wall_ms.max());
+  fprintf(out, "  function calls per fit:   mean %10.1f  median %10.1f  max %10.0f\n", calls.mean(), calls.median(), calls.max());
+  fprintf(out, "slowest fits:\n  %7s %10s %10s %7s %10s %6s %10s  %s\n", "channel", "wall [ms]", "cpu [ms]", "calls",
+          "iterations", "status", "edm", "seed");
+  for (const FitTelemetry &fit : slowest_fits(fits, n_slowest)) {
+    fprintf(out, "  %7d %10.3f %10.3f %7d %10d %6d %10.3g  %s\n", fit.channel, 1000*fit.wall_time, 1000*fit.cpu_time,
+            fit.n_calls, fit.n_iterations, fit.status, fit.edm, fit_seed_name(fit.seed));
+  }
+}
+
+/**
+ * @brief Histograms of the cost of a run's fits: wall time and CPU time (log10 ms), function calls and EDM (log10).
+ *
+ * @param fits
+ * @param file_name e.g. "all_run_fits/21518/fit_costs.png".
+ */
+void save_fit_cost_plots(const std::vector<FitTelemetry> &fits, const std::string &file_name) {
+  if (fits.empty()) {
+    return;
+  }
+  const char *titles[4] = {"wall time per fit;log_{10}(wall time [ms]);fits", "cpu time per fit;log_{10}(cpu time [ms]);fits",
+                           "function calls per fit;calls;fits", "EDM;log_{10}(EDM);fits"};
+  std::vector<double> values[4];
+  for (const FitTelemetry &fit : fits) {
+    values[0].push_back(std::log10(std::max(1e-3, 1000*fit.wall_time)));
+    values[1].push_back(std::log10(std::max(1e-3, 1000*fit.cpu_time)));
+    values[2].push_back(fit.n_calls);
+    if (fit.edm > 0) {
+      values[3].push_back(std::log10(fit.edm));
+    }
+  }
+
+  TCanvas *c = new TCanvas("", "", 1000, 800);
+  c->Divide(2, 2);
+  TH1D *hists[4] = {};
+  for (int q = 0; q < 4; q++) {
+    if (values[q].empty()) {
+      continue;
+    }
+    double lo = *std::min_element(values[q].begin(), values[q].end());
+    double hi = *std::max_element(values[q].begin(), values[q].end());
+    double pad = std::max(0.5, 0.05*(hi - lo));
+    hists[q] = new TH1D(Form("h_fit_cost_%d", q), titles[q], 50, lo - pad, hi + pad);
+    hists[q]->SetDirectory(nullptr);
+    hists[q]->SetStats(false);
+    for (double value : values[q]) {
+      hists[q]->Fill(value);
+    }
+    c->cd(q + 1);
+    hists[q]->Draw();
+  }
+  c->SaveAs(file_name.c_str());
+  delete c;
+  for (TH1D *h : hists) {
+    delete h;
+  }
+}
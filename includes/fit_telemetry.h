@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <TH1D.h>
+#include <TCanvas.h>
+#include <TStyle.h>
+#include <TString.h>
+#include <TFitResult.h>
+#include <Fit/Fitter.h>
+
+#include <time.h>
+
+#include "stats.h"
+
+/**
+ * @brief Where the starting values of a fit came from.
+ */
+enum class FitSeed {
+  FIXED,            // constants of the fitter
+  PRELIMINARY_FIT,  // fits of parts of the spectrum (e.g. the gaus and landau seeds of fit_single_pixels)
+  HISTORY,          // an earlier fit of the channel (e.g. of the previous run)
+  SPECTRUM,         // the shape of the spectrum (e.g. the peak and half maximum points of fit_mip)
+};
+
+const char *fit_seed_name(FitSeed seed);
+
+/**
+ * @brief Cost and convergence of one channel's fit, stored next to the fit results (fit_telemetry.csv).
+ */
+typedef struct FitTelemetry {
+  int channel;
+  std::string minimizer;    // e.g. "Minuit / Migrad"
+  int status;               // of the minimizer (0 = converged)
+  double edm;               // estimated distance to the minimum
+  int n_calls;              // objective function calls, including those of numerical derivatives
+  int n_grad_calls;         // analytic gradient calls; -1 if not reported (all fits here use numerical derivatives)
+  int n_iterations;         // -1 if not reported (fits through TH1::Fit)
+  double wall_time;         // s, of the final fit
+  double cpu_time;          // s, of the fitting thread
+  double seed_time;         // s, wall time of the preliminary fits (0 for other seeds)
+  FitSeed seed;
+} FitTelemetry;
+
+/**
+ * @brief Wall time and CPU time of the calling thread since construction or restart(), in s. CPU time is per thread,
+ *    so fits running in parallel do not count each other.
+ */
+class FitClock {
+  public:
+  FitClock() { restart(); }
+  void restart();
+  double wall_time() const;
+  double cpu_time() const;
+
+  private:
+  static double thread_cpu_time();
+
+  std::chrono::steady_clock::time_point wall_start;
+  double cpu_start;
+};
+
+FitTelemetry fit_telemetry(int channel, const TFitResultPtr &result, const FitClock &clock, FitSeed seed, double seed_time = 0);
+FitTelemetry fit_telemetry(int channel, const ROOT::Fit::Fitter &fitter, const FitClock &clock, FitSeed seed, double seed_time = 0);
+
+void write_fit_telemetry_csv(const std::vector<FitTelemetry> &fits, const std::string &file_name);
+std::vector<FitTelemetry> read_fit_telemetry_csv(const std::string &file_name);
+std::vector<FitTelemetry> slowest_fits(const std::vector<FitTelemetry> &fits, size_t n);
+void print_fit_costs(const std::vector<FitTelemetry> &fits, size_t n_slowest = 10, FILE *out = stdout);
+void save_fit_cost_plots(const std::vector<FitTelemetry> &fits, const std::string &file_name);
+
+#ifndef EMCAL_LIBRARY
+#include "fit_telemetry.cpp"
+#endif
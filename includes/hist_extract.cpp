@@ -0,0 +1,228 @@
+#include "hist_extract.h"
+
+/**
+ * @brief Write a slim copy of a QA histograms.root with only the calibration objects (CALIB_HISTOGRAMS, plus the per
+ *    channel ADC spectra h_alladc_<channel> if with_adc), reading only those keys of the source. The copy is written
+ *    to "<dest>.tmp" and renamed to dest. Throws std::runtime_error if the source cannot be read, lacks one of
+ *    CALIB_HISTOGRAMS, or the copy cannot be written.
+ *
+ * @param source e.g. "/gpfs/.../qa_output_00021518/histograms.root"
+ * @param dest e.g. "physics_runs/qa_output_00021518/histograms.root"
+ * @param with_adc
+ * @return ExtractResult (run and wall_time are left for the caller)
+ */
+ExtractResult extract_histograms(const std::string &source, const std::string &dest, bool with_adc) {
+  TFile *infile = TFile::Open(source.c_str(), "READ");
+  if (!infile || infile->IsZombie()) {
+    delete infile;
+    throw std::runtime_error(Form("unable to open '%s'", source.c_str()));
+  }
+  std::string tmp_name = dest + ".tmp";
+  TFile *outfile = TFile::Open(tmp_name.c_str(), "RECREATE");
+  if (!outfile || outfile->IsZombie()) {
+    delete outfile;
+    infile->Close();
+    delete infile;
+    throw std::runtime_error(Form("unable to open '%s' for writing", tmp_name.c_str()));
+  }
+
+  // keys are sorted by decreasing cycle, so the first key of a name is the latest
+  std::set<std::string> written;
+  TIter next(infile->GetListOfKeys());
+  TKey *key;
+  while ((key = (TKey*) next())) {
+    std::string name = key->GetName();
+    bool wanted = std::find(CALIB_HISTOGRAMS.begin(), CALIB_HISTOGRAMS.end(), name) != CALIB_HISTOGRAMS.end() ||
+                  (with_adc && name.rfind("h_alladc_", 0) == 0);
+    if (!wanted || written.count(name) > 0) {
+      continue;
+    }
+    TObject *obj = key->ReadObj();
+    if (!obj) {
+      infile->Close();
+      delete infile;
+      outfile->Close();
+      delete outfile;
+      remove(tmp_name.c_str());
+      throw std::runtime_error(Form("unable to read '%s' from '%s'", name.c_str(), source.c_str()));
+    }
+    outfile->WriteTObject(obj, name.c_str());
+    delete obj;
+    written.insert(name);
+  }
+  ExtractResult result = {0, true, written.size(), infile->GetSize(), infile->GetBytesRead(), 0, 0, ""};
+  infile->Close();
+  delete infile;
+  outfile->Close();
+  result.bytes_written = outfile->GetBytesWritten();
+  delete outfile;
+
+  for (const std::string &name : CALIB_HISTOGRAMS) {
+    if (written.count(name) == 0) {
+      remove(tmp_name.c_str());
+      throw std::runtime_error(Form("'%s' has no %s", source.c_str(), name.c_str()));
+    }
+  }
+  if (rename(tmp_name.c_str(), dest.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("unable to rename '%s' to '%s'", tmp_name.c_str(), dest.c_str()));
+  }
+  return result;
+}
+
+/**
+ * @brief Extract the calibration histograms (see extract_histograms) of runs, n_workers runs at a time. A failed run
+ *    does not stop the others. The slim files are recorded in dest_dir/.manifest (see RunFetcher::adopt), so
+ *    get_physics_runs() into the same directory keeps them rather than copying the full files over them; remove a
+ *    run's folder to fetch its full file again.
+ *
+ * @param runs run numbers.
+ * @param source_dir directory with the qa_output_000<run> folders (e.g. PHYSICS_RUNS_SOURCE).
+ * @param dest_dir directory the slim qa_output_000<run>/histograms.root files are written into.
+ * @param with_adc also copy h_alladc_<channel> (needed to refit the channels).
+ * @param n_workers
+ * @return one ExtractResult per run, in the order of runs.
+ */
+std::vector<ExtractResult> extract_runs(const std::vector<int> &runs, const std::string &source_dir, const std::string &dest_dir, bool with_adc, unsigned int n_workers) {
+  typedef std::chrono::steady_clock clock;
+  if (n_workers > 1) {
+    ROOT::EnableThreadSafety();
+  }
+  make_directory(dest_dir);
+  std::vector<ExtractResult> results(runs.size());
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < runs.size(); i = next++) {
+      clock::time_point start = clock::now();
+      std::string folder = run_folder_name(runs[i]);
+      try {
+        make_directory(dest_dir + "/" + folder);
+        results[i] = extract_histograms(source_dir + "/" + folder + "/histograms.root", dest_dir + "/" + folder + "/histograms.root", with_adc);
+      } catch (const std::exception &e) {
+        results[i] = {0, false, 0, 0, 0, 0, 0, e.what()};
+      }
+      results[i].run = runs[i];
+      results[i].wall_time = std::chrono::duration<double>(clock::now() - start).count();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < std::max(n_workers, 1u); t++) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  RunFetcher fetcher(source_dir, dest_dir);
+  for (ExtractResult &result : results) {
+    if (result.ok) {
+      try {
+        fetcher.adopt(result.run, "histograms.root");
+      } catch (const std::exception &e) {
+        result.ok = false;
+        result.error = e.what();
+      }
+    }
+  }
+  return results;
+}
+
+/**
+ * @brief Print objects, bytes and time of every run, and the totals.
+ *
+ * @param results
+ * @param wall_time seconds the extraction took.
+ * @param out
+ */
+void print_extract_report(const std::vector<ExtractResult> &results, double wall_time, FILE *out) {
+  long long source_size = 0, bytes_read = 0, bytes_written = 0;
+  size_t n_failed = 0;
+  for (const ExtractResult &r : results) {
+    if (r.ok) {
+      fprintf(out, "ok       %8.3f s  run %d: %zu objects, read %.1f of %.1f kB, wrote %.1f kB\n", r.wall_time, r.run, r.n_objects,
+              r.bytes_read/1e3, r.source_size/1e3, r.bytes_written/1e3);
+    } else {
+      fprintf(out, "FAILED   %8.3f s  run %d (%s)\n", r.wall_time, r.run, r.error.c_str());
+    }
+    source_size += r.source_size;
+    bytes_read += r.bytes_read;
+    bytes_written += r.bytes_written;
+    n_failed += !r.ok;
+  }
+  fprintf(out, "%zu runs (%zu failed): read %.1f of %.1f MB, wrote %.1f MB in %.3f s\n", results.size(), n_failed,
+          bytes_read/1e6, source_size/1e6, bytes_written/1e6, wall_time);
+}
+
+/**
+ * @brief Total size of the regular files in a directory (not recursive), or -1 if it cannot be read.
+ */
+long long directory_size(const std::string &dir_name) {
+  DIR *dir = opendir(dir_name.c_str());
+  if (!dir) {
+    return -1;
+  }
+  long long size = 0;
+  struct dirent *entry;
+  struct stat st;
+  while ((entry = readdir(dir))) {
+    if (stat((dir_name + "/" + entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+      size += st.st_size;
+    }
+  }
+  closedir(dir);
+  return size;
+}
+
+/**
+ * @brief Compare bytes moved and wall time of copying whole run folders one at a time (what get_physics_runs used to do,
+ *    "cp -r") with extracting the calibration histograms on n_workers threads. Both write into scratch_dir, which is
+ *    emptied first.
+ *
+ * NOTE: the extraction runs first, so if the source is local the copy reads a warm page cache; on GPFS the bytes
+ *    moved are the number that matters. For the 65 runs of files/physics_runs.csv (key lists of the local copies):
+ *    the full files are 118.1 MB; the extraction reads 3.9 MB (3.1 MB of key lists, 0.72 MB of h_allchannels and
+ *    h_sp_perchnl, 11 kB per run) and writes about 0.7 MB; with_adc adds 76.2 MB of h_alladc_<channel> to both.
+ *
+ * @param runs
+ * @param source_dir
+ * @param scratch_dir e.g. "/tmp/emcal_extract_benchmark"
+ * @param with_adc
+ * @param n_workers
+ */
+void benchmark_extraction(const std::vector<int> &runs, const std::string &source_dir, const std::string &scratch_dir, bool with_adc, unsigned int n_workers) {
+  typedef std::chrono::steady_clock clock;
+  std::string full_dir = scratch_dir + "/full";
+  std::string slim_dir = scratch_dir + "/slim";
+  make_directory(scratch_dir);
+  if (system(Form("rm -rf '%s' '%s'", full_dir.c_str(), slim_dir.c_str())) != 0) {
+    throw std::runtime_error(Form("unable to empty '%s'", scratch_dir.c_str()));
+  }
+  make_directory(full_dir);
+
+  clock::time_point start = clock::now();
+  std::vector<ExtractResult> results = extract_runs(runs, source_dir, slim_dir, with_adc, n_workers);
+  double slim_time = std::chrono::duration<double>(clock::now() - start).count();
+  long long slim_read = 0, slim_written = 0;
+  for (const ExtractResult &r : results) {
+    slim_read += r.bytes_read;
+    slim_written += r.bytes_written;
+  }
+  print_extract_report(results, slim_time);
+
+  start = clock::now();
+  long long full_bytes = 0;
+  for (int run : runs) {
+    std::string folder = source_dir + "/" + run_folder_name(run);
+    long long size = directory_size(folder);
+    if (size < 0 || system(Form("cp -r '%s' '%s'", folder.c_str(), full_dir.c_str())) != 0) {
+      printf("FAILED to copy %s\n", folder.c_str());
+      continue;
+    }
+    full_bytes += size;
+  }
+  double full_time = std::chrono::duration<double>(clock::now() - start).count();
+
+  printf("\n%zu runs%s:\n", runs.size(), with_adc ? " (with h_alladc_*)" : "");
+  printf("%-28s %12s %14s %10s\n", "", "MB read", "MB written", "s");
+  printf("%-28s %12.2f %14.2f %10.3f\n", "cp -r run folders (serial)", full_bytes/1e6, full_bytes/1e6, full_time);
+  printf("%-28s %12.2f %14.2f %10.3f\n", Form("extract (%u workers)", n_workers), slim_read/1e6, slim_written/1e6, slim_time);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include <dirent.h>
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TList.h>
+#include <TROOT.h>
+#include <TString.h>
+
+#include "run_fetch.h"
+
+/**
+ * @brief Objects of a QA histograms.root used by the calibration (h_alladc_<channel> optionally, see extract_histograms).
+ */
+const std::vector<std::string> CALIB_HISTOGRAMS = {"h_allchannels", "h_sp_perchnl"};
+
+typedef struct ExtractResult {
+  int run;
+  bool ok;
+  size_t n_objects;         // objects written
+  long long source_size;    // bytes of the source file
+  long long bytes_read;     // bytes read from the source file
+  long long bytes_written;  // bytes of the slim file
+  double wall_time;         // seconds
+  std::string error;
+} ExtractResult;
+
+ExtractResult extract_histograms(const std::string &source, const std::string &dest, bool with_adc);
+std::vector<ExtractResult> extract_runs(const std::vector<int> &runs, const std::string &source_dir, const std::string &dest_dir, bool with_adc, unsigned int n_workers);
+void print_extract_report(const std::vector<ExtractResult> &results, double wall_time, FILE *out = stdout);
+void benchmark_extraction(const std::vector<int> &runs, const std::string &source_dir, const std::string &scratch_dir, bool with_adc, unsigned int n_workers);
+
+#ifndef EMCAL_LIBRARY
+#include "hist_extract.cpp"
+#endif
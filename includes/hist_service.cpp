@@ -0,0 +1,563 @@
+#include "hist_service.h"
+
+void MessageBuffer::put_bytes(const void *bytes, size_t n) {
+  const char *p = static_cast<const char*>(bytes);
+  data.insert(data.end(), p, p + n);
+}
+
+void MessageBuffer::get_bytes(void *bytes, size_t n) {
+  if (pos + n > data.size()) {
+    throw std::runtime_error("message too short");
+  }
+  memcpy(bytes, data.data() + pos, n);
+  pos += n;
+}
+
+MessageBuffer &MessageBuffer::put_int(int32_t value) {
+  put_bytes(&value, sizeof(value));
+  return *this;
+}
+
+MessageBuffer &MessageBuffer::put_double(double value) {
+  put_bytes(&value, sizeof(value));
+  return *this;
+}
+
+MessageBuffer &MessageBuffer::put_string(const std::string &value) {
+  put_int(static_cast<int32_t>(value.size()));
+  put_bytes(value.data(), value.size());
+  return *this;
+}
+
+MessageBuffer &MessageBuffer::put_doubles(const std::vector<double> &values) {
+  put_int(static_cast<int32_t>(values.size()));
+  put_bytes(values.data(), values.size()*sizeof(double));
+  return *this;
+}
+
+int32_t MessageBuffer::get_int() {
+  int32_t value;
+  get_bytes(&value, sizeof(value));
+  return value;
+}
+
+double MessageBuffer::get_double() {
+  double value;
+  get_bytes(&value, sizeof(value));
+  return value;
+}
+
+std::string MessageBuffer::get_string() {
+  int32_t n = get_int();
+  if (n < 0 || pos + n > data.size()) {
+    throw std::runtime_error("message too short");
+  }
+  std::string value(data.data() + pos, n);
+  pos += n;
+  return value;
+}
+
+std::vector<double> MessageBuffer::get_doubles() {
+  int32_t n = get_int();
+  if (n < 0 || pos + n*sizeof(double) > data.size()) {
+    throw std::runtime_error("message too short");
+  }
+  std::vector<double> values(n);
+  get_bytes(values.data(), n*sizeof(double));
+  return values;
+}
+
+static void write_all(int fd, const char *bytes, size_t n) {
+  while (n > 0) {
+    ssize_t n_written = send(fd, bytes, n, MSG_NOSIGNAL);
+    if (n_written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n_written <= 0) {
+      throw std::runtime_error(Form("unable to send message: %s", strerror(errno)));
+    }
+    bytes += n_written;
+    n -= n_written;
+  }
+}
+
+/**
+ * @return false if the connection was closed before the first byte. Throws if the socket's SO_RCVTIMEO runs out.
+ */
+static bool read_all(int fd, char *bytes, size_t n) {
+  size_t n_total = 0;
+  while (n_total < n) {
+    ssize_t n_read = read(fd, bytes + n_total, n - n_total);
+    if (n_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n_read == 0 && n_total == 0) {
+      return false;
+    }
+    if (n_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      throw std::runtime_error("timed out within a message");
+    }
+    if (n_read <= 0) {
+      throw std::runtime_error(n_read == 0 ? "connection closed within a message" : Form("unable to receive message: %s", strerror(errno)));
+    }
+    n_total += n_read;
+  }
+  return true;
+}
+
+/**
+ * @brief Send a message (header and payload) on a connected socket.
+ */
+void send_message(int fd, uint16_t type, const MessageBuffer &payload) {
+  MessageHeader header = {HIST_SERVICE_MAGIC, HIST_SERVICE_VERSION, type, static_cast<uint32_t>(payload.data.size())};
+  write_all(fd, reinterpret_cast<const char*>(&header), sizeof(header));
+  write_all(fd, payload.data.data(), payload.data.size());
+}
+
+/**
+ * @brief Receive a whole message; throws std::runtime_error on a message of another protocol or version.
+ *
+ * @param fd connected socket.
+ * @param type set to the message type.
+ * @param payload set to the payload (read position 0).
+ * @return false if the peer closed the connection.
+ */
+bool receive_message(int fd, uint16_t &type, MessageBuffer &payload) {
+  MessageHeader header;
+  if (!read_all(fd, reinterpret_cast<char*>(&header), sizeof(header))) {
+    return false;
+  }
+  if (header.magic != HIST_SERVICE_MAGIC || header.version != HIST_SERVICE_VERSION) {
+    throw std::runtime_error(Form("not a histogram service message (version %u)", header.version));
+  }
+  if (header.size > HIST_SERVICE_MAX_PAYLOAD) {
+    throw std::runtime_error(Form("message of %u bytes too large", header.size));
+  }
+  type = header.type;
+  payload.data.resize(header.size);
+  payload.pos = 0;
+  if (header.size > 0 && !read_all(fd, payload.data.data(), header.size)) {
+    throw std::runtime_error("connection closed within a message");
+  }
+  return true;
+}
+
+static sockaddr_un socket_address(const std::string &socket_path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error(Form("socket path '%s' too long", socket_path.c_str()));
+  }
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+/**
+ * @brief Listen on socket_path (a stale socket file of a service which is not running any more is replaced).
+ *
+ * @param socket_path
+ * @param max_open_runs run files kept open (least recently used closed first).
+ * @param runs_dir directory of the qa_output_000<run> folders.
+ */
+HistService::HistService(const std::string &socket_path, size_t max_open_runs, const std::string &runs_dir)
+  : socket_path(socket_path), runs_dir(runs_dir), max_open_runs(std::max<size_t>(max_open_runs, 1)), start(clock::now()) {
+  sockaddr_un address = socket_address(socket_path);
+  struct stat st;
+  if (stat(socket_path.c_str(), &st) == 0) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool in_use = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    if (probe >= 0) {
+      close(probe);
+    }
+    if (in_use) {
+      throw std::runtime_error(Form("a histogram service is already listening on '%s'", socket_path.c_str()));
+    }
+    unlink(socket_path.c_str());
+  }
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    throw std::runtime_error(Form("unable to create socket: %s", strerror(errno)));
+  }
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd, 16) != 0) {
+    std::string error = strerror(errno);
+    close(listen_fd);
+    throw std::runtime_error(Form("unable to listen on '%s': %s", socket_path.c_str(), error.c_str()));
+  }
+}
+
+HistService::~HistService() {
+  while (!runs.empty()) {
+    close_run(runs.begin()->first);
+  }
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+  }
+}
+
+/**
+ * @brief The run's file, opened unless open and unchanged on disk; closes the least recently used run file if more
+ *    than max_open_runs are open.
+ */
+HistService::OpenRun &HistService::open_run(int run) {
+  std::string file_name = runs_dir + Form("/qa_output_000%i/histograms.root", run);
+  struct stat st;
+  if (stat(file_name.c_str(), &st) != 0) {
+    close_run(run);
+    throw std::runtime_error(Form("no run file %s", file_name.c_str()));
+  }
+  auto it = runs.find(run);
+  if (it != runs.end() && (it->second.mtime != st.st_mtime || it->second.size != st.st_size)) {
+    close_run(run);
+    it = runs.end();
+  }
+  if (it == runs.end()) {
+    if (runs.size() >= max_open_runs) {
+      auto oldest = runs.begin();
+      for (auto jt = runs.begin(); jt != runs.end(); jt++) {
+        if (jt->second.last_used < oldest->second.last_used) {
+          oldest = jt;
+        }
+      }
+      close_run(oldest->first);
+    }
+    TFile *file = TFile::Open(file_name.c_str(), "READ");
+    if (!file || file->IsZombie()) {
+      delete file;
+      throw std::runtime_error(Form("unable to open %s", file_name.c_str()));
+    }
+    n_file_opens++;
+    it = runs.insert({run, OpenRun{file, st.st_mtime, st.st_size, 0, {}, false, RunHists()}}).first;
+  }
+  it->second.last_used = ++n_uses;
+  return it->second;
+}
+
+void HistService::close_run(int run) {
+  auto it = runs.find(run);
+  if (it == runs.end()) {
+    return;
+  }
+  it->second.file->Close();
+  delete it->second.file;
+  runs.erase(it);
+}
+
+/**
+ * @brief A histogram of a run, read from its file the first time.
+ */
+TH1 *HistService::get_hist(int run, const std::string &name) {
+  OpenRun &open = open_run(run);
+  auto it = open.hists.find(name);
+  if (it != open.hists.end()) {
+    n_hist_hits++;
+    return it->second;
+  }
+  TH1 *hist = nullptr;
+  open.file->GetObject(name.c_str(), hist);
+  if (!hist) {
+    throw std::runtime_error(Form("no histogram '%s' in run %d", name.c_str(), run));
+  }
+  n_hist_reads++;
+  open.hists[name] = hist;
+  return hist;
+}
+
+const RunHists &HistService::get_run_hists(int run) {
+  OpenRun &open = open_run(run);
+  if (!open.has_run_hists) {
+    if (!read_run_hists(open.file, run, open.run_hists)) {
+      throw std::runtime_error(Form("no h_allchannels/h_sp_perchnl in run %d", run));
+    }
+    n_hist_reads += 2;
+    open.has_run_hists = true;
+  } else {
+    n_hist_hits += 2;
+  }
+  return open.run_hists;
+}
+
+/**
+ * @brief Answer a request (see HistRequest); throws std::runtime_error if it cannot be answered.
+ */
+void HistService::answer(uint16_t type, MessageBuffer &request, MessageBuffer &response) {
+  if (type == HIST_SLICE) {
+    int run = request.get_int();
+    std::string name = request.get_string();
+    int first_bin = request.get_int();
+    int last_bin = request.get_int();
+    TH1 *hist = get_hist(run, name);
+    if (hist->GetDimension() != 1) {
+      throw std::runtime_error(Form("'%s' is not a 1D histogram", name.c_str()));
+    }
+    int n_bins = hist->GetNbinsX();
+    first_bin = std::max(first_bin, 1);
+    last_bin = last_bin < 1 ? n_bins : std::min(last_bin, n_bins);
+    std::vector<double> edges, contents, errors;
+    for (int bin = first_bin; bin <= last_bin; bin++) {
+      edges.push_back(hist->GetBinLowEdge(bin));
+      contents.push_back(hist->GetBinContent(bin));
+      errors.push_back(hist->GetBinError(bin));
+    }
+    if (first_bin <= last_bin) {
+      edges.push_back(hist->GetBinLowEdge(last_bin + 1));
+    }
+    response.put_int(first_bin).put_doubles(edges).put_doubles(contents).put_doubles(errors);
+  } else if (type == HIST_FIT) {
+    int run = request.get_int();
+    int channel = request.get_int();
+    if (channel < 0 || channel >= SECTOR_CHANNELS) {
+      throw std::runtime_error(Form("channel %d not in [0, %d)", channel, SECTOR_CHANNELS));
+    }
+    SinglePixelFit fit = fit_single_pixels(get_hist(run, Form("h_alladc_%d", channel)));
+    const FitTelemetry &t = fit.telemetry;
+    response.put_int(fit.status).put_double(fit.chi2).put_int(fit.ndf);
+    response.put_doubles(std::vector<double>(fit.params.begin(), fit.params.end()));
+    response.put_doubles(std::vector<double>(fit.errors.begin(), fit.errors.end()));
+    response.put_string(t.minimizer).put_int(t.status).put_double(t.edm).put_int(t.n_calls).put_int(t.n_grad_calls);
+    response.put_int(t.n_iterations).put_double(t.wall_time).put_double(t.cpu_time).put_double(t.seed_time).put_int((int) t.seed);
+  } else if (type == HIST_COMPARE) {
+    int reference = request.get_int();
+    int run = request.get_int();
+    int first_channel = request.get_int();
+    int last_channel = request.get_int();
+    // copy the reference: reading the run may close its file
+    RunHists reference_hists = get_run_hists(reference);
+    RunComparison comparison = compare_run_batch(reference_hists, {get_run_hists(run)}, first_channel, last_channel)[0];
+    response.put_doubles(comparison.mpv_ratio).put_doubles(comparison.mpv_ratio_err);
+    response.put_doubles(comparison.sp_ratio).put_doubles(comparison.sp_ratio_err);
+    response.put_double(comparison.gain_mpv_corr);
+  } else if (type == HIST_STATS) {
+    char *text = nullptr;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    print_report(out);
+    fclose(out);
+    response.put_string(std::string(text, size));
+    free(text);
+  } else if (type == HIST_SHUTDOWN) {
+    running = false;
+  } else {
+    throw std::runtime_error(Form("unknown request type %u", type));
+  }
+}
+
+/**
+ * @brief Answer the next request of a connection.
+ *
+ * @return false once the connection is closed (by the client, or after a malformed message).
+ */
+bool HistService::handle(int fd) {
+  uint16_t type;
+  MessageBuffer request;
+  try {
+    if (!receive_message(fd, type, request)) {
+      return false;
+    }
+  } catch (const std::exception &e) {
+    printf("dropped connection: %s\n", e.what());
+    return false;
+  }
+  clock::time_point request_start = clock::now();
+  MessageBuffer body;
+  std::string error;
+  try {
+    answer(type, request, body);
+  } catch (const std::exception &e) {
+    error = e.what();
+    n_failed++;
+  }
+  double seconds = std::chrono::duration<double>(clock::now() - request_start).count();
+  request_time += seconds;
+  if (type <= HIST_SHUTDOWN) {
+    n_requests[type]++;
+  }
+  MessageBuffer response;
+  response.put_int(error.empty()).put_string(error).put_double(seconds*1000);
+  response.data.insert(response.data.end(), body.data.begin(), body.data.end());
+  try {
+    send_message(fd, type, response);
+  } catch (const std::exception &e) {
+    printf("dropped connection: %s\n", e.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Accept connections and answer their requests until a HIST_SHUTDOWN request.
+ */
+void HistService::serve() {
+  // compile the formulas of the fits once, not in the first fit request
+  TF1 warm_up_gaus("hist_service_gaus", "gaus", 0, 1);
+  TF1 warm_up_landau("hist_service_landaugaus", "landau(0) + gaus(3)", 0, 1);
+
+  running = true;
+  std::vector<pollfd> fds = {{listen_fd, POLLIN, 0}};
+  printf("histogram service listening on %s\n", socket_path.c_str());
+  while (running) {
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(Form("poll failed: %s", strerror(errno)));
+    }
+    for (size_t i = 1; i < fds.size() && running; i++) {
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        if (!handle(fds[i].fd)) {
+          close(fds[i].fd);
+          fds[i].fd = -1;
+        }
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd >= 0) {
+        // poll only says a message has started; a client stalling within it must not block the other connections
+        timeval timeout = {HIST_SERVICE_CLIENT_TIMEOUT, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        fds.push_back({fd, POLLIN, 0});
+      }
+    }
+    fds.erase(std::remove_if(fds.begin() + 1, fds.end(), [](const pollfd &p) { return p.fd < 0; }), fds.end());
+  }
+  for (size_t i = 1; i < fds.size(); i++) {
+    close(fds[i].fd);
+  }
+  print_report();
+}
+
+/**
+ * @brief Print the requests answered (with their mean time), the open run files and the histogram reads vs cache hits.
+ */
+void HistService::print_report(FILE *out) const {
+  const char *type_names[] = {"", "slice", "fit", "compare", "stats", "shutdown"};
+  long n_total = 0;
+  fprintf(out, "up %.1f s, requests:", std::chrono::duration<double>(clock::now() - start).count());
+  for (int type = HIST_SLICE; type <= HIST_SHUTDOWN; type++) {
+    fprintf(out, " %s %ld", type_names[type], n_requests[type]);
+    n_total += n_requests[type];
+  }
+  fprintf(out, " (%ld failed), %.3f ms per request\n", n_failed, n_total > 0 ? request_time*1000/n_total : 0.0);
+  fprintf(out, "%zu of %zu run files open (%ld opens), %ld histograms read, %ld cache hits\n", runs.size(), max_open_runs,
+          n_file_opens, n_hist_reads, n_hist_hits);
+  for (const auto &p : runs) {
+    fprintf(out, "  run %d: %zu histograms%s\n", p.first, p.second.hists.size(), p.second.has_run_hists ? " + h_allchannels/h_sp_perchnl" : "");
+  }
+}
+
+/**
+ * @brief
+ *
+ * @param socket_path socket of a running HistService.
+ */
+HistClient::HistClient(const std::string &socket_path) {
+  sockaddr_un address = socket_address(socket_path);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    std::string error = strerror(errno);
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw std::runtime_error(Form("no histogram service on '%s' (%s)", socket_path.c_str(), error.c_str()));
+  }
+}
+
+HistClient::~HistClient() {
+  close(fd);
+}
+
+MessageBuffer HistClient::request(uint16_t type, const MessageBuffer &payload) {
+  send_message(fd, type, payload);
+  uint16_t response_type;
+  MessageBuffer response;
+  if (!receive_message(fd, response_type, response)) {
+    throw std::runtime_error("histogram service closed the connection");
+  }
+  if (response_type != type) {
+    throw std::runtime_error(Form("response of type %u to a request of type %u", response_type, type));
+  }
+  bool ok = response.get_int();
+  std::string error = response.get_string();
+  service_ms = response.get_double();
+  if (!ok) {
+    throw std::runtime_error(error);
+  }
+  return response;
+}
+
+/**
+ * @brief Bins of a 1D histogram of a run.
+ *
+ * @param run
+ * @param name e.g. "h_allchannels" or "h_alladc_17".
+ * @param first_bin 1-based.
+ * @param last_bin inclusive; < 1 for the last bin of the histogram.
+ */
+HistSlice HistClient::slice(int run, const std::string &name, int first_bin, int last_bin) {
+  MessageBuffer response = request(HIST_SLICE, MessageBuffer().put_int(run).put_string(name).put_int(first_bin).put_int(last_bin));
+  HistSlice slice = {run, name, response.get_int(), {}, {}, {}};
+  slice.edges = response.get_doubles();
+  slice.contents = response.get_doubles();
+  slice.errors = response.get_doubles();
+  return slice;
+}
+
+/**
+ * @brief Single pixel fit (fit_single_pixels) of a channel's h_alladc_<channel>, run by the service.
+ */
+SinglePixelFit HistClient::fit(int run, int channel) {
+  MessageBuffer response = request(HIST_FIT, MessageBuffer().put_int(run).put_int(channel));
+  SinglePixelFit fit = {response.get_int(), response.get_double(), response.get_int(), {}, {}, {}};
+  std::vector<double> params = response.get_doubles();
+  std::vector<double> errors = response.get_doubles();
+  if (params.size() != SP_FIT_N_PARAMS || errors.size() != SP_FIT_N_PARAMS) {
+    throw std::runtime_error(Form("fit of %zu parameters", params.size()));
+  }
+  std::copy(params.begin(), params.end(), fit.params.begin());
+  std::copy(errors.begin(), errors.end(), fit.errors.begin());
+  fit.telemetry = {channel, response.get_string(), response.get_int(), response.get_double(), response.get_int(),
+                   response.get_int(), response.get_int(), response.get_double(), response.get_double(),
+                   response.get_double(), (FitSeed) response.get_int()};
+  return fit;
+}
+
+/**
+ * @brief Comparison of run to reference (as compare_run_batch), from the histograms cached by the service.
+ */
+RunComparison HistClient::compare(int reference, int run, int first_channel, int last_channel) {
+  MessageBuffer response = request(HIST_COMPARE, MessageBuffer().put_int(reference).put_int(run).put_int(first_channel).put_int(last_channel));
+  RunComparison comparison;
+  comparison.reference = reference;
+  comparison.run = run;
+  comparison.mpv_ratio = response.get_doubles();
+  comparison.mpv_ratio_err = response.get_doubles();
+  comparison.sp_ratio = response.get_doubles();
+  comparison.sp_ratio_err = response.get_doubles();
+  comparison.gain_mpv_corr = response.get_double();
+  // the statistics over the projection range, added in the order of compare_run_batch
+  for (int chnl = first_channel; chnl <= last_channel && chnl < (int) comparison.mpv_ratio.size(); chnl++) {
+    if (!std::isnan(comparison.mpv_ratio[chnl])) {
+      comparison.mpv_stats.add(comparison.mpv_ratio[chnl]);
+    }
+    if (!std::isnan(comparison.sp_ratio[chnl])) {
+      comparison.sp_stats.add(comparison.sp_ratio[chnl]);
+    }
+  }
+  return comparison;
+}
+
+/**
+ * @brief Report of the service (see HistService::print_report).
+ */
+std::string HistClient::stats() {
+  return request(HIST_STATS, MessageBuffer()).get_string();
+}
+
+/**
+ * @brief Stop the service (once this request is answered).
+ */
+void HistClient::shutdown() {
+  request(HIST_SHUTDOWN, MessageBuffer());
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TF1.h>
+#include <TString.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "run_compare.h"
+#include "sp_fit.h"
+
+/**
+ * @brief Protocol of HistService: every message (request or response) is a header followed by header.size bytes of
+ *    payload, in the byte order of the host (client and service run on the same machine). A response has the type of
+ *    its request; its payload starts with an int (1 if the request succeeded), the error message ("" on success) and
+ *    the time the service spent on the request (ms), followed by the answer (see HistClient).
+ */
+const uint32_t HIST_SERVICE_MAGIC = 0x53484d45;   // "EMHS"
+const uint16_t HIST_SERVICE_VERSION = 2;
+const uint32_t HIST_SERVICE_MAX_PAYLOAD = 64 << 20;
+const std::string HIST_SERVICE_SOCKET = ".emcal_histd.sock";
+const int HIST_SERVICE_CLIENT_TIMEOUT = 5;         // s a connection may stall within a message before it is dropped
+
+enum HistRequest : uint16_t {
+  HIST_SLICE = 1,     // run, histogram name, first bin, last bin -> HistSlice
+  HIST_FIT = 2,       // run, channel -> SinglePixelFit of h_alladc_<channel>, with its FitTelemetry
+  HIST_COMPARE = 3,   // reference run, run, first channel, last channel -> RunComparison
+  HIST_STATS = 4,     // -> report of the service (text)
+  HIST_SHUTDOWN = 5,  // stop serving once answered
+};
+
+typedef struct MessageHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t type;
+  uint32_t size;
+} MessageHeader;
+
+/**
+ * @brief Payload of a message: values are appended with put_*() and read back in the same order with get_*(), which
+ *    throw std::runtime_error past the end.
+ */
+class MessageBuffer {
+  public:
+  MessageBuffer &put_int(int32_t value);
+  MessageBuffer &put_double(double value);
+  MessageBuffer &put_string(const std::string &value);
+  MessageBuffer &put_doubles(const std::vector<double> &values);
+
+  int32_t get_int();
+  double get_double();
+  std::string get_string();
+  std::vector<double> get_doubles();
+
+  std::vector<char> data;
+  size_t pos = 0;     // read position
+
+  private:
+  void put_bytes(const void *bytes, size_t n);
+  void get_bytes(void *bytes, size_t n);
+};
+
+void send_message(int fd, uint16_t type, const MessageBuffer &payload);
+bool receive_message(int fd, uint16_t &type, MessageBuffer &payload);
+
+/**
+ * @brief Bins [first_bin, first_bin + contents.size()) of a 1D histogram of a run.
+ */
+typedef struct HistSlice {
+  int run;
+  std::string name;
+  int first_bin;                  // 1-based, as in TH1
+  std::vector<double> edges;      // low edges of the bins, and the high edge of the last
+  std::vector<double> contents;
+  std::vector<double> errors;
+} HistSlice;
+
+/**
+ * @brief Long-lived service answering histogram slice, single pixel fit and run comparison requests over a Unix socket
+ *    (see HistRequest), so that ROOT starts once and run files are opened once: the last max_open_runs run files stay
+ *    open, with the histograms read from them, and a file is reopened once it changed on disk (e.g. refetched by
+ *    RunFetcher). Requests are answered one at a time, in one thread; a client may keep its connection for many requests.
+ *    A connection which stalls within a message for HIST_SERVICE_CLIENT_TIMEOUT is dropped.
+ */
+class HistService {
+  public:
+  explicit HistService(const std::string &socket_path = HIST_SERVICE_SOCKET, size_t max_open_runs = 8, const std::string &runs_dir = "physics_runs");
+  ~HistService();
+  HistService(const HistService &) = delete;
+  HistService &operator=(const HistService &) = delete;
+
+  void serve();
+  void print_report(FILE *out = stdout) const;
+
+  private:
+  typedef std::chrono::steady_clock clock;
+  typedef struct OpenRun {
+    TFile *file;
+    time_t mtime;                       // of the file when opened
+    off_t size;
+    unsigned long last_used;
+    std::map<std::string, TH1*> hists;  // read so far (owned by file)
+    bool has_run_hists;
+    RunHists run_hists;                 // h_allchannels and h_sp_perchnl, once read
+  } OpenRun;
+
+  OpenRun &open_run(int run);
+  void close_run(int run);
+  TH1 *get_hist(int run, const std::string &name);
+  const RunHists &get_run_hists(int run);
+  bool handle(int fd);
+  void answer(uint16_t type, MessageBuffer &request, MessageBuffer &response);
+
+  std::string socket_path;
+  std::string runs_dir;
+  size_t max_open_runs;
+  int listen_fd = -1;
+  bool running = false;
+  std::map<int, OpenRun> runs;
+  unsigned long n_uses = 0;
+  clock::time_point start;
+  long n_requests[HIST_SHUTDOWN + 1] = {};
+  long n_failed = 0;
+  double request_time = 0;            // s, summed over requests
+  long n_file_opens = 0;
+  long n_hist_reads = 0;
+  long n_hist_hits = 0;
+};
+
+/**
+ * @brief Client of a HistService; one connection, kept for all requests. Requests throw std::runtime_error with the
+ *    service's message if it could not answer them.
+ */
+class HistClient {
+  public:
+  explicit HistClient(const std::string &socket_path = HIST_SERVICE_SOCKET);
+  ~HistClient();
+  HistClient(const HistClient &) = delete;
+  HistClient &operator=(const HistClient &) = delete;
+
+  HistSlice slice(int run, const std::string &name, int first_bin = 1, int last_bin = -1);
+  SinglePixelFit fit(int run, int channel);
+  RunComparison compare(int reference, int run, int first_channel = 64, int last_channel = 318);
+  std::string stats();
+  void shutdown();
+
+  double last_service_time() const { return service_ms; }
+
+  private:
+  MessageBuffer request(uint16_t type, const MessageBuffer &payload);
+
+  int fd;
+  double service_ms = 0;   // time the service spent on the last request
+};
+
+#ifndef EMCAL_LIBRARY
+#include "hist_service.cpp"
+#endif
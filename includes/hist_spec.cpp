@@ -0,0 +1,325 @@
+#include "hist_spec.h"
+
+quantity_getter block_quantity(double Block::*member) {
+  return [member](const Block &block, double *out) {
+    out[0] = block.*member;
+    return 1;
+  };
+}
+
+quantity_getter channel_quantity(double Block::*m0, double Block::*m1, double Block::*m2, double Block::*m3) {
+  return [m0, m1, m2, m3](const Block &block, double *out) {
+    out[0] = block.*m0;
+    out[1] = block.*m1;
+    out[2] = block.*m2;
+    out[3] = block.*m3;
+    return 4;
+  };
+}
+
+/**
+ * @brief Register a histogram spec. Must be called before fill().
+ * 
+ * @param spec 
+ * @return size_t index of the spec (used to retrieve the filled histograms).
+ */
+size_t HistBuilder::add(const HistSpec &spec) {
+  if (filled) {
+    throw std::runtime_error("HistBuilder: cannot add specs after fill()");
+  }
+  if (!spec.quantity) {
+    throw std::runtime_error(Form("HistBuilder: spec '%s' has no quantity", spec.name.c_str()));
+  }
+  int split_idx = -1;
+  if (spec.split) {
+    auto it = std::find(splits.begin(), splits.end(), spec.split);
+    if (it == splits.end()) {
+      splits.push_back(spec.split);
+      split_idx = splits.size() - 1;
+    } else {
+      split_idx = it - splits.begin();
+    }
+  }
+  specs.push_back(spec);
+  spec_split_idx.push_back(split_idx);
+  stacks.push_back(nullptr);
+  return specs.size() - 1;
+}
+
+/**
+ * @brief Register a count spec. Must be called before fill().
+ * 
+ * @param spec 
+ * @return size_t index of the counter.
+ */
+size_t HistBuilder::add_counter(const CountSpec &spec) {
+  if (filled) {
+    throw std::runtime_error("HistBuilder: cannot add counters after fill()");
+  }
+  counters.push_back(spec);
+  return counters.size() - 1;
+}
+
+/**
+ * @brief Create (detached from gDirectory) one histogram per spec per category.
+ * 
+ * @param partial 
+ * @param suffix appended to histogram names so that partials never share a name.
+ */
+void HistBuilder::book(Partial &partial, const std::string &suffix) const {
+  bool add_directory = TH1::AddDirectoryStatus();
+  TH1::AddDirectory(false);
+  partial.hists.resize(specs.size());
+  for (size_t i = 0; i < specs.size(); i++) {
+    const HistSpec &spec = specs[i];
+    if (spec.split) {
+      for (size_t cat = 0; cat < spec.split->size(); cat++) {
+        partial.hists[i].push_back(new TH1D(Form("h_%s_%zu%s", spec.name.c_str(), cat, suffix.c_str()), "", spec.n_bins, spec.x_min, spec.x_max));
+      }
+    } else {
+      partial.hists[i].push_back(new TH1D(Form("h_%s%s", spec.name.c_str(), suffix.c_str()), spec.title.c_str(), spec.n_bins, spec.x_min, spec.x_max));
+    }
+  }
+  TH1::AddDirectory(add_directory);
+  partial.counts = std::vector<std::map<std::string, int>>(counters.size());
+  partial.n_unmatched = std::vector<long>(specs.size(), 0);
+}
+
+/**
+ * @brief Fill a partial result from blocks [begin, end).
+ */
+void HistBuilder::fill_range(const std::vector<Block> &all_blocks, size_t begin, size_t end, Partial &partial) const {
+  std::vector<int> categories(splits.size());
+  std::string key;
+  double values[4];
+  for (size_t b = begin; b < end; b++) {
+    const Block &block = all_blocks[b];
+    // evaluate each distinct split once per block
+    for (size_t s = 0; s < splits.size(); s++) {
+      categories[s] = -1;
+      const HistSplit &split = *splits[s];
+      for (size_t cat = 0; cat < split.size(); cat++) {
+        if (split[cat].accepts ? split[cat].accepts(block) : is_selected(split_cuts[s][cat], b)) {
+          categories[s] = cat;
+          break;
+        }
+      }
+    }
+    for (size_t i = 0; i < specs.size(); i++) {
+      const HistSpec &spec = specs[i];
+      if (!spec_cuts[i].empty() && !is_selected(spec_cuts[i], b)) {
+        continue;
+      }
+      int cat = 0;
+      if (spec_split_idx[i] >= 0) {
+        cat = categories[spec_split_idx[i]];
+        if (cat < 0) {
+          partial.n_unmatched[i]++;
+          continue;
+        }
+      }
+      TH1D *h = partial.hists[i][cat];
+      int n = spec.quantity(block, values);
+      for (int v = 0; v < n; v++) {
+        if (!spec.is_valid || spec.is_valid(values[v])) {
+          h->Fill(values[v]);
+        }
+      }
+    }
+    for (size_t c = 0; c < counters.size(); c++) {
+      if (counters[c].key(block, key)) {
+        partial.counts[c][key]++;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Evaluate the cut expressions of all specs and split categories over the whole block table (once, column-wise).
+ */
+void HistBuilder::select_cuts(const std::vector<Block> &all_blocks) {
+  BlockTable table;
+  bool has_table = false;
+  auto select = [&](const std::string &cut) {
+    if (!has_table) {
+      table = BlockTable(all_blocks);
+      has_table = true;
+    }
+    return Expr::compile(cut).select(table);
+  };
+  split_cuts.assign(splits.size(), {});
+  for (size_t s = 0; s < splits.size(); s++) {
+    for (const HistCategory &category : *splits[s]) {
+      if (!category.accepts && category.cut.empty()) {
+        throw std::runtime_error(Form("HistBuilder: category '%s' has neither a predicate nor a cut", category.label.c_str()));
+      }
+      split_cuts[s].push_back(category.accepts ? Selection() : select(category.cut));
+    }
+  }
+  spec_cuts.assign(specs.size(), Selection());
+  for (size_t i = 0; i < specs.size(); i++) {
+    if (!specs[i].cut.empty()) {
+      spec_cuts[i] = select(specs[i].cut);
+    }
+  }
+}
+
+/**
+ * @brief Fill every registered spec in a single pass over the blocks. With n_threads > 1, the block table is split into
+ *    contiguous chunks, each filled into its own partial histograms, which are merged at the end.
+ * 
+ * @param all_blocks 
+ * @param n_threads 
+ */
+void HistBuilder::fill(const std::vector<Block> &all_blocks, unsigned int n_threads) {
+  if (filled) {
+    throw std::runtime_error("HistBuilder: fill() may only be called once");
+  }
+  if (n_threads < 1) {
+    throw std::runtime_error("n_threads should be >= 1");
+  }
+  filled = true;
+  select_cuts(all_blocks);
+  book(result, "");
+  if (n_threads == 1 || all_blocks.size() < 2*n_threads) {
+    fill_range(all_blocks, 0, all_blocks.size(), result);
+    return;
+  }
+
+  std::vector<Partial> partials(n_threads);
+  for (unsigned int t = 0; t < n_threads; t++) {
+    book(partials[t], Form("_t%u", t));
+  }
+  std::vector<std::thread> threads;
+  size_t chunk = (all_blocks.size() + n_threads - 1) / n_threads;
+  for (unsigned int t = 0; t < n_threads; t++) {
+    size_t begin = std::min(all_blocks.size(), t*chunk);
+    size_t end = std::min(all_blocks.size(), begin + chunk);
+    threads.emplace_back(&HistBuilder::fill_range, this, std::cref(all_blocks), begin, end, std::ref(partials[t]));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // merge partials in thread order so results do not depend on scheduling
+  for (Partial &partial : partials) {
+    for (size_t i = 0; i < specs.size(); i++) {
+      for (size_t cat = 0; cat < partial.hists[i].size(); cat++) {
+        result.hists[i][cat]->Add(partial.hists[i][cat]);
+        delete partial.hists[i][cat];
+      }
+      result.n_unmatched[i] += partial.n_unmatched[i];
+    }
+    for (size_t c = 0; c < counters.size(); c++) {
+      for (const auto &p : partial.counts[c]) {
+        result.counts[c][p.first] += p.second;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Get a filled histogram.
+ * 
+ * @param spec_idx 
+ * @param category category index within the spec's split (0 for unsplit specs).
+ * @return TH1D* 
+ */
+TH1D *HistBuilder::hist(size_t spec_idx, size_t category) const {
+  if (!filled) {
+    throw std::runtime_error("HistBuilder: hist() called before fill()");
+  }
+  return result.hists.at(spec_idx).at(category);
+}
+
+/**
+ * @brief Get the count map of a counter.
+ */
+const std::map<std::string, int> &HistBuilder::counts(size_t counter_idx) const {
+  if (!filled) {
+    throw std::runtime_error("HistBuilder: counts() called before fill()");
+  }
+  return result.counts.at(counter_idx);
+}
+
+/**
+ * @brief Number of blocks which did not fall into any category of the spec's split.
+ */
+long HistBuilder::n_unmatched(size_t spec_idx) const {
+  return result.n_unmatched.at(spec_idx);
+}
+
+/**
+ * @brief Style (and optionally fit) the category histograms of a split spec and collect them in a THStack.
+ * 
+ * @param spec_idx 
+ * @return THStack* named "hs_<spec name>".
+ */
+THStack *HistBuilder::stack(size_t spec_idx) {
+  if (stacks.at(spec_idx)) {
+    return stacks[spec_idx];
+  }
+  const HistSpec &spec = specs.at(spec_idx);
+  if (!spec.split) {
+    throw std::runtime_error(Form("HistBuilder: spec '%s' has no split to stack", spec.name.c_str()));
+  }
+  THStack *hs = new THStack(Form("hs_%s", spec.name.c_str()), spec.title.c_str());
+  for (size_t cat = 0; cat < spec.split->size(); cat++) {
+    const HistCategory &category = spec.split->at(cat);
+    TH1D *h = hist(spec_idx, cat);
+    if (spec.fit_gaus && h->GetEntries() > 0) {
+      h->Fit("gaus");
+    }
+    h->SetLineColorAlpha(category.color, 1);
+    h->SetLineWidth(1.0);
+    h->SetFillColorAlpha(category.color, 0.3);
+    if (TF1 *f = h->GetFunction("gaus")) {
+      f->SetLineColor(category.color);
+      f->SetLineWidth(2.0);
+      f->SetLineStyle(kDashed);
+    }
+    hs->Add(h);
+  }
+  stacks[spec_idx] = hs;
+  return hs;
+}
+
+/**
+ * @brief Draw a split spec as an unstacked THStack with legend and per-category stats box, and save it.
+ * 
+ * @param spec_idx 
+ * @param layout 
+ * @param ctx plotting context (style, output directory).
+ * @param file_name relative to the context's output directory.
+ */
+void HistBuilder::save_stack(size_t spec_idx, const StackLayout &layout, const PlotContext &ctx, const std::string &file_name) {
+  const HistSpec &spec = specs.at(spec_idx);
+  THStack *hs = stack(spec_idx);
+
+  TLegend *leg = new TLegend(layout.legend_box[0], layout.legend_box[1], layout.legend_box[2], layout.legend_box[3]);
+  for (size_t cat = 0; cat < spec.split->size(); cat++) {
+    leg->AddEntry(hist(spec_idx, cat), spec.split->at(cat).label.c_str(), "f");
+  }
+
+  TCanvas *c = ctx.draw(700, 500, [&](TCanvas *) {
+    hs->Draw("NOSTACKB");
+    leg->Draw();
+    TPaveStats *pt = new TPaveStats(layout.stats_box[0], layout.stats_box[1], layout.stats_box[2], layout.stats_box[3], "NDC");
+    pt->SetTextFont(42);
+    pt->AddText(layout.stats_title.c_str())->SetTextFont(62);
+    for (size_t cat = 0; cat < spec.split->size(); cat++) {
+      TH1D *h = hist(spec_idx, cat);
+      pt->AddText(spec.split->at(cat).label.c_str())->SetTextFont(62);
+      if (TF1 *f = h->GetFunction("gaus")) {
+        pt->AddText(Form("Gaus Mean = %7.3f #pm %5.3f", f->GetParameter(1), f->GetParError(1)));
+      }
+      pt->AddText(Form("Mean = %7.3f", h->GetMean()));
+    }
+    pt->SetFillColorAlpha(0, 0);
+    pt->SetTextAlign(12);
+    pt->SetTextSize(0.02);
+    pt->SetShadowColor(kWhite);
+    pt->Draw();
+  }, file_name);
+  ctx.close(c);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <functional>
+#include <thread>
+#include <stdexcept>
+
+#include <TH1D.h>
+#include <THStack.h>
+#include <TCanvas.h>
+#include <TLegend.h>
+#include <TPaveStats.h>
+#include <TF1.h>
+
+#include "blocks.h"
+#include "expr.h"
+#include "plot_context.h"
+
+/**
+ * @brief One category of a histogram split (e.g., "UIUC S1-12"). A block belongs to the first category whose predicate accepts it.
+ *    The predicate is either a function (accepts) or, if accepts is empty, a cut expression (see expr.h).
+ */
+typedef struct HistCategory {
+  std::string label;
+  Color_t color;
+  std::function<bool(const Block &)> accepts;
+  std::string cut;
+} HistCategory;
+
+/**
+ * @brief An ordered list of categories. Specs sharing a split (by address) have its category evaluated only once per block.
+ */
+typedef std::vector<HistCategory> HistSplit;
+
+/**
+ * @brief Writes up to 4 values of a quantity for a block into the output array (1 for block-level quantities,
+ *    4 for channel/tower-level quantities) and returns how many were written.
+ */
+typedef std::function<int(const Block &, double *)> quantity_getter;
+
+/**
+ * @brief Declarative description of a 1D distribution (optionally split into categories and drawn as a THStack).
+ *    Only blocks passing the optional cut expression (see expr.h) are filled.
+ */
+typedef struct HistSpec {
+  std::string name;
+  std::string title;
+  quantity_getter quantity;
+  std::function<bool(double)> is_valid;
+  int n_bins;
+  double x_min;
+  double x_max;
+  const HistSplit *split;
+  bool fit_gaus;
+  std::string cut;
+} HistSpec;
+
+/**
+ * @brief Counts blocks by a string key (e.g., fiber batch). Blocks for which the key getter returns false are skipped.
+ */
+typedef struct CountSpec {
+  std::string name;
+  std::function<bool(const Block &, std::string &)> key;
+} CountSpec;
+
+/**
+ * @brief Where to put the legend and stats box when drawing a split spec (NDC coordinates x1, y1, x2, y2).
+ */
+typedef struct StackLayout {
+  std::string stats_title;
+  double legend_box[4];
+  double stats_box[4];
+} StackLayout;
+
+/**
+ * @brief Fills all registered histogram and count specs in a single pass over the block table.
+ */
+class HistBuilder {
+  public:
+  size_t add(const HistSpec &spec);
+  size_t add_counter(const CountSpec &spec);
+  void fill(const std::vector<Block> &all_blocks, unsigned int n_threads = 1);
+
+  TH1D *hist(size_t spec_idx, size_t category = 0) const;
+  THStack *stack(size_t spec_idx);
+  const std::map<std::string, int> &counts(size_t counter_idx) const;
+  long n_unmatched(size_t spec_idx) const;
+  void save_stack(size_t spec_idx, const StackLayout &layout, const PlotContext &ctx, const std::string &file_name);
+
+  private:
+  typedef struct Partial {
+    std::vector<std::vector<TH1D*>> hists;
+    std::vector<std::map<std::string, int>> counts;
+    std::vector<long> n_unmatched;
+  } Partial;
+
+  void book(Partial &partial, const std::string &suffix) const;
+  void select_cuts(const std::vector<Block> &all_blocks);
+  void fill_range(const std::vector<Block> &all_blocks, size_t begin, size_t end, Partial &partial) const;
+
+  std::vector<HistSpec> specs;
+  std::vector<CountSpec> counters;
+  std::vector<const HistSplit*> splits;
+  std::vector<int> spec_split_idx;
+  std::vector<std::vector<Selection>> split_cuts; // [split][category], empty if the category has a predicate function
+  std::vector<Selection> spec_cuts; // [spec], empty if the spec has no cut
+  Partial result;
+  std::vector<THStack*> stacks;
+  bool filled = false;
+};
+
+/**
+ * @brief Quantity getter for a single per-block member (e.g., &Block::mpv).
+ */
+quantity_getter block_quantity(double Block::*member);
+
+/**
+ * @brief Quantity getter for the four per-channel/per-tower members of a block (e.g., ch0..ch3 mpv).
+ */
+quantity_getter channel_quantity(double Block::*m0, double Block::*m1, double Block::*m2, double Block::*m3);
+
+#ifndef EMCAL_LIBRARY
+#include "hist_spec.cpp"
+#endif
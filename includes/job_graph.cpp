@@ -0,0 +1,298 @@
+#include "job_graph.h"
+
+/**
+ * @brief
+ *
+ * @param inputs files the outputs of jobs without a fingerprint depend on (e.g. the block database and the plotting sources).
+ * @param fingerprints store of the fingerprints of outputs (updated and saved by run()); null to compare mtimes only.
+ */
+JobGraph::JobGraph(const std::vector<std::string> &inputs, FingerprintStore *fingerprints) : inputs(inputs), fingerprints(fingerprints) {}
+
+/**
+ * @brief Add a job. Dependencies must already be in the graph (so the graph is acyclic by construction).
+ *
+ * @return index of the job
+ */
+size_t JobGraph::add(const GraphJob &job) {
+  for (size_t dep : job.deps) {
+    if (dep >= jobs.size()) {
+      throw std::runtime_error(Form("JobGraph: job '%s' depends on unknown job %zu", job.name.c_str(), dep));
+    }
+  }
+  jobs.push_back(job);
+  results.push_back({JobResult::PENDING, 0, ""});
+  return jobs.size() - 1;
+}
+
+/**
+ * @brief Whether all outputs of a job exist and were made with the job's fingerprint or, without fingerprint, none is
+ *    older than an input (missing inputs count as changed).
+ */
+bool JobGraph::up_to_date(const GraphJob &job) const {
+  if (job.outputs.empty()) {
+    return false;
+  }
+  if (fingerprints && !job.fingerprint.empty()) {
+    for (const std::string &output : job.outputs) {
+      if (!fingerprints->unchanged(output, job.fingerprint)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  struct stat st;
+  time_t newest_input = 0;
+  for (const std::string &input : inputs) {
+    if (stat(input.c_str(), &st) != 0) {
+      return false;
+    }
+    newest_input = std::max(newest_input, st.st_mtime);
+  }
+  for (const std::string &output : job.outputs) {
+    if (stat(output.c_str(), &st) != 0 || st.st_mtime < newest_input) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Run a job in the calling thread, catching exceptions into error.
+ */
+void JobGraph::run_job(size_t job, std::string &error) const {
+  ScopedTimer timer("job", jobs[job].name.c_str());
+  try {
+    jobs[job].run();
+  } catch (const std::exception &e) {
+    error = e.what();
+  } catch (...) {
+    error = "unknown exception";
+  }
+}
+
+/**
+ * @brief Run all jobs which are not up to date, at most n_workers at a time, in dependency order.
+ *
+ * @param n_workers 1 runs every job in the calling thread (no worker threads or processes), so single-worker callers
+ *    need neither batch mode nor ROOT::EnableThreadSafety.
+ * @param executor
+ * @param force run every job regardless of its outputs.
+ */
+void JobGraph::run(unsigned int n_workers, JobExecutor executor, bool force) {
+  typedef std::chrono::steady_clock clock;
+  auto seconds_since = [](clock::time_point start) {
+    return std::chrono::duration<double>(clock::now() - start).count();
+  };
+  clock::time_point graph_start = clock::now();
+  n_workers = std::max(n_workers, 1u);
+  size_t n_jobs = jobs.size();
+
+  // which jobs need to run: stale jobs with outputs, and output-less jobs feeding a job which runs
+  std::vector<bool> needed(n_jobs, false);
+  std::vector<std::vector<size_t>> dependents(n_jobs);
+  for (size_t j = 0; j < n_jobs; j++) {
+    for (size_t dep : jobs[j].deps) {
+      dependents[dep].push_back(j);
+    }
+  }
+  for (size_t j = n_jobs; j-- > 0;) {
+    if (!jobs[j].outputs.empty()) {
+      needed[j] = force || !up_to_date(jobs[j]);
+    } else {
+      for (size_t d : dependents[j]) {
+        needed[j] = needed[j] || needed[d];
+      }
+    }
+  }
+
+  std::vector<size_t> n_waiting(n_jobs, 0);
+  std::deque<size_t> ready;
+  size_t n_finished = 0;
+  for (size_t j = 0; j < n_jobs; j++) {
+    results[j] = {JobResult::PENDING, 0, ""};
+    n_waiting[j] = jobs[j].deps.size();
+  }
+
+  std::vector<clock::time_point> start_times(n_jobs);
+  // finish a job and release (or fail) its dependents
+  std::function<void(size_t, JobResult::Status, const std::string &)> finish = [&](size_t j, JobResult::Status status, const std::string &error) {
+    results[j] = {status, status == JobResult::SKIPPED ? 0 : seconds_since(start_times[j]), error};
+    n_finished++;
+    if (status == JobResult::DONE && fingerprints && !jobs[j].fingerprint.empty()) {
+      for (const std::string &output : jobs[j].outputs) {
+        fingerprints->record(output, jobs[j].fingerprint);
+      }
+    }
+    for (size_t d : dependents[j]) {
+      if (status == JobResult::FAILED) {
+        if (results[d].status == JobResult::PENDING) {
+          start_times[d] = clock::now();
+          finish(d, JobResult::FAILED, "dependency '" + jobs[j].name + "' failed");
+        }
+      } else if (--n_waiting[d] == 0 && results[d].status == JobResult::PENDING) {
+        ready.push_back(d);
+      }
+    }
+  };
+  for (size_t j = 0; j < n_jobs; j++) {
+    if (n_waiting[j] == 0) {
+      ready.push_back(j);
+    }
+  }
+
+  // completions reported by worker threads / child processes
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::pair<size_t, std::string>> completed;
+  // the jobs started, waited for on the way out, also when the loop below throws: a running job uses the locals
+  // above, and a std::thread destroyed while joinable calls std::terminate
+  struct RunningJobs {
+    std::vector<std::thread> threads;
+    std::vector<std::pair<pid_t, size_t>> children;
+    ~RunningJobs() {
+      for (std::thread &thread : threads) {
+        thread.join();
+      }
+      for (const std::pair<pid_t, size_t> &child : children) {
+        while (waitpid(child.first, nullptr, 0) < 0 && errno == EINTR) {
+        }
+      }
+    }
+  } running;
+  std::vector<std::thread> &threads = running.threads;
+  std::vector<std::pair<pid_t, size_t>> &children = running.children;
+  unsigned int n_running = 0;
+
+  while (n_finished < n_jobs) {
+    while (!ready.empty() && n_running < n_workers) {
+      size_t j = ready.front();
+      ready.pop_front();
+      start_times[j] = clock::now();
+      if (!needed[j]) {
+        finish(j, JobResult::SKIPPED, "");
+      } else if (jobs[j].local || n_workers == 1) {
+        std::string error;
+        run_job(j, error);
+        finish(j, error.empty() ? JobResult::DONE : JobResult::FAILED, error);
+      } else if (executor == JobExecutor::THREADS) {
+        n_running++;
+        threads.emplace_back([&, j]() {
+          std::string error;
+          run_job(j, error);
+          std::lock_guard<std::mutex> lock(mutex);
+          completed.push_back({j, error});
+          cv.notify_one();
+        });
+      } else {
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+          finish(j, JobResult::FAILED, "fork failed");
+        } else if (pid == 0) {
+          std::string error;
+          run_job(j, error);
+          if (!error.empty()) {
+            fprintf(stderr, "job '%s' failed: %s\n", jobs[j].name.c_str(), error.c_str());
+          }
+          fflush(stdout);
+          fflush(stderr);
+          _exit(error.empty() ? 0 : 1);
+        } else {
+          n_running++;
+          children.push_back({pid, j});
+        }
+      }
+    }
+    trace_counter("job graph: ready jobs", ready.size());
+    trace_counter("job graph: running jobs", n_running);
+    if (n_running == 0) {
+      if (ready.empty() && n_finished < n_jobs) {
+        throw std::runtime_error("JobGraph: no runnable job left (dependency cycle?)");
+      }
+      continue;
+    }
+    // wait for one running job
+    if (executor == JobExecutor::THREADS) {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&]() { return !completed.empty(); });
+      while (!completed.empty()) {
+        std::pair<size_t, std::string> c = completed.front();
+        completed.pop_front();
+        n_running--;
+        finish(c.first, c.second.empty() ? JobResult::DONE : JobResult::FAILED, c.second);
+      }
+    } else {
+      // only the children of this graph: waitpid(-1) would also reap processes forked by the caller
+      bool reaped = false;
+      while (!reaped) {
+        for (size_t i = 0; i < children.size();) {
+          int status = 0;
+          pid_t pid = waitpid(children[i].first, &status, WNOHANG);
+          int wait_errno = errno;
+          if (pid == 0 || (pid < 0 && wait_errno == EINTR)) {
+            i++;
+            continue;
+          }
+          size_t j = children[i].second;
+          children.erase(children.begin() + i);
+          n_running--;
+          reaped = true;
+          if (pid < 0) {
+            finish(j, JobResult::FAILED, Form("unable to wait for the job's process: %s", strerror(wait_errno)));
+          } else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            finish(j, JobResult::DONE, "");
+          } else if (WIFSIGNALED(status)) {
+            finish(j, JobResult::FAILED, Form("killed by signal %d", WTERMSIG(status)));
+          } else {
+            finish(j, JobResult::FAILED, Form("exit status %d", WEXITSTATUS(status)));
+          }
+        }
+        if (!reaped) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+      }
+    }
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+  total_wall_time = seconds_since(graph_start);
+  if (fingerprints) {
+    fingerprints->save();
+  }
+
+  for (size_t j = 0; j < n_jobs; j++) {
+    if (results[j].status == JobResult::FAILED) {
+      print_report(stderr);
+      throw std::runtime_error(Form("JobGraph: job '%s' failed: %s", jobs[j].name.c_str(), results[j].error.c_str()));
+    }
+  }
+}
+
+/**
+ * @brief Print status and wall time of every job (and why skipped jobs with outputs were skipped), and the summed job
+ *    time vs the elapsed time of the last run().
+ */
+void JobGraph::print_report(FILE *out) const {
+  const char *status_names[] = {"pending", "skipped", "done", "FAILED"};
+  double job_time = 0;
+  size_t n_skipped = 0;
+  size_t n_unchanged = 0;
+  for (size_t j = 0; j < jobs.size(); j++) {
+    const JobResult &r = results[j];
+    fprintf(out, "%-8s %8.3f s  %s", status_names[r.status], r.wall_time, jobs[j].name.c_str());
+    if (!r.error.empty()) {
+      fprintf(out, " (%s)", r.error.c_str());
+    } else if (r.status == JobResult::SKIPPED && !jobs[j].outputs.empty()) {
+      bool by_fingerprint = fingerprints && !jobs[j].fingerprint.empty();
+      fprintf(out, " (%s)", by_fingerprint ? ("unchanged, fingerprint " + jobs[j].fingerprint).c_str() : "up to date");
+      n_unchanged += by_fingerprint;
+    }
+    fprintf(out, "\n");
+    job_time += r.wall_time;
+    n_skipped += r.status == JobResult::SKIPPED;
+  }
+  fprintf(out, "%zu jobs (%zu skipped, %zu with unchanged fingerprint): %.3f s of job time in %.3f s\n", jobs.size(), n_skipped, n_unchanged, job_time, total_wall_time);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdexcept>
+
+#include <TString.h>
+
+#include "fingerprint.h"
+#include "profiler.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @brief One node of a JobGraph: a piece of work which writes zero or more output files once its dependencies are done.
+ */
+typedef struct GraphJob {
+  std::string name;
+  std::vector<std::string> outputs;   // files written by the job (relative to the working directory)
+  std::vector<size_t> deps;           // jobs which must finish first
+  std::function<void()> run;
+  bool local;                         // builds in-memory results for later jobs: always runs in this process, never forked
+  std::string fingerprint;            // hash of everything the outputs are made from (see Fingerprint); "" to compare mtimes
+} GraphJob;
+
+/**
+ * @brief How a JobGraph runs jobs concurrently.
+ */
+enum class JobExecutor {
+  THREADS,    // worker threads of this process (ROOT drawing is serialized by PlotContext's render lock); call
+              // ROOT::EnableThreadSafety and use batch mode when running more than one worker
+  PROCESSES   // one forked process per job (copy-on-write view of the local jobs' results); use with ROOT batch mode
+};
+
+typedef struct JobResult {
+  enum Status {PENDING, SKIPPED, DONE, FAILED} status;
+  double wall_time;                   // seconds from start to finish of the job
+  std::string error;
+} JobResult;
+
+/**
+ * @brief Dependency graph of jobs run on a bounded worker pool. A job is skipped (unless forced) if its outputs all
+ *    exist and either were recorded in the graph's FingerprintStore with the job's fingerprint or, for jobs without a
+ *    fingerprint, are newer than the graph's inputs; a job without outputs runs only if a job depending on it runs.
+ *    Jobs whose dependency failed are not run. run() throws std::runtime_error if any job failed.
+ */
+class JobGraph {
+  public:
+  explicit JobGraph(const std::vector<std::string> &inputs = {}, FingerprintStore *fingerprints = nullptr);
+  size_t add(const GraphJob &job);
+  void run(unsigned int n_workers = 1, JobExecutor executor = JobExecutor::THREADS, bool force = false);
+  const JobResult &result(size_t job) const { return results.at(job); }
+  void print_report(FILE *out = stdout) const;
+
+  private:
+  bool up_to_date(const GraphJob &job) const;
+  void run_job(size_t job, std::string &error) const;
+
+  std::vector<std::string> inputs;
+  FingerprintStore *fingerprints;
+  std::vector<GraphJob> jobs;
+  std::vector<JobResult> results;
+  double total_wall_time = 0;
+};
+
+#ifndef EMCAL_LIBRARY
+#include "job_graph.cpp"
+#endif
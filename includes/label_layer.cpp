@@ -0,0 +1,50 @@
+#include "label_layer.h"
+
+/**
+ * @brief Add a label in the box [x1, x2] x [y1, y2] (user coordinates of the pad it is drawn on).
+ *
+ * @param x1
+ * @param y1
+ * @param x2
+ * @param y2
+ * @param text
+ * @param align TAttText alignment of the text inside the box (e.g. 22 = centred, 32 = right, vertically centred).
+ * @param font TAttText font.
+ * @param size TAttText size (fraction of the pad), or 0 to fit the text to the box height.
+ */
+void LabelLayer::add(double x1, double y1, double x2, double y2, const std::string &text, int align, int font, double size) {
+  labels.push_back({x1, y1, x2, y2, text, (short) align, (short) font, (float) size});
+}
+
+/**
+ * @brief Paint all labels onto the current pad (called by ROOT when the pad is painted).
+ */
+void LabelLayer::Paint(Option_t *) {
+  if (!gPad) {
+    return;
+  }
+  // text sizes of precision 2 fonts are relative to the smaller pad dimension
+  double pad_px = std::min(gPad->GetWw()*gPad->GetAbsWNDC(), gPad->GetWh()*gPad->GetAbsHNDC());
+  if (pad_px <= 0) {
+    return;
+  }
+  const double margin = 0.05; // TPaveText default margin (fraction of the box)
+  TText text;
+  for (const Label &label : labels) {
+    double size = label.size;
+    if (size <= 0) {
+      double box_px = std::abs(gPad->YtoAbsPixel(label.y2) - gPad->YtoAbsPixel(label.y1));
+      size = 0.85*box_px/pad_px;
+    }
+    int h_align = label.align/10;
+    int v_align = label.align % 10;
+    double dx = margin*(label.x2 - label.x1);
+    double dy = margin*(label.y2 - label.y1);
+    double x = h_align == 1 ? label.x1 + dx : (h_align == 3 ? label.x2 - dx : 0.5*(label.x1 + label.x2));
+    double y = v_align == 1 ? label.y1 + dy : (v_align == 3 ? label.y2 - dy : 0.5*(label.y1 + label.y2));
+    text.SetTextAlign(label.align);
+    text.SetTextFont(label.font);
+    text.SetTextSize(size);
+    text.PaintText(x, y, label.text.c_str());
+  }
+}
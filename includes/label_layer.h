@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <Rtypes.h>
+#include <TObject.h>
+#include <TText.h>
+#include <TVirtualPad.h>
+
+/**
+ * @brief Many text labels drawn as a single pad primitive. Replaces one TPaveText per label: the layer is built
+ *    once, can be drawn on any number of canvases, and paints all of its labels with one reusable TText.
+ *
+ * Labels are placed like TPaveText(x1, y1, x2, y2, "NB") with one line of text (transparent box, no border): align
+ * picks the anchor inside the box, and a size of 0 scales the text to the box height as TPaveText does.
+ *
+ * NOTE: drawing does not transfer ownership (kCanDelete is not set), so a layer may be shared between canvases but
+ *    must outlive them. Set kCanDelete to hand a layer to a single canvas.
+ */
+class LabelLayer : public TObject {
+  public:
+  typedef struct Label {
+    double x1;
+    double y1;
+    double x2;
+    double y2;
+    std::string text;
+    short align;
+    short font;
+    float size;
+  } Label;
+
+  void add(double x1, double y1, double x2, double y2, const std::string &text, int align = 22, int font = 42, double size = 0);
+  size_t size() const { return labels.size(); }
+  const std::vector<Label> &get_labels() const { return labels; }
+  void clear() { labels.clear(); }
+  void Paint(Option_t *option = "") override;
+
+  private:
+  std::vector<Label> labels;
+
+  ClassDefOverride(LabelLayer, 0)   // not written to files: version 0
+};
+
+#ifndef EMCAL_LIBRARY
+#include "label_layer.cpp"
+#endif
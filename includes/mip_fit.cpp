@@ -0,0 +1,474 @@
+#include "mip_fit.h"
+
+/**
+ * @brief Landau convolved with a Gaussian, as in ROOT's langaus tutorial: the convolution integral is summed over
+ *    +- 5 sigma of the Gaussian in 100 steps, and the Landau location is shifted so that parameter 1 is the most
+ *    probable value of the Landau (see MIP_FIT_N_PARAMS).
+ */
+double langaus_function(double x, const double *par) {
+  const double inv_sqrt_2pi = 0.3989422804014;
+  const double mp_shift = -0.22278298;    // location of the maximum of TMath::Landau(x, 0, 1)
+  const int n_steps = 100;
+  const double n_sigmas = 5;
+  double width = par[0];
+  double sigma = par[3];
+  if (!(width > 0) || !(sigma > 0)) {
+    return 0;
+  }
+  double location = par[1] - mp_shift*width;
+  double low = x - n_sigmas*sigma;
+  double high = x + n_sigmas*sigma;
+  double step = (high - low)/n_steps;
+  double sum = 0;
+  for (int i = 1; i <= n_steps/2; i++) {
+    double xx = low + (i - 0.5)*step;
+    sum += TMath::Landau(xx, location, width)*TMath::Gaus(x, xx, sigma);
+    xx = high - (i - 0.5)*step;
+    sum += TMath::Landau(xx, location, width)*TMath::Gaus(x, xx, sigma);
+  }
+  return par[2]*step*sum*inv_sqrt_2pi/(width*sigma);
+}
+
+/**
+ * @brief Starting values and range of a channel's fit, from the shape of its spectrum.
+ */
+typedef struct MipSeed {
+  double peak;      // ADC, centre of the highest 5 bin average above fit_min
+  double left;      // ADC, half maximum points around it
+  double right;
+  double params[MIP_FIT_N_PARAMS];
+  double low;       // ADC, fit range
+  double high;
+} MipSeed;
+
+/**
+ * @brief Seed the fit of a spectrum from the peak of its 5 bin running average above config.fit_min (robust against
+ *    single bin fluctuations) and the half maximum points around it: the full width at half maximum is shared equally
+ *    between the Landau (FWHM 4.02 widths) and the Gaussian (FWHM 2.35 sigmas), and the fit range is scaled from the
+ *    distances of the half maximum points to the peak.
+ *
+ * @return false if the spectrum has too few entries above fit_min or too few filled bins around the peak to fit.
+ */
+static bool seed_mip(const TH1 *h, const MipFitConfig &config, MipSeed &seed) {
+  const int n_bins = h->GetNbinsX();
+  int first = 1;
+  while (first <= n_bins && h->GetBinCenter(first) < config.fit_min) {
+    first++;
+  }
+  if (n_bins - first < 2*MIP_FIT_N_PARAMS) {
+    return false;
+  }
+  double entries = 0;
+  std::vector<double> average(n_bins + 2, 0);
+  for (int bin = first; bin <= n_bins; bin++) {
+    entries += h->GetBinContent(bin);
+    int begin = std::max(first, bin - 2);
+    int end = std::min(n_bins, bin + 2);
+    for (int b = begin; b <= end; b++) {
+      average[bin] += h->GetBinContent(b);
+    }
+    average[bin] /= end - begin + 1;
+  }
+  if (entries < config.min_entries) {
+    return false;
+  }
+  int max_bin = first;
+  for (int bin = first; bin <= n_bins; bin++) {
+    if (average[bin] > average[max_bin]) {
+      max_bin = bin;
+    }
+  }
+  double half = 0.5*average[max_bin];
+  double bin_width = h->GetBinWidth(max_bin);
+  int bin = max_bin;
+  while (bin > first && average[bin - 1] > half) {
+    bin--;
+  }
+  seed.left = h->GetBinCenter(bin);
+  if (bin > first) {
+    seed.left -= bin_width*(average[bin] - half)/(average[bin] - average[bin - 1]);
+  }
+  bin = max_bin;
+  while (bin < n_bins && average[bin + 1] > half) {
+    bin++;
+  }
+  seed.right = h->GetBinCenter(bin);
+  if (bin < n_bins) {
+    seed.right += bin_width*(average[bin] - half)/(average[bin] - average[bin + 1]);
+  }
+  seed.peak = h->GetBinCenter(max_bin);
+  seed.left = std::min(seed.left, seed.peak - 0.5*bin_width);
+  seed.right = std::max(seed.right, seed.peak + 0.5*bin_width);
+  double fwhm = seed.right - seed.left;
+
+  double axis_low = h->GetBinLowEdge(first);
+  double axis_high = h->GetBinLowEdge(n_bins) + h->GetBinWidth(n_bins);
+  seed.low = std::max(axis_low, seed.peak - config.range_low*(seed.peak - seed.left));
+  seed.high = std::min(axis_high, seed.peak + config.range_high*(seed.right - seed.peak));
+  double area = 0;
+  int n_filled = 0;
+  for (int b = first; b <= n_bins; b++) {
+    double x = h->GetBinCenter(b);
+    if (x >= seed.low && x <= seed.high && h->GetBinContent(b) > 0) {
+      area += h->GetBinContent(b)*h->GetBinWidth(b);
+      n_filled++;
+    }
+  }
+  if (n_filled <= MIP_FIT_N_PARAMS) {
+    return false;
+  }
+  seed.params[0] = fwhm/(4.02*std::sqrt(2.0));
+  seed.params[1] = seed.peak;
+  seed.params[2] = area;
+  seed.params[3] = fwhm/(2.35*std::sqrt(2.0));
+  return true;
+}
+
+/**
+ * @brief One chi2 fit of langaus_function to the filled bins of the seed's range (errors sqrt(content)), with Minuit2,
+ *    which unlike Minuit keeps no global state.
+ *
+ * @param fix_sigma keep the Gaussian sigma at its seed.
+ * @return true if the fit converged to a valid minimum.
+ */
+static bool run_mip_fit(const TH1 *h, const MipSeed &seed, bool fix_sigma, ROOT::Fit::Fitter &fitter) {
+  ROOT::Fit::BinData data(h->GetNbinsX(), 1);
+  for (int bin = 1; bin <= h->GetNbinsX(); bin++) {
+    double x = h->GetBinCenter(bin);
+    double y = h->GetBinContent(bin);
+    if (x >= seed.low && x <= seed.high && y > 0) {
+      data.Add(x, y, std::sqrt(y));
+    }
+  }
+  LandauGauss model;
+  model.SetParameters(seed.params);
+  double fwhm = seed.right - seed.left;
+  fitter.Config().SetMinimizer("Minuit2", "Migrad");
+  fitter.SetFunction(model, false);
+  fitter.Config().ParSettings(0).SetLimits(0.02*fwhm, fwhm);
+  fitter.Config().ParSettings(1).SetLimits(seed.left, seed.right);
+  fitter.Config().ParSettings(2).SetLimits(0.1*seed.params[2], 10*seed.params[2]);
+  fitter.Config().ParSettings(3).SetLimits(0.02*fwhm, fwhm);
+  if (fix_sigma) {
+    fitter.Config().ParSettings(3).Fix();
+  }
+  return fitter.Fit(data) && fitter.Result().IsValid();
+}
+
+/**
+ * @brief Maximum of langaus_function by golden section search around the Landau MPV.
+ */
+static double langaus_peak(const double *par) {
+  const double ratio = 0.5*(std::sqrt(5.0) - 1);
+  double a = par[1] - 2*(par[0] + par[3]);
+  double b = par[1] + 2*(par[0] + par[3]);
+  double c = b - ratio*(b - a);
+  double d = a + ratio*(b - a);
+  double fc = langaus_function(c, par);
+  double fd = langaus_function(d, par);
+  for (int i = 0; i < 60 && b - a > 1e-4*std::max(1.0, std::abs(par[1])); i++) {
+    if (fc > fd) {
+      b = d;
+      d = c;
+      fd = fc;
+      c = b - ratio*(b - a);
+      fc = langaus_function(c, par);
+    } else {
+      a = c;
+      c = d;
+      fc = fd;
+      d = a + ratio*(b - a);
+      fd = langaus_function(d, par);
+    }
+  }
+  return 0.5*(a + b);
+}
+
+/**
+ * @brief Fit the MIP peak of a channel's ADC spectrum (h_alladc_<channel>) with langaus_function, seeded by the shape
+ *    of the spectrum (see seed_mip). A fit that does not converge is repeated once with the Gaussian sigma fixed at
+ *    its seed, as the sigma and the Landau width trade off on narrow or sparse peaks. The histogram is only read, so
+ *    fits of different channels run in parallel. The result depends only on the spectrum and config.
+ *
+ * @param h_adc
+ * @param channel stored in the result.
+ * @param config
+ * @return MipFit status -1 (nothing else set) if the spectrum could not be seeded.
+ */
+MipFit fit_mip(const TH1 *h_adc, int channel, const MipFitConfig &config) {
+  ScopedTimer timer("mip fit: channel");
+  timer.arg("channel", channel);
+  FitClock clock;
+  MipFit fit = {channel, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {channel, "", -1, NAN, 0, -1, -1, 0, 0, 0, FitSeed::SPECTRUM}};
+  MipSeed seed;
+  if (!h_adc || !seed_mip(h_adc, config, seed)) {
+    return fit;
+  }
+  double seed_time = clock.wall_time();
+  ROOT::Fit::Fitter fitter;
+  clock.restart();
+  fit.attempts = 1;
+  bool valid = run_mip_fit(h_adc, seed, false, fitter);
+  if (!valid) {
+    clock.restart();
+    fit.attempts = 2;
+    valid = run_mip_fit(h_adc, seed, true, fitter);   // SetFunction resets the parameter settings
+  }
+  const ROOT::Fit::FitResult &result = fitter.Result();
+  double params[MIP_FIT_N_PARAMS];
+  for (int i = 0; i < MIP_FIT_N_PARAMS; i++) {
+    params[i] = result.Parameter(i);
+  }
+  fit.status = valid ? 0 : std::max(1, result.Status());
+  fit.mpv = params[1];
+  fit.mpv_err = result.ParError(1);
+  fit.peak = langaus_peak(params);
+  fit.width = params[0];
+  fit.sigma = params[3];
+  fit.area = params[2];
+  fit.chi2 = result.Chi2();
+  fit.ndf = result.Ndf();
+  fit.fit_low = seed.low;
+  fit.fit_high = seed.high;
+  fit.telemetry = fit_telemetry(channel, fitter, clock, FitSeed::SPECTRUM, seed_time);
+  return fit;
+}
+
+/**
+ * @brief Fit the MIP peak of every channel (see fit_mip), config.n_threads channels at a time. Each thread takes the
+ *    next unfitted channel, so slow fits do not hold up a fixed share of the channels; the results are stored by
+ *    channel, so they do not depend on the number of threads or on scheduling.
+ *
+ * @param adc_hists [channel] -> h_alladc_<channel>; a null histogram is not fitted.
+ * @param config
+ * @return std::vector<MipFit> [channel]
+ */
+std::vector<MipFit> fit_mip_spectra(const std::vector<TH1D*> &adc_hists, const MipFitConfig &config) {
+  unsigned int n_threads = config.n_threads > 0 ? config.n_threads : std::max(1u, std::thread::hardware_concurrency());
+  n_threads = std::max<size_t>(1, std::min<size_t>(n_threads, adc_hists.size()));
+  ScopedTimer timer("mip fit: spectra");
+  timer.arg("threads", n_threads);
+  if (n_threads > 1) {
+    ROOT::EnableThreadSafety();
+  }
+  std::vector<MipFit> fits(adc_hists.size());
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t ch = next++; ch < adc_hists.size(); ch = next++) {
+      fits[ch] = fit_mip(adc_hists[ch], ch, config);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < n_threads; t++) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return fits;
+}
+
+/**
+ * @brief The converged fits in the layout of h_allchannels (bin channel + 1: Landau MPV, error), for
+ *    read_run_chnl_mpv and the other readers of the QA output. Channels without a converged fit get 0 +- 0.
+ *
+ * @param fits of fit_mip_spectra.
+ * @return TH1D* h_allchannels, detached, owned by the caller.
+ */
+TH1D *mip_fit_hist(const std::vector<MipFit> &fits) {
+  TH1D *mpvs = new TH1D("h_allchannels", "h_allchannels", fits.size(), -0.5, fits.size() - 0.5);
+  mpvs->SetDirectory(nullptr);
+  for (size_t ch = 0; ch < fits.size(); ch++) {
+    if (fits[ch].status == 0) {
+      mpvs->SetBinContent(ch + 1, fits[ch].mpv);
+      mpvs->SetBinError(ch + 1, fits[ch].mpv_err);
+    }
+  }
+  return mpvs;
+}
+
+void write_mip_fits_csv(const std::vector<MipFit> &fits, const std::string &file_name) {
+  FILE *file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", file_name.c_str()));
+  }
+  fprintf(file, "channel, status, attempts, mpv, mpv_err, peak, width, sigma, area, chi2, ndf, fit_low, fit_high\n");
+  for (const MipFit &fit : fits) {
+    fprintf(file, "%d, %d, %d, %f, %f, %f, %f, %f, %f, %f, %d, %f, %f\n", fit.channel, fit.status, fit.attempts, fit.mpv,
+            fit.mpv_err, fit.peak, fit.width, fit.sigma, fit.area, fit.chi2, fit.ndf, fit.fit_low, fit.fit_high);
+  }
+  fclose(file);
+}
+
+/**
+ * @brief Compare the converged local fits to the upstream MPVs of the same run, channel by channel. Channels without a
+ *    converged fit or without an upstream MPV (<= 0) are left out of the statistics.
+ *
+ * @param run
+ * @param fits of fit_mip_spectra.
+ * @param upstream_mpv [channel] -> MPV of the upstream h_allchannels (see read_run_chnl_mpv).
+ * @param upstream_err
+ * @param pull_cut channels with a larger |pull| are listed as outliers.
+ * @return MipDiff
+ */
+MipDiff diff_mip_fits(int run, const std::vector<MipFit> &fits, const std::vector<double> &upstream_mpv, const std::vector<double> &upstream_err, double pull_cut) {
+  MipDiff diff;
+  diff.run = run;
+  diff.pull_cut = pull_cut;
+  diff.upstream_mpv.assign(fits.size(), 0);
+  diff.upstream_err.assign(fits.size(), 0);
+  diff.diff.assign(fits.size(), NAN);
+  diff.pull.assign(fits.size(), NAN);
+  for (size_t ch = 0; ch < fits.size(); ch++) {
+    if (ch < upstream_mpv.size() && upstream_mpv[ch] > 0) {
+      diff.upstream_mpv[ch] = upstream_mpv[ch];
+      diff.upstream_err[ch] = ch < upstream_err.size() ? upstream_err[ch] : 0;
+    }
+    if (fits[ch].status != 0 || diff.upstream_mpv[ch] <= 0) {
+      continue;
+    }
+    diff.diff[ch] = fits[ch].mpv - diff.upstream_mpv[ch];
+    diff.diff_stats.add(diff.diff[ch]);
+    diff.ratio_stats.add(fits[ch].mpv/diff.upstream_mpv[ch]);
+    double err = std::sqrt(fits[ch].mpv_err*fits[ch].mpv_err + diff.upstream_err[ch]*diff.upstream_err[ch]);
+    if (err > 0) {
+      diff.pull[ch] = diff.diff[ch]/err;
+      diff.pull_stats.add(diff.pull[ch]);
+      if (std::abs(diff.pull[ch]) > pull_cut) {
+        diff.outliers.push_back(ch);
+      }
+    }
+  }
+  std::sort(diff.outliers.begin(), diff.outliers.end(), [&](int a, int b) {
+    return std::abs(diff.pull[a]) > std::abs(diff.pull[b]);
+  });
+  return diff;
+}
+
+void write_mip_diff_csv(const std::vector<MipFit> &fits, const MipDiff &diff, const std::string &file_name) {
+  FILE *file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", file_name.c_str()));
+  }
+  fprintf(file, "channel, status, mpv, mpv_err, upstream_mpv, upstream_mpv_err, diff, ratio, pull\n");
+  for (size_t ch = 0; ch < fits.size(); ch++) {
+    double ratio = std::isnan(diff.diff[ch]) ? NAN : fits[ch].mpv/diff.upstream_mpv[ch];
+    fprintf(file, "%d, %d, %f, %f, %f, %f, %f, %f, %f\n", fits[ch].channel, fits[ch].status, fits[ch].mpv,
+            fits[ch].mpv_err, diff.upstream_mpv[ch], diff.upstream_err[ch], diff.diff[ch], ratio, diff.pull[ch]);
+  }
+  fclose(file);
+}
+
+/**
+ * @brief Print the statistics of a diff_mip_fits and its n_outliers largest pulls.
+ */
+void print_mip_diff(const MipDiff &diff, size_t n_outliers, FILE *out) {
+  fprintf(out, "run %d vs upstream h_allchannels: %ld channels, diff mean %.2f sigma %.2f median %.2f ADC, "
+          "ratio mean %.4f median %.4f, pull mean %.2f sigma %.2f, %zu with |pull| > %g\n", diff.run,
+          diff.diff_stats.count(), diff.diff_stats.mean(), diff.diff_stats.std_dev(), diff.diff_stats.median(),
+          diff.ratio_stats.mean(), diff.ratio_stats.median(), diff.pull_stats.mean(), diff.pull_stats.std_dev(),
+          diff.outliers.size(), diff.pull_cut);
+  for (size_t i = 0; i < std::min(n_outliers, diff.outliers.size()); i++) {
+    int ch = diff.outliers[i];
+    fprintf(out, "  channel %3d: diff %8.2f ADC, upstream %8.2f +- %.2f, pull %6.1f\n", ch, diff.diff[ch],
+            diff.upstream_mpv[ch], diff.upstream_err[ch], diff.pull[ch]);
+  }
+}
+
+/**
+ * @brief Refit the MIP peaks of a run from the h_alladc_<channel> of "<runs_dir>/qa_output_000<run>/histograms.root"
+ *    (see fit_mip_spectra) and write into "<out_dir>/qa_output_000<run>/":
+ *    - mip_fits.root: h_allchannels of the fits (see mip_fit_hist), read by get_chnl_mpv_with_err("mip_fits.root");
+ *    - mip_fits.csv: every parameter of every channel (write_mip_fits_csv);
+ *    - mip_fit_telemetry.csv: cost and convergence of every fit (write_fit_telemetry_csv);
+ *    - mip_diff.csv: the channel-wise difference to the upstream h_allchannels of the run file, if it has one
+ *      (write_mip_diff_csv), whose summary is printed.
+ *    mip_fits.root is written to a temporary file and renamed. Throws std::runtime_error on failure.
+ *
+ * @param run
+ * @param runs_dir with the qa_output_000<run> folders, e.g. "physics_runs".
+ * @param out_dir e.g. runs_dir.
+ * @param config
+ * @return MipRunResult
+ */
+MipRunResult fit_run_mips(int run, const std::string &runs_dir, const std::string &out_dir, const MipFitConfig &config) {
+  ScopedTimer timer("mip fit: run");
+  timer.arg("run", run);
+  std::string folder = run_folder_name(run);
+  std::string in_name = runs_dir + "/" + folder + "/histograms.root";
+  ScopedTimer read_timer("mip fit: read h_alladc_*");
+  TFile *hist_file = TFile::Open(in_name.c_str());
+  if (!hist_file || hist_file->IsZombie()) {
+    delete hist_file;
+    throw std::runtime_error(Form("unable to open '%s'", in_name.c_str()));
+  }
+  std::vector<TH1D*> hists(SECTOR_CHANNELS, nullptr);
+  for (int ch = 0; ch < SECTOR_CHANNELS; ch++) {
+    hist_file->GetObject(Form("h_alladc_%d", ch), hists[ch]);
+    if (hists[ch]) {
+      hists[ch]->SetDirectory(nullptr);
+    }
+  }
+  TH1D *h_upstream = nullptr;
+  hist_file->GetObject("h_allchannels;1", h_upstream);
+  std::vector<double> upstream_mpv, upstream_err;
+  for (int ch = 0; h_upstream && ch < SECTOR_CHANNELS; ch++) {
+    upstream_mpv.push_back(h_upstream->GetBinContent(ch + 1));
+    upstream_err.push_back(h_upstream->GetBinError(ch + 1));
+  }
+  hist_file->Close();
+  delete hist_file;
+  read_timer.stop();
+
+  MipRunResult result = {run, 0, 0, 0, !upstream_mpv.empty(), 0, ""};
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<MipFit> fits = fit_mip_spectra(hists, config);
+  result.fit_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for (TH1D *h : hists) {
+    delete h;
+  }
+  std::vector<FitTelemetry> telemetry;
+  for (const MipFit &fit : fits) {
+    if (fit.status < 0) {
+      result.n_skipped++;
+      continue;
+    }
+    telemetry.push_back(fit.telemetry);
+    if (fit.status == 0) {
+      result.n_fitted++;
+    } else {
+      result.n_failed++;
+    }
+  }
+
+  ScopedTimer write_timer("mip fit: write");
+  std::string run_dir = out_dir + "/" + folder;
+  make_directory(out_dir);
+  make_directory(run_dir);
+  result.output = run_dir + "/mip_fits.root";
+  std::string tmp_name = result.output + ".tmp";
+  TH1D *mpvs = mip_fit_hist(fits);
+  TFile *outfile = TFile::Open(tmp_name.c_str(), "RECREATE");
+  bool ok = outfile && !outfile->IsZombie() && outfile->WriteTObject(mpvs, mpvs->GetName()) > 0;
+  if (outfile) {
+    outfile->Close();
+  }
+  delete outfile;
+  delete mpvs;
+  if (!ok || rename(tmp_name.c_str(), result.output.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("unable to write '%s'", result.output.c_str()));
+  }
+  write_mip_fits_csv(fits, run_dir + "/mip_fits.csv");
+  write_fit_telemetry_csv(telemetry, run_dir + "/mip_fit_telemetry.csv");
+  write_timer.stop();
+
+  printf("run %d: %zu channels fitted, %zu not converged, %zu skipped in %.2f s -> %s\n", run, result.n_fitted,
+         result.n_failed, result.n_skipped, result.fit_time, result.output.c_str());
+  if (result.has_upstream) {
+    MipDiff diff = diff_mip_fits(run, fits, upstream_mpv, upstream_err);
+    write_mip_diff_csv(fits, diff, run_dir + "/mip_diff.csv");
+    print_mip_diff(diff);
+  }
+  return result;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TFile.h>
+#include <TH1D.h>
+#include <TMath.h>
+#include <TString.h>
+#include <Fit/Fitter.h>
+#include <Fit/BinData.h>
+#include <Math/IParamFunction.h>
+
+#include "run_fetch.h"
+#include "run_compare.h"
+#include "profiler.h"
+#include "fit_telemetry.h"
+#include "stats.h"
+
+/**
+ * @brief Parameters of langaus_function: a Landau convolved with a Gaussian (the MIP peak of a channel's spectrum).
+ *    0: landau width (scale), 1: landau mpv, 2: area (integral over all x, counts x bin width), 3: gauss sigma.
+ */
+const int MIP_FIT_N_PARAMS = 4;
+
+double langaus_function(double x, const double *par);
+
+/**
+ * @brief langaus_function as the model of a ROOT::Fit::Fitter. Each fit owns its copy (no TF1, no global state), so
+ *    fits run in parallel.
+ */
+class LandauGauss : public ROOT::Math::IParamFunction {
+  public:
+  void SetParameters(const double *p) { std::copy(p, p + MIP_FIT_N_PARAMS, params); }
+  const double *Parameters() const { return params; }
+  ROOT::Math::IGenFunction *Clone() const {
+    LandauGauss *f = new LandauGauss();
+    f->SetParameters(params);
+    return f;
+  }
+  unsigned int NPar() const { return MIP_FIT_N_PARAMS; }
+
+  private:
+  double DoEvalPar(double x, const double *p) const { return langaus_function(x, p); }
+
+  double params[MIP_FIT_N_PARAMS] = {};
+};
+
+/**
+ * @brief Fit range, seeding and parallelism of the MIP fits. The defaults suit h_alladc_<channel> of the QA output.
+ */
+typedef struct MipFitConfig {
+  double fit_min = 50;            // ADC; the pedestal and single pixel peaks lie below it
+  double min_entries = 100;       // in [fit_min, end of the axis]; emptier channels are not fitted
+  double range_low = 2;           // fit from the peak - range_low x (peak - left half maximum point)
+  double range_high = 3;          // to the peak + range_high x (right half maximum point - peak)
+  unsigned int n_threads = 0;     // 0: one per core
+} MipFitConfig;
+
+/**
+ * @brief Result of fit_mip for one channel.
+ */
+typedef struct MipFit {
+  int channel;
+  int status;                     // of the final fit (0 = converged); -1: not fitted (too few entries or no peak)
+  int attempts;                   // fits made: 2 if the first did not converge and was refit with the sigma fixed
+  double mpv;                     // landau mpv (parameter 1): the value of h_allchannels
+  double mpv_err;
+  double peak;                    // maximum of the fitted Landau x Gauss
+  double width;
+  double sigma;
+  double area;
+  double chi2;
+  int ndf;
+  double fit_low;                 // ADC, range of the final fit
+  double fit_high;
+  FitTelemetry telemetry;         // of the final fit
+} MipFit;
+
+/**
+ * @brief Channel-wise difference of local MIP fits to the upstream h_allchannels of the same run.
+ */
+typedef struct MipDiff {
+  int run;
+  std::vector<double> upstream_mpv;   // 0 where upstream has no value
+  std::vector<double> upstream_err;
+  std::vector<double> diff;           // local - upstream; NaN where either is missing
+  std::vector<double> pull;           // diff / sqrt(local err^2 + upstream err^2); NaN without errors
+  RunningStats diff_stats;
+  RunningStats ratio_stats;           // local / upstream
+  RunningStats pull_stats;
+  double pull_cut;
+  std::vector<int> outliers;          // channels with |pull| > pull_cut, by decreasing |pull|
+} MipDiff;
+
+/**
+ * @brief Files and counts of fit_run_mips.
+ */
+typedef struct MipRunResult {
+  int run;
+  size_t n_fitted;                // channels with a converged fit
+  size_t n_failed;                // fitted without converging
+  size_t n_skipped;               // too few entries or no peak
+  bool has_upstream;              // the run file has an h_allchannels (mip_diff.csv written)
+  double fit_time;                // s, wall time of the fits
+  std::string output;             // mip_fits.root written
+} MipRunResult;
+
+MipFit fit_mip(const TH1 *h_adc, int channel, const MipFitConfig &config);
+std::vector<MipFit> fit_mip_spectra(const std::vector<TH1D*> &adc_hists, const MipFitConfig &config);
+TH1D *mip_fit_hist(const std::vector<MipFit> &fits);
+void write_mip_fits_csv(const std::vector<MipFit> &fits, const std::string &file_name);
+MipDiff diff_mip_fits(int run, const std::vector<MipFit> &fits, const std::vector<double> &upstream_mpv, const std::vector<double> &upstream_err, double pull_cut = 3);
+void write_mip_diff_csv(const std::vector<MipFit> &fits, const MipDiff &diff, const std::string &file_name);
+void print_mip_diff(const MipDiff &diff, size_t n_outliers = 10, FILE *out = stdout);
+MipRunResult fit_run_mips(int run, const std::string &runs_dir, const std::string &out_dir, const MipFitConfig &config);
+
+#ifndef EMCAL_LIBRARY
+#include "mip_fit.cpp"
+#endif
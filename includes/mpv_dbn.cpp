@@ -11,15 +11,6 @@ constexpr char PRINT_GREEN[] = "\x1b[1;32m";
 constexpr char PRINT_BLUE[] = "\x1b[1;34m";
 constexpr char PRINT_END[] = "\x1b[0m";
 
-/**
- * @brief The lower nonphysical threshold for block MPV. MPVs <= this value will be saved as -1.
- */
-constexpr double MPV_CUTOFF_LOW = 0.0;
-/**
- * @brief The upper nonphysical threshold for block MPV. MPVs >= this value will be saved as -1.
- */
-constexpr double MPV_CUTOFF_HIGH = 1000.0;
-
 /**
  * @brief Get the channel numbers associated with a block.
  * 
@@ -59,7 +50,7 @@ int channel_to_block(int channel) {
  * @param drop_low_rap_edge whether to count low rapidity edge as part of the perimeter.
  * @return std::set<int> set of channel numbers (0-based) which are on the perimeter of a sector. 
  */
-std::set<int> perimeter_channels(bool drop_low_rap_edge = true) {
+std::set<int> perimeter_channels(bool drop_low_rap_edge) {
   std::set<int> perimeter;
   std::vector<std::vector<int>> channels(48);
   for (auto &vec : channels) {
@@ -147,46 +138,26 @@ std::map<int, int> read_physics_runs() {
 }
 
 /**
- * @brief Copy Tim's run folders that don't exist locally.
+ * @brief Fetch the histograms of the runs in files/physics_runs.csv which are not local yet (see RunFetcher), printing a
+ *    report. Throws std::runtime_error if any run failed (after fetching all others).
+ * 
+ * NOTE: must be run on SDCC (unless source_dir is a local copy).
  * 
- * NOTE: must be run on SDCC.
+ * @param n_workers number of runs copied at a time.
+ * @param source_dir directory with Tim's qa_output_000<run> folders.
  */
-void get_physics_runs() {
-  std::map<int, int> sector_runs = read_physics_runs();
-  for (int sector = 1; sector <= 64; sector++) {
-    int run = sector_runs[sector];
-    if (run > 0) {
-      // check if local folder exists
-      char *local_folder_name = Form("physics_runs/qa_output_000%05d", run);
-      if (opendir(local_folder_name)) {
-        // folder exists locally!
-        continue;
-      } else if (errno == ENOENT) {
-        // folder does not exist locally
-        char *server_folder_name = Form("/gpfs/mnt/gpfs02/sphenix/user/trinn/sPHENIX_emcal_cosmics_sector0/macros/qa_output_000%05d/", run);
-        // check if server folder exists!
-        if (opendir(server_folder_name)) {
-          // it worked!
-        } else if (errno == ENOENT) {
-          throw std::runtime_error(Form("%s does not exist!", server_folder_name));
-        } else {
-          throw std::runtime_error(Form("opendir failed"));
-        }
-        system(Form("cp -r %s physics_runs", server_folder_name));
-        // check if it worked...
-        if (opendir(local_folder_name)) {
-          // it worked!
-          printf("got new physics fun for sector %2d\n", sector);
-          continue;
-        } else if (errno == ENOENT) {
-          throw std::runtime_error(Form("failed to cp %s -> physics_runs", server_folder_name));
-        } else {
-          throw std::runtime_error(Form("opendir failed"));
-        }
-      } else {
-        throw std::runtime_error(Form("opendir failed"));
-      }
-    } // else we don't have the info OR it's in sector_data already
+void get_physics_runs(unsigned int n_workers, const std::string &source_dir) {
+  std::vector<int> runs;
+  for (std::pair<int, int> p : read_physics_runs()) {
+    if (p.second > 0) {
+      runs.push_back(p.second);
+    }
+  }
+  RunFetcher fetcher(source_dir, "physics_runs");
+  fetcher.fetch(runs, n_workers);
+  fetcher.print_report();
+  if (fetcher.n_failed() > 0) {
+    throw std::runtime_error(Form("failed to fetch %zu of %zu runs", fetcher.n_failed(), runs.size()));
   }
 }
 
@@ -279,12 +250,54 @@ std::vector<std::vector<std::string>> get_dbns() {
   return dbns;
 }
 
+/**
+ * @brief Read the channel MPVs and errors of one run from h_allchannels.
+ * 
+ * @param run_num 
+ * @param chnl_mpv [channel number] -> mpv, filled on success.
+ * @param chnl_mpv_err [channel number] -> mpv error, filled on success.
+ * @param file_name in physics_runs/qa_output_000<run>: the QA output, or "mip_fits.root" for the MPVs of fit_run_mips.
+ * @return true if the run file and histogram were found.
+ */
+bool read_run_chnl_mpv(int run_num, std::vector<double> &chnl_mpv, std::vector<double> &chnl_mpv_err, const std::string &file_name) {
+  ScopedTimer open_timer("read: open run file");
+  TFile *hist_file = TFile::Open(Form("physics_runs/qa_output_000%i/%s", run_num, file_name.c_str()));
+  open_timer.stop();
+  if (!hist_file) {
+    printf("FAILED to find run file: qa_output_000%i/%s\n", run_num, file_name.c_str());
+    return false;
+  }
+  if (debug) {
+    printf("found run file: physics_runs/qa_output_000%i/%s\n", run_num, file_name.c_str());
+  }
+  TH1D* data = nullptr;
+  ScopedTimer read_timer("read: h_allchannels");
+  hist_file->GetObject("h_allchannels;1", data);
+  read_timer.stop();
+  if (!data) {
+    std::cerr << "  unable to get histogram" << std::endl;
+  } else {
+    chnl_mpv.resize(384);
+    chnl_mpv_err.resize(384);
+    for (int chnl = 0; chnl < 384; chnl++) {
+      chnl_mpv[chnl] = data->GetBinContent(chnl + 1);
+      chnl_mpv_err[chnl] = data->GetBinError(chnl + 1);
+    }
+  }
+  ScopedTimer close_timer("read: close run file");
+  hist_file->Close();
+  delete hist_file;
+  return data != nullptr;
+}
+
 /**
  * @brief Get MPVs for each channel for each sector from h_allchannels.
  * 
+ * @param file_name of each run, see read_run_chnl_mpv.
  * @return std::vector<std::vector<double>> [sector][channel number] -> mpv 
  */
-std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> get_chnl_mpv_with_err() {
+std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> get_chnl_mpv_with_err(const std::string &file_name) {
+  ScopedTimer timer("read: get_chnl_mpv_with_err");
   std::vector<std::vector<double>> chnl_mpv(64);
   std::vector<std::vector<double>> chnl_mpv_err(64);
   for (auto &vec : chnl_mpv) {
@@ -294,34 +307,13 @@ std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> ge
     vec = std::vector<double>(384, -1.0);
   }
 
-  TFile *hist_file;
-  char filename[64];
   std::map<int, int> physics_runs = read_physics_runs();
   for (std::pair<int, int> p : physics_runs) {
     int sector = p.first;
     int run_num = p.second;
     if (run_num > 0) {
       // get data from the run number
-      sprintf(filename, "physics_runs/qa_output_000%i/histograms.root ", run_num);
-      if ((hist_file = TFile::Open(filename))) {
-        if (debug) {
-          printf("found run file for sector %i: physics_runs/qa_output_000%i/histograms.root\n", sector, run_num);
-        }
-        TH1D* data;
-        hist_file->GetObject("h_allchannels;1", data);
-        if (!data) {
-          std::cerr << "  unable to get histogram" << std::endl;
-          continue;       
-        }
-        for (int chnl = 0; chnl < 384; chnl++) {
-          double this_err = data->GetBinError(chnl + 1);
-          double this_mpv = data->GetBinContent(chnl + 1);
-          chnl_mpv[sector - 1][chnl] = this_mpv;
-          chnl_mpv_err[sector - 1][chnl] = this_err;
-        }
-      } else {
-        printf("FAILED to find run file for sector %i: qa_output_000%i/histograms.root\n", sector, run_num);
-      }
+      read_run_chnl_mpv(run_num, chnl_mpv[sector - 1], chnl_mpv_err[sector - 1], file_name);
     }
   }
   return std::make_pair(chnl_mpv, chnl_mpv_err);
@@ -361,81 +353,126 @@ std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> ca
   return std::make_pair(block_mpvs, block_mpv_errs);
 }
 
+/**
+ * @brief Set the MPV columns of blocks (as read by read_block_database) from channel MPVs, like write_map_to_file writes
+ *    them: -1 (an empty cell) for blocks without MPV and for channels not contributing to their block's MPV.
+ * 
+ * @param all_blocks blocks to update.
+ * @param chnl_mpv_and_err see get_chnl_mpv_with_err.
+ * @param perimeter see perimeter_channels.
+ * @param sector only update the blocks of this (1-based) sector; -1 for all.
+ */
+void set_block_mpvs(std::vector<Block> &all_blocks, const std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> &chnl_mpv_and_err, const std::set<int> &perimeter, int sector) {
+  auto block_mpv_and_err = calculate_block_mpv_with_err(chnl_mpv_and_err, perimeter);
+  double Block::*chnl_mpv_fields[4] = {&Block::ch0_mpv, &Block::ch1_mpv, &Block::ch2_mpv, &Block::ch3_mpv};
+  double Block::*chnl_mpv_err_fields[4] = {&Block::ch0_mpv_err, &Block::ch1_mpv_err, &Block::ch2_mpv_err, &Block::ch3_mpv_err};
+  for (Block &block : all_blocks) {
+    if (sector > 0 && (int) block.sector != sector) {
+      continue;
+    }
+    int sector_num = block.sector - 1;
+    int block_num = block.block_number - 1;
+    double mpv = block_mpv_and_err.first[sector_num][block_num];
+    block.mpv = mpv > 0 ? mpv : -1;
+    block.mpv_err = mpv > 0 ? block_mpv_and_err.second[sector_num][block_num] : -1;
+    std::vector<int> all_chnls = block_to_channel(block_num);
+    for (int i = 0; i < 4; i++) {
+      bool contributes = mpv > 0 && perimeter.find(all_chnls[i]) == perimeter.end();
+      block.*chnl_mpv_fields[i] = contributes ? chnl_mpv_and_err.first[sector_num][all_chnls[i]] : -1;
+      block.*chnl_mpv_err_fields[i] = contributes ? chnl_mpv_and_err.second[sector_num][all_chnls[i]] : -1;
+    }
+  }
+}
+
+/**
+ * @brief Read the single pixel gaps of one run's blocks (average of h_sp_perchnl over the block's four towers).
+ * 
+ * @param run_num 
+ * @param sector 1-based sector of the run (for messages).
+ * @param sp_gaps [block number] -> gap, filled on success.
+ * @return true if the run file and histogram were found.
+ */
+bool read_run_sp_gaps(int run_num, int sector, std::vector<double> &sp_gaps) {
+  ScopedTimer open_timer("read: open run file");
+  TFile *hist_file = TFile::Open(Form("physics_runs/qa_output_000%i/histograms.root", run_num));
+  open_timer.stop();
+  if (!hist_file) {
+    printf("FAILED to find run file for sector %i: qa_output_000%i/histograms.root\n", sector, run_num);
+    return false;
+  }
+  if (debug) {
+    printf("found run file for sector %i: physics_runs/qa_output_000%i/histograms.root\n", sector, run_num);
+  }
+  TH1D* data = nullptr;
+  ScopedTimer read_timer("read: h_sp_perchnl");
+  hist_file->GetObject("h_sp_perchnl;1", data);
+  read_timer.stop();
+  if (!data) {
+    std::cerr << "  unable to get sp histogram" << std::endl;
+  } else {
+    sp_gaps.resize(96);
+    for (int block_num = 0; block_num < 96; block_num++) {
+      double avg_sp_gap = 0;
+      for (int &chnl : block_to_channel(block_num)) {
+        double content = data->GetBinContent(chnl + 1);
+        if (content <= 0) {
+          printf("complaint at sector %i channel %i: sp_gap <= 0 (%f)\n", sector, chnl, content);
+        }
+        avg_sp_gap += content;
+      }
+      sp_gaps[block_num] = avg_sp_gap/4;
+      // printf("sector %2d block %2d: sp gap = %f\n", sector, block_num + 1, sp_gaps[block_num]);
+    }
+  }
+  ScopedTimer close_timer("read: close run file");
+  hist_file->Close();
+  delete hist_file;
+  return data != nullptr;
+}
+
+/**
+ * @brief Write IB mean and sigma of single pixel gaps to csv files.
+ * 
+ * @param sp_gaps [sector][block number] -> gap (see get_sp_gaps).
+ * @param physics_runs sector -> run (see read_physics_runs).
+ */
+void write_sp_gap_ib(const std::vector<std::vector<double>> &sp_gaps, const std::map<int, int> &physics_runs) {
+  HierarchicalStats stats;
+  for (short sector = 0; sector < 64; sector++) {
+    for (short block = 0; block < 96; block++) {
+      double content = sp_gaps[sector][block];
+      if (content > 0) {
+        stats.add_block(sector, block, content);
+      }
+    }
+  }
+  write_ib_summary(stats, physics_runs, "files/sp_gap_avg_ib_mean.csv", "files/sp_gap_avg_ib_sigma.csv");
+}
+
 /**
  * @brief Get single pixel gaps for each block for each sector (average of block's four towers).
  * 
  * @param write_ib write IB mean and sigma to csv file.
  * @return std::vector<std::vector<double>> [sector][block number] -> gap.
  */
-std::vector<std::vector<double>> get_sp_gaps(bool write_ib = false) {
+std::vector<std::vector<double>> get_sp_gaps(bool write_ib) {
+  ScopedTimer timer("read: get_sp_gaps");
   std::vector<std::vector<double>> sp_gaps(64);
   for (auto &vec : sp_gaps) {
     vec = std::vector<double>(96, -1.0);
   }
 
-  TFile *hist_file;
-  char filename[64];
   std::map<int, int> physics_runs = read_physics_runs();
   for (std::pair<int, int> p : physics_runs) {
     int sector = p.first;
     int run_num = p.second;
     if (run_num > 0) {
       // get data from the run number
-      sprintf(filename, "physics_runs/qa_output_000%i/histograms.root", run_num);
-      if ((hist_file = TFile::Open(filename))) {
-        if (debug) {
-          printf("found run file for sector %i: physics_runs/qa_output_000%i/histograms.root\n", sector, run_num);
-        }
-        TH1D* data;
-        hist_file->GetObject("h_sp_perchnl;1", data);
-        if (!data) {
-          std::cerr << "  unable to get sp histogram" << std::endl;
-          continue;       
-        }
-        for (int block_num = 0; block_num < 96; block_num++) {
-          double avg_sp_gap = 0;
-          for (int &chnl : block_to_channel(block_num)) {
-            double content = data->GetBinContent(chnl + 1);
-            if (content <= 0) {
-              printf("complaint at sector %i channel %i: sp_gap <= 0 (%f)\n", sector, chnl, content);
-            }
-            avg_sp_gap += content;
-          }
-          sp_gaps[sector - 1][block_num] = avg_sp_gap/4;
-          // printf("sector %2d block %2d: sp gap = %f\n", sector, block_num + 1, sp_gaps[sector - 1][block_num]);
-        }
-      } else {
-        printf("FAILED to find run file for sector %i: qa_output_000%i/histograms.root\n", sector, run_num);
-      }
+      read_run_sp_gaps(run_num, sector, sp_gaps[sector - 1]);
     }
   }
   if (write_ib) {
-    FILE *mean_outfile = fopen("files/sp_gap_avg_ib_mean.csv", "w+");
-    FILE *sigma_outfile = fopen("files/sp_gap_avg_ib_sigma.csv", "w+");
-    fprintf(mean_outfile, "SECTOR, RUN, IB0, IB1, IB2, IB3, IB4, IB5");
-    fprintf(sigma_outfile, "SECTOR, RUN, IB0, IB1, IB2, IB3, IB4, IB5");
-    for (short sector = 0; sector < 64; sector++) {
-      fprintf(mean_outfile, "\n%i, %i", sector + 1, physics_runs[sector + 1]);
-      fprintf(sigma_outfile, "\n%i, %i", sector + 1, physics_runs[sector + 1]);
-      for (short ib = 0; ib < 6; ib++) {
-        std::vector<double> entries;
-        for (short block = 0; block < 16; block++) {
-          double content = sp_gaps[sector][ib*16 + block];
-          if (content > 0) {
-            entries.push_back(content);
-          }
-        }
-        if (entries.size() > 0) {
-          fprintf(mean_outfile, ", %f", TMath::Mean(entries.begin(), entries.end()));
-          fprintf(sigma_outfile, ", %f", TMath::StdDev(entries.begin(), entries.end()));
-        } else {
-          fprintf(mean_outfile, ", ");
-          fprintf(sigma_outfile, ", ");
-        }
-      }
-    }
-    fclose(mean_outfile);
-    fclose(sigma_outfile);
+    write_sp_gap_ib(sp_gaps, physics_runs);
   }
 
   return sp_gaps;
@@ -448,16 +485,26 @@ std::vector<std::vector<double>> get_sp_gaps(bool write_ib = false) {
  *    or keep it (FALSE, default behavior of h_allblocks).
  */
 void write_map_to_file(bool drop_low_rap_edge) {
-  FILE *outfile = fopen("files/dbn_mpv.csv", "w+");
-  fprintf(outfile, "sector, block, dbn, mpv, mpv_err, ch0_mpv, ch0_mpv_err, ch1_mpv, ch1_mpv_err, ch2_mpv, ch2_mpv_err, ch3_mpv, ch3_mpv_err");
-  auto dbns = get_dbns();
   // auto mpvs = get_mpvs();
   // auto mpv_errs = get_mpv_errs(mpvs);
+  write_map_to_file(drop_low_rap_edge, get_dbns(), get_chnl_mpv_with_err());
+}
+
+/**
+ * @brief Write "database" to file as csv from DBNs and channel MPVs already read.
+ * 
+ * @param drop_low_rap_edge see write_map_to_file(bool).
+ * @param dbns see get_dbns.
+ * @param chnl_mpv_and_err see get_chnl_mpv_with_err.
+ */
+void write_map_to_file(bool drop_low_rap_edge, const std::vector<std::vector<std::string>> &dbns, const std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> &chnl_mpv_and_err) {
+  ScopedTimer timer("write: files/dbn_mpv.csv");
+  FILE *outfile = fopen("files/dbn_mpv.csv", "w+");
+  fprintf(outfile, "sector, block, dbn, mpv, mpv_err, ch0_mpv, ch0_mpv_err, ch1_mpv, ch1_mpv_err, ch2_mpv, ch2_mpv_err, ch3_mpv, ch3_mpv_err");
   std::set<int> perimeter = perimeter_channels(drop_low_rap_edge);
-  auto chnl_mpv_and_err = get_chnl_mpv_with_err();
   auto block_mpv_and_err = calculate_block_mpv_with_err(chnl_mpv_and_err, perimeter);
-  auto chnl_mpvs = chnl_mpv_and_err.first;
-  auto chnl_mpv_errs = chnl_mpv_and_err.second;
+  const auto &chnl_mpvs = chnl_mpv_and_err.first;
+  const auto &chnl_mpv_errs = chnl_mpv_and_err.second;
   auto block_mpvs = block_mpv_and_err.first;
   auto block_mpv_errs = block_mpv_and_err.second;
   for (int sector = 0; sector < 64; sector++) {
@@ -502,4 +549,122 @@ void write_map_to_file(bool drop_low_rap_edge) {
     }
   }
   fclose(outfile);
+}
+
+/**
+ * @brief Write the binary per-tower calibration table (see calib_table.h): correction = reference_mpv / tower MPV, with
+ *    the error propagated from the MPV fit error. Towers without a usable MPV get correction 1 and a status flag.
+ *    The table is written to a temporary file and renamed, so readers never see a partial table.
+ * 
+ * @param file_name e.g., "files/emcal_calib.bin".
+ * @param drop_low_rap_edge whether to drop low rapidity edge like all other edges (only affects the CALIB_PERIMETER flag).
+ * @param reference_mpv target MPV; <= 0 uses the mean MPV of all good towers.
+ */
+void write_calib_table(const std::string &file_name, bool drop_low_rap_edge, double reference_mpv) {
+  auto dbns = get_dbns();
+  std::set<int> perimeter = perimeter_channels(drop_low_rap_edge);
+  auto chnl_mpv_and_err = get_chnl_mpv_with_err();
+  const std::vector<std::vector<double>> &chnl_mpvs = chnl_mpv_and_err.first;
+  const std::vector<std::vector<double>> &chnl_mpv_errs = chnl_mpv_and_err.second;
+
+  std::vector<TowerCalib> records(CALIB_N_TOWERS);
+  RunningStats good_mpv;
+  for (uint32_t sector = 0; sector < CALIB_SECTORS; sector++) {
+    for (uint32_t chnl = 0; chnl < CALIB_CHANNELS_PER_SECTOR; chnl++) {
+      TowerCalib &record = records[calib_tower_id(sector, chnl)];
+      double mpv = chnl_mpvs[sector][chnl];
+      record.mpv = mpv;
+      record.status = CALIB_OK;
+      // exclusive (see CalibStatus): with MPV_CUTOFF_LOW = 0 only MPVs >= MPV_CUTOFF_HIGH are out of range
+      if (mpv <= 0) {
+        record.status |= CALIB_NO_DATA;
+      } else if (mpv <= MPV_CUTOFF_LOW || mpv >= MPV_CUTOFF_HIGH) {
+        record.status |= CALIB_OUT_OF_RANGE;
+      } else {
+        good_mpv.add(mpv);
+      }
+      if (perimeter.find(chnl) != perimeter.end()) {
+        record.status |= CALIB_PERIMETER;
+      }
+      if (dbns[sector][channel_to_block(chnl)] == "") {
+        record.status |= CALIB_NO_DBN;
+      }
+    }
+  }
+  if (reference_mpv <= 0) {
+    if (good_mpv.count() == 0) {
+      throw std::runtime_error("no tower has a usable MPV, unable to choose a reference MPV");
+    }
+    reference_mpv = good_mpv.mean();
+  }
+  for (uint32_t sector = 0; sector < CALIB_SECTORS; sector++) {
+    for (uint32_t chnl = 0; chnl < CALIB_CHANNELS_PER_SECTOR; chnl++) {
+      TowerCalib &record = records[calib_tower_id(sector, chnl)];
+      if (record.status & CALIB_BAD) {
+        record.correction = 1;
+        record.correction_err = 0;
+      } else {
+        double mpv = chnl_mpvs[sector][chnl];
+        double correction = reference_mpv/mpv;
+        record.correction = correction;
+        record.correction_err = correction*chnl_mpv_errs[sector][chnl]/mpv;
+      }
+    }
+  }
+
+  CalibHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CALIB_MAGIC, sizeof(CALIB_MAGIC));
+  header.version = CALIB_VERSION;
+  header.header_size = sizeof(CalibHeader);
+  header.record_size = sizeof(TowerCalib);
+  header.n_towers = CALIB_N_TOWERS;
+  header.reference_mpv = reference_mpv;
+  header.created = time(nullptr);
+  header.checksum = calib_checksum(header, records.data(), records.size());
+
+  std::string tmp_name = file_name + ".tmp";
+  FILE *outfile = fopen(tmp_name.c_str(), "wb");
+  if (!outfile) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", tmp_name.c_str()));
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, outfile) == 1 && fwrite(records.data(), sizeof(TowerCalib), records.size(), outfile) == records.size();
+  ok = (fclose(outfile) == 0) && ok;
+  if (!ok || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("failed to write calibration table '%s'", file_name.c_str()));
+  }
+  printf("wrote %u towers (%ld with a usable MPV, reference MPV %f) to %s\n", CALIB_N_TOWERS, good_mpv.count(), reference_mpv, file_name.c_str());
+}
+
+/**
+ * @brief Write IB mean and sigma of block MPV to csv files. Blocks with nonphysical MPV (see MPV_CUTOFF_LOW/HIGH) are skipped.
+ * 
+ * @param drop_low_rap_edge whether to drop low rapidity edge like all other edges when calculating block mpv.
+ */
+void write_mpv_ib(bool drop_low_rap_edge) {
+  write_mpv_ib(drop_low_rap_edge, get_chnl_mpv_with_err(), read_physics_runs());
+}
+
+/**
+ * @brief Write IB mean and sigma of block MPV to csv files from channel MPVs already read.
+ * 
+ * @param drop_low_rap_edge see write_mpv_ib(bool).
+ * @param chnl_mpv_and_err see get_chnl_mpv_with_err.
+ * @param physics_runs sector -> run (see read_physics_runs).
+ */
+void write_mpv_ib(bool drop_low_rap_edge, const std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> &chnl_mpv_and_err, const std::map<int, int> &physics_runs) {
+  std::set<int> perimeter = perimeter_channels(drop_low_rap_edge);
+  auto block_mpv_and_err = calculate_block_mpv_with_err(chnl_mpv_and_err, perimeter);
+  const std::vector<std::vector<double>> &block_mpvs = block_mpv_and_err.first;
+  HierarchicalStats stats;
+  for (short sector = 0; sector < 64; sector++) {
+    for (short block = 0; block < 96; block++) {
+      double mpv = block_mpvs[sector][block];
+      if (mpv > MPV_CUTOFF_LOW && mpv < MPV_CUTOFF_HIGH) {
+        stats.add_block(sector, block, mpv);
+      }
+    }
+  }
+  write_ib_summary(stats, physics_runs, "files/mpv_avg_ib_mean.csv", "files/mpv_avg_ib_sigma.csv");
 }
\ No newline at end of file
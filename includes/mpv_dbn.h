@@ -7,22 +7,49 @@
 #include <map>
 #include <set>
 #include <string>
+#include <ctime>
 //#include <filesystem>
 #include <stdexcept>
 
-#include <dirent.h>
-
 #include <TSystem.h>
 #include <TH1D.h>
 #include <TFile.h>
 
-std::set<int> perimeter_channels(bool drop_low_rap_edge);
+#include "blocks.h"
+#include "profiler.h"
+#include "run_fetch.h"
+
+/**
+ * @brief The lower nonphysical threshold for block MPV. MPVs <= this value will be saved as -1.
+ */
+constexpr double MPV_CUTOFF_LOW = 0.0;
+/**
+ * @brief The upper nonphysical threshold for block MPV. MPVs >= this value will be saved as -1.
+ */
+constexpr double MPV_CUTOFF_HIGH = 1000.0;
+
+std::vector<int> block_to_channel(int block_num);
+int channel_to_block(int channel);
+std::set<int> perimeter_channels(bool drop_low_rap_edge = true);
 std::map<int, int> read_physics_runs();
-void get_physics_runs();
+void get_physics_runs(unsigned int n_workers = 8, const std::string &source_dir = PHYSICS_RUNS_SOURCE);
 std::vector<std::vector<std::string>> get_dbns();
-std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> get_chnl_mpv_with_err();
+bool read_run_chnl_mpv(int run_num, std::vector<double> &chnl_mpv, std::vector<double> &chnl_mpv_err, const std::string &file_name = "histograms.root");
+std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> get_chnl_mpv_with_err(const std::string &file_name = "histograms.root");
 std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> calculate_block_mpv_with_err(const std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> &chnl_mpv_with_err, const std::set<int> &perimeter);
-std::vector<std::vector<double>> get_sp_gaps(bool write_ib);
+void set_block_mpvs(std::vector<Block> &all_blocks, const std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> &chnl_mpv_and_err, const std::set<int> &perimeter, int sector = -1);
+bool read_run_sp_gaps(int run_num, int sector, std::vector<double> &sp_gaps);
+void write_sp_gap_ib(const std::vector<std::vector<double>> &sp_gaps, const std::map<int, int> &physics_runs);
+std::vector<std::vector<double>> get_sp_gaps(bool write_ib = false);
 void write_map_to_file(bool drop_low_rap_edge);
+void write_map_to_file(bool drop_low_rap_edge, const std::vector<std::vector<std::string>> &dbns, const std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> &chnl_mpv_and_err);
+void write_mpv_ib(bool drop_low_rap_edge);
+void write_mpv_ib(bool drop_low_rap_edge, const std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> &chnl_mpv_and_err, const std::map<int, int> &physics_runs);
+void write_calib_table(const std::string &file_name, bool drop_low_rap_edge = true, double reference_mpv = -1);
+
+#include "stats.h"
+#include "calib_table.h"
 
-#include "mpv_dbn.cpp"
\ No newline at end of file
+#ifndef EMCAL_LIBRARY
+#include "mpv_dbn.cpp"
+#endif
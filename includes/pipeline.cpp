@@ -0,0 +1,169 @@
+#include "pipeline.h"
+
+/**
+ * @brief Fingerprint of the product; throws std::runtime_error if the stage making it has not run yet (e.g. the product
+ *    was read by a stage which does not list it as an input).
+ */
+const Fingerprint &ProductBase::fingerprint() const {
+  if (!ready) {
+    throw std::runtime_error(Form("product '%s' used before it was made (missing stage input?)", name.c_str()));
+  }
+  return fp;
+}
+
+/**
+ * @brief
+ *
+ * @param cache_dir directory of the cached products and the fingerprints (created if needed).
+ */
+Pipeline::Pipeline(const std::string &cache_dir) : cache_dir(cache_dir), fingerprints(cache_dir + "/.fingerprints") {
+  make_directory(cache_dir);
+}
+
+size_t Pipeline::add_job(const std::string &name, const std::vector<std::string> &outputs, const std::vector<ProductBase*> &inputs, const std::function<void()> &run) {
+  std::vector<size_t> deps;
+  for (ProductBase *input : inputs) {
+    if (!input->added) {
+      throw std::runtime_error(Form("stage '%s': input '%s' is not made by a stage of the pipeline", name.c_str(), input->name.c_str()));
+    }
+    deps.push_back(input->stage);
+  }
+  names.push_back(name);
+  notes.push_back("");
+  return graph.add({name, outputs, deps, run, false, ""});
+}
+
+/**
+ * @brief Fingerprint of a stage: its name, configuration and the fingerprints of its inputs (in order).
+ */
+Fingerprint Pipeline::input_fingerprint(const std::string &name, const std::vector<ProductBase*> &inputs, const Fingerprint &config) const {
+  Fingerprint fp;
+  fp.add(name).add(config);
+  for (const ProductBase *input : inputs) {
+    fp.add(input->fingerprint());
+  }
+  return fp;
+}
+
+bool Pipeline::unchanged(const std::vector<std::string> &outputs, const Fingerprint &fp) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (force) {
+    return false;
+  }
+  for (const std::string &output : outputs) {
+    if (!fingerprints.unchanged(output, fp.hex())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Pipeline::record(const std::vector<std::string> &outputs, const Fingerprint &fp) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const std::string &output : outputs) {
+    fingerprints.record(output, fp.hex());
+  }
+}
+
+void Pipeline::note(size_t stage, const std::string &what) {
+  std::lock_guard<std::mutex> lock(mutex);
+  notes[stage] = what;
+}
+
+/**
+ * @brief Add a stage writing files from inputs, unless the files were written from the same fingerprint.
+ *
+ * @param name
+ * @param outputs files written; none for stages with other effects (e.g. plot_blocks, which writes many files and keeps
+ *    its own fingerprints): a stamp file in the cache directory stands for them.
+ * @param inputs see stage.
+ * @param config see stage.
+ * @param write
+ * @return stage index.
+ */
+size_t Pipeline::sink(const std::string &name, const std::vector<std::string> &outputs, const std::vector<ProductBase*> &inputs, const Fingerprint &config, const std::function<void()> &write) {
+  std::vector<std::string> files = outputs;
+  if (files.empty()) {
+    std::string stamp = name;
+    std::replace(stamp.begin(), stamp.end(), ' ', '_');
+    std::replace(stamp.begin(), stamp.end(), '/', '_');
+    files.push_back(cache_path(stamp + ".stamp"));
+  }
+  size_t index = names.size();
+  return add_job(name, files, inputs, [this, files, outputs, inputs, config, write, name, index]() {
+    Fingerprint fp = input_fingerprint(name, inputs, config);
+    if (unchanged(files, fp)) {
+      note(index, "unchanged, fingerprint " + fp.hex());
+      return;
+    }
+    write();
+    if (outputs.empty()) {
+      FILE *stamp = fopen(files[0].c_str(), "w");
+      if (!stamp) {
+        throw std::runtime_error(Form("unable to write '%s'", files[0].c_str()));
+      }
+      fprintf(stamp, "%s\n", fp.hex().c_str());
+      fclose(stamp);
+    }
+    record(files, fp);
+    note(index, "written");
+  });
+}
+
+/**
+ * @brief Content digest of an input file (cached by size and mtime in the fingerprints), e.g. of the code of a stage.
+ */
+std::string Pipeline::file_digest(const std::string &file_name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return fingerprints.file_digest(file_name);
+}
+
+/**
+ * @brief Run every stage (at most n_workers at a time), and save the fingerprints, also if a stage failed. Throws
+ *    std::runtime_error (see JobGraph::run) if a stage failed; stages not depending on it still run.
+ *
+ * @param n_workers 1 runs the stages in the calling thread; more run them on threads, with ROOT's thread safety on.
+ * @param force make every product and write every sink, regardless of fingerprints.
+ */
+void Pipeline::run(unsigned int n_workers, bool force) {
+  typedef std::chrono::steady_clock clock;
+  clock::time_point start = clock::now();
+  this->force = force;
+  if (n_workers > 1) {
+    ROOT::EnableThreadSafety();
+  }
+  try {
+    // every stage runs (stages decide themselves by fingerprint what to make)
+    graph.run(n_workers, JobExecutor::THREADS, true);
+  } catch (...) {
+    total_wall_time = std::chrono::duration<double>(clock::now() - start).count();
+    fingerprints.save();
+    throw;
+  }
+  total_wall_time = std::chrono::duration<double>(clock::now() - start).count();
+  fingerprints.save();
+}
+
+/**
+ * @brief Print status, wall time and what every stage did in the last run(), and the summed stage time vs the elapsed
+ *    time (their ratio is the overlap of the stages).
+ */
+void Pipeline::print_report(FILE *out) const {
+  const char *status_names[] = {"pending", "skipped", "done", "FAILED"};
+  std::lock_guard<std::mutex> lock(mutex);
+  double stage_time = 0;
+  size_t n_failed = 0;
+  for (size_t j = 0; j < names.size(); j++) {
+    const JobResult &r = graph.result(j);
+    fprintf(out, "%-8s %8.3f s  %s", status_names[r.status], r.wall_time, names[j].c_str());
+    if (!r.error.empty()) {
+      fprintf(out, " (%s)", r.error.c_str());
+    } else if (!notes[j].empty()) {
+      fprintf(out, " (%s)", notes[j].c_str());
+    }
+    fprintf(out, "\n");
+    stage_time += r.wall_time;
+    n_failed += r.status == JobResult::FAILED;
+  }
+  fprintf(out, "%zu stages (%zu failed): %.3f s of stage time in %.3f s\n", names.size(), n_failed, stage_time, total_wall_time);
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+#include <TROOT.h>
+#include <TString.h>
+
+#include "fingerprint.h"
+#include "job_graph.h"
+#include "run_fetch.h"
+
+/**
+ * @brief What every Product has, whatever its type: the stage making it and the fingerprint of what it was made from.
+ */
+class ProductBase {
+  public:
+  explicit ProductBase(const std::string &name, const std::string &cache_file = "") : name(name), cache_file(cache_file) {}
+  virtual ~ProductBase() {}
+  ProductBase(const ProductBase &) = delete;
+  ProductBase &operator=(const ProductBase &) = delete;
+
+  const std::string &get_name() const { return name; }
+  const std::string &get_cache_file() const { return cache_file; }
+  const Fingerprint &fingerprint() const;
+
+  protected:
+  friend class Pipeline;
+
+  std::string name;
+  std::string cache_file;         // where the value is cached between runs; "" for values only kept in memory
+  Fingerprint fp;
+  size_t stage = 0;               // job of the Pipeline's JobGraph making the product
+  bool added = false;             // made by a stage of a Pipeline
+  std::atomic<bool> ready{false}; // fingerprint known (value made, cached or made on demand)
+};
+
+/**
+ * @brief Typed output of a Pipeline stage. Stages running in the same process pass the value in memory; a cached
+ *    product whose fingerprint is unchanged is read from its cache file only if a later stage needs its value, and an
+ *    uncached product of a stage (see Pipeline::stage) is made on demand, by the first stage calling get().
+ *
+ * @tparam T value type (default constructible).
+ */
+template <typename T>
+class Product : public ProductBase {
+  public:
+  typedef std::function<void(const std::string &file_name, const T &value)> saver;
+  typedef std::function<T(const std::string &file_name)> loader;
+
+  explicit Product(const std::string &name, const std::string &cache_file = "", saver save = nullptr, loader load = nullptr);
+  const T &get();
+
+  private:
+  friend class Pipeline;
+  void set(T new_value);
+
+  saver save;
+  loader load;
+  std::function<T()> make_on_demand;
+  std::mutex mutex;
+  bool has_value = false;
+  T value;
+};
+
+/**
+ * @brief Stages with typed inputs and outputs (Products) run as a JobGraph: a stage starts as soon as the stages making
+ *    its inputs are done, and independent stages run concurrently. The fingerprint of a product is that of its inputs
+ *    and the stage configuration (sources fingerprint their value), so a stage whose cached product or sink outputs
+ *    were made from the same fingerprint is not run again. Fingerprints are kept in cache_dir/.fingerprints.
+ *
+ * NOTE: with one worker, stages run in the calling thread; with more, run() enables ROOT's thread safety before
+ *    starting the worker threads. Batch mode is left to the caller.
+ */
+class Pipeline {
+  public:
+  explicit Pipeline(const std::string &cache_dir = ".pipeline");
+
+  template <typename T>
+  size_t source(const std::string &name, Product<T> &out, const std::function<T()> &make, const std::function<Fingerprint(const T &value)> &fingerprint_of);
+  template <typename T>
+  size_t stage(const std::string &name, Product<T> &out, const std::vector<ProductBase*> &inputs, const Fingerprint &config, const std::function<T()> &make);
+  size_t sink(const std::string &name, const std::vector<std::string> &outputs, const std::vector<ProductBase*> &inputs, const Fingerprint &config, const std::function<void()> &write);
+
+  std::string file_digest(const std::string &file_name);
+  std::string cache_path(const std::string &file_name) const { return cache_dir + "/" + file_name; }
+  void run(unsigned int n_workers = 1, bool force = false);
+  void print_report(FILE *out = stdout) const;
+
+  private:
+  size_t add_job(const std::string &name, const std::vector<std::string> &outputs, const std::vector<ProductBase*> &inputs, const std::function<void()> &run);
+  Fingerprint input_fingerprint(const std::string &name, const std::vector<ProductBase*> &inputs, const Fingerprint &config) const;
+  bool unchanged(const std::vector<std::string> &outputs, const Fingerprint &fp);
+  void record(const std::vector<std::string> &outputs, const Fingerprint &fp);
+  void note(size_t stage, const std::string &what);
+
+  std::string cache_dir;
+  FingerprintStore fingerprints;
+  JobGraph graph;
+  std::vector<std::string> names;
+  std::vector<std::string> notes;     // what each stage did (e.g. "cached", "unchanged", "made on demand in 0.1 s")
+  mutable std::mutex mutex;           // guards fingerprints and notes
+  bool force = false;
+  double total_wall_time = 0;
+};
+
+/**
+ * @brief
+ *
+ * @param name e.g. "fit sector 12".
+ * @param cache_file file the value is cached in (with save and load), e.g. pipeline.cache_path("sector_12.txt"); "" to
+ *    keep the value in memory only.
+ * @param save writes the value to a file.
+ * @param load reads a value written by save.
+ */
+template <typename T>
+Product<T>::Product(const std::string &name, const std::string &cache_file, saver save, loader load)
+  : ProductBase(name, cache_file), save(save), load(load) {
+  if (!cache_file.empty() && (!save || !load)) {
+    throw std::runtime_error(Form("product '%s': a cached product needs save and load", name.c_str()));
+  }
+}
+
+/**
+ * @brief Value of the product: the one made in this run, else read from the cache file, else made on demand. Safe to
+ *    call from several stages at once.
+ */
+template <typename T>
+const T &Product<T>::get() {
+  fingerprint();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!has_value) {
+    if (make_on_demand) {
+      value = make_on_demand();
+    } else if (load) {
+      value = load(cache_file);
+    } else {
+      throw std::runtime_error(Form("product '%s' has no value", name.c_str()));
+    }
+    has_value = true;
+  }
+  return value;
+}
+
+template <typename T>
+void Product<T>::set(T new_value) {
+  std::lock_guard<std::mutex> lock(mutex);
+  value = std::move(new_value);
+  has_value = true;
+}
+
+/**
+ * @brief Add a stage without inputs (e.g. reading or fetching a file) which always runs; its product is fingerprinted
+ *    by its value.
+ *
+ * @param name
+ * @param out product made.
+ * @param make
+ * @param fingerprint_of e.g. the content digest of the fetched file, or the columns of a table which later stages use.
+ * @return stage index.
+ */
+template <typename T>
+size_t Pipeline::source(const std::string &name, Product<T> &out, const std::function<T()> &make, const std::function<Fingerprint(const T &value)> &fingerprint_of) {
+  if (out.added) {
+    throw std::runtime_error(Form("product '%s' is made by two stages", out.name.c_str()));
+  }
+  out.stage = add_job(name, {}, {}, [this, &out, make, fingerprint_of]() {
+    T value = make();
+    out.fp = fingerprint_of(value);
+    out.set(std::move(value));
+    out.ready = true;
+  });
+  out.added = true;
+  return out.stage;
+}
+
+/**
+ * @brief Add a stage making out from inputs. A cached product (see Product) is made as soon as the inputs are done,
+ *    unless its cache file was written from the same fingerprint; an uncached product is made on demand, by the first
+ *    stage needing its value, so stages whose outputs are unchanged never make it.
+ *
+ * @param name
+ * @param out product made.
+ * @param inputs products make reads (with get()); they must be made by stages added before.
+ * @param config everything else the product depends on (options, code digests, ...).
+ * @param make
+ * @return stage index.
+ */
+template <typename T>
+size_t Pipeline::stage(const std::string &name, Product<T> &out, const std::vector<ProductBase*> &inputs, const Fingerprint &config, const std::function<T()> &make) {
+  if (out.added) {
+    throw std::runtime_error(Form("product '%s' is made by two stages", out.name.c_str()));
+  }
+  std::vector<std::string> outputs;
+  if (!out.cache_file.empty()) {
+    outputs.push_back(out.cache_file);
+  }
+  size_t index = names.size();
+  out.stage = add_job(name, outputs, inputs, [this, &out, inputs, config, make, name, index]() {
+    typedef std::chrono::steady_clock clock;
+    out.fp = input_fingerprint(name, inputs, config);
+    if (out.cache_file.empty()) {
+      out.make_on_demand = [this, make, index]() {
+        clock::time_point start = clock::now();
+        T value = make();
+        note(index, Form("made on demand in %.3f s", std::chrono::duration<double>(clock::now() - start).count()));
+        return value;
+      };
+      note(index, "not needed");
+    } else if (unchanged({out.cache_file}, out.fp)) {
+      note(index, "cached, fingerprint " + out.fp.hex());
+    } else {
+      T value = make();
+      std::string tmp_name = out.cache_file + ".tmp";
+      out.save(tmp_name, value);
+      if (rename(tmp_name.c_str(), out.cache_file.c_str()) != 0) {
+        remove(tmp_name.c_str());
+        throw std::runtime_error(Form("unable to rename '%s' to '%s'", tmp_name.c_str(), out.cache_file.c_str()));
+      }
+      record({out.cache_file}, out.fp);
+      out.set(std::move(value));
+      note(index, "made");
+    }
+    out.ready = true;
+  });
+  out.added = true;
+  return out.stage;
+}
+
+#ifndef EMCAL_LIBRARY
+#include "pipeline.cpp"
+#endif
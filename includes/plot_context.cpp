@@ -0,0 +1,99 @@
+#include "plot_context.h"
+
+/**
+ * @brief ROOT palette (EColorPalette) with the same colour stops as a raster palette.
+ */
+int root_palette(Palette palette) {
+  switch (palette) {
+    case Palette::BIRD: return kBird;
+    case Palette::RAINBOW: return kRainBow;
+    case Palette::VIRIDIS: return kViridis;
+    case Palette::GRAYSCALE: return kGreyScale;
+  }
+  return kBird;
+}
+
+PlotContext::PlotContext(const std::string &output_dir, const std::string &tag, PlotStyle style, bool raster)
+  : output_dir(output_dir), tag(tag), style(style), raster(raster) {}
+
+/**
+ * @brief Path of an output file: output_dir/file_name, with "_<tag>" inserted before the extension.
+ *
+ * @param file_name e.g. "mpv_block_map.pdf"
+ */
+std::string PlotContext::path(const std::string &file_name) const {
+  std::string name = file_name;
+  if (!tag.empty()) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+      dot = name.size();
+    }
+    name.insert(dot, "_" + tag);
+  }
+  return output_dir.empty() ? name : output_dir + "/" + name;
+}
+
+/**
+ * @brief Process-wide unique ROOT object name ("<base>[_<tag>]_<n>").
+ */
+std::string PlotContext::unique_name(const std::string &base) const {
+  static std::atomic<unsigned long> n_names(0);
+  return base + (tag.empty() ? "" : "_" + tag) + "_" + std::to_string(n_names++);
+}
+
+std::recursive_mutex &PlotContext::render_mutex() {
+  static std::recursive_mutex mutex;
+  return mutex;
+}
+
+/**
+ * @brief Set the context's style in gStyle (render lock must be held: ROOT reads it while painting).
+ */
+void PlotContext::apply_style() const {
+  gStyle->SetOptStat(style.opt_stat);
+  gStyle->SetLineScalePS(style.line_scale_ps);
+  gStyle->SetImageScaling(style.image_scaling);
+  gStyle->SetPalette(root_palette(style.palette));
+}
+
+/**
+ * @brief Create a canvas and draw into it with the context's style, holding the render lock.
+ *
+ * @param width
+ * @param height
+ * @param draw_fn draws onto the canvas (which is the current pad); may call save() for several outputs.
+ * @param file_name if not empty, saved (see save()) after draw_fn.
+ * @return TCanvas* (kept alive like any other canvas; not thread-safe to modify outside of draw/save)
+ */
+TCanvas *PlotContext::draw(int width, int height, const std::function<void(TCanvas *c)> &draw_fn, const std::string &file_name) const {
+  ScopedTimer wait_timer("plot: wait for render lock");
+  std::lock_guard<std::recursive_mutex> lock(render_mutex());
+  wait_timer.stop();
+  apply_style();
+  TCanvas *c = new TCanvas(unique_name("c").c_str(), "", width, height);
+  c->cd();
+  draw_fn(c);
+  if (!file_name.empty()) {
+    save(c, file_name);
+  }
+  return c;
+}
+
+/**
+ * @brief Repaint a canvas with the context's style and save it to path(file_name).
+ */
+void PlotContext::save(TCanvas *c, const std::string &file_name) const {
+  std::lock_guard<std::recursive_mutex> lock(render_mutex());
+  apply_style();
+  c->Modified();
+  c->Update();
+  c->SaveAs(path(file_name).c_str());
+}
+
+/**
+ * @brief Delete a canvas made by draw() (under the render lock, since it unregisters from gROOT).
+ */
+void PlotContext::close(TCanvas *c) const {
+  std::lock_guard<std::recursive_mutex> lock(render_mutex());
+  delete c;
+}
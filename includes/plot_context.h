@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include <TCanvas.h>
+#include <TStyle.h>
+#include <TH1.h>
+
+#include "raster.h"
+#include "profiler.h"
+
+/**
+ * @brief Style of the canvases of a PlotContext (the gStyle settings the plotting code used to set globally).
+ */
+typedef struct PlotStyle {
+  int opt_stat;           // TStyle::SetOptStat (0 also turns off the stats box of histograms made by the context)
+  double line_scale_ps;   // TStyle::SetLineScalePS
+  double image_scaling;   // TStyle::SetImageScaling (PNG output)
+  Palette palette;        // ROOT palette of COLZ/LEGO plots and palette of raster maps
+} PlotStyle;
+
+const PlotStyle DEFAULT_PLOT_STYLE = {0, 0.5, 1.0, Palette::BIRD};
+
+int root_palette(Palette palette);
+
+/**
+ * @brief Everything the plotting functions used to take from process-global ROOT state: style, palette, output
+ *    directory and file/object naming. Histograms it makes have unique names and are detached from gDirectory, and
+ *    canvases are drawn and saved under a process-wide render lock with the context's style applied, so plots of
+ *    several contexts (or of one context) can be produced from concurrent threads.
+ *
+ * NOTE: ROOT graphics are not thread-safe, so the render lock serializes drawing and saving; reading, selecting and
+ *    filling run concurrently. Call ROOT::EnableThreadSafety() and use batch mode before plotting from threads.
+ */
+class PlotContext {
+  public:
+  PlotContext(const std::string &output_dir = "emcal_plots", const std::string &tag = "", PlotStyle style = DEFAULT_PLOT_STYLE, bool raster = false);
+
+  std::string path(const std::string &file_name) const;
+  std::string unique_name(const std::string &base) const;
+  template <typename H, typename... Args>
+  H *hist(const std::string &name, Args... args) const;
+  TCanvas *draw(int width, int height, const std::function<void(TCanvas *c)> &draw_fn, const std::string &file_name = "") const;
+  void save(TCanvas *c, const std::string &file_name) const;
+  void close(TCanvas *c) const;
+
+  std::string output_dir;
+  std::string tag;        // appended to output file names (before the extension) when not empty
+  PlotStyle style;
+  bool raster;            // render maps headless to PNG (includes/raster.h) instead of through TCanvas
+
+  private:
+  static std::recursive_mutex &render_mutex();
+  void apply_style() const;
+};
+
+/**
+ * @brief Create a histogram with a unique name, detached from gDirectory (owned by the caller), with the stats box
+ *    following the context's style.
+ *
+ * @tparam H histogram class, e.g. TH2D
+ * @param name base of the histogram name (see unique_name)
+ * @param args remaining constructor arguments (title, binning)
+ */
+template <typename H, typename... Args>
+H *PlotContext::hist(const std::string &name, Args... args) const {
+  H *h = new H(unique_name(name).c_str(), args...);
+  h->SetDirectory(nullptr);
+  h->SetStats(style.opt_stat != 0);
+  return h;
+}
+
+#ifndef EMCAL_LIBRARY
+#include "plot_context.cpp"
+#endif
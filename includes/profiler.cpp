@@ -0,0 +1,240 @@
+#include "profiler.h"
+
+Profiler::Profiler() : start(std::chrono::steady_clock::now()) {
+  const char *value = getenv("EMCAL_TRACE");
+  if (value) {
+    trace_file = value;
+  }
+}
+
+Profiler &Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+/**
+ * @brief Whether stages and counters are recorded; initially set from the environment variable EMCAL_PROFILE.
+ */
+std::atomic<bool> &Profiler::enabled_flag() {
+  static std::atomic<bool> enabled([]() {
+    const char *value = getenv("EMCAL_PROFILE");
+    return value && *value && std::string(value) != "0";
+  }());
+  return enabled;
+}
+
+/**
+ * @brief Whether spans and counter values are recorded; initially set from the environment variable EMCAL_TRACE.
+ */
+std::atomic<bool> &Profiler::tracing_flag() {
+  static std::atomic<bool> enabled([]() {
+    const char *value = getenv("EMCAL_TRACE");
+    return value && *value;
+  }());
+  return enabled;
+}
+
+/**
+ * @brief Record the trace (from now on) and write it to file_name in finish(), like EMCAL_TRACE=file_name.
+ *
+ * @param file_name e.g. "trace.json" (open in chrome://tracing or ui.perfetto.dev).
+ */
+void Profiler::start_trace(const std::string &file_name) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    trace_file = file_name;
+  }
+  tracing_flag() = !file_name.empty();
+}
+
+/**
+ * @brief Table of the calling thread (registered on its first record; kept after the thread exits).
+ */
+Profiler::ThreadTable &Profiler::table() {
+  thread_local ThreadTable *own = nullptr;
+  if (!own) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tables.emplace_back(new ThreadTable());
+    own = tables.back().get();
+    own->index = tables.size() - 1;
+  }
+  return *own;
+}
+
+double Profiler::since_start(std::chrono::steady_clock::time_point t) const {
+  return std::chrono::duration<double, std::micro>(t - start).count();
+}
+
+static void add_to(std::map<std::string, StageTime> &times, const std::string &name, double amount) {
+  auto it = times.find(name);
+  if (it == times.end()) {
+    times[name] = {1, amount, amount};
+  } else {
+    it->second.calls++;
+    it->second.total += amount;
+    it->second.max = std::max(it->second.max, amount);
+  }
+}
+
+void Profiler::add_time(const std::string &stage, double seconds) {
+  ThreadTable &own = table();
+  std::lock_guard<std::mutex> lock(own.mutex);
+  add_to(own.stages, stage, seconds);
+}
+
+void Profiler::add_count(const std::string &counter, double amount) {
+  ThreadTable &own = table();
+  std::lock_guard<std::mutex> lock(own.mutex);
+  add_to(own.counters, counter, amount);
+}
+
+void Profiler::add_span(const std::string &name, std::chrono::steady_clock::time_point span_start, std::chrono::steady_clock::time_point span_end, const char *arg_name, double arg_value) {
+  ThreadTable &own = table();
+  double ts = since_start(span_start);
+  std::lock_guard<std::mutex> lock(own.mutex);
+  own.events.push_back({'X', name, ts, since_start(span_end) - ts, arg_name, arg_value});
+}
+
+void Profiler::add_counter_value(const char *counter, double value) {
+  ThreadTable &own = table();
+  double ts = since_start(std::chrono::steady_clock::now());
+  std::lock_guard<std::mutex> lock(own.mutex);
+  own.events.push_back({'C', counter, ts, 0, counter, value});
+}
+
+/**
+ * @brief Forget everything recorded so far (e.g. between two runs of a macro in one session).
+ */
+void Profiler::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &own : tables) {
+    std::lock_guard<std::mutex> table_lock(own->mutex);
+    own->stages.clear();
+    own->counters.clear();
+    own->events.clear();
+  }
+}
+
+/**
+ * @brief Print every stage summed over threads (calls, total, mean and max time, sorted by total time), the counters,
+ *    and the stage totals of each thread.
+ */
+void Profiler::print_report(FILE *out) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<std::string, StageTime> stages;
+  std::map<std::string, StageTime> counters;
+  for (const auto &own : tables) {
+    std::lock_guard<std::mutex> table_lock(own->mutex);
+    for (const auto &p : own->stages) {
+      StageTime &sum = stages.emplace(p.first, StageTime{0, 0, 0}).first->second;
+      sum.calls += p.second.calls;
+      sum.total += p.second.total;
+      sum.max = std::max(sum.max, p.second.max);
+    }
+    for (const auto &p : own->counters) {
+      StageTime &sum = counters.emplace(p.first, StageTime{0, 0, 0}).first->second;
+      sum.calls += p.second.calls;
+      sum.total += p.second.total;
+      sum.max = std::max(sum.max, p.second.max);
+    }
+  }
+  std::vector<std::pair<std::string, StageTime>> sorted(stages.begin(), stages.end());
+  std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, StageTime> &a, const std::pair<std::string, StageTime> &b) {
+    return a.second.total > b.second.total;
+  });
+
+  fprintf(out, "%-48s %8s %11s %11s %11s\n", "stage", "calls", "total [s]", "mean [ms]", "max [ms]");
+  for (const auto &p : sorted) {
+    fprintf(out, "%-48s %8ld %11.3f %11.3f %11.3f\n", p.first.c_str(), p.second.calls, p.second.total,
+            p.second.total*1000/p.second.calls, p.second.max*1000);
+  }
+  if (!counters.empty()) {
+    fprintf(out, "\n%-48s %8s %11s %11s\n", "counter", "adds", "total", "max");
+    for (const auto &p : counters) {
+      fprintf(out, "%-48s %8ld %11.6g %11.6g\n", p.first.c_str(), p.second.calls, p.second.total, p.second.max);
+    }
+  }
+  for (const auto &own : tables) {
+    std::lock_guard<std::mutex> table_lock(own->mutex);
+    if (own->stages.empty()) {
+      continue;
+    }
+    fprintf(out, "\nthread %d:\n", own->index);
+    for (const auto &p : own->stages) {
+      fprintf(out, "  %-46s %8ld %11.3f\n", p.first.c_str(), p.second.calls, p.second.total);
+    }
+  }
+}
+
+static std::string json_string(const std::string &str) {
+  std::string quoted = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      quoted += Form("\\u%04x", c);
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+/**
+ * @brief Write the trace in the Chrome trace event format (JSON), readable by chrome://tracing and ui.perfetto.dev:
+ *    one track per thread ("thread <n>", in order of their first record) with its spans, and one counter track per
+ *    trace_counter name. Written to a temporary file and renamed.
+ */
+void Profiler::write_trace(const std::string &file_name) const {
+  std::string tmp_name = file_name + ".tmp";
+  FILE *out = fopen(tmp_name.c_str(), "w");
+  if (!out) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", tmp_name.c_str()));
+  }
+  int pid = getpid();
+  size_t n_events = 0;
+  fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  fprintf(out, "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": %d, \"tid\": 0, \"args\": {\"name\": \"emcal\"}}", pid);
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &own : tables) {
+    std::lock_guard<std::mutex> table_lock(own->mutex);
+    fprintf(out, ",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+            pid, own->index, own->index);
+    for (const TraceEvent &event : own->events) {
+      fprintf(out, ",\n{\"ph\": \"%c\", \"name\": %s, \"pid\": %d, \"tid\": %d, \"ts\": %.3f", event.phase,
+              json_string(event.name).c_str(), pid, own->index, event.ts);
+      if (event.phase == 'X') {
+        fprintf(out, ", \"dur\": %.3f", event.dur);
+      }
+      if (event.arg_name) {
+        fprintf(out, ", \"args\": {%s: %.17g}", json_string(event.arg_name).c_str(), event.arg_value);
+      }
+      fprintf(out, "}");
+      n_events++;
+    }
+  }
+  fprintf(out, "\n]}\n");
+  if (fclose(out) != 0 || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("unable to write '%s'", file_name.c_str()));
+  }
+  printf("wrote %zu trace events to %s\n", n_events, file_name.c_str());
+}
+
+/**
+ * @brief End of a macro or tool: print the report if profiling, and write the trace if tracing.
+ */
+void Profiler::finish() const {
+  if (profiling()) {
+    print_report();
+  }
+  std::string file_name;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    file_name = trace_file;
+  }
+  if (tracing() && !file_name.empty()) {
+    write_trace(file_name);
+  }
+}
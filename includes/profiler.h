@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TString.h>
+
+#include <unistd.h>
+
+/**
+ * @brief Wall time and calls of one stage (or the total of one counter) in one thread.
+ */
+typedef struct StageTime {
+  long calls;
+  double total;   // s (counters: summed amount)
+  double max;     // s (counters: largest amount)
+} StageTime;
+
+/**
+ * @brief One event of the trace (Chrome trace event format): a span ('X') or a counter value ('C').
+ */
+typedef struct TraceEvent {
+  char phase;
+  std::string name;
+  double ts;              // us since the profiler started
+  double dur;             // us (spans)
+  const char *arg_name;   // optional argument of a span (e.g. "channel"), or the series of a counter; may be null
+  double arg_value;
+} TraceEvent;
+
+/**
+ * @brief Process-wide collection of ScopedTimer stage times and profile_count counters (the profile), and of spans and
+ *    counter values on a timeline (the trace). Every thread records into its own table, so threads never wait for each
+ *    other. The profile is on if the environment variable EMCAL_PROFILE is set (to anything but "0") or after enable();
+ *    the trace is on if EMCAL_TRACE is set to a file name or after start_trace(). While both are off, timers and
+ *    counters only test two flags.
+ *
+ * NOTE: stages of jobs run in forked processes (JobExecutor::PROCESSES) are recorded in the child and lost.
+ */
+class Profiler {
+  public:
+  static Profiler &instance();
+  static std::atomic<bool> &enabled_flag();
+  static std::atomic<bool> &tracing_flag();
+
+  void enable(bool on = true) { enabled_flag() = on; }
+  void start_trace(const std::string &file_name);
+  void add_time(const std::string &stage, double seconds);
+  void add_count(const std::string &counter, double amount);
+  void add_span(const std::string &name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, const char *arg_name, double arg_value);
+  void add_counter_value(const char *counter, double value);
+  void reset();
+  void print_report(FILE *out = stdout) const;
+  void write_trace(const std::string &file_name) const;
+  void finish() const;
+
+  private:
+  typedef struct ThreadTable {
+    int index;                                // in order of the first record of the thread
+    std::mutex mutex;                         // only contended while a report or trace is written
+    std::map<std::string, StageTime> stages;
+    std::map<std::string, StageTime> counters;
+    std::vector<TraceEvent> events;
+  } ThreadTable;
+
+  Profiler();
+  ThreadTable &table();
+  double since_start(std::chrono::steady_clock::time_point t) const;
+
+  std::chrono::steady_clock::time_point start;
+  std::string trace_file;
+  mutable std::mutex mutex;                   // guards tables and trace_file
+  std::vector<std::unique_ptr<ThreadTable>> tables;
+};
+
+inline bool profiling() {
+  return Profiler::enabled_flag().load(std::memory_order_relaxed);
+}
+
+inline bool tracing() {
+  return Profiler::tracing_flag().load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Add to a counter (e.g. bytes read, histograms filled) of the calling thread, if profiling.
+ */
+inline void profile_count(const char *counter, double amount = 1) {
+  if (profiling()) {
+    Profiler::instance().add_count(counter, amount);
+  }
+}
+
+/**
+ * @brief Record the current value of a quantity on the trace timeline (e.g. the depth of a work queue), if tracing.
+ */
+inline void trace_counter(const char *counter, double value) {
+  if (tracing()) {
+    Profiler::instance().add_counter_value(counter, value);
+  }
+}
+
+/**
+ * @brief Records the wall time from construction to destruction as one call of a stage (profile) and as one span
+ *    (trace), e.g. { ScopedTimer t("fit: single pixels"); ... } or ScopedTimer t("plot_helper: colz", cfg.file_name.c_str())
+ *    for a stage per output. The names are only copied when profiling or tracing.
+ */
+class ScopedTimer {
+  public:
+  explicit ScopedTimer(const char *stage, const char *detail = nullptr) : stage(profiling() || tracing() ? stage : nullptr), detail(detail) {
+    if (this->stage) {
+      start = clock::now();
+    }
+  }
+  ~ScopedTimer() { stop(); }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  /**
+   * @brief Attach a number to the span (shown in the trace viewer, not in the profile), e.g. arg("channel", 17).
+   */
+  ScopedTimer &arg(const char *name, double value) {
+    arg_name = name;
+    arg_value = value;
+    return *this;
+  }
+
+  /**
+   * @brief Record the stage now instead of at destruction.
+   */
+  void stop() {
+    if (stage) {
+      clock::time_point end = clock::now();
+      std::string name = detail ? std::string(stage) + " " + detail : std::string(stage);
+      if (profiling()) {
+        Profiler::instance().add_time(name, std::chrono::duration<double>(end - start).count());
+      }
+      if (tracing()) {
+        Profiler::instance().add_span(name, start, end, arg_name, arg_value);
+      }
+      stage = nullptr;
+    }
+  }
+
+  private:
+  typedef std::chrono::steady_clock clock;
+  const char *stage;    // nullptr when not recording
+  const char *detail;
+  const char *arg_name = nullptr;
+  double arg_value = 0;
+  clock::time_point start;
+};
+
+#ifndef EMCAL_LIBRARY
+#include "profiler.cpp"
+#endif
@@ -0,0 +1,494 @@
+#include "raster.h"
+
+Palette parse_palette(const std::string &name) {
+  if (name == "bird") {
+    return Palette::BIRD;
+  } else if (name == "rainbow") {
+    return Palette::RAINBOW;
+  } else if (name == "viridis") {
+    return Palette::VIRIDIS;
+  } else if (name == "grayscale") {
+    return Palette::GRAYSCALE;
+  }
+  throw std::runtime_error(Form("unknown palette '%s'", name.c_str()));
+}
+
+/**
+ * @brief Colour at position t (0 = minimum, 1 = maximum) of a palette, linearly interpolated between 9 equidistant stops.
+ *
+ * @param palette
+ * @param t
+ * @return uint32_t 0xRRGGBB
+ */
+uint32_t palette_color(Palette palette, double t) {
+  static const double stops[3][3][9] = {
+    { // bird
+      {0.2082, 0.0592, 0.0780, 0.0232, 0.1802, 0.5301, 0.8186, 0.9956, 0.9764},
+      {0.1664, 0.3599, 0.5041, 0.6419, 0.7178, 0.7492, 0.7328, 0.7862, 0.9832},
+      {0.5293, 0.8684, 0.8385, 0.7914, 0.6425, 0.4662, 0.3499, 0.1968, 0.0539},
+    },
+    { // rainbow
+      {0/255., 5/255., 15/255., 35/255., 102/255., 196/255., 208/255., 199/255., 110/255.},
+      {0/255., 48/255., 124/255., 192/255., 206/255., 226/255., 97/255., 16/255., 0/255.},
+      {99/255., 142/255., 198/255., 201/255., 90/255., 22/255., 13/255., 8/255., 2/255.},
+    },
+    { // viridis
+      {26/255., 51/255., 43/255., 33/255., 28/255., 35/255., 74/255., 144/255., 246/255.},
+      {9/255., 24/255., 55/255., 87/255., 118/255., 150/255., 180/255., 200/255., 222/255.},
+      {30/255., 96/255., 112/255., 114/255., 112/255., 101/255., 72/255., 35/255., 0/255.},
+    },
+  };
+  t = std::min(1.0, std::max(0.0, t));
+  if (palette == Palette::GRAYSCALE) {
+    uint32_t g = (uint32_t) std::lround(255*(1 - t));
+    return (g << 16) | (g << 8) | g;
+  }
+  const double (*rgb)[9] = stops[(int) palette];
+  double pos = t*8;
+  int i = std::min(7, (int) pos);
+  double f = pos - i;
+  uint32_t result = 0;
+  for (int c = 0; c < 3; c++) {
+    double v = rgb[c][i] + f*(rgb[c][i + 1] - rgb[c][i]);
+    result = (result << 8) | (uint32_t) std::lround(255*v);
+  }
+  return result;
+}
+
+RasterImage::RasterImage(int width, int height, uint32_t background) : w(width), h(height), pixels(3*(size_t) width*height) {
+  fill_rect(0, 0, w, h, background);
+}
+
+void RasterImage::set_pixel(int x, int y, uint32_t rgb) {
+  if (x < 0 || y < 0 || x >= w || y >= h) {
+    return;
+  }
+  uint8_t *p = &pixels[3*((size_t) y*w + x)];
+  p[0] = rgb >> 16;
+  p[1] = rgb >> 8;
+  p[2] = rgb;
+}
+
+/**
+ * @brief Fill pixels [x0, x1) x [y0, y1) (clipped to the image).
+ */
+void RasterImage::fill_rect(int x0, int y0, int x1, int y1, uint32_t rgb) {
+  x0 = std::max(0, x0);
+  y0 = std::max(0, y0);
+  x1 = std::min(w, x1);
+  y1 = std::min(h, y1);
+  for (int y = y0; y < y1; y++) {
+    uint8_t *p = &pixels[3*((size_t) y*w + x0)];
+    for (int x = x0; x < x1; x++) {
+      *p++ = rgb >> 16;
+      *p++ = rgb >> 8;
+      *p++ = rgb;
+    }
+  }
+}
+
+void RasterImage::hline(int x0, int x1, int y, uint32_t rgb, bool dotted) {
+  for (int x = x0; x <= x1; x++) {
+    if (!dotted || x % 4 < 2) {
+      set_pixel(x, y, rgb);
+    }
+  }
+}
+
+void RasterImage::vline(int x, int y0, int y1, uint32_t rgb, bool dotted) {
+  for (int y = y0; y <= y1; y++) {
+    if (!dotted || y % 4 < 2) {
+      set_pixel(x, y, rgb);
+    }
+  }
+}
+
+/**
+ * @brief 5x7 glyph of a character (rows top to bottom, bit 4 = leftmost column). Lower case is drawn as upper case;
+ *    '#' (ROOT latex prefix) and unknown characters are drawn as nothing.
+ */
+static const uint8_t *glyph(char c) {
+  static const uint8_t blank[7] = {0, 0, 0, 0, 0, 0, 0};
+  static const uint8_t digits[10][7] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+  };
+  static const uint8_t letters[26][7] = {
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // A B
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, // C D
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // E F
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // G H
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // I J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // K L
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // M N
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // O P
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // Q R
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // S T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // U V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // W X
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Y Z
+  };
+  static const uint8_t minus[7] = {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00};
+  static const uint8_t plus[7] = {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00};
+  static const uint8_t dot[7] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C};
+  static const uint8_t comma[7] = {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08};
+  static const uint8_t percent[7] = {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03};
+  static const uint8_t lbracket[7] = {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E};
+  static const uint8_t rbracket[7] = {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E};
+  static const uint8_t lparen[7] = {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02};
+  static const uint8_t rparen[7] = {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08};
+  static const uint8_t slash[7] = {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00};
+  static const uint8_t colon[7] = {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00};
+  static const uint8_t equals[7] = {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00};
+  static const uint8_t underscore[7] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F};
+  if (c >= '0' && c <= '9') {
+    return digits[c - '0'];
+  } else if (c >= 'A' && c <= 'Z') {
+    return letters[c - 'A'];
+  } else if (c >= 'a' && c <= 'z') {
+    return letters[c - 'a'];
+  }
+  switch (c) {
+    case '-': return minus;
+    case '+': return plus;
+    case '.': return dot;
+    case ',': return comma;
+    case '%': return percent;
+    case '[': return lbracket;
+    case ']': return rbracket;
+    case '(': return lparen;
+    case ')': return rparen;
+    case '/': return slash;
+    case ':': return colon;
+    case '=': return equals;
+    case '_': return underscore;
+    default: return blank;
+  }
+}
+
+/**
+ * @brief Width in pixels of a text drawn with draw_text ('#' is skipped).
+ */
+int RasterImage::text_width(const std::string &text, int scale) {
+  int n = std::count_if(text.begin(), text.end(), [](char c) { return c != '#'; });
+  return n > 0 ? (6*n - 1)*scale : 0;
+}
+
+/**
+ * @brief Draw text anchored at pixel (x, y).
+ *
+ * @param x
+ * @param y
+ * @param text
+ * @param align ROOT convention (see MapLabel), e.g. 22 = centred.
+ * @param scale pixel size of one font dot.
+ * @param rgb
+ */
+void RasterImage::draw_text(int x, int y, const std::string &text, int align, int scale, uint32_t rgb) {
+  int width = text_width(text, scale);
+  int height = 7*scale;
+  int h_align = align/10;
+  int v_align = align%10;
+  int left = h_align == 1 ? x : (h_align == 2 ? x - width/2 : x - width);
+  int top = v_align == 3 ? y : (v_align == 2 ? y - height/2 : y - height);
+  for (char c : text) {
+    if (c == '#') {
+      continue;
+    }
+    const uint8_t *rows = glyph(c);
+    for (int row = 0; row < 7; row++) {
+      for (int col = 0; col < 5; col++) {
+        if (rows[row] & (0x10 >> col)) {
+          fill_rect(left + col*scale, top + row*scale, left + (col + 1)*scale, top + (row + 1)*scale, rgb);
+        }
+      }
+    }
+    left += 6*scale;
+  }
+}
+
+static uint32_t crc32(const uint8_t *data, size_t n, uint32_t crc = 0) {
+  static const std::vector<uint32_t> table = []() {
+    std::vector<uint32_t> result(256);
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      result[i] = c;
+    }
+    return result;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < n; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/**
+ * @brief LSB-first bit writer for deflate.
+ */
+class BitWriter {
+  public:
+  BitWriter(std::vector<uint8_t> &out) : out(out) {}
+  void bits(uint32_t value, int n) {
+    for (int i = 0; i < n; i++) {
+      acc |= ((value >> i) & 1) << n_acc;
+      if (++n_acc == 8) {
+        out.push_back(acc);
+        acc = 0;
+        n_acc = 0;
+      }
+    }
+  }
+  // Huffman codes are sent most significant bit first
+  void code(uint32_t value, int n) {
+    for (int i = n - 1; i >= 0; i--) {
+      bits((value >> i) & 1, 1);
+    }
+  }
+  void flush() {
+    if (n_acc > 0) {
+      out.push_back(acc);
+      acc = 0;
+      n_acc = 0;
+    }
+  }
+
+  private:
+  std::vector<uint8_t> &out;
+  uint32_t acc = 0;
+  int n_acc = 0;
+};
+
+static void deflate_literal(BitWriter &bw, int v) {
+  if (v < 144) {
+    bw.code(0x30 + v, 8);
+  } else if (v < 256) {
+    bw.code(0x190 + v - 144, 9);
+  } else if (v < 280) {
+    bw.code(v - 256, 7);
+  } else {
+    bw.code(0xC0 + v - 280, 8);
+  }
+}
+
+static void deflate_match(BitWriter &bw, int length, int distance) {
+  static const int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const int dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  static const int dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+  int l = 28;
+  while (length_base[l] > length) {
+    l--;
+  }
+  deflate_literal(bw, 257 + l);
+  bw.bits(length - length_base[l], length_extra[l]);
+  int d = 29;
+  while (dist_base[d] > distance) {
+    d--;
+  }
+  bw.code(d, 5);
+  bw.bits(distance - dist_base[d], dist_extra[d]);
+}
+
+/**
+ * @brief zlib stream of data using one fixed-Huffman deflate block. Matches are only searched at the previous pixel
+ *    and the pixel above, which is where nearly all redundancy of a detector map is.
+ */
+static std::vector<uint8_t> zlib_compress(const std::vector<uint8_t> &data, int stride) {
+  std::vector<uint8_t> out = {0x78, 0x01};
+  BitWriter bw(out);
+  bw.bits(1, 1); // final block
+  bw.bits(1, 2); // fixed Huffman
+  const int distances[2] = {3, stride};
+  size_t i = 0;
+  while (i < data.size()) {
+    int best_length = 0;
+    int best_distance = 0;
+    for (int distance : distances) {
+      if (distance > 32768 || i < (size_t) distance) {
+        continue;
+      }
+      int length = 0;
+      while (length < 258 && i + length < data.size() && data[i + length] == data[i + length - distance]) {
+        length++;
+      }
+      if (length > best_length) {
+        best_length = length;
+        best_distance = distance;
+      }
+    }
+    if (best_length >= 3) {
+      deflate_match(bw, best_length, best_distance);
+      i += best_length;
+    } else {
+      deflate_literal(bw, data[i]);
+      i++;
+    }
+  }
+  deflate_literal(bw, 256);
+  bw.flush();
+  uint32_t a = 1, b = 0;
+  for (uint8_t byte : data) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  uint32_t adler = (b << 16) | a;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(adler >> shift);
+  }
+  return out;
+}
+
+static void png_chunk(FILE *file, const char *type, const std::vector<uint8_t> &data) {
+  uint8_t header[8];
+  uint32_t n = data.size();
+  for (int k = 0; k < 4; k++) {
+    header[k] = n >> (24 - 8*k);
+    header[4 + k] = type[k];
+  }
+  uint32_t crc = crc32(header + 4, 4);
+  crc = crc32(data.data(), data.size(), crc);
+  uint8_t trailer[4] = {(uint8_t) (crc >> 24), (uint8_t) (crc >> 16), (uint8_t) (crc >> 8), (uint8_t) crc};
+  fwrite(header, 1, 8, file);
+  fwrite(data.data(), 1, data.size(), file);
+  fwrite(trailer, 1, 4, file);
+}
+
+/**
+ * @brief Encode the image as an 8 bit RGB PNG.
+ *
+ * @param file_name
+ */
+void RasterImage::write_png(const std::string &file_name) const {
+  size_t stride = 1 + 3*(size_t) w;
+  std::vector<uint8_t> raw(stride*h);
+  for (int y = 0; y < h; y++) {
+    raw[y*stride] = 0; // filter: none
+    std::copy(&pixels[3*(size_t) y*w], &pixels[3*(size_t) (y + 1)*w], &raw[y*stride + 1]);
+  }
+  std::vector<uint8_t> ihdr(13, 0);
+  for (int k = 0; k < 4; k++) {
+    ihdr[k] = (uint32_t) w >> (24 - 8*k);
+    ihdr[4 + k] = (uint32_t) h >> (24 - 8*k);
+  }
+  ihdr[8] = 8; // bit depth
+  ihdr[9] = 2; // RGB
+  FILE *file = fopen(file_name.c_str(), "wb");
+  if (!file) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", file_name.c_str()));
+  }
+  const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  fwrite(signature, 1, 8, file);
+  png_chunk(file, "IHDR", ihdr);
+  png_chunk(file, "IDAT", zlib_compress(raw, stride));
+  png_chunk(file, "IEND", {});
+  fclose(file);
+}
+
+/**
+ * @brief Round a tick step up to 1, 2 or 5 times a power of 10.
+ */
+static double nice_step(double raw_step) {
+  double magnitude = std::pow(10, std::floor(std::log10(raw_step)));
+  double f = raw_step/magnitude;
+  return (f <= 1 ? 1 : f <= 2 ? 2 : f <= 5 ? 5 : 10)*magnitude;
+}
+
+/**
+ * @brief Render a detector map (the equivalent of TH2D::Draw("COLZ0") plus decorations) into an image.
+ *    Cells that are 0, NaN or below z_min are left white; cells above z_max get the top colour.
+ *
+ * @param cells nx*ny values, cell (i, j) at cells[j*nx + i], j = 0 is the bottom row.
+ * @param nx
+ * @param ny
+ * @param z_min
+ * @param z_max
+ * @param decor
+ * @param palette
+ * @param cell_px pixels per cell side.
+ * @return RasterImage
+ */
+RasterImage render_map(const std::vector<double> &cells, int nx, int ny, double z_min, double z_max, const MapDecor &decor, Palette palette, int cell_px) {
+  if ((int) cells.size() != nx*ny) {
+    throw std::runtime_error(Form("render_map: %zu cells for a %d x %d map", cells.size(), nx, ny));
+  }
+  const int left = 80;
+  const int right = 120;
+  const int top = 60;
+  const int bottom = 60;
+  const uint32_t black = 0x000000;
+  const uint32_t grid = 0x808080;
+  int map_w = nx*cell_px;
+  int map_h = ny*cell_px;
+  RasterImage image(left + map_w + right, top + map_h + bottom);
+  auto px = [&](double x) { return (int) std::lround(left + x*cell_px); };
+  auto py = [&](double y) { return (int) std::lround(top + (ny - y)*cell_px); };
+
+  double z_range = z_max > z_min ? z_max - z_min : 1;
+  for (int j = 0; j < ny; j++) {
+    for (int i = 0; i < nx; i++) {
+      double v = cells[j*nx + i];
+      if (v == 0 || std::isnan(v) || v < z_min) {
+        continue;
+      }
+      image.fill_rect(px(i), py(j + 1), px(i + 1), py(j), palette_color(palette, (v - z_min)/z_range));
+    }
+  }
+
+  if (decor.grid_x > 0) {
+    for (int i = decor.grid_x; i < nx; i += decor.grid_x) {
+      image.vline(px(i), py(ny), py(0), grid, true);
+    }
+  }
+  if (decor.grid_y > 0) {
+    for (int j = decor.grid_y; j < ny; j += decor.grid_y) {
+      image.hline(px(0), px(nx), py(j), grid, true);
+    }
+  }
+  image.hline(px(0), px(nx), py(0), black);
+  image.hline(px(0), px(nx), py(ny), black);
+  image.vline(px(0), py(ny), py(0), black);
+  image.vline(px(nx), py(ny), py(0), black);
+
+  for (const MapLabel &label : decor.labels) {
+    image.draw_text(px(label.x), py(label.y), label.text, label.align, 1, black);
+  }
+  for (const MapTick &tick : decor.x_ticks) {
+    image.vline(px(tick.pos), py(0), py(0) + 4, black);
+    image.draw_text(px(tick.pos), py(0) + 7, tick.text, 23, 1, black);
+  }
+  for (const MapTick &tick : decor.y_ticks) {
+    image.hline(px(0) - 4, px(0), py(tick.pos), black);
+    image.draw_text(px(0) - 7, py(tick.pos), tick.text, 32, 1, black);
+  }
+
+  image.draw_text(image.width()/2, 10, decor.title, 23, 2, black);
+  image.draw_text(px(nx), image.height() - 8, decor.x_title, 31, 1, black);
+  image.draw_text(8, py(ny) - 14, decor.y_title, 11, 1, black);
+
+  // colour bar
+  int bar_x0 = px(nx) + 20;
+  int bar_x1 = bar_x0 + 20;
+  for (int y = py(ny); y < py(0); y++) {
+    double t = 1 - (y - py(ny) + 0.5)/map_h;
+    image.hline(bar_x0, bar_x1 - 1, y, palette_color(palette, t));
+  }
+  image.vline(bar_x0 - 1, py(ny), py(0), black);
+  image.vline(bar_x1, py(ny), py(0), black);
+  image.hline(bar_x0 - 1, bar_x1, py(ny) - 1, black);
+  image.hline(bar_x0 - 1, bar_x1, py(0), black);
+  double step = nice_step(z_range/5);
+  for (double z = std::ceil(z_min/step)*step; z <= z_max + 1e-9*step; z += step) {
+    int y = py(0) - (int) std::lround((z - z_min)/z_range*map_h);
+    image.hline(bar_x1 - 4, bar_x1, y, black);
+    image.draw_text(bar_x1 + 4, y, Form("%g", std::fabs(z) < 1e-9*step ? 0.0 : z), 12, 1, black);
+  }
+  image.draw_text(bar_x0 + 10, py(ny) - 6, decor.z_title, 21, 1, black);
+  return image;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TString.h>
+
+/**
+ * @brief Colour palettes of the raster renderer (same colour stops as the ROOT palettes of the same name).
+ */
+enum class Palette {
+  BIRD,      // ROOT default (kBird)
+  RAINBOW,   // kRainBow
+  VIRIDIS,   // kViridis
+  GRAYSCALE  // kGreyScale
+};
+
+Palette parse_palette(const std::string &name);
+uint32_t palette_color(Palette palette, double t);
+
+/**
+ * @brief RGB image in memory, with just enough drawing (rectangles, lines, 5x7 bitmap text) for detector maps.
+ *    Colours are 0xRRGGBB. (0, 0) is the top left pixel.
+ */
+class RasterImage {
+  public:
+  RasterImage(int width, int height, uint32_t background = 0xFFFFFF);
+  int width() const { return w; }
+  int height() const { return h; }
+  void set_pixel(int x, int y, uint32_t rgb);
+  void fill_rect(int x0, int y0, int x1, int y1, uint32_t rgb);
+  void hline(int x0, int x1, int y, uint32_t rgb, bool dotted = false);
+  void vline(int x, int y0, int y1, uint32_t rgb, bool dotted = false);
+  void draw_text(int x, int y, const std::string &text, int align, int scale, uint32_t rgb);
+  static int text_width(const std::string &text, int scale);
+  void write_png(const std::string &file_name) const;
+
+  private:
+  int w;
+  int h;
+  std::vector<uint8_t> pixels;
+};
+
+/**
+ * @brief Text label in map (cell) coordinates: x to the right, y up, cell (i, j) spans [i, i + 1) x [j, j + 1).
+ *    align follows ROOT's TAttText convention (10*horizontal + vertical; 1 = left/bottom, 2 = centre, 3 = right/top).
+ */
+typedef struct MapLabel {
+  double x;
+  double y;
+  std::string text;
+  int align;
+} MapLabel;
+
+/**
+ * @brief Axis tick label at a position in map (cell) coordinates.
+ */
+typedef struct MapTick {
+  double pos;
+  std::string text;
+} MapTick;
+
+/**
+ * @brief Everything drawn around the cells of a detector map: titles, grid lines, labels and axis ticks.
+ */
+typedef struct MapDecor {
+  std::string title;
+  std::string x_title;
+  std::string y_title;
+  std::string z_title;
+  int grid_x;                   // grid line every grid_x cells (0 = none)
+  int grid_y;
+  std::vector<MapLabel> labels;
+  std::vector<MapTick> x_ticks;
+  std::vector<MapTick> y_ticks;
+} MapDecor;
+
+RasterImage render_map(const std::vector<double> &cells, int nx, int ny, double z_min, double z_max, const MapDecor &decor, Palette palette = Palette::BIRD, int cell_px = 8);
+
+#ifndef EMCAL_LIBRARY
+#include "raster.cpp"
+#endif
@@ -0,0 +1,172 @@
+#pragma once
+
+/**
+ * Binary raw-event file, a local stand-in for the DAQ output of one sector: a 64 byte header followed by one record per
+ * event with the pedestal subtracted amplitude of each of the sector's 384 channels (h_alladc numbering). All values
+ * are little-endian; the structs are read and written as is, so the code compiles only for little-endian hosts.
+ *
+ * Like calib_table.h, this header is self-contained (no ROOT, no .cpp) so producers can copy it as is. The histogram
+ * builder reading these files is in adc_ingest.h.
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char RAW_EVENT_MAGIC[8] = {'E', 'M', 'C', 'A', 'L', 'R', 'A', 'W'};
+const uint32_t RAW_EVENT_VERSION = 1;
+const uint32_t RAW_N_CHANNELS = 384;
+
+typedef struct alignas(64) RawEventHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;   // bytes before the first record
+  uint32_t record_size;   // sizeof(RawEvent)
+  uint32_t n_channels;
+  int32_t run;
+  int32_t sector;         // 0-based, -1 if unknown
+  uint64_t n_events;
+  int64_t created;        // unix time
+  uint8_t reserved[16];
+} RawEventHeader;
+
+typedef struct RawEvent {
+  uint32_t event;                 // event number
+  uint32_t trigger;               // trigger bits
+  float adc[RAW_N_CHANNELS];      // pedestal subtracted amplitude [ADC]
+} RawEvent;
+
+static_assert(sizeof(RawEventHeader) == 64, "RawEventHeader must be one cache line");
+static_assert(sizeof(RawEvent) == 8 + 4*RAW_N_CHANNELS, "RawEvent must not be padded");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "raw-event files are read and written as host structs, which must be little-endian");
+
+/**
+ * @brief Read-only, memory-mapped raw-event file (read sequentially, so the kernel reads ahead). Throws
+ *    std::runtime_error if the file is missing, of another version or layout, or shorter than its header says.
+ */
+class RawEventFile {
+  public:
+  explicit RawEventFile(const std::string &file_name) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("unable to open raw-event file '" + file_name + "'");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(RawEventHeader)) {
+      close(fd);
+      throw std::runtime_error("raw-event file '" + file_name + "' is truncated");
+    }
+    length = st.st_size;
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      throw std::runtime_error("unable to mmap raw-event file '" + file_name + "'");
+    }
+    madvise(mapped, length, MADV_SEQUENTIAL);
+    base = static_cast<const char*>(mapped);
+    const RawEventHeader &h = header();
+    std::string error;
+    if (memcmp(h.magic, RAW_EVENT_MAGIC, sizeof(RAW_EVENT_MAGIC)) != 0) {
+      error = "is not a raw-event file";
+    } else if (h.version != RAW_EVENT_VERSION) {
+      error = "has unsupported version " + std::to_string(h.version);
+    } else if (h.record_size != sizeof(RawEvent) || h.n_channels != RAW_N_CHANNELS || h.header_size % 64 != 0
+               || length < (size_t) h.header_size + (size_t) h.n_events*h.record_size) {
+      error = "has an unexpected layout";
+    }
+    if (!error.empty()) {
+      munmap(const_cast<char*>(base), length);
+      throw std::runtime_error("raw-event file '" + file_name + "' " + error);
+    }
+  }
+  ~RawEventFile() {
+    munmap(const_cast<char*>(base), length);
+  }
+  RawEventFile(const RawEventFile &) = delete;
+  RawEventFile &operator=(const RawEventFile &) = delete;
+
+  const RawEventHeader &header() const { return *reinterpret_cast<const RawEventHeader*>(base); }
+  const RawEvent *events() const { return reinterpret_cast<const RawEvent*>(base + header().header_size); }
+  size_t size() const { return header().n_events; }
+  size_t bytes() const { return length; }
+  const RawEvent &operator[](size_t i) const { return events()[i]; }
+
+  private:
+  const char *base = nullptr;
+  size_t length = 0;
+};
+
+/**
+ * @brief Writer of a raw-event file: the events are written to "<file_name>.tmp", which close() completes (event
+ *    count in the header) and renames to file_name, so readers never see a partial file. A writer destroyed without
+ *    close() removes its temporary file.
+ */
+class RawEventWriter {
+  public:
+  RawEventWriter(const std::string &file_name, int run, int sector = -1) : file_name(file_name), tmp_name(file_name + ".tmp") {
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, RAW_EVENT_MAGIC, sizeof(RAW_EVENT_MAGIC));
+    head.version = RAW_EVENT_VERSION;
+    head.header_size = sizeof(RawEventHeader);
+    head.record_size = sizeof(RawEvent);
+    head.n_channels = RAW_N_CHANNELS;
+    head.run = run;
+    head.sector = sector;
+    head.created = time(nullptr);
+    file = fopen(tmp_name.c_str(), "wb");
+    if (!file || fwrite(&head, sizeof(head), 1, file) != 1) {
+      abandon();
+      throw std::runtime_error("unable to open '" + tmp_name + "' for writing");
+    }
+  }
+  ~RawEventWriter() {
+    abandon();
+  }
+  RawEventWriter(const RawEventWriter &) = delete;
+  RawEventWriter &operator=(const RawEventWriter &) = delete;
+
+  void write(const RawEvent &event) {
+    if (!file || fwrite(&event, sizeof(event), 1, file) != 1) {
+      throw std::runtime_error("unable to write '" + tmp_name + "'");
+    }
+    head.n_events++;
+  }
+
+  void close() {
+    if (!file) {
+      throw std::runtime_error("'" + tmp_name + "' is already closed");
+    }
+    bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&head, sizeof(head), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    if (!ok || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+      remove(tmp_name.c_str());
+      throw std::runtime_error("unable to write '" + file_name + "'");
+    }
+  }
+
+  uint64_t size() const { return head.n_events; }
+
+  private:
+  void abandon() {
+    if (file) {
+      fclose(file);
+      file = nullptr;
+      remove(tmp_name.c_str());
+    }
+  }
+
+  std::string file_name;
+  std::string tmp_name;
+  RawEventHeader head;
+  FILE *file = nullptr;
+};
@@ -0,0 +1,32 @@
+#include "root_arena.h"
+
+/**
+ * @brief Delete (or give back) everything of the arena, newest first. The arena can be used again afterwards.
+ */
+void RootArena::clear() {
+  while (!releases.empty()) {
+    std::function<void()> release = std::move(releases.back());
+    releases.pop_back();
+    release();
+  }
+}
+
+/**
+ * @brief Reset of a TF1Pool: all parameters free (no fixed values or limits), zero, without errors. The formula and
+ *    range stay.
+ */
+void reset_tf1(TF1 *f) {
+  for (int i = 0; i < f->GetNpar(); i++) {
+    f->ReleaseParameter(i);
+    f->SetParLimits(i, 0, 0);
+    f->SetParameter(i, 0);
+    f->SetParError(i, 0);
+  }
+}
+
+/**
+ * @brief Reset of a TH1Pool: empty contents, errors, statistics, minimum and maximum; fit functions removed.
+ */
+void reset_th1(TH1 *h) {
+  h->Reset("M");
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <utility>
+
+#include <TObject.h>
+#include <TH1.h>
+#include <TF1.h>
+
+template <typename T>
+class RootPool;
+
+/**
+ * @brief Owner of the ROOT objects made in one scope (a run, a sector, a channel, a plot): every object made with
+ *    make() or handed over with adopt() is deleted when the arena is cleared or goes out of scope, newest first (so
+ *    what was drawn into a canvas goes before the canvas), and every object leased from a RootPool goes back to its
+ *    pool. Histograms made or adopted are detached from gDirectory, so closing a file cannot delete them twice.
+ *
+ * NOTE: ROOT deletes a canvas itself when another canvas of the same name is made, and a file deletes the objects read
+ *    from it when it is closed: do not put a canvas in an arena if one of its name follows in the arena's lifetime, nor
+ *    an object read from a file (adopt the file instead). Not thread-safe; use one arena per thread.
+ */
+class RootArena {
+  public:
+  RootArena() = default;
+  ~RootArena() { clear(); }
+  RootArena(const RootArena &) = delete;
+  RootArena &operator=(const RootArena &) = delete;
+
+  template <typename T, typename... Args>
+  T *make(Args&&... args);
+  template <typename T>
+  T *adopt(T *object);
+  template <typename T>
+  T *lease(RootPool<T> &pool);
+
+  void clear();
+  size_t size() const { return releases.size(); }
+
+  private:
+  static void detach(TH1 *h) { h->SetDirectory(nullptr); }
+  static void detach(void *) {}
+
+  std::vector<std::function<void()>> releases;   // oldest first
+};
+
+/**
+ * @brief Reuse pool of ROOT objects of one fixed shape (e.g. the seed TF1s of a channel fit, or the TH1s of a
+ *    per-channel spectrum): acquire() hands out a released object after reset(), or makes a new one, so a loop over
+ *    channels and runs makes as many objects as it uses at a time instead of one per iteration. The pool owns all
+ *    objects and deletes them when it goes out of scope, so it must outlive the arenas it lends to. Not thread-safe.
+ */
+template <typename T>
+class RootPool {
+  public:
+  explicit RootPool(std::function<T*()> make, std::function<void(T*)> reset = nullptr) : make(make), reset(reset) {}
+  RootPool(const RootPool &) = delete;
+  RootPool &operator=(const RootPool &) = delete;
+
+  T *acquire();
+  void release(T *object) { free.push_back(object); }
+
+  size_t n_made() const { return objects.size(); }
+  size_t n_reused() const { return reuses; }
+
+  private:
+  std::function<T*()> make;
+  std::function<void(T*)> reset;
+  std::vector<std::unique_ptr<T>> objects;
+  std::vector<T*> free;
+  size_t reuses = 0;
+};
+
+typedef RootPool<TF1> TF1Pool;
+typedef RootPool<TH1> TH1Pool;
+
+void reset_tf1(TF1 *f);
+void reset_th1(TH1 *h);
+
+/**
+ * @brief Make an object owned by the arena, e.g. arena.make<TCanvas>(name, "", 700, 500).
+ */
+template <typename T, typename... Args>
+T *RootArena::make(Args&&... args) {
+  return adopt(new T(std::forward<Args>(args)...));
+}
+
+/**
+ * @brief Take ownership of an object made elsewhere (e.g. a TFile of TFile::Open, closed and deleted by the arena).
+ */
+template <typename T>
+T *RootArena::adopt(T *object) {
+  if (object) {
+    detach(object);
+    releases.push_back([object]() { delete object; });
+  }
+  return object;
+}
+
+/**
+ * @brief Borrow an object of a pool until the arena is cleared.
+ */
+template <typename T>
+T *RootArena::lease(RootPool<T> &pool) {
+  T *object = pool.acquire();
+  releases.push_back([&pool, object]() { pool.release(object); });
+  return object;
+}
+
+template <typename T>
+T *RootPool<T>::acquire() {
+  if (!free.empty()) {
+    T *object = free.back();
+    free.pop_back();
+    if (reset) {
+      reset(object);
+    }
+    reuses++;
+    return object;
+  }
+  T *object = make();
+  objects.emplace_back(object);
+  return object;
+}
+
+#ifndef EMCAL_LIBRARY
+#include "root_arena.cpp"
+#endif
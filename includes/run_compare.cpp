@@ -0,0 +1,277 @@
+#include "run_compare.h"
+
+/**
+ * @brief Read h_allchannels and h_sp_perchnl of a run from physics_runs/qa_output_000<run>/histograms.root.
+ * 
+ * @param run 
+ * @param hists filled on success.
+ * @return true if the file and both histograms were found.
+ */
+bool read_run_hists(int run, RunHists &hists) {
+  TFile *hist_file = TFile::Open(Form("physics_runs/qa_output_000%i/histograms.root", run));
+  if (!hist_file) {
+    printf("FAILED to find run file: physics_runs/qa_output_000%i/histograms.root\n", run);
+    return false;
+  }
+  bool found = read_run_hists(hist_file, run, hists);
+  hist_file->Close();
+  delete hist_file;
+  return found;
+}
+
+/**
+ * @brief Read h_allchannels and h_sp_perchnl of a run from an open file (e.g. one kept open by HistService).
+ * 
+ * @param hist_file the run's histograms.root.
+ * @param run 
+ * @param hists filled on success.
+ * @return true if both histograms were found.
+ */
+bool read_run_hists(TFile *hist_file, int run, RunHists &hists) {
+  TH1D *h_mpv = nullptr;
+  TH1D *h_sp = nullptr;
+  hist_file->GetObject("h_allchannels;1", h_mpv);
+  hist_file->GetObject("h_sp_perchnl;1", h_sp);
+  if (!h_mpv || !h_sp) {
+    printf("FAILED to get h_allchannels/h_sp_perchnl for run %i\n", run);
+    return false;
+  }
+  hists.run = run;
+  hists.mpv.resize(SECTOR_CHANNELS);
+  hists.mpv_err.resize(SECTOR_CHANNELS);
+  hists.sp.resize(SECTOR_CHANNELS);
+  hists.sp_err.resize(SECTOR_CHANNELS);
+  for (int chnl = 0; chnl < SECTOR_CHANNELS; chnl++) {
+    hists.mpv[chnl] = h_mpv->GetBinContent(chnl + 1);
+    hists.mpv_err[chnl] = h_mpv->GetBinError(chnl + 1);
+    hists.sp[chnl] = h_sp->GetBinContent(chnl + 1);
+    hists.sp_err[chnl] = h_sp->GetBinError(chnl + 1);
+  }
+  return true;
+}
+
+std::pair<int, int> channel_grid_pos(int channel) {
+  // ADC channel of each tower of an 8 x 8 interface board; each board covers 8 rows of the grid, 64 channels
+  static const int emcadc[8][8] = {
+    {62, 60, 46, 44, 30, 28, 14, 12},
+    {63, 61, 47, 45, 31, 29, 15, 13},
+    {58, 56, 42, 40, 26, 24, 10,  8},
+    {59, 57, 43, 41, 27, 25, 11,  9},
+    {54, 52, 38, 36, 22, 20,  6,  4},
+    {55, 53, 39, 37, 23, 21,  7,  5},
+    {50, 48, 34, 32, 18, 16,  2,  0},
+    {51, 49, 35, 33, 19, 17,  3,  1},
+  };
+  static const std::array<std::pair<int, int>, SECTOR_CHANNELS> grid = []() {
+    std::array<std::pair<int, int>, SECTOR_CHANNELS> result;
+    for (int board = 0; board < SECTOR_CHANNELS/64; board++) {
+      for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+          result[emcadc[i][j] + 64*board] = std::make_pair(i + 8*board, j);
+        }
+      }
+    }
+    return result;
+  }();
+  return grid.at(channel);
+}
+
+/**
+ * @brief Ratio a/b with uncorrelated error propagation; NaN if either value is not positive.
+ */
+static inline void ratio_with_err(double a, double a_err, double b, double b_err, double &ratio, double &ratio_err) {
+  if (a > 0 && b > 0) {
+    ratio = a/b;
+    ratio_err = ratio*std::sqrt((a_err/a)*(a_err/a) + (b_err/b)*(b_err/b));
+  } else {
+    ratio = std::numeric_limits<double>::quiet_NaN();
+    ratio_err = std::numeric_limits<double>::quiet_NaN();
+  }
+}
+
+/**
+ * @brief Compare every candidate run to the reference run channel by channel.
+ * 
+ * @param reference 
+ * @param candidates 
+ * @param first_channel first channel (0-based) of the projection range (compareruns.C used bins 65..319).
+ * @param last_channel last channel (0-based, inclusive) of the projection range.
+ * @return std::vector<RunComparison> one per candidate, in order.
+ */
+std::vector<RunComparison> compare_run_batch(const RunHists &reference, const std::vector<RunHists> &candidates, int first_channel, int last_channel) {
+  if (first_channel < 0 || last_channel >= SECTOR_CHANNELS || first_channel > last_channel) {
+    throw std::runtime_error(Form("invalid projection channel range [%d, %d]", first_channel, last_channel));
+  }
+  std::vector<RunComparison> comparisons(candidates.size());
+  for (size_t c = 0; c < candidates.size(); c++) {
+    const RunHists &candidate = candidates[c];
+    RunComparison &cmp = comparisons[c];
+    cmp.reference = reference.run;
+    cmp.run = candidate.run;
+    cmp.mpv_ratio.resize(SECTOR_CHANNELS);
+    cmp.mpv_ratio_err.resize(SECTOR_CHANNELS);
+    cmp.sp_ratio.resize(SECTOR_CHANNELS);
+    cmp.sp_ratio_err.resize(SECTOR_CHANNELS);
+    for (int chnl = 0; chnl < SECTOR_CHANNELS; chnl++) {
+      ratio_with_err(reference.mpv[chnl], reference.mpv_err[chnl], candidate.mpv[chnl], candidate.mpv_err[chnl], cmp.mpv_ratio[chnl], cmp.mpv_ratio_err[chnl]);
+      ratio_with_err(reference.sp[chnl], reference.sp_err[chnl], candidate.sp[chnl], candidate.sp_err[chnl], cmp.sp_ratio[chnl], cmp.sp_ratio_err[chnl]);
+    }
+
+    double n = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    for (int chnl = first_channel; chnl <= last_channel; chnl++) {
+      double mpv_ratio = cmp.mpv_ratio[chnl];
+      double sp_ratio = cmp.sp_ratio[chnl];
+      if (!std::isnan(mpv_ratio)) {
+        cmp.mpv_stats.add(mpv_ratio);
+      }
+      if (!std::isnan(sp_ratio)) {
+        cmp.sp_stats.add(sp_ratio);
+      }
+      if (!std::isnan(mpv_ratio) && !std::isnan(sp_ratio)) {
+        n++;
+        sx += sp_ratio;
+        sy += mpv_ratio;
+        sxx += sp_ratio*sp_ratio;
+        syy += mpv_ratio*mpv_ratio;
+        sxy += sp_ratio*mpv_ratio;
+      }
+    }
+    double cxx = sxx - sx*sx/n;
+    double cyy = syy - sy*sy/n;
+    cmp.gain_mpv_corr = (n > 1 && cxx > 0 && cyy > 0) ? (sxy - sx*sy/n)/std::sqrt(cxx*cyy) : std::numeric_limits<double>::quiet_NaN();
+  }
+  return comparisons;
+}
+
+/**
+ * @brief Write one summary row per comparison (for trend monitoring).
+ * 
+ * @param comparisons 
+ * @param file_name 
+ */
+void write_run_comparison_csv(const std::vector<RunComparison> &comparisons, const std::string &file_name) {
+  FILE *file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", file_name.c_str()));
+  }
+  fprintf(file, "reference, run, n_mpv, mpv_ratio_mean, mpv_ratio_sigma, mpv_ratio_median, n_sp, sp_ratio_mean, sp_ratio_sigma, sp_ratio_median, gain_mpv_corr\n");
+  for (const RunComparison &cmp : comparisons) {
+    fprintf(file, "%d, %d, %ld, %f, %f, %f, %ld, %f, %f, %f, %f\n", cmp.reference, cmp.run,
+      cmp.mpv_stats.count(), cmp.mpv_stats.mean(), cmp.mpv_stats.std_dev(), cmp.mpv_stats.median(),
+      cmp.sp_stats.count(), cmp.sp_stats.mean(), cmp.sp_stats.std_dev(), cmp.sp_stats.median(), cmp.gain_mpv_corr);
+  }
+  fclose(file);
+}
+
+/**
+ * @brief Projection histogram of ratios over [first_channel, last_channel], centred on the median.
+ */
+static TH1D *ratio_projection(const char *name, const std::vector<double> &ratio, const RunningStats &stats, int first_channel, int last_channel) {
+  double half_width = std::max(0.05, 5*stats.std_dev());
+  double center = stats.count() > 0 ? stats.median() : 1.0;
+  TH1D *h = new TH1D(name, "", 80, center - half_width, center + half_width);
+  h->SetDirectory(nullptr);
+  h->Sumw2();
+  for (int chnl = first_channel; chnl <= last_channel; chnl++) {
+    if (!std::isnan(ratio[chnl])) {
+      h->Fill(ratio[chnl]);
+    }
+  }
+  return h;
+}
+
+/**
+ * @brief Save the plots of compareruns.C for one comparison: channel ratios, their projections (with gaus fit),
+ *    48 x 8 ratio maps and the gain ratio vs MPV ratio correlation.
+ * 
+ * @param comparison 
+ * @param first_channel projection range (as in compare_run_batch).
+ * @param last_channel 
+ * @param prefix file name prefix, e.g. "physics_runs/qa_output_00017867/compare_17995".
+ */
+void save_run_comparison_plots(const RunComparison &comparison, int first_channel, int last_channel, const std::string &prefix) {
+  // restored at the end, so the caller's style is left as it was
+  int opt_fit = gStyle->GetOptFit();
+  int opt_stat = gStyle->GetOptStat();
+  std::vector<int> palette(gStyle->GetNumberOfColors());
+  for (size_t i = 0; i < palette.size(); i++) {
+    palette[i] = gStyle->GetColorPalette(i);
+  }
+  gStyle->SetOptFit(1);
+  gStyle->SetOptStat(0);
+  const char *names[2] = {"mpv", "sp"};
+  const std::vector<double> *ratios[2] = {&comparison.mpv_ratio, &comparison.sp_ratio};
+  const std::vector<double> *errors[2] = {&comparison.mpv_ratio_err, &comparison.sp_ratio_err};
+  const RunningStats *stats[2] = {&comparison.mpv_stats, &comparison.sp_stats};
+  for (int q = 0; q < 2; q++) {
+    const char *title = Form("%s ratio run %d / run %d", names[q], comparison.reference, comparison.run);
+
+    TH1D *h_ratio = new TH1D(Form("h_%s_ratio_%d", names[q], comparison.run), Form("%s;channel;ratio", title), SECTOR_CHANNELS, 0, SECTOR_CHANNELS);
+    h_ratio->SetDirectory(nullptr);
+    TH2D *h_map = new TH2D(Form("h_%s_2dmap_%d", names[q], comparison.run), title, 48, 0, 48, 8, 0, 8);
+    h_map->SetDirectory(nullptr);
+    for (int chnl = 0; chnl < SECTOR_CHANNELS; chnl++) {
+      double ratio = ratios[q]->at(chnl);
+      if (std::isnan(ratio)) {
+        continue;
+      }
+      h_ratio->SetBinContent(chnl + 1, ratio);
+      h_ratio->SetBinError(chnl + 1, errors[q]->at(chnl));
+      std::pair<int, int> pos = channel_grid_pos(chnl);
+      h_map->SetBinContent(pos.first + 1, 8 - pos.second, ratio);
+    }
+
+    TCanvas *c = new TCanvas("", "", 700, 500);
+    h_ratio->SetAxisRange(0.8, 1.2, "Y");
+    h_ratio->Draw();
+    c->SaveAs(Form("%s_%s_ratio.pdf", prefix.c_str(), names[q]));
+    delete c;
+
+    TH1D *h_proj = ratio_projection(Form("h_%s_proj_%d", names[q], comparison.run), *ratios[q], *stats[q], first_channel, last_channel);
+    h_proj->SetTitle(Form("%s;ratio;channels", title));
+    c = new TCanvas("", "", 500, 500);
+    h_proj->Draw();
+    if (h_proj->GetEntries() > 0) {
+      h_proj->Fit("gaus", "Q");
+    }
+    c->SaveAs(Form("%s_%s_proj.pdf", prefix.c_str(), names[q]));
+    delete c;
+
+    gStyle->SetPalette(kRainBow);
+    c = new TCanvas("", "", 1200, 500);
+    if (stats[q]->count() > 0) {
+      h_map->SetAxisRange(stats[q]->quartile_low() - 3*(stats[q]->quartile_high() - stats[q]->quartile_low()), stats[q]->quartile_high() + 3*(stats[q]->quartile_high() - stats[q]->quartile_low()), "Z");
+    }
+    h_map->Draw("COLZ");
+    c->SaveAs(Form("%s_%s_map.pdf", prefix.c_str(), names[q]));
+    delete c;
+
+    delete h_ratio;
+    delete h_proj;
+    delete h_map;
+  }
+
+  const RunningStats &sp = comparison.sp_stats;
+  const RunningStats &mpv = comparison.mpv_stats;
+  double sp_half = std::max(0.05, 5*sp.std_dev());
+  double mpv_half = std::max(0.05, 5*mpv.std_dev());
+  double sp_center = sp.count() > 0 ? sp.median() : 1.0;
+  double mpv_center = mpv.count() > 0 ? mpv.median() : 1.0;
+  TH2D *h_corr = new TH2D(Form("h_corr_%d", comparison.run), Form("gain vs MPV ratio (r = %.3f);sp ratio;mpv ratio", comparison.gain_mpv_corr),
+    30, sp_center - sp_half, sp_center + sp_half, 30, mpv_center - mpv_half, mpv_center + mpv_half);
+  h_corr->SetDirectory(nullptr);
+  for (int chnl = first_channel; chnl <= last_channel; chnl++) {
+    if (!std::isnan(comparison.sp_ratio[chnl]) && !std::isnan(comparison.mpv_ratio[chnl])) {
+      h_corr->Fill(comparison.sp_ratio[chnl], comparison.mpv_ratio[chnl]);
+    }
+  }
+  TCanvas *c = new TCanvas("", "", 700, 500);
+  h_corr->Draw("COLZ");
+  c->SaveAs(Form("%s_corr.pdf", prefix.c_str()));
+  delete c;
+  delete h_corr;
+
+  gStyle->SetOptFit(opt_fit);
+  gStyle->SetOptStat(opt_stat);
+  gStyle->SetPalette(palette.size(), palette.data());
+}
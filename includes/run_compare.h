@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include <TFile.h>
+#include <TH1D.h>
+#include <TH2D.h>
+#include <TCanvas.h>
+#include <TStyle.h>
+#include <TF1.h>
+
+#include "mpv_dbn.h"
+
+/**
+ * @brief Channels per sector (bins of h_allchannels and h_sp_perchnl).
+ */
+const int SECTOR_CHANNELS = 384;
+
+/**
+ * @brief Per-channel MPV (h_allchannels) and single-pixel gain (h_sp_perchnl) of one run, with errors.
+ */
+typedef struct RunHists {
+  int run;
+  std::vector<double> mpv;
+  std::vector<double> mpv_err;
+  std::vector<double> sp;
+  std::vector<double> sp_err;
+} RunHists;
+
+bool read_run_hists(int run, RunHists &hists);
+bool read_run_hists(TFile *hist_file, int run, RunHists &hists);
+
+/**
+ * @brief Position of a channel on the 48 x 8 readout grid used by compareruns.C (row along the sector, column across).
+ */
+std::pair<int, int> channel_grid_pos(int channel);
+
+/**
+ * @brief Channel-wise comparison of a candidate run to a reference run: ratios (reference / candidate, as compareruns.C
+ *    divides the run of its folder by the other run) with propagated errors, their distributions over the projection
+ *    channel range and the gain ratio vs MPV ratio correlation.
+ */
+typedef struct RunComparison {
+  int reference;
+  int run;
+  std::vector<double> mpv_ratio;     // NaN where undefined
+  std::vector<double> mpv_ratio_err;
+  std::vector<double> sp_ratio;
+  std::vector<double> sp_ratio_err;
+  RunningStats mpv_stats;            // over the projection channel range
+  RunningStats sp_stats;
+  double gain_mpv_corr;              // Pearson(sp ratio, mpv ratio) over the projection channel range
+} RunComparison;
+
+std::vector<RunComparison> compare_run_batch(const RunHists &reference, const std::vector<RunHists> &candidates, int first_channel = 64, int last_channel = 318);
+void write_run_comparison_csv(const std::vector<RunComparison> &comparisons, const std::string &file_name);
+void save_run_comparison_plots(const RunComparison &comparison, int first_channel, int last_channel, const std::string &prefix);
+
+#ifndef EMCAL_LIBRARY
+#include "run_compare.cpp"
+#endif
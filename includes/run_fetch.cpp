@@ -0,0 +1,372 @@
+#include "run_fetch.h"
+
+/**
+ * @brief Name of a run's QA output folder, e.g. "qa_output_00021518".
+ */
+std::string run_folder_name(int run) {
+  return Form("qa_output_000%05d", run);
+}
+
+/**
+ * @brief Create a directory unless it exists. Throws std::runtime_error on failure.
+ */
+void make_directory(const std::string &dir_name) {
+  if (mkdir(dir_name.c_str(), 0755) != 0 && errno != EEXIST) {
+    throw std::runtime_error(Form("unable to create directory '%s'", dir_name.c_str()));
+  }
+}
+
+/**
+ * @brief
+ *
+ * @param source_dir directory with the qa_output_000<run> folders.
+ * @param dest_dir local directory the folders are copied into.
+ * @param files files of each run folder to copy.
+ */
+RunFetcher::RunFetcher(const std::string &source_dir, const std::string &dest_dir, const std::vector<std::string> &files)
+  : source_dir(source_dir), dest_dir(dest_dir), files(files) {
+  load_manifest();
+}
+
+void RunFetcher::load_manifest() {
+  FILE *infile = fopen((dest_dir + "/.manifest").c_str(), "r");
+  if (!infile) {
+    return;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), infile)) {
+    line[strcspn(line, "\n")] = '\0';
+    int run;
+    long long size;
+    char digest[17];
+    int n_chars = 0;
+    if (sscanf(line, "%d %lld %16s %n", &run, &size, digest, &n_chars) == 3 && n_chars > 0) {
+      manifest[{run, line + n_chars}] = {line + n_chars, size, digest, 0};
+    }
+  }
+  fclose(infile);
+}
+
+/**
+ * @brief Write dest_dir/.manifest (to a temporary file, then renamed over the old one).
+ */
+void RunFetcher::save_manifest() const {
+  std::string file_name = dest_dir + "/.manifest";
+  std::string tmp_name = file_name + ".tmp";
+  FILE *outfile = fopen(tmp_name.c_str(), "w");
+  if (!outfile) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", tmp_name.c_str()));
+  }
+  for (const auto &p : manifest) {
+    fprintf(outfile, "%d %lld %s %s\n", p.first.first, p.second.size, p.second.digest.c_str(), p.first.second.c_str());
+  }
+  bool ok = !ferror(outfile);
+  ok = (fclose(outfile) == 0) && ok;
+  if (!ok || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+    remove(tmp_name.c_str());
+    throw std::runtime_error(Form("failed to write manifest '%s'", file_name.c_str()));
+  }
+}
+
+/**
+ * @brief Copy (or finish copying) a file into a ".partial" file and verify it: its size must be the source's and its
+ *    content must hash to the digest of the bytes read from the source. The size and mtime of the source are kept next
+ *    to the partial file ("<partial>.source"); if they match, a later call compares the whole chunks already copied
+ *    (see DIGEST_CHUNK_SIZE) with the source and resumes from the first which differs, so a corrupt prefix is copied
+ *    again.
+ *
+ * @param source
+ * @param partial
+ * @return FetchedFile (name is left empty)
+ */
+FetchedFile RunFetcher::copy_file(const std::string &source, const std::string &partial) const {
+  struct stat source_st;
+  if (stat(source.c_str(), &source_st) != 0) {
+    throw std::runtime_error(Form("%s does not exist", source.c_str()));
+  }
+  long long source_size = source_st.st_size;
+  long long source_mtime = source_st.st_mtime;
+
+  // resume from the last whole chunk if the partial copy is of the same source
+  std::string info_name = partial + ".source";
+  long long offset = 0;
+  struct stat partial_st;
+  FILE *info = fopen(info_name.c_str(), "r");
+  if (info) {
+    long long size, mtime;
+    if (fscanf(info, "%lld %lld", &size, &mtime) == 2 && size == source_size && mtime == source_mtime &&
+        stat(partial.c_str(), &partial_st) == 0) {
+      offset = std::min<long long>(partial_st.st_size, source_size) / DIGEST_CHUNK_SIZE * DIGEST_CHUNK_SIZE;
+    }
+    fclose(info);
+  }
+  if (offset == 0) {
+    info = fopen(info_name.c_str(), "w");
+    if (!info) {
+      throw std::runtime_error(Form("unable to open '%s' for writing", info_name.c_str()));
+    }
+    fprintf(info, "%lld %lld\n", source_size, source_mtime);
+    fclose(info);
+  } else if (truncate(partial.c_str(), offset) != 0) {
+    throw std::runtime_error(Form("unable to truncate '%s'", partial.c_str()));
+  }
+
+  FILE *infile = fopen(source.c_str(), "rb");
+  if (!infile) {
+    throw std::runtime_error(Form("unable to open '%s' for reading", source.c_str()));
+  }
+  FILE *outfile = fopen(partial.c_str(), offset > 0 ? "r+b" : "wb");
+  if (!outfile) {
+    fclose(infile);
+    throw std::runtime_error(Form("unable to open '%s' for writing", partial.c_str()));
+  }
+  Fingerprint fp;
+  std::vector<char> buffer(DIGEST_CHUNK_SIZE);
+  std::vector<char> copied(DIGEST_CHUNK_SIZE);
+  bool ok = true;
+  // keep the copied chunks which match the source (hashing the source's bytes), then copy from the first which does not
+  long long resumed = 0;
+  while (ok && resumed < offset) {
+    ok = fread(buffer.data(), 1, DIGEST_CHUNK_SIZE, infile) == DIGEST_CHUNK_SIZE;
+    if (!ok || fread(copied.data(), 1, DIGEST_CHUNK_SIZE, outfile) != DIGEST_CHUNK_SIZE ||
+        memcmp(buffer.data(), copied.data(), DIGEST_CHUNK_SIZE) != 0) {
+      break;
+    }
+    fp.add(buffer.data(), DIGEST_CHUNK_SIZE);
+    resumed += DIGEST_CHUNK_SIZE;
+  }
+  offset = resumed;
+  ok = ok && fseeko(infile, offset, SEEK_SET) == 0 && fseeko(outfile, offset, SEEK_SET) == 0;
+  long long bytes_copied = 0;
+  size_t n_read;
+  while (ok && (n_read = fread(buffer.data(), 1, buffer.size(), infile)) > 0) {
+    ok = fwrite(buffer.data(), 1, n_read, outfile) == n_read;
+    fp.add(buffer.data(), n_read);
+    bytes_copied += n_read;
+  }
+  ok = ok && !ferror(infile);
+  fclose(infile);
+  ok = (fclose(outfile) == 0) && ok;
+  if (!ok) {
+    throw std::runtime_error(Form("failed to copy '%s' to '%s'", source.c_str(), partial.c_str()));
+  }
+
+  if (stat(partial.c_str(), &partial_st) != 0 || partial_st.st_size != source_size) {
+    remove(partial.c_str());
+    remove(info_name.c_str());
+    throw std::runtime_error(Form("size of '%s' does not match '%s' (changed while copying?)", partial.c_str(), source.c_str()));
+  }
+  std::string digest = content_digest(partial);
+  if (digest != fp.hex()) {
+    remove(partial.c_str());
+    remove(info_name.c_str());
+    throw std::runtime_error(Form("checksum of '%s' does not match the bytes read from '%s'", partial.c_str(), source.c_str()));
+  }
+  remove(info_name.c_str());
+  return {"", source_size, digest, bytes_copied};
+}
+
+/**
+ * @brief Fetch the missing files of one run (runs in a worker thread; reads but does not modify the manifest).
+ *
+ * @param result run to fetch; files and status are filled in.
+ * @param verify recompute the digest of files which are already local and refetch those not matching the manifest.
+ */
+void RunFetcher::fetch_run(RunFetch &result, bool verify) const {
+  std::string folder = run_folder_name(result.run);
+  std::string run_dir = dest_dir + "/" + folder;
+  std::string staging_dir = dest_dir + "/.fetch/" + folder;
+  std::vector<std::string> copied;
+  struct stat st;
+  for (const std::string &file : files) {
+    std::string local = run_dir + "/" + file;
+    if (stat(local.c_str(), &st) == 0) {
+      std::unique_lock<std::mutex> lock(mutex);
+      auto it = manifest.find({result.run, file});
+      if (it == manifest.end()) {
+        // copied before there was a manifest
+        lock.unlock();
+        result.files.push_back({file, static_cast<long long>(st.st_size), content_digest(local), 0});
+        continue;
+      }
+      FetchedFile recorded = it->second;
+      lock.unlock();
+      if (recorded.size == st.st_size && (!verify || content_digest(local) == recorded.digest)) {
+        result.files.push_back(recorded);
+        continue;
+      }
+    }
+    make_directory(staging_dir);
+    std::string partial = staging_dir + "/" + file + ".partial";
+    FetchedFile fetched = copy_file(source_dir + "/" + folder + "/" + file, partial);
+    fetched.name = file;
+    if (rename(partial.c_str(), (staging_dir + "/" + file).c_str()) != 0) {
+      throw std::runtime_error(Form("unable to rename '%s'", partial.c_str()));
+    }
+    result.files.push_back(fetched);
+    copied.push_back(file);
+  }
+  if (copied.empty()) {
+    result.status = RunFetch::LOCAL;
+    return;
+  }
+
+  // move the run into place: the whole folder if it is new, else the copied files
+  if (stat(run_dir.c_str(), &st) != 0) {
+    if (rename(staging_dir.c_str(), run_dir.c_str()) != 0) {
+      throw std::runtime_error(Form("unable to rename '%s' to '%s'", staging_dir.c_str(), run_dir.c_str()));
+    }
+  } else {
+    for (const std::string &file : copied) {
+      if (rename((staging_dir + "/" + file).c_str(), (run_dir + "/" + file).c_str()) != 0) {
+        throw std::runtime_error(Form("unable to move '%s' into '%s'", file.c_str(), run_dir.c_str()));
+      }
+    }
+    rmdir(staging_dir.c_str());
+  }
+  result.status = RunFetch::FETCHED;
+}
+
+/**
+ * @brief Fetch runs with at most n_workers copying at a time. A failed run does not stop the others; see n_failed()
+ *    and print_report().
+ *
+ * @param runs run numbers (duplicates are fetched once).
+ * @param n_workers
+ * @param verify see fetch_run.
+ * @return one RunFetch per distinct run, in increasing run order.
+ */
+const std::vector<RunFetch> &RunFetcher::fetch(const std::vector<int> &runs, unsigned int n_workers, bool verify) {
+  typedef std::chrono::steady_clock clock;
+  clock::time_point fetch_start = clock::now();
+  results.clear();
+  for (int run : std::set<int>(runs.begin(), runs.end())) {
+    results.push_back({run, RunFetch::PENDING, {}, 0, ""});
+  }
+  make_directory(dest_dir);
+  make_directory(dest_dir + "/.fetch");
+
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < results.size(); i = next++) {
+      trace_counter("fetch: queued runs", results.size() - std::min(i + 1, results.size()));
+      fetch_timed(results[i], verify);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < std::max(n_workers, 1u); t++) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (const RunFetch &result : results) {
+    record(result);
+  }
+  save_manifest();
+  total_wall_time = std::chrono::duration<double>(clock::now() - fetch_start).count();
+  return results;
+}
+
+/**
+ * @brief Fetch one run, e.g. from a job of a Pipeline which processes each run as soon as it is local. Safe to call
+ *    from several threads at once; the run is added to the results (see print_report) and the manifest is saved.
+ *
+ * @param run
+ * @param verify see fetch_run.
+ * @return the run's RunFetch (status FAILED with the error instead of throwing).
+ */
+RunFetch RunFetcher::fetch_one(int run, bool verify) {
+  make_directory(dest_dir);
+  make_directory(dest_dir + "/.fetch");
+  RunFetch result = {run, RunFetch::PENDING, {}, 0, ""};
+  fetch_timed(result, verify);
+  std::lock_guard<std::mutex> lock(mutex);
+  record(result);
+  save_manifest();
+  results.push_back(result);
+  total_wall_time += result.wall_time;   // summed over the runs fetched one at a time
+  return result;
+}
+
+/**
+ * @brief Record a file of a run which was written into dest_dir by other means (e.g. extract_runs) in the manifest, so
+ *    that fetching the run keeps it instead of copying the source's file over it. Safe to call from several threads
+ *    at once; the manifest is saved. Throws std::runtime_error if the file does not exist.
+ *
+ * @param run
+ * @param file_name e.g. "histograms.root"
+ */
+void RunFetcher::adopt(int run, const std::string &file_name) {
+  std::string local = dest_dir + "/" + run_folder_name(run) + "/" + file_name;
+  struct stat st;
+  if (stat(local.c_str(), &st) != 0) {
+    throw std::runtime_error(Form("no file '%s'", local.c_str()));
+  }
+  FetchedFile file = {file_name, static_cast<long long>(st.st_size), content_digest(local), 0};
+  std::lock_guard<std::mutex> lock(mutex);
+  manifest[{run, file_name}] = file;
+  save_manifest();
+}
+
+/**
+ * @brief fetch_run, catching its error into result and timing it.
+ */
+void RunFetcher::fetch_timed(RunFetch &result, bool verify) const {
+  typedef std::chrono::steady_clock clock;
+  clock::time_point start = clock::now();
+  ScopedTimer timer("fetch: run");
+  timer.arg("run", result.run);
+  try {
+    fetch_run(result, verify);
+  } catch (const std::exception &e) {
+    result.status = RunFetch::FAILED;
+    result.error = e.what();
+    // keeps partial copies (to resume) but not an empty staging directory
+    rmdir((dest_dir + "/.fetch/" + run_folder_name(result.run)).c_str());
+  }
+  result.wall_time = std::chrono::duration<double>(clock::now() - start).count();
+}
+
+/**
+ * @brief Add the files of a fetched (or local) run to the manifest.
+ */
+void RunFetcher::record(const RunFetch &result) {
+  if (result.status != RunFetch::FAILED) {
+    for (const FetchedFile &file : result.files) {
+      manifest[{result.run, file.name}] = {file.name, file.size, file.digest, 0};
+    }
+  }
+}
+
+size_t RunFetcher::n_failed() const {
+  size_t n = 0;
+  for (const RunFetch &result : results) {
+    n += result.status == RunFetch::FAILED;
+  }
+  return n;
+}
+
+/**
+ * @brief Print the status, copied bytes and time of every run of the last fetch(), and the totals.
+ */
+void RunFetcher::print_report(FILE *out) const {
+  const char *status_names[] = {"pending", "local", "fetched", "FAILED"};
+  long long total_bytes = 0;
+  size_t n_fetched = 0;
+  for (const RunFetch &result : results) {
+    long long bytes = 0;
+    for (const FetchedFile &file : result.files) {
+      bytes += file.bytes_copied;
+    }
+    fprintf(out, "%-8s %8.3f s %10.1f kB  run %d", status_names[result.status], result.wall_time, bytes/1e3, result.run);
+    if (!result.error.empty()) {
+      fprintf(out, " (%s)", result.error.c_str());
+    }
+    fprintf(out, "\n");
+    total_bytes += bytes;
+    n_fetched += result.status == RunFetch::FETCHED;
+  }
+  fprintf(out, "%zu runs (%zu fetched, %zu failed): %.1f MB copied in %.3f s\n", results.size(), n_fetched, n_failed(), total_bytes/1e6, total_wall_time);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+
+#include <TString.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fingerprint.h"
+#include "profiler.h"
+
+/**
+ * @brief Tim's QA output folders (qa_output_000<run>) on GPFS.
+ */
+const std::string PHYSICS_RUNS_SOURCE = "/gpfs/mnt/gpfs02/sphenix/user/trinn/sPHENIX_emcal_cosmics_sector0/macros";
+
+std::string run_folder_name(int run);
+void make_directory(const std::string &dir_name);
+
+/**
+ * @brief A file of a run, as copied (or found) locally.
+ */
+typedef struct FetchedFile {
+  std::string name;         // e.g. "histograms.root"
+  long long size;
+  std::string digest;       // content_digest of the local copy
+  long long bytes_copied;   // by this fetch (0 if the file was already local)
+} FetchedFile;
+
+typedef struct RunFetch {
+  int run;
+  enum Status {PENDING, LOCAL, FETCHED, FAILED} status;
+  std::vector<FetchedFile> files;
+  double wall_time;         // seconds
+  std::string error;
+} RunFetch;
+
+/**
+ * @brief Copies selected files of run folders from a source directory (GPFS, or any local directory) into a destination
+ *    directory, several runs at a time. Each file is copied to a ".partial" file in a staging directory
+ *    (dest_dir/.fetch/qa_output_000<run>), checked against the source size and the checksum of the copied bytes, and
+ *    the run's folder is then renamed into dest_dir, so dest_dir never has half-copied runs. An interrupted copy is
+ *    resumed from the last whole chunk if the source did not change. Local files are recorded with their size and
+ *    digest in dest_dir/.manifest; files written into dest_dir by other means are recorded with adopt().
+ */
+class RunFetcher {
+  public:
+  RunFetcher(const std::string &source_dir = PHYSICS_RUNS_SOURCE, const std::string &dest_dir = "physics_runs",
+             const std::vector<std::string> &files = {"histograms.root"});
+  const std::vector<RunFetch> &fetch(const std::vector<int> &runs, unsigned int n_workers = 4, bool verify = false);
+  RunFetch fetch_one(int run, bool verify = false);
+  void adopt(int run, const std::string &file_name = "histograms.root");
+  size_t n_failed() const;
+  void print_report(FILE *out = stdout) const;
+
+  private:
+  void fetch_run(RunFetch &result, bool verify) const;
+  void fetch_timed(RunFetch &result, bool verify) const;
+  void record(const RunFetch &result);
+  FetchedFile copy_file(const std::string &source, const std::string &partial) const;
+  void load_manifest();
+  void save_manifest() const;
+
+  std::string source_dir;
+  std::string dest_dir;
+  std::vector<std::string> files;
+  std::map<std::pair<int, std::string>, FetchedFile> manifest;   // (run, file name) -> local copy
+  std::vector<RunFetch> results;
+  double total_wall_time = 0;
+  mutable std::mutex mutex;   // guards manifest and results while fetch_one runs in several threads
+};
+
+#ifndef EMCAL_LIBRARY
+#include "run_fetch.cpp"
+#endif
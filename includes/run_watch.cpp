@@ -0,0 +1,241 @@
+#include "run_watch.h"
+
+/**
+ * @brief Run number of a run folder name, e.g. 21518 for "qa_output_00021518" or "qa_output_nopedestal_00021518".
+ *
+ * @return run number, or -1 if folder is not a run folder.
+ */
+int run_from_folder_name(const std::string &folder) {
+  if (folder.rfind("qa_output_", 0) != 0) {
+    return -1;
+  }
+  std::string digits = folder.substr(folder.rfind('_') + 1);
+  if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) {
+    return -1;
+  }
+  return atoi(digits.c_str());
+}
+
+/**
+ * @brief Events of a run folder which restart its debounce: files created, written (every write, so a slow copy keeps
+ *    the folder unsettled until it ends), closed after writing or renamed into it.
+ */
+static const uint32_t RUN_FOLDER_EVENTS = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR;
+
+/**
+ * @brief
+ *
+ * @param debounce_seconds how long a run folder or file must be unchanged to be reported.
+ */
+RunWatcher::RunWatcher(double debounce_seconds) : fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), debounce_seconds(debounce_seconds) {
+  if (fd < 0) {
+    throw std::runtime_error("inotify_init1 failed");
+  }
+}
+
+RunWatcher::~RunWatcher() {
+  close(fd);
+}
+
+/**
+ * @return false if path is gone (or no longer a directory): a run folder may be removed or renamed (as rsync does with
+ *    its temporary folders) before its event is read. Its new name, if any, has an event of its own, and a rescan
+ *    watches every run folder there is. Throws std::runtime_error on any other failure.
+ */
+bool RunWatcher::add_watch(const std::string &path, uint32_t mask, const Watch &watch) {
+  int wd = inotify_add_watch(fd, path.c_str(), mask);
+  if (wd < 0 && (errno == ENOENT || errno == ENOTDIR)) {
+    return false;
+  }
+  if (wd < 0) {
+    throw std::runtime_error(Form("unable to watch '%s': %s", path.c_str(), strerror(errno)));
+  }
+  watches[wd] = watch;
+  return true;
+}
+
+/**
+ * @brief Watch a directory for new run folders, and its run folders for new or rewritten files.
+ *
+ * @param dir e.g. "physics_runs"
+ */
+void RunWatcher::watch_runs(const std::string &dir) {
+  if (!add_watch(dir, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR, {dir, "", true})) {
+    throw std::runtime_error(Form("no directory '%s' to watch", dir.c_str()));
+  }
+  watch_run_folders(dir, false);
+}
+
+/**
+ * @brief Watch every run folder of dir (a folder already watched keeps its watch descriptor).
+ *
+ * @param dir
+ * @param mark_pending also treat every run folder as changed now.
+ */
+void RunWatcher::watch_run_folders(const std::string &dir, bool mark_pending) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) {
+    throw std::runtime_error(Form("unable to read directory '%s'", dir.c_str()));
+  }
+  struct dirent *entry;
+  while ((entry = readdir(d))) {
+    std::string folder = entry->d_name;
+    struct stat st;
+    if (run_from_folder_name(folder) > 0 && stat((dir + "/" + folder).c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      if (add_watch(dir + "/" + folder, RUN_FOLDER_EVENTS, {dir, folder, true}) && mark_pending) {
+        pending_runs[{dir, folder}] = clock::now();
+      }
+    }
+  }
+  closedir(d);
+}
+
+/**
+ * @brief After an event queue overflow (events were lost): watch run folders created meanwhile, and treat every run
+ *    folder and watched file as changed, so each is reported again once settled.
+ */
+void RunWatcher::rescan() {
+  std::vector<std::string> run_dirs;
+  for (const std::pair<const int, Watch> &w : watches) {
+    if (w.second.runs && w.second.folder.empty()) {
+      run_dirs.push_back(w.second.dir);
+    }
+  }
+  for (const std::string &dir : run_dirs) {
+    watch_run_folders(dir, true);
+  }
+  for (const std::pair<const std::string, std::vector<std::string>> &dir : watched_files) {
+    for (const std::string &name : dir.second) {
+      pending_files[dir.first + "/" + name] = clock::now();
+    }
+  }
+}
+
+/**
+ * @brief Watch a file for being rewritten or replaced (by watching its directory, so editors renaming over it work).
+ *
+ * NOTE: do not watch files in a directory also given to watch_runs.
+ *
+ * @param file_name e.g. "files/physics_runs.csv"
+ */
+void RunWatcher::watch_file(const std::string &file_name) {
+  size_t slash = file_name.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : file_name.substr(0, slash);
+  std::string name = slash == std::string::npos ? file_name : file_name.substr(slash + 1);
+  if (watched_files.find(dir) == watched_files.end() && !add_watch(dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR, {dir, "", false})) {
+    throw std::runtime_error(Form("no directory '%s' to watch", dir.c_str()));
+  }
+  watched_files[dir].push_back(name);
+}
+
+/**
+ * @brief Read all queued inotify events and note the run folders and files they changed.
+ */
+void RunWatcher::read_events() {
+  alignas(struct inotify_event) char buffer[16384];
+  ssize_t n_read;
+  while ((n_read = read(fd, buffer, sizeof(buffer))) > 0) {
+    clock::time_point now = clock::now();
+    for (char *p = buffer; p < buffer + n_read;) {
+      const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        rescan();
+        continue;
+      }
+      auto it = watches.find(event->wd);
+      if (it == watches.end()) {
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        // the folder was removed
+        watches.erase(it);
+        continue;
+      }
+      Watch watch = it->second;
+      std::string name = event->len > 0 ? event->name : "";
+      if (!watch.runs) {
+        const std::vector<std::string> &names = watched_files[watch.dir];
+        if (std::find(names.begin(), names.end(), name) != names.end()) {
+          pending_files[watch.dir + "/" + name] = now;
+        }
+      } else if (watch.folder.empty()) {
+        if ((event->mask & IN_ISDIR) && run_from_folder_name(name) > 0 &&
+            add_watch(watch.dir + "/" + name, RUN_FOLDER_EVENTS, {watch.dir, name, true})) {
+          pending_runs[{watch.dir, name}] = now;
+        }
+      } else {
+        pending_runs[{watch.dir, watch.folder}] = now;
+      }
+    }
+  }
+}
+
+bool RunWatcher::settled(clock::time_point last_change) const {
+  return std::chrono::duration<double>(clock::now() - last_change).count() >= debounce_seconds;
+}
+
+/**
+ * @brief Block until run folders or files have settled (nothing changed in them for the debounce time).
+ *
+ * @param runs set to the settled run folders with a histograms.root.
+ * @param files set to the settled watched files (paths as given to watch_file).
+ * @param timeout_seconds give up after this long; < 0 waits forever.
+ * @return false on timeout.
+ */
+bool RunWatcher::wait(std::vector<RunEvent> &runs, std::vector<std::string> &files, double timeout_seconds) {
+  runs.clear();
+  files.clear();
+  clock::time_point start = clock::now();
+  while (true) {
+    read_events();
+    for (auto it = pending_runs.begin(); it != pending_runs.end();) {
+      if (!settled(it->second)) {
+        it++;
+        continue;
+      }
+      const std::string &dir = it->first.first;
+      const std::string &folder = it->first.second;
+      struct stat st;
+      if (stat((dir + "/" + folder + "/histograms.root").c_str(), &st) == 0) {
+        runs.push_back({dir, folder, run_from_folder_name(folder)});
+      }
+      it = pending_runs.erase(it);
+    }
+    for (auto it = pending_files.begin(); it != pending_files.end();) {
+      if (settled(it->second)) {
+        files.push_back(it->first);
+        it = pending_files.erase(it);
+      } else {
+        it++;
+      }
+    }
+    if (!runs.empty() || !files.empty()) {
+      return true;
+    }
+
+    // sleep until the next event, the next pending change settles, or the timeout
+    double wait_seconds = -1;
+    auto wait_for = [&](clock::time_point t) {
+      double seconds = std::max(0.0, std::chrono::duration<double>(t - clock::now()).count());
+      wait_seconds = wait_seconds < 0 ? seconds : std::min(wait_seconds, seconds);
+    };
+    for (const auto &p : pending_runs) {
+      wait_for(p.second + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(debounce_seconds)));
+    }
+    for (const auto &p : pending_files) {
+      wait_for(p.second + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(debounce_seconds)));
+    }
+    if (timeout_seconds >= 0) {
+      clock::time_point deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(timeout_seconds));
+      if (clock::now() >= deadline) {
+        return false;
+      }
+      wait_for(deadline);
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, wait_seconds < 0 ? -1 : static_cast<int>(wait_seconds*1000) + 1) < 0 && errno != EINTR) {
+      throw std::runtime_error("poll on inotify failed");
+    }
+  }
+}
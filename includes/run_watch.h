@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <TString.h>
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief A run folder (qa_output_*<run>) which appeared or changed in a watched directory and has settled.
+ */
+typedef struct RunEvent {
+  std::string dir;      // watched directory, e.g. "physics_runs"
+  std::string folder;   // e.g. "qa_output_00021518"
+  int run;
+} RunEvent;
+
+int run_from_folder_name(const std::string &folder);
+
+/**
+ * @brief Watches directories of run folders (inotify) and single files, and reports a run folder or file once nothing
+ *    changed in it for the debounce time. A run folder is only reported once it has a histograms.root, so folders
+ *    being copied (or renamed into place by RunFetcher) are reported once, when complete. Every write into a run
+ *    folder restarts its debounce, so a slow copy is not reported half-written; if the kernel's event queue
+ *    overflows, every watched run folder and file is treated as changed.
+ *
+ * NOTE: Linux only (inotify).
+ */
+class RunWatcher {
+  public:
+  explicit RunWatcher(double debounce_seconds = 5);
+  ~RunWatcher();
+  RunWatcher(const RunWatcher &) = delete;
+  RunWatcher &operator=(const RunWatcher &) = delete;
+
+  void watch_runs(const std::string &dir);
+  void watch_file(const std::string &file_name);
+  bool wait(std::vector<RunEvent> &runs, std::vector<std::string> &files, double timeout_seconds = -1);
+
+  private:
+  typedef std::chrono::steady_clock clock;
+  typedef struct Watch {
+    std::string dir;
+    std::string folder;   // run folder watched (dir/folder), "" for the directory itself
+    bool runs;            // dir holds run folders (else: files watched with watch_file)
+  } Watch;
+
+  bool add_watch(const std::string &path, uint32_t mask, const Watch &watch);
+  void watch_run_folders(const std::string &dir, bool mark_pending);
+  void rescan();
+  void read_events();
+  bool settled(clock::time_point last_change) const;
+
+  int fd;
+  double debounce_seconds;
+  std::map<int, Watch> watches;                              // watch descriptor -> what it watches
+  std::map<std::string, std::vector<std::string>> watched_files;   // directory -> names of files watched in it
+  std::map<std::pair<std::string, std::string>, clock::time_point> pending_runs;   // (dir, folder) -> last change
+  std::map<std::string, clock::time_point> pending_files;    // path -> last change
+};
+
+#ifndef EMCAL_LIBRARY
+#include "run_watch.cpp"
+#endif
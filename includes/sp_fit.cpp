@@ -0,0 +1,75 @@
+#include "sp_fit.h"
+
+/**
+ * @brief Single pixel fit function of singlepixelfit.C (see SP_FIT_N_PARAMS).
+ */
+double sp_fit_function(double *x, double *par) {
+  double landau = par[0]*TMath::Landau(x[0], par[1], par[2]);
+  double gaussians = par[5]*TMath::Exp(-TMath::Power(x[0] - par[4], 2)/(2*par[6]*par[6]));
+  for (int i = 1; i < 4; i++) {
+    gaussians += par[2*i + 5]*TMath::Exp(-TMath::Power(x[0] - (i*par[3] + par[4]), 2)/(2*par[2*i + 6]*par[2*i + 6]));
+  }
+  return landau + gaussians;
+}
+
+/**
+ * @brief Fit the single pixel peaks of a channel's ADC spectrum (h_alladc_<channel>) like singlepixelfit.C: seed the
+ *    first peak (gaus) and the MIP (landau), fit both together, then fit sp_fit_function with those fixed. The histogram
+ *    is not modified (no function is attached to it).
+ *
+ * NOTE: singlepixelfit.C declares the function with 13 parameters but uses 15; all 15 are fitted here.
+ *
+ * @param h_adc
+ * @return SinglePixelFit
+ */
+SinglePixelFit fit_single_pixels(TH1 *h_adc) {
+  static std::atomic<unsigned long> n_fits(0);
+  std::string suffix = std::to_string(n_fits++);
+  FitClock clock;
+  ScopedTimer seed_timer("fit: seed gaus");
+  TF1 f_tmp(("sp_seed_gaus_" + suffix).c_str(), "gaus", 20, 40);
+  h_adc->Fit(&f_tmp, "Q0N", "", 20, 40);
+  seed_timer.stop();
+  ScopedTimer landau_timer("fit: seed landau");
+  TF1 f_landautmp(("sp_seed_landau_" + suffix).c_str(), "landau", 0, 15);
+  h_adc->Fit(&f_landautmp, "Q0N", "", 1.5, 18);
+  landau_timer.stop();
+  ScopedTimer landaugaus_timer("fit: seed landau + gaus");
+  TF1 f_landaugaus(("sp_seed_landaugaus_" + suffix).c_str(), "landau(0) + gaus(3)", 0, 30);
+  f_landaugaus.SetParameters(f_landautmp.GetParameter(0), f_landautmp.GetParameter(1), f_landautmp.GetParameter(2),
+                             f_tmp.GetParameter(0), f_tmp.GetParameter(1), f_tmp.GetParameter(2));
+  h_adc->Fit(&f_landaugaus, "Q0N", "", 0.5, 45);
+  landaugaus_timer.stop();
+
+  TF1 f_sp(("sp_fit_" + suffix).c_str(), sp_fit_function, 0, 160, SP_FIT_N_PARAMS);
+  f_sp.FixParameter(0, f_landaugaus.GetParameter(0));
+  f_sp.FixParameter(1, f_landaugaus.GetParameter(1));
+  f_sp.FixParameter(2, f_landaugaus.GetParameter(2));
+  f_sp.FixParameter(4, f_landaugaus.GetParameter(4));
+  f_sp.FixParameter(5, f_landaugaus.GetParameter(3));
+  f_sp.FixParameter(6, f_landaugaus.GetParameter(5));
+  f_sp.SetParameter(3, 28);
+  f_sp.SetParLimits(3, 20, 40);
+  double amplitude = f_tmp.GetParameter(0);
+  double sigma = f_tmp.GetParameter(2);
+  double divisors[4] = {2, 5, 10, 15};
+  for (int peak = 0; peak < 4; peak++) {
+    f_sp.SetParameter(7 + 2*peak, amplitude/divisors[peak]);
+    f_sp.SetParameter(8 + 2*peak, sigma);
+    f_sp.SetParLimits(7 + 2*peak, f_landautmp.Eval(35*(peak + 1) + f_tmp.GetParameter(1)), 1000000);
+    f_sp.SetParLimits(8 + 2*peak, 0.5*sigma, 1.15*sigma);
+  }
+  double seed_time = clock.wall_time();
+  ScopedTimer fit_timer("fit: single pixels");
+  clock.restart();
+  TFitResultPtr result = h_adc->Fit(&f_sp, "Q0NS", "", 1.5, 140);
+  fit_timer.stop();
+
+  SinglePixelFit fit = {(int) result, f_sp.GetChisquare(), f_sp.GetNDF(), {}, {},
+                        fit_telemetry(-1, result, clock, FitSeed::PRELIMINARY_FIT, seed_time)};
+  for (int i = 0; i < SP_FIT_N_PARAMS; i++) {
+    fit.params[i] = f_sp.GetParameter(i);
+    fit.errors[i] = f_sp.GetParError(i);
+  }
+  return fit;
+}
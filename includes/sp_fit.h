@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <atomic>
+
+#include <TF1.h>
+#include <TH1.h>
+#include <TMath.h>
+#include <TString.h>
+
+#include "profiler.h"
+#include "fit_telemetry.h"
+
+/**
+ * @brief Parameters of sp_fit_function: a Landau (MIP peak) plus four equally spaced Gaussians (single pixel peaks).
+ *    0: landau amplitude, 1: landau mpv, 2: landau sigma, 3: gap spacing, 4: first peak mean, 5: first peak amplitude,
+ *    6: first peak sigma, 7/9/11/13: other peak amplitudes, 8/10/12/14: other peak sigmas.
+ */
+const int SP_FIT_N_PARAMS = 15;
+
+double sp_fit_function(double *x, double *par);
+
+/**
+ * @brief Result of fit_single_pixels.
+ */
+typedef struct SinglePixelFit {
+  int status;                                 // of the final fit (0 = converged)
+  double chi2;
+  int ndf;
+  std::array<double, SP_FIT_N_PARAMS> params;
+  std::array<double, SP_FIT_N_PARAMS> errors;
+  FitTelemetry telemetry;                     // of the final fit (channel -1: set by the caller)
+} SinglePixelFit;
+
+SinglePixelFit fit_single_pixels(TH1 *h_adc);
+
+#ifndef EMCAL_LIBRARY
+#include "sp_fit.cpp"
+#endif
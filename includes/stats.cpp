@@ -0,0 +1,220 @@
+#include "stats.h"
+#include "mpv_dbn.h"
+
+#include <algorithm>
+
+void P2Quantile::add(double x) {
+  if (n < 5) {
+    // keep the first 5 values sorted
+    int i = n;
+    while (i > 0 && heights[i - 1] > x) {
+      heights[i] = heights[i - 1];
+      i--;
+    }
+    heights[i] = x;
+    n++;
+    if (n == 5) {
+      for (int j = 0; j < 5; j++) {
+        positions[j] = j + 1;
+      }
+    }
+    return;
+  }
+
+  // find the cell k such that heights[k] <= x < heights[k + 1], extending the extreme markers if needed
+  int k;
+  if (x < heights[0]) {
+    heights[0] = x;
+    k = 0;
+  } else if (x >= heights[4]) {
+    heights[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while (k < 3 && x >= heights[k + 1]) {
+      k++;
+    }
+  }
+  for (int i = k + 1; i < 5; i++) {
+    positions[i]++;
+  }
+  n++;
+
+  // desired marker positions for the current n
+  const double fractions[5] = {0.0, p/2, p, (1 + p)/2, 1.0};
+  for (int i = 1; i < 4; i++) {
+    double desired = 1 + (n - 1)*fractions[i];
+    double d = desired - positions[i];
+    if ((d >= 1 && positions[i + 1] - positions[i] > 1) || (d <= -1 && positions[i - 1] - positions[i] < -1)) {
+      int ds = d > 0 ? 1 : -1;
+      // piecewise-parabolic prediction
+      double q = heights[i] + (double) ds/(positions[i + 1] - positions[i - 1])
+        * ((positions[i] - positions[i - 1] + ds)*(heights[i + 1] - heights[i])/(positions[i + 1] - positions[i])
+          + (positions[i + 1] - positions[i] - ds)*(heights[i] - heights[i - 1])/(positions[i] - positions[i - 1]));
+      if (heights[i - 1] < q && q < heights[i + 1]) {
+        heights[i] = q;
+      } else {
+        // fall back to linear prediction
+        heights[i] += ds*(heights[i + ds] - heights[i])/(positions[i + ds] - positions[i]);
+      }
+      positions[i] += ds;
+    }
+  }
+}
+
+/**
+ * @brief Current quantile estimate (NaN if no values were added).
+ */
+double P2Quantile::value() const {
+  if (n == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  if (n <= 5) {
+    // exact, with linear interpolation between order statistics
+    double pos = p*(n - 1);
+    int i = (int) pos;
+    if (i + 1 >= n) {
+      return heights[n - 1];
+    }
+    return heights[i] + (pos - i)*(heights[i + 1] - heights[i]);
+  }
+  return heights[2];
+}
+
+void RunningStats::add(double x) {
+  n++;
+  double delta = x - m;
+  m += delta/n;
+  m2 += delta*(x - m);
+  lo = std::min(lo, x);
+  hi = std::max(hi, x);
+  q25.add(x);
+  q50.add(x);
+  q75.add(x);
+}
+
+/**
+ * @brief Combine count, mean, variance and min/max of another accumulator into this one (Chan et al.).
+ *    Quantile estimators cannot be merged and are left untouched.
+ */
+void RunningStats::merge_moments(const RunningStats &other) {
+  if (other.n == 0) {
+    return;
+  }
+  long n_total = n + other.n;
+  double delta = other.m - m;
+  m += delta*other.n/n_total;
+  m2 += other.m2 + delta*delta*((double) n*other.n/n_total);
+  n = n_total;
+  lo = std::min(lo, other.lo);
+  hi = std::max(hi, other.hi);
+}
+
+/**
+ * @brief Which half of the detector a sector is in.
+ * 
+ * @param sector 0-based sector index.
+ * @return int 0 = south (odd 1-based sectors), 1 = north (even 1-based sectors).
+ */
+int sector_half(int sector) {
+  return (sector + 1) % 2 == 0 ? 1 : 0;
+}
+
+HierarchicalStats::HierarchicalStats() {
+  levels[(int) Level::CHANNEL] = std::vector<RunningStats>(64*384);
+  levels[(int) Level::BLOCK] = std::vector<RunningStats>(64*96);
+  levels[(int) Level::IB] = std::vector<RunningStats>(64*6);
+  levels[(int) Level::SECTOR] = std::vector<RunningStats>(64);
+  levels[(int) Level::HALF] = std::vector<RunningStats>(2);
+  levels[(int) Level::DETECTOR] = std::vector<RunningStats>(1);
+}
+
+/**
+ * @brief Add a per-channel value; it is also accumulated into the channel's block, IB, sector, half and the detector.
+ * 
+ * @param sector 0-based sector index.
+ * @param channel channel number (0-based, corresponding to h_allchannels).
+ * @param value 
+ */
+void HierarchicalStats::add_channel(int sector, int channel, double value) {
+  if (sector < 0 || sector >= 64 || channel < 0 || channel >= 384) {
+    throw std::runtime_error("HierarchicalStats: sector/channel out of range");
+  }
+  levels[(int) Level::CHANNEL][384*sector + channel].add(value);
+  // NOTE: channel numbering groups the 4 channels of a block, and 16 blocks per IB (see block_to_channel), so the
+  //    block's IB (block/16) is the channel's (channel/64)
+  add_above_block(sector, channel_to_block(channel), value);
+}
+
+/**
+ * @brief Add a per-block value; it is also accumulated into the block's IB, sector, half and the detector
+ *    (but not into any channel).
+ * 
+ * @param sector 0-based sector index.
+ * @param block block number (/96, 0-based, corresponding to h_allblocks).
+ * @param value 
+ */
+void HierarchicalStats::add_block(int sector, int block, double value) {
+  if (sector < 0 || sector >= 64 || block < 0 || block >= 96) {
+    throw std::runtime_error("HierarchicalStats: sector/block out of range");
+  }
+  add_above_block(sector, block, value);
+}
+
+/**
+ * @brief Accumulate a value into a block, its IB, sector, half and the detector (arguments already checked).
+ */
+void HierarchicalStats::add_above_block(int sector, int block, double value) {
+  levels[(int) Level::BLOCK][96*sector + block].add(value);
+  levels[(int) Level::IB][6*sector + block/16].add(value);
+  levels[(int) Level::SECTOR][sector].add(value);
+  levels[(int) Level::HALF][sector_half(sector)].add(value);
+  levels[(int) Level::DETECTOR][0].add(value);
+}
+
+/**
+ * @brief Get the accumulator of a node.
+ * 
+ * @param level 
+ * @param idx index within the level (e.g., 6*sector + ib for Level::IB).
+ * @return const RunningStats& 
+ */
+const RunningStats &HierarchicalStats::at(Level level, int idx) const {
+  return levels[(int) level].at(idx);
+}
+
+/**
+ * @brief Write IB-level mean and sigma csv files (one row per sector, empty cells for IBs without entries).
+ * 
+ * @param stats 
+ * @param physics_runs (sector -> run number), 1-based sectors.
+ * @param mean_file_name 
+ * @param sigma_file_name 
+ */
+void write_ib_summary(const HierarchicalStats &stats, const std::map<int, int> &physics_runs, const char *mean_file_name, const char *sigma_file_name) {
+  FILE *mean_outfile = fopen(mean_file_name, "w+");
+  FILE *sigma_outfile = fopen(sigma_file_name, "w+");
+  if (!mean_outfile || !sigma_outfile) {
+    throw std::runtime_error(Form("unable to open %s or %s for writing", mean_file_name, sigma_file_name));
+  }
+  fprintf(mean_outfile, "SECTOR, RUN, IB0, IB1, IB2, IB3, IB4, IB5");
+  fprintf(sigma_outfile, "SECTOR, RUN, IB0, IB1, IB2, IB3, IB4, IB5");
+  for (short sector = 0; sector < 64; sector++) {
+    auto it = physics_runs.find(sector + 1);
+    int run = it == physics_runs.end() ? 0 : it->second;
+    fprintf(mean_outfile, "\n%i, %i", sector + 1, run);
+    fprintf(sigma_outfile, "\n%i, %i", sector + 1, run);
+    for (short ib = 0; ib < 6; ib++) {
+      const RunningStats &s = stats.ib(sector, ib);
+      if (s.count() > 0) {
+        fprintf(mean_outfile, ", %f", s.mean());
+        fprintf(sigma_outfile, ", %f", s.std_dev());
+      } else {
+        fprintf(mean_outfile, ", ");
+        fprintf(sigma_outfile, ", ");
+      }
+    }
+  }
+  fclose(mean_outfile);
+  fclose(sigma_outfile);
+}
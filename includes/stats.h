@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <map>
+#include <string>
+#include <stdexcept>
+
+#include <TString.h>
+
+/**
+ * @brief Streaming estimate of a single quantile (P-square algorithm, Jain & Chlamtac 1985). Uses constant memory;
+ *    exact for the first 5 values.
+ */
+class P2Quantile {
+  public:
+  P2Quantile(double p = 0.5) : p(p) {}
+  void add(double x);
+  double value() const;
+
+  private:
+  double p;
+  long n = 0;
+  double heights[5];
+  long positions[5];
+};
+
+/**
+ * @brief Single-pass summary statistics of a stream of values: count, mean and variance (Welford), min/max and
+ *    robust quantiles (quartiles, via P2Quantile). No allocation per value.
+ */
+class RunningStats {
+  public:
+  void add(double x);
+  void merge_moments(const RunningStats &other);
+
+  long count() const { return n; }
+  double mean() const { return n > 0 ? m : std::numeric_limits<double>::quiet_NaN(); }
+  double variance() const { return n > 1 ? m2/(n - 1) : 0.0; }
+  double std_dev() const { return std::sqrt(variance()); }
+  double min() const { return lo; }
+  double max() const { return hi; }
+  double median() const { return q50.value(); }
+  double quartile_low() const { return q25.value(); }
+  double quartile_high() const { return q75.value(); }
+
+  private:
+  long n = 0;
+  double m = 0.0;
+  double m2 = 0.0;
+  double lo = std::numeric_limits<double>::infinity();
+  double hi = -std::numeric_limits<double>::infinity();
+  P2Quantile q25 = P2Quantile(0.25);
+  P2Quantile q50 = P2Quantile(0.50);
+  P2Quantile q75 = P2Quantile(0.75);
+};
+
+/**
+ * @brief Levels of the EMCal geometry hierarchy.
+ */
+enum class Level {
+  CHANNEL,  // 64*384 (channel numbering of h_allchannels)
+  BLOCK,    // 64*96 (block numbering of h_allblocks)
+  IB,       // 64*6 (interface boards, 16 blocks / 64 channels each)
+  SECTOR,   // 64
+  HALF,     // 2 (0 = south/odd sectors, 1 = north/even sectors)
+  DETECTOR  // 1
+};
+
+/**
+ * @brief RunningStats for every node of the geometry hierarchy. Each value added at channel (or block) level is
+ *    accumulated into all enclosing levels in the same pass. All accumulators are allocated once up front.
+ * 
+ * NOTE: sector indices are 0-based (sector - 1), matching the [sector][...] vectors of mpv_dbn.
+ * NOTE: uses channel_to_block(); include via mpv_dbn.h.
+ */
+class HierarchicalStats {
+  public:
+  HierarchicalStats();
+  void add_channel(int sector, int channel, double value);
+  void add_block(int sector, int block, double value);
+  const RunningStats &at(Level level, int idx = 0) const;
+  const RunningStats &ib(int sector, int ib) const { return at(Level::IB, 6*sector + ib); }
+
+  private:
+  void add_above_block(int sector, int block, double value);
+  std::vector<RunningStats> levels[6];
+};
+
+int sector_half(int sector);
+void write_ib_summary(const HierarchicalStats &stats, const std::map<int, int> &physics_runs, const char *mean_file_name, const char *sigma_file_name);
+
+#ifndef EMCAL_LIBRARY
+#include "stats.cpp"
+#endif
@@ -7,4 +7,6 @@ namespace utils {
   
 };
 
-#include "utils.cpp"
\ No newline at end of file
+#ifndef EMCAL_LIBRARY
+#include "utils.cpp"
+#endif
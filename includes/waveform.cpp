@@ -0,0 +1,360 @@
+#include "waveform.h"
+
+/**
+ * @brief Shape of a calorimeter pulse, t samples after its start: (t/rise)^power exp(power (1 - t/rise)), which peaks
+ *    at 1 for t = rise.
+ */
+static double pulse_value(double t, double rise, double power) {
+  if (t <= 0) {
+    return 0;
+  }
+  double x = t/rise;
+  return std::pow(x, power)*std::exp(power*(1 - x));
+}
+
+/**
+ * @brief The pulse shape sampled at the digitizer samples.
+ *
+ * @param n_samples
+ * @param start sample (fractional) where the pulse starts.
+ * @param rise samples from start to peak.
+ * @param power
+ * @return std::vector<float> n_samples values, peak 1.
+ */
+std::vector<float> pulse_template(int n_samples, double start, double rise, double power) {
+  std::vector<float> shape(n_samples);
+  for (int s = 0; s < n_samples; s++) {
+    shape[s] = pulse_value(s - start, rise, power);
+  }
+  return shape;
+}
+
+/**
+ * @brief Set the templates of TEMPLATE_FIT: the default pulse (see pulse_template) starting at n_trials times evenly
+ *    spaced in [first_start, last_start].
+ */
+void pulse_templates(WaveformConfig &config, double first_start, double last_start, int n_trials) {
+  const double rise = 2.5;
+  config.templates.clear();
+  config.template_peaks.clear();
+  for (int k = 0; k < n_trials; k++) {
+    double start = n_trials > 1 ? first_start + k*(last_start - first_start)/(n_trials - 1) : first_start;
+    config.templates.push_back(pulse_template(config.n_samples, start, rise));
+    config.template_peaks.push_back(start + rise);
+  }
+}
+
+/**
+ * @brief Check the config and, for TEMPLATE_FIT, solve the least squares fit of x_s = A T_s + P once per template: A
+ *    and P are then fixed weighted sums of the samples. Throws std::runtime_error on a bad config.
+ */
+WaveformKernel::WaveformKernel(const WaveformConfig &config) : config(config), shifted(config.n_samples*RAW_N_CHANNELS) {
+  const int n = config.n_samples;
+  if (n < 2 || config.n_pedestal < 1 || config.n_pedestal >= n) {
+    throw std::runtime_error(Form("bad waveform config: %d samples, %d pedestal samples", n, config.n_pedestal));
+  }
+  if (config.method != AmplitudeMethod::TEMPLATE_FIT) {
+    return;
+  }
+  if (config.templates.empty() || config.templates.size() != config.template_peaks.size()) {
+    throw std::runtime_error("TEMPLATE_FIT needs templates and their peak samples (see pulse_templates)");
+  }
+  for (const std::vector<float> &shape : config.templates) {
+    if ((int) shape.size() != n) {
+      throw std::runtime_error(Form("pulse template of %zu samples for %d samples", shape.size(), n));
+    }
+    double sum = 0;
+    double sum2 = 0;
+    for (float t : shape) {
+      sum += t;
+      sum2 += t*t;
+    }
+    double det = n*sum2 - sum*sum;
+    if (det <= 1e-9*n*sum2) {
+      throw std::runtime_error("pulse template is flat within the samples");
+    }
+    for (float t : shape) {
+      amp_weights.push_back((n*t - sum)/det);
+      ped_weights.push_back((sum2 - sum*t)/det);
+    }
+  }
+}
+
+/**
+ * @brief Amplitudes and peak times (in samples) of all channels of one event.
+ *
+ * @param samples n_samples*RAW_N_CHANNELS values, [sample*RAW_N_CHANNELS + channel].
+ * @param amplitude RAW_N_CHANNELS values (e.g. RawEvent::adc).
+ * @param peak_time RAW_N_CHANNELS values.
+ */
+void WaveformKernel::extract(const float *samples, float *amplitude, float *peak_time) {
+  if (config.method == AmplitudeMethod::TEMPLATE_FIT) {
+    template_fit(samples, amplitude, peak_time);
+  } else {
+    max_sample(samples, amplitude, peak_time);
+  }
+}
+
+// The steps of the kernel, each one pass over the channels of a sample. The arrays are parameters with __restrict so
+// the compiler knows they do not overlap and vectorizes without runtime checks.
+
+// On x86-64 the kernel is compiled for AVX-512, AVX2 and the baseline ISA, and the loader picks the widest the CPU has
+// (function multiversioning; the steps below are inlined into each version). The library is then portable, yet uses
+// the wide registers without -march=native.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__CLING__) && !defined(__AVX512F__)
+#define WAVEFORM_MULTIVERSIONED
+#define WAVEFORM_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define WAVEFORM_CLONES
+#endif
+
+static void fill_channels(float value, float *__restrict out) {
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    out[ch] = value;
+  }
+}
+
+static void add_channels(const float *__restrict row, float *__restrict sum) {
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    sum[ch] += row[ch];
+  }
+}
+
+static void keep_max(const float *__restrict row, float time, float *__restrict top, float *__restrict top_time) {
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    bool higher = row[ch] > top[ch];
+    top[ch] = higher ? row[ch] : top[ch];
+    top_time[ch] = higher ? time : top_time[ch];
+  }
+}
+
+static void subtract_mean(const float *__restrict top, const float *__restrict sum, float scale, float *__restrict out) {
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    out[ch] = top[ch] - scale*sum[ch];
+  }
+}
+
+static void shift_and_add(const float *__restrict row, const float *__restrict first, float *__restrict out, float *__restrict sum) {
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    out[ch] = row[ch] - first[ch];
+    sum[ch] += out[ch];
+  }
+}
+
+static void weighted_sums(const float *__restrict row, float wa, float wp, float t, float *__restrict a, float *__restrict p, float *__restrict dot) {
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    a[ch] += wa*row[ch];
+    p[ch] += wp*row[ch];
+    dot[ch] += t*row[ch];
+  }
+}
+
+static void keep_best_fit(const float *__restrict a, const float *__restrict p, const float *__restrict dot,
+                          const float *__restrict sum, float time, float *__restrict quality,
+                          float *__restrict amplitude, float *__restrict peak_time) {
+  for (uint32_t ch = 0; ch < RAW_N_CHANNELS; ch++) {
+    float q = a[ch]*dot[ch] + p[ch]*sum[ch];
+    bool better = q > quality[ch];
+    quality[ch] = better ? q : quality[ch];
+    amplitude[ch] = better ? a[ch] : amplitude[ch];
+    peak_time[ch] = better ? time : peak_time[ch];
+  }
+}
+
+WAVEFORM_CLONES void WaveformKernel::max_sample(const float *samples, float *amplitude, float *peak_time) {
+  const int N = RAW_N_CHANNELS;
+  fill_channels(0, acc_sum);
+  for (int s = 0; s < config.n_pedestal; s++) {
+    add_channels(samples + s*N, acc_sum);
+  }
+  memcpy(best, samples + config.n_pedestal*N, sizeof(best));
+  fill_channels(config.n_pedestal, peak_time);
+  for (int s = config.n_pedestal + 1; s < config.n_samples; s++) {
+    keep_max(samples + s*N, s, best, peak_time);
+  }
+  subtract_mean(best, acc_sum, 1.0f/config.n_pedestal, amplitude);
+}
+
+/**
+ * @brief For each template: A = sum w_A x, P = sum w_P x and the fit quality A sum(T x) + P sum(x) (the sum of
+ *    squares minus the chi2, so the largest is the best fit); keep the A and peak time of the best template.
+ */
+WAVEFORM_CLONES void WaveformKernel::template_fit(const float *samples, float *amplitude, float *peak_time) {
+  const int N = RAW_N_CHANNELS;
+  const int n = config.n_samples;
+  fill_channels(0, acc_sum);
+  fill_channels(-INFINITY, best);
+  fill_channels(0, amplitude);
+  fill_channels(0, peak_time);
+  // relative to the first sample: the fit is the same (its pedestal absorbs the offset, and the quality of every
+  // template changes by the same amount), but the sums stay small enough for float precision
+  memcpy(acc_dot, samples, sizeof(acc_dot));
+  for (int s = 0; s < n; s++) {
+    shift_and_add(samples + s*N, acc_dot, shifted.data() + s*N, acc_sum);
+  }
+  for (size_t k = 0; k < config.templates.size(); k++) {
+    const float *shape = config.templates[k].data();
+    const float *w_amp = amp_weights.data() + k*n;
+    const float *w_ped = ped_weights.data() + k*n;
+    fill_channels(0, acc_amp);
+    fill_channels(0, acc_ped);
+    fill_channels(0, acc_dot);
+    for (int s = 0; s < n; s++) {
+      weighted_sums(shifted.data() + s*N, w_amp[s], w_ped[s], shape[s], acc_amp, acc_ped, acc_dot);
+    }
+    keep_best_fit(acc_amp, acc_ped, acc_dot, acc_sum, config.template_peaks[k], best, amplitude, peak_time);
+  }
+}
+
+/**
+ * @brief The same amplitudes as WaveformKernel, one channel at a time in double precision (the straightforward loop
+ *    over a channel's samples): the reference of benchmark_waveform_kernel.
+ */
+void reference_amplitudes(const WaveformConfig &config, const float *samples, float *amplitude, float *peak_time) {
+  const int N = RAW_N_CHANNELS;
+  const int n = config.n_samples;
+  for (int ch = 0; ch < N; ch++) {
+    if (config.method == AmplitudeMethod::MAX_SAMPLE) {
+      double pedestal = 0;
+      for (int s = 0; s < config.n_pedestal; s++) {
+        pedestal += samples[s*N + ch];
+      }
+      int top = config.n_pedestal;
+      for (int s = config.n_pedestal + 1; s < n; s++) {
+        if (samples[s*N + ch] > samples[top*N + ch]) {
+          top = s;
+        }
+      }
+      amplitude[ch] = samples[top*N + ch] - pedestal/config.n_pedestal;
+      peak_time[ch] = top;
+      continue;
+    }
+    double best_chi2 = INFINITY;
+    for (size_t k = 0; k < config.templates.size(); k++) {
+      const std::vector<float> &shape = config.templates[k];
+      double st = 0, stt = 0, sx = 0, sxt = 0, sxx = 0;
+      for (int s = 0; s < n; s++) {
+        double x = samples[s*N + ch];
+        st += shape[s];
+        stt += shape[s]*shape[s];
+        sx += x;
+        sxt += x*shape[s];
+        sxx += x*x;
+      }
+      double det = n*stt - st*st;
+      double a = (n*sxt - st*sx)/det;
+      double p = (stt*sx - st*sxt)/det;
+      double chi2 = sxx - a*sxt - p*sx;
+      if (chi2 < best_chi2) {
+        best_chi2 = chi2;
+        amplitude[ch] = a;
+        peak_time[ch] = config.template_peaks[k];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Simulated digitizer samples of cosmic events, [event][sample][channel]: a pedestal of about 1500 ADC per
+ *    channel with noise, and in 5% of the channels a pulse (Landau amplitude, MPV 120 ADC) starting 3-5 samples in.
+ */
+std::vector<float> synthetic_waveforms(size_t n_events, int n_samples, unsigned int seed) {
+  const int N = RAW_N_CHANNELS;
+  TRandom3 random(seed);
+  std::vector<float> pedestal(N);
+  for (int ch = 0; ch < N; ch++) {
+    pedestal[ch] = 1500 + random.Gaus(0, 50);
+  }
+  std::vector<float> samples(n_events*n_samples*N);
+  for (size_t e = 0; e < n_events; e++) {
+    float *event = samples.data() + e*n_samples*N;
+    for (int ch = 0; ch < N; ch++) {
+      double amplitude = random.Uniform() < 0.05 ? std::min(3000.0, random.Landau(120, 12)) : 0;
+      double start = 3 + 2*random.Uniform();
+      for (int s = 0; s < n_samples; s++) {
+        event[s*N + ch] = pedestal[ch] + random.Gaus(0, 2) + amplitude*pulse_value(s - start, 2.5, 4);
+      }
+    }
+  }
+  return samples;
+}
+
+static const char *simd_target() {
+#if defined(WAVEFORM_MULTIVERSIONED)
+  // the version of the kernel WAVEFORM_CLONES dispatches to
+  return __builtin_cpu_supports("avx512f") ? "AVX-512" : __builtin_cpu_supports("avx2") ? "AVX2" : "SSE2";
+#elif defined(__AVX512F__)
+  return "AVX-512";
+#elif defined(__AVX2__)
+  return "AVX2";
+#elif defined(__AVX__)
+  return "AVX";
+#elif defined(__SSE2__)
+  return "SSE2";
+#elif defined(__ARM_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+/**
+ * @brief Events per second on one core of WaveformKernel and of reference_amplitudes on synthetic waveforms, for
+ *    MAX_SAMPLE and for TEMPLATE_FIT with n_trials templates, with the largest difference of their amplitudes.
+ *
+ * NOTE: the numbers depend on the flags this file is compiled with (the vector instructions used are printed): at -O2
+ *    the selections of the maximum and of the best template are not vectorized. Run it from the library built with -O3
+ *    (emcal-ingest --waveform-benchmark), not from cling. With the default events, which do not fit in the caches,
+ *    MAX_SAMPLE is bound by the memory bandwidth. The max |diff| of TEMPLATE_FIT is not a rounding error: where two
+ *    trial templates fit about equally well, float and double sums can pick different ones (about 1 ADC apart).
+ *
+ * @param n_events synthetic events (about 25 kB each for 16 samples); the kernel runs over them for at least 0.5 s.
+ * @param n_samples
+ * @param n_trials
+ */
+void benchmark_waveform_kernel(size_t n_events, int n_samples, int n_trials) {
+  typedef std::chrono::steady_clock clock;
+  const int N = RAW_N_CHANNELS;
+  std::vector<float> samples = synthetic_waveforms(n_events, n_samples);
+  printf("waveform kernel: %zu events of %d channels x %d samples (%s)\n", n_events, N, n_samples, simd_target());
+  printf("%-14s %7s %14s %12s %14s %9s %12s\n", "method", "trials", "kernel [ev/s]", "[ns/channel]", "scalar [ev/s]",
+         "speedup", "max |diff|");
+
+  std::vector<float> amplitude(n_events*N), peak_time(N), ref_amplitude(N), ref_time(N);
+  for (AmplitudeMethod method : {AmplitudeMethod::MAX_SAMPLE, AmplitudeMethod::TEMPLATE_FIT}) {
+    WaveformConfig config;
+    config.n_samples = n_samples;
+    config.method = method;
+    if (method == AmplitudeMethod::TEMPLATE_FIT) {
+      pulse_templates(config, 2.5, 5.5, n_trials);
+    }
+    WaveformKernel kernel(config);
+
+    size_t n_kernel = 0;
+    clock::time_point start = clock::now();
+    double kernel_time = 0;
+    while (kernel_time < 0.5) {
+      for (size_t e = 0; e < n_events; e++) {
+        kernel.extract(samples.data() + e*n_samples*N, amplitude.data() + e*N, peak_time.data());
+      }
+      n_kernel += n_events;
+      kernel_time = std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    double max_diff = 0;
+    start = clock::now();
+    for (size_t e = 0; e < n_events; e++) {
+      reference_amplitudes(config, samples.data() + e*n_samples*N, ref_amplitude.data(), ref_time.data());
+      for (int ch = 0; ch < N; ch++) {
+        max_diff = std::max(max_diff, (double) std::fabs(ref_amplitude[ch] - amplitude[e*N + ch]));
+      }
+    }
+    double ref_time_s = std::chrono::duration<double>(clock::now() - start).count();
+
+    double kernel_rate = n_kernel/kernel_time;
+    double ref_rate = n_events/ref_time_s;
+    printf("%-14s %7d %14.0f %12.2f %14.0f %8.1fx %12.3g\n", method == AmplitudeMethod::MAX_SAMPLE ? "max sample" : "template fit",
+           method == AmplitudeMethod::MAX_SAMPLE ? 0 : n_trials, kernel_rate, 1e9/(kernel_rate*N), ref_rate,
+           kernel_rate/ref_rate, max_diff);
+  }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TRandom3.h>
+#include <TString.h>
+
+#include "raw_event.h"
+
+/**
+ * @brief How WaveformKernel turns the samples of a channel into an amplitude.
+ */
+enum class AmplitudeMethod {
+  MAX_SAMPLE,     // highest sample after the pedestal samples, minus the pedestal (their mean)
+  TEMPLATE_FIT,   // least squares fit of amplitude and pedestal with the pulse template, at the best of its trial times
+};
+
+/**
+ * @brief Digitizer samples per channel and the amplitude method (with its pulse templates, see pulse_templates).
+ */
+typedef struct WaveformConfig {
+  int n_samples = 16;
+  int n_pedestal = 3;             // leading samples without pulse (MAX_SAMPLE)
+  AmplitudeMethod method = AmplitudeMethod::MAX_SAMPLE;
+  std::vector<std::vector<float>> templates;    // TEMPLATE_FIT: the pulse (peak 1) at each trial time, n_samples each
+  std::vector<float> template_peaks;            // TEMPLATE_FIT: sample of the peak of each template
+} WaveformConfig;
+
+/**
+ * @brief Amplitude and peak time of every channel of a sector per event. The samples of an event are channel-fastest
+ *    ([sample*RAW_N_CHANNELS + channel]), so every step of the kernel is one pass over 384 contiguous floats with the
+ *    same operations for every channel: no branches, no gathers, vectorized by the compiler (build with -O3; on x86-64
+ *    the CPU picks the AVX-512, AVX2 or baseline version at load time). Holds the channel buffers of one event: use one
+ *    kernel per thread.
+ */
+class WaveformKernel {
+  public:
+  explicit WaveformKernel(const WaveformConfig &config);
+
+  void extract(const float *samples, float *amplitude, float *peak_time);
+  int n_samples() const { return config.n_samples; }
+
+  private:
+  void max_sample(const float *samples, float *amplitude, float *peak_time);
+  void template_fit(const float *samples, float *amplitude, float *peak_time);
+
+  WaveformConfig config;
+  std::vector<float> amp_weights;   // [trial*n_samples + sample]: amplitude of the fit = weighted sum of the samples
+  std::vector<float> ped_weights;   // [trial*n_samples + sample]: pedestal of the fit
+  std::vector<float> shifted;       // [sample*RAW_N_CHANNELS + channel]: samples minus the channel's first sample
+  alignas(64) float acc_amp[RAW_N_CHANNELS];
+  alignas(64) float acc_ped[RAW_N_CHANNELS];
+  alignas(64) float acc_dot[RAW_N_CHANNELS];
+  alignas(64) float acc_sum[RAW_N_CHANNELS];
+  alignas(64) float best[RAW_N_CHANNELS];
+};
+
+std::vector<float> pulse_template(int n_samples, double start, double rise = 2.5, double power = 4);
+void pulse_templates(WaveformConfig &config, double first_start, double last_start, int n_trials);
+void reference_amplitudes(const WaveformConfig &config, const float *samples, float *amplitude, float *peak_time);
+std::vector<float> synthetic_waveforms(size_t n_events, int n_samples, unsigned int seed = 4357);
+void benchmark_waveform_kernel(size_t n_events = 20000, int n_samples = 16, int n_trials = 8);
+
+#ifndef EMCAL_LIBRARY
+#include "waveform.cpp"
+#endif
@@ -20,6 +20,7 @@
 #include <map>
 #include <algorithm>
 #include "csvFile.h"
+#include "../includes/root_arena.h"
 #include <exception>
 
 // the root of all evil
@@ -385,7 +386,8 @@ void compare_vop() {
     std::cout << "SECTOR " << sector << ":" << std::endl;
     std::stringstream sectorFileName;
     sectorFileName << "./sector_data/sector" << sector << ".root";
-    TFile* sectorFile = new TFile(sectorFileName.str().c_str());
+    RootArena sector_arena;   // the sector's file (and the histogram read from it), closed after the sector
+    TFile* sectorFile = sector_arena.adopt(new TFile(sectorFileName.str().c_str()));
     TH1D* data;
     std::stringstream blockFileName;
     blockFileName << "h_run" << sector << "_block;1";
@@ -505,20 +507,22 @@ void compare_vop() {
     std::map<double, std::vector<double>> vop_mpv_map = p.second;
     std::stringstream sector_title;
     sector_title << "sector " << sector << ";mpv;n_blocks";
-    THStack *hs = new THStack("hs", sector_title.str().c_str());
+    RootArena stack_arena;   // the stack, its histograms and canvas
+    THStack *hs = stack_arena.make<THStack>("hs", sector_title.str().c_str());
     for (const auto & q : vop_mpv_map) {
       double vop = q.first;
       std::vector<double> mpvs = q.second;
-      TCanvas* vop_canvas = new TCanvas("vop", "vop");
+      RootArena hist_arena;
+      TCanvas* vop_canvas = hist_arena.make<TCanvas>("vop", "vop");
       gStyle->SetOptStat(0);
       gStyle->SetOptFit(1);
       std::stringstream vop_title;
       vop_title << "sector " << sector << ", vop " << vop << ";mpv;n_blocks";
-      TH1D* vop_hist = new TH1D("vop_hist", vop_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* vop_hist = hist_arena.make<TH1D>("vop_hist", vop_title.str().c_str(), num_bins, x_min, x_max);
       vop_hist->GetSumw2();
       std::stringstream stack_title;
       stack_title << "vop " << vop;
-      TH1D* stack_hist = new TH1D("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* stack_hist = stack_arena.make<TH1D>("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
       stack_hist->GetSumw2();
       for (double mpv : mpvs) {
         vop_hist->Fill(mpv);
@@ -538,7 +542,7 @@ void compare_vop() {
       stack_hist->GetFunction("gaus")->SetLineColor(new_vop_colors[vop]);
       hs->Add(stack_hist);
     }
-    TCanvas* sector_canvas = new TCanvas("sector", "sector");
+    TCanvas* sector_canvas = stack_arena.make<TCanvas>("sector", "sector");
     gStyle->SetOptStat(0);
     gStyle->SetOptFit(0);
     hs->Draw("nostackb");
@@ -554,20 +558,22 @@ void compare_vop() {
     std::map<int, std::vector<double>> sector_mpv_map = p.second;
     std::stringstream vop_title;
     vop_title << "vop " << vop << ";mpv;n_blocks";
-    THStack *hs = new THStack("hs", vop_title.str().c_str());
+    RootArena stack_arena;   // the stack, its histograms and canvas
+    THStack *hs = stack_arena.make<THStack>("hs", vop_title.str().c_str());
     for (const auto & q : sector_mpv_map) {
       int sector = q.first;
       std::vector<double> mpvs = q.second;
-      TCanvas* sector_canvas = new TCanvas();
+      RootArena hist_arena;
+      TCanvas* sector_canvas = hist_arena.make<TCanvas>();
       // gStyle->SetOptStat(0);
       // gStyle->SetOptFit(1);
       std::stringstream sector_title;
       sector_title << "sector " << sector << ", vop " << vop << ";mpv;n_blocks";
-      TH1D* vop_hist = new TH1D("vop_hist", sector_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* vop_hist = hist_arena.make<TH1D>("vop_hist", sector_title.str().c_str(), num_bins, x_min, x_max);
       vop_hist->GetSumw2();
       std::stringstream stack_title;
       stack_title << "sector " << sector;
-      TH1D* stack_hist = new TH1D("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* stack_hist = stack_arena.make<TH1D>("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
       stack_hist->GetSumw2();
       for (double mpv : mpvs) {
         vop_hist->Fill(mpv);
@@ -587,7 +593,7 @@ void compare_vop() {
       stack_hist->GetFunction("gaus")->SetLineColor(sector_colors[sector]);
       hs->Add(stack_hist);
     }
-    TCanvas* vop_canvas = new TCanvas();
+    TCanvas* vop_canvas = stack_arena.make<TCanvas>();
     gStyle->SetOptStat(0);
     gStyle->SetOptFit(0);
     hs->Draw("nostackb");
@@ -696,7 +702,8 @@ void compare_vop() {
     std::cout << "SECTOR " << sector << ":" << std::endl;
     std::stringstream sectorFileName;
     sectorFileName << "./sector_data/sector" << sector << ".root";
-    TFile* sectorFile = new TFile(sectorFileName.str().c_str());
+    RootArena sector_arena;   // the sector's file (and the histogram read from it), closed after the sector
+    TFile* sectorFile = sector_arena.adopt(new TFile(sectorFileName.str().c_str()));
     TH1D* data;
     std::stringstream blockFileName;
     blockFileName << "h_run" << sector << "_block;1";
@@ -805,20 +812,22 @@ void compare_vop() {
     std::map<double, std::vector<double>> vop_mpv_map = p.second;
     std::stringstream sector_title;
     sector_title << "sector " << sector << ";mpv;n_blocks";
-    THStack *hs = new THStack("hs", sector_title.str().c_str());
+    RootArena stack_arena;   // the stack, its histograms and canvas
+    THStack *hs = stack_arena.make<THStack>("hs", sector_title.str().c_str());
     for (const auto & q : vop_mpv_map) {
       double vop = q.first;
       std::vector<double> mpvs = q.second;
-      TCanvas* vop_canvas = new TCanvas("vop", "vop");
+      RootArena hist_arena;
+      TCanvas* vop_canvas = hist_arena.make<TCanvas>("vop", "vop");
       gStyle->SetOptStat(0);
       gStyle->SetOptFit(1);
       std::stringstream vop_title;
       vop_title << "sector " << sector << ", vop " << vop << ";mpv;n_blocks";
-      TH1D* vop_hist = new TH1D("vop_hist", vop_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* vop_hist = hist_arena.make<TH1D>("vop_hist", vop_title.str().c_str(), num_bins, x_min, x_max);
       vop_hist->GetSumw2();
       std::stringstream stack_title;
       stack_title << "vop " << vop;
-      TH1D* stack_hist = new TH1D("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* stack_hist = stack_arena.make<TH1D>("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
       stack_hist->GetSumw2();
       for (double mpv : mpvs) {
         vop_hist->Fill(mpv);
@@ -838,7 +847,7 @@ void compare_vop() {
       stack_hist->GetFunction("gaus")->SetLineColor(old_vop_colors[vop]);
       hs->Add(stack_hist);
     }
-    TCanvas* sector_canvas = new TCanvas("sector", "sector");
+    TCanvas* sector_canvas = stack_arena.make<TCanvas>("sector", "sector");
     gStyle->SetOptStat(0);
     gStyle->SetOptFit(0);
     hs->Draw("nostackb");
@@ -854,20 +863,22 @@ void compare_vop() {
     std::map<int, std::vector<double>> sector_mpv_map = p.second;
     std::stringstream vop_title;
     vop_title << "vop " << vop << ";mpv;n_blocks";
-    THStack *hs = new THStack("hs", vop_title.str().c_str());
+    RootArena stack_arena;   // the stack, its histograms and canvas
+    THStack *hs = stack_arena.make<THStack>("hs", vop_title.str().c_str());
     for (const auto & q : sector_mpv_map) {
       int sector = q.first;
       std::vector<double> mpvs = q.second;
-      TCanvas* sector_canvas = new TCanvas();
+      RootArena hist_arena;
+      TCanvas* sector_canvas = hist_arena.make<TCanvas>();
       // gStyle->SetOptStat(0);
       // gStyle->SetOptFit(1);
       std::stringstream sector_title;
       sector_title << "sector " << sector << ", vop " << vop << ";mpv;n_blocks";
-      TH1D* vop_hist = new TH1D("vop_hist", sector_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* vop_hist = hist_arena.make<TH1D>("vop_hist", sector_title.str().c_str(), num_bins, x_min, x_max);
       vop_hist->GetSumw2();
       std::stringstream stack_title;
       stack_title << "sector " << sector;
-      TH1D* stack_hist = new TH1D("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
+      TH1D* stack_hist = stack_arena.make<TH1D>("stack_hist", stack_title.str().c_str(), num_bins, x_min, x_max);
       stack_hist->GetSumw2();
       for (double mpv : mpvs) {
         vop_hist->Fill(mpv);
@@ -887,7 +898,7 @@ void compare_vop() {
       stack_hist->GetFunction("gaus")->SetLineColor(sector_colors[sector]);
       hs->Add(stack_hist);
     }
-    TCanvas* vop_canvas = new TCanvas();
+    TCanvas* vop_canvas = stack_arena.make<TCanvas>();
     gStyle->SetOptStat(0);
     gStyle->SetOptFit(0);
     hs->Draw("nostackb");
@@ -16,6 +16,10 @@
 #include <assert.h>
 #include <sys/stat.h>
 
+#include "../includes/profiler.h"
+#include "../includes/fit_telemetry.h"
+#include "../includes/root_arena.h"
+
 // divides to errorful arrays of numbers x + dx / y + dy and puts result in z, dz
 void divide_err(size_t n, double *x, double *dx, double *y, double *dy, double *z, double *dz) {
   for (int i = 0; i < n; i++) {
@@ -85,10 +89,12 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
   gStyle->SetOptFit(1);   //make the plot list all the fit information
   
   // retrieve all histograms from the root file
+  ScopedTimer read_timer("all_fits: read h_alladc_*");
   TH1D *h_alladc[384];
   for (int i = 0; i < 384;i++) {
     h_alladc[i] = (TH1D*) histograms->Get(Form("h_alladc_%i", i));
   }
+  read_timer.stop();
   
   TF1 *f_singlepixels[384];
   Double_t sp_gaps[384];
@@ -113,27 +119,47 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
 
   Double_t actual_peak1_height[384];
   Double_t actual_peak2_height[384];
+  std::vector<FitTelemetry> telemetry;
+
+  // the functions of a channel fit have the same shape for every channel: made once, reset and reused
+  TF1Pool sp_pool([]() { return new TF1("f_sp", fitf, 0, 160, 13); }, reset_tf1);
+  TF1Pool seed_gaus_pool([]() { return new TF1("f_tmp", "gaus", 20, 40); }, reset_tf1);
+  TF1Pool seed_landau_pool([]() { return new TF1("f_landautmp", "landau", 0, 15); }, reset_tf1);
+  TF1Pool seed_landaugaus_pool([]() { return new TF1("f_landaugaus", "landau(0) + gaus(3)", 0, 30); }, reset_tf1);
+  TF1Pool draw_landau_pool([]() { return new TF1("landau", "landau", 0.0, 200.0); }, reset_tf1);
+  int n_draw_gaus = 0;
+  TF1Pool draw_gaus_pool([&n_draw_gaus]() { return new TF1(Form("gaus%i", ++n_draw_gaus), "gaus", 0.0, 200.0); }, reset_tf1);
+  RootArena run_arena;   // summary canvases and graphs
 
   for (int i = 0; i < 384; i++) {
+    RootArena channel_arena;   // everything made for channel i
     if (h_alladc[i]->GetEntries() < 1e2) {
       printf("rejected channel %i for too few entries\n", i);
+      profile_count("all_fits: channels with too few entries");
       continue;
     }
     
     // this scheme could likely be proved upon by finding more suitable parameters for each histogram
     // rather than using the same constants for each histogram and sector...
     
-    f_singlepixels[i] = new TF1(Form("f_%i", i), fitf,0,160,13);
+    f_singlepixels[i] = channel_arena.lease(sp_pool);
     
-    TF1* f_tmp = new TF1("f_tmp","gaus",20,40);
+    FitClock fit_clock;
+    ScopedTimer seed_timer("fit: seed gaus");
+    TF1* f_tmp = channel_arena.lease(seed_gaus_pool);
     h_alladc[i]->Fit(f_tmp,"Q0","",20,40);
+    seed_timer.stop();
 
-    TF1* f_landautmp = new TF1("f_landautmp","landau",0,15);
+    ScopedTimer landau_timer("fit: seed landau");
+    TF1* f_landautmp = channel_arena.lease(seed_landau_pool);
     h_alladc[i]->Fit(f_landautmp,"Q0","",1.5,18);
+    landau_timer.stop();
 
-    TF1* f_landaugaus = new TF1("f_landaugaus","landau(0) + gaus(3)",0,30);
+    ScopedTimer landaugaus_timer("fit: seed landau + gaus");
+    TF1* f_landaugaus = channel_arena.lease(seed_landaugaus_pool);
     f_landaugaus->SetParameters(f_landautmp->GetParameter(0), f_landautmp->GetParameter(1) ,f_landautmp->GetParameter(2) ,f_tmp->GetParameter(0) ,f_tmp->GetParameter(1) ,f_tmp->GetParameter(2));
     h_alladc[i]->Fit(f_landaugaus,"Q0","",0.5,45);
+    landaugaus_timer.stop();
 
     // f_singlepixels[i]->SetParameters(f_tmp->GetParameter(0),30,5,f_tmp->GetParameter(0)/3,28,f_tmp->GetParameter(0)/10, f_tmp->GetParameter(0)/20,f_tmp->GetParameter(0)/100);
     
@@ -183,9 +209,15 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
     //par[7,9,11,13] = other peak amplitudes
     //par[8,10,12,14] = other peak sigmas
 
+    double seed_time = fit_clock.wall_time();
+    ScopedTimer fit_timer("fit: single pixels");
+    fit_clock.restart();
     TFitResultPtr sp_fit = h_alladc[i]->Fit(f_singlepixels[i],"Q S","",1.5,140);
+    telemetry.push_back(fit_telemetry(i, sp_fit, fit_clock, FitSeed::PRELIMINARY_FIT, seed_time));
+    fit_timer.stop();
     if (sp_fit->IsEmpty()) {
       printf("rejected channel %i for null or empty sp_fit\n", i);
+      profile_count("all_fits: channels with empty fit");
       continue;
     }
     Double_t sp_gap = sp_fit->Parameter(3);
@@ -211,7 +243,8 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
     landau_sigmas[i] = sp_fit->Parameter(2);
     landau_sigmas_err[i] = sp_fit->ParError(2);
 
-    TF1 *landau = new TF1("landau", "landau", 0.0, 200.0);
+    ScopedTimer draw_timer("all_fits: draw channel");
+    TF1 *landau = channel_arena.lease(draw_landau_pool);
     landau->SetParameter(0, landau_amplitudes[i]);
     landau->SetParameter(1, landau_mpvs[i]);
     landau->SetParameter(2, landau_sigmas[i]);
@@ -223,7 +256,7 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
     //landau_ampl->SetLineWidth(1);
     
 
-    TF1 *gaus1 = new TF1("gaus1", "gaus", 0.0, 200.0);
+    TF1 *gaus1 = channel_arena.lease(draw_gaus_pool);
     gaus1->SetParameter(0, first_gauss_amplitude[i]);
     gaus1->SetParameter(1, first_gauss_mean[i]);
     gaus1->SetParameter(2, first_gauss_sigma[i]);
@@ -241,25 +274,25 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
     actual_peak1_height[i] = f_singlepixels[i]->Eval(p1);
     actual_peak2_height[i] = f_singlepixels[i]->Eval(p2);
 
-    TF1 *gaus2 = new TF1("gaus2", "gaus", 0.0, 200.0);
+    TF1 *gaus2 = channel_arena.lease(draw_gaus_pool);
     gaus2->SetParameter(0, other_gauss_amplitudes[i][0]);
     gaus2->SetParameter(1, first_gauss_mean[i] + sp_gap);
     gaus2->SetParameter(2, other_gauss_sigmas[i][0]);
     gaus2->SetLineStyle(1); gaus2->SetLineColor(kBlue); gaus2->SetLineWidth(1);
 
-    TF1 *gaus3 = new TF1("gaus3", "gaus", 0.0, 200.0);
+    TF1 *gaus3 = channel_arena.lease(draw_gaus_pool);
     gaus3->SetParameter(0, other_gauss_amplitudes[i][1]);
     gaus3->SetParameter(1, first_gauss_mean[i] + 2*sp_gap);
     gaus3->SetParameter(2, other_gauss_sigmas[i][1]);
     gaus3->SetLineStyle(1); gaus3->SetLineColor(kBlue); gaus3->SetLineWidth(1);
 
-    TF1 *gaus4 = new TF1("gaus4", "gaus", 0.0, 200.0);
+    TF1 *gaus4 = channel_arena.lease(draw_gaus_pool);
     gaus4->SetParameter(0, other_gauss_amplitudes[i][2]);
     gaus4->SetParameter(1, first_gauss_mean[i] + 3*sp_gap);
     gaus4->SetParameter(2, other_gauss_sigmas[i][2]);
     gaus4->SetLineStyle(1); gaus4->SetLineColor(kBlue); gaus4->SetLineWidth(1);
     
-    TF1 *gaus5 = new TF1("gaus5", "gaus", 0.0, 200.0);
+    TF1 *gaus5 = channel_arena.lease(draw_gaus_pool);
     gaus5->SetParameter(0, other_gauss_amplitudes[i][3]);
     gaus5->SetParameter(1, first_gauss_mean[i] + 4*sp_gap);
     gaus5->SetParameter(2, other_gauss_sigmas[i][3]);
@@ -267,7 +300,7 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
 
 
     
-    TCanvas* c1 = new TCanvas(Form("c%i", i), "", 700, 500);
+    TCanvas* c1 = channel_arena.make<TCanvas>(Form("c%i", i), "", 700, 500);
     gPad->SetLogy();
     h_alladc[i]->Draw();
 
@@ -294,16 +327,21 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
     p2_line->Draw("SAME");
     */
 
-    TLegend* legend = new TLegend(0.6, 0.75, 0.9, 0.9);
+    TLegend* legend = channel_arena.make<TLegend>(0.6, 0.75, 0.9, 0.9);
     legend->AddEntry(f_landaugaus, Form("SP Gap: %.3f", sp_gap), "l");
     legend->AddEntry("", Form("ChiSqr/NDF: %.3f", chisqr_ndfs[i]));
     legend->Draw();
 
+    draw_timer.stop();
+
+    ScopedTimer save_timer("all_fits: save channel png");
     c1->SaveAs(Form("%s/fit_channel_hists/channel_%i.png", file_prefix, i));
+    save_timer.stop();
     n_channels++;
   }
   
 
+  ScopedTimer summary_timer("all_fits: all_gaps.csv and summary plots");
   Double_t min_chisqr_ndf = chisqr_ndfs[0];
   int min_chisqr_idx = 0;
   Double_t max_chisqr_ndf = chisqr_ndfs[0];
@@ -327,13 +365,24 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
   }
   fclose(fp);
 
+  // cost of the fits
+  write_fit_telemetry_csv(telemetry, Form("%s/fit_telemetry.csv", file_prefix));
+  save_fit_cost_plots(telemetry, Form("%s/fit_costs.png", file_prefix));
+  FILE *costs = fopen(Form("%s/fit_costs.txt", file_prefix), "w");
+  if (costs) {
+    print_fit_costs(telemetry, 20, costs);
+    fclose(costs);
+  }
+  printf("run %i: ", run_num);
+  print_fit_costs(telemetry);
+
   // plot chisqr / ndf by channel
   Double_t bins[384];
   for (int i = 0; i < 384; i++) {
     bins[i] = i;
   }
-  TCanvas *c_chi = new TCanvas("c_chi", "", 700, 500);
-  TGraph *chi_graph = new TGraph(384, bins, chisqr_ndfs);
+  TCanvas *c_chi = run_arena.make<TCanvas>("c_chi", "", 700, 500);
+  TGraph *chi_graph = run_arena.make<TGraph>(384, bins, chisqr_ndfs);
   chi_graph->SetTitle("Single Pixel Fit Chi Sqr by Channel");
   chi_graph->GetXaxis()->SetTitle("Channel");
   chi_graph->GetYaxis()->SetTitle("ChiSqr/NDF");
@@ -363,8 +412,8 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
   Double_t ib_bins[6] = {0.0, 1.0, 2.0, 3.0, 4.0, 5.0};
 
   // plot ratio of 1st and 2nd peak as a fn of IB
-  TCanvas *c_ib_ratio = new TCanvas("c_ib_ratio", "", 700, 500);
-  TGraph *ib_ratio_graph = new TGraph(6, ib_bins, avg_ib_ratio);
+  TCanvas *c_ib_ratio = run_arena.make<TCanvas>("c_ib_ratio", "", 700, 500);
+  TGraph *ib_ratio_graph = run_arena.make<TGraph>(6, ib_bins, avg_ib_ratio);
   ib_ratio_graph->SetTitle("Peak Height Ratio by IB");
   ib_ratio_graph->GetXaxis()->SetTitle("IB");
   ib_ratio_graph->GetYaxis()->SetTitle("1st peak / 2nd peak");
@@ -378,8 +427,8 @@ int all_fits (int run_num, char *path_to_runs, TFile *histograms) {
   c_ib_ratio->SaveAs(Form("%s/peak_ratio_by_ib.png", file_prefix));
 
   // plot ratio of 1st and 2nd peak as a fn of chisqr
-  TCanvas *c_ratio_chi = new TCanvas("c_ratio_chi", "", 700, 500);
-  TGraph *ratio_chi_graph = new TGraph(384, chisqr_ndfs, ratios);
+  TCanvas *c_ratio_chi = run_arena.make<TCanvas>("c_ratio_chi", "", 700, 500);
+  TGraph *ratio_chi_graph = run_arena.make<TGraph>(384, chisqr_ndfs, ratios);
   ratio_chi_graph->SetTitle("Peak Height Ratio by Chi Sqr");
   ratio_chi_graph->GetXaxis()->SetTitle("ChiSqr/NDF");
   ratio_chi_graph->GetYaxis()->SetTitle("1st peak / 2nd peak");
@@ -437,7 +486,14 @@ void fit_all_runs() {
       if (sscanf(entry, "qa_output_000%i", &run_num) == 1 && stat(filename, &statbuf) == 0 && S_ISDIR(statbuf.st_mode) && !strchr(entry, '.')
           && (hist_file = TFile::Open(Form("%s%s", filename, "/histograms.root")))) {
         printf("found run num %i at %s\n", run_num, filename);
+        ScopedTimer run_timer("fit_all_runs: all_fits of a run");
         int n_channels = all_fits(run_num, path_to_fits, hist_file);
+        delete hist_file;   // with the run's histograms (and the fit functions attached to them)
+        run_timer.stop();
+        // resident memory after each run: flat over a campaign once a run's objects are all freed with it
+        ProcInfo_t proc_info;
+        gSystem->GetProcInfo(&proc_info);
+        printf("run %i: %i channels fitted, %.1f MB resident\n", run_num, n_channels, proc_info.fMemResident/1024.0);
         fprintf(fp, "\n%i, %i", run_num, n_channels);
       }
 
@@ -445,4 +501,5 @@ void fit_all_runs() {
   }
 
   fclose(fp);
+  Profiler::instance().finish();
 }
\ No newline at end of file
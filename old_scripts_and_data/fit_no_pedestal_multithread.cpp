@@ -23,6 +23,9 @@
 #include <sys/stat.h>
 #include <pthread.h>
 
+#include "../includes/mpv_dbn.h"
+#include "../includes/fit_telemetry.h"
+
 #define SAVE_PLOTS false
 
 // TODO: multithreading
@@ -45,6 +48,8 @@ Double_t other_ampl[384][5][2];
 Double_t other_sigma[384][5][2];
 
 bool fit_success[384] = {false};
+bool fit_tried[384] = {false};
+FitTelemetry fit_telemetries[384];
 
 /**
  * The function used for fitting
@@ -85,7 +90,9 @@ class six_gauss : public ROOT::Math::IParamFunction {
 
 void *parallel_fit(void *ptr) {
   while (1) {
+    ScopedTimer wait_timer("fit_no_pedestal: wait for queue_lock");
     pthread_mutex_lock(&queue_lock);
+    wait_timer.stop();
     if (tasks.empty()) {
       pthread_mutex_unlock(&queue_lock);
       break;
@@ -93,10 +100,13 @@ void *parallel_fit(void *ptr) {
     // else there are tasks :)
     task_t my_task = tasks.front();
     tasks.pop();
+    trace_counter("fit_no_pedestal: queued channels", tasks.size());
     pthread_mutex_unlock(&queue_lock);
 
     TH1D *my_hist = my_task.hist;
     int i = my_task.channel_num;
+    ScopedTimer channel_timer("fit_no_pedestal: channel");
+    channel_timer.arg("channel", i);
     pthread_t my_id = pthread_self();
 
     printf("(thread %lu) channel %i: started...\n", my_id, i);
@@ -160,7 +170,13 @@ void *parallel_fit(void *ptr) {
       fitter.Config().ParSettings(2*j+5).SetLimits(5.0, 10.0);
     }
 
+    ScopedTimer fit_timer("fit: six gauss (GSLMultiMin)");
+    fit_timer.arg("channel", i);
+    FitClock fit_clock;
     bool sp_fit = fitter.Fit(d);
+    fit_telemetries[i] = fit_telemetry(i, fitter, fit_clock, FitSeed::FIXED);
+    fit_tried[i] = true;
+    fit_timer.stop();
 
     bool success = fitter.Result().IsValid();
 
@@ -301,6 +317,8 @@ void *parallel_fit(void *ptr) {
       legend->Draw();
       */
 
+      ScopedTimer save_timer("fit_no_pedestal: save channel png");
+      save_timer.arg("channel", i);
       c1->SaveAs(Form("%s/channel_%i.png", file_prefix, i));
     }
 
@@ -310,10 +328,21 @@ void *parallel_fit(void *ptr) {
   return NULL;
 }
 
-void fit_no_pedestal_multithread(int run_num, int n_threads) {
+/**
+ * @brief Fit the single pixel peaks of all channels of a run with n_threads threads.
+ *
+ * @param run_num
+ * @param n_threads
+ * @param trace_file if not empty, write a trace of the fits (a span per channel fit and thread, the reads and png saves,
+ *    and the number of queued channels) to this file, for chrome://tracing or ui.perfetto.dev; as EMCAL_TRACE=<file>.
+ */
+void fit_no_pedestal_multithread(int run_num, int n_threads, std::string trace_file = "") {
   if (n_threads < 1) {
     throw std::runtime_error("n_threads should be >= 1");
   }
+  if (!trace_file.empty()) {
+    Profiler::instance().start_trace(trace_file);
+  }
   ROOT::EnableThreadSafety();
   //ROOT::EnableImplicitMT();
   int n_channels = 0;
@@ -321,6 +350,7 @@ void fit_no_pedestal_multithread(int run_num, int n_threads) {
   gStyle->SetOptStat(0);
   gStyle->SetOptFit(1);   //make the plot list all the fit information
   
+  ScopedTimer read_timer("fit_no_pedestal: read histograms");
   TFile *hist_file = TFile::Open(Form("./all_runs/qa_output_nopedestal_000%i/histograms.root", run_num));
   if (!hist_file) {
     throw std::runtime_error("unable to open histogram file");
@@ -333,6 +363,7 @@ void fit_no_pedestal_multithread(int run_num, int n_threads) {
   for (int i = 0; i < 384;i++) {
     h_alladc[i] = (TH1D*) hist_file->Get(Form("h_alladc_%i", i));
   }
+  read_timer.stop();
   
   TF1 *f_singlepixels[384];
 
@@ -435,6 +466,8 @@ void fit_no_pedestal_multithread(int run_num, int n_threads) {
         */
       }
 
+      ScopedTimer save_timer("fit_no_pedestal: save channel png");
+      save_timer.arg("channel", i);
       c1->SaveAs(hist_file_name);
     }
   }
@@ -449,6 +482,17 @@ void fit_no_pedestal_multithread(int run_num, int n_threads) {
   }
   fclose(outfile);
 
+  // cost of the fits
+  std::vector<FitTelemetry> telemetry;
+  for (int i = 0; i < 384; i++) {
+    if (fit_tried[i]) {
+      telemetry.push_back(fit_telemetries[i]);
+    }
+  }
+  write_fit_telemetry_csv(telemetry, Form("%s/fit_telemetry.csv", file_prefix));
+  save_fit_cost_plots(telemetry, Form("%s/fit_costs.png", file_prefix));
+  print_fit_costs(telemetry);
+
 
   // compute block gaps
   Double_t blocks[96];
@@ -491,16 +535,12 @@ void fit_no_pedestal_multithread(int run_num, int n_threads) {
   //printf("max chisqr_ndf: %f (channel %i); min chisqr_ndf: %f (channel %i)\n", max_chisqr_ndf, max_chisqr_idx, min_chisqr_ndf, min_chisqr_idx);
 
   // compute averages for IBs 0-2 and 3-5
-  Double_t avg_gap = 0;
-  for (int i = 0; i < 192; i++) {
-    avg_gap += gap_spacing[i][0];
-  }
-  Double_t ib0_2_avg_gap = avg_gap / 192;
-  avg_gap = 0;
-  for (int i = 192; i < 384; i++) {
-    avg_gap += gap_spacing[i][0];
+  RunningStats ib0_2_gap;
+  RunningStats ib3_5_gap;
+  for (int i = 0; i < 384; i++) {
+    (i < 192 ? ib0_2_gap : ib3_5_gap).add(gap_spacing[i][0]);
   }
-  Double_t ib3_5_avg_gap = avg_gap / 192;
-  printf("IBs 0-2: avg sp gap = %f; IBs 3-5 avg sp gap = %f\n", ib0_2_avg_gap, ib3_5_avg_gap);
+  printf("IBs 0-2: avg sp gap = %f; IBs 3-5 avg sp gap = %f\n", ib0_2_gap.mean(), ib3_5_gap.mean());
   free(file_prefix);
+  Profiler::instance().finish();
 }
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "includes/mpv_dbn.h"
+#include "includes/pipeline.h"
+#include "emcal_plots/plot.cpp"
+
+const std::string BLOCK_DATABASE = "files/sPHENIX_EMCal_blocks - dbn_mpv.csv";
+
+/**
+ * @brief A run's histograms.root, local in physics_runs/ (see RunFetcher).
+ */
+typedef struct RunFile {
+  int run;
+  std::string digest;   // content_digest of the local file
+} RunFile;
+
+/**
+ * @brief MPVs and single pixel gaps of one sector, as read from its run (-1 where missing).
+ */
+typedef struct SectorFit {
+  int run;
+  std::vector<double> chnl_mpv;       // [channel number] -> mpv
+  std::vector<double> chnl_mpv_err;
+  std::vector<double> sp_gaps;        // [block number] -> gap
+} SectorFit;
+
+/**
+ * @brief All sectors' SectorFit in the layout of get_chnl_mpv_with_err and get_sp_gaps.
+ */
+typedef struct SectorFits {
+  std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> chnl_mpv_and_err;
+  std::vector<std::vector<double>> sp_gaps;
+} SectorFits;
+
+void write_sector_fit(const std::string &file_name, const SectorFit &fit) {
+  FILE *outfile = fopen(file_name.c_str(), "w");
+  if (!outfile) {
+    throw std::runtime_error(Form("unable to open '%s' for writing", file_name.c_str()));
+  }
+  fprintf(outfile, "run %d\n", fit.run);
+  for (size_t chnl = 0; chnl < fit.chnl_mpv.size(); chnl++) {
+    fprintf(outfile, "chnl %zu %.17g %.17g\n", chnl, fit.chnl_mpv[chnl], fit.chnl_mpv_err[chnl]);
+  }
+  for (size_t block = 0; block < fit.sp_gaps.size(); block++) {
+    fprintf(outfile, "sp_gap %zu %.17g\n", block, fit.sp_gaps[block]);
+  }
+  if (fclose(outfile) != 0) {
+    throw std::runtime_error(Form("unable to write '%s'", file_name.c_str()));
+  }
+}
+
+SectorFit read_sector_fit(const std::string &file_name) {
+  FILE *infile = fopen(file_name.c_str(), "r");
+  if (!infile) {
+    throw std::runtime_error(Form("unable to open '%s'", file_name.c_str()));
+  }
+  SectorFit fit = {-1, std::vector<double>(384, -1.0), std::vector<double>(384, -1.0), std::vector<double>(96, -1.0)};
+  char line[256];
+  size_t idx;
+  double value, err;
+  while (fgets(line, sizeof(line), infile)) {
+    if (sscanf(line, "run %d", &fit.run) == 1) {
+      continue;
+    } else if (sscanf(line, "chnl %zu %lf %lf", &idx, &value, &err) == 3 && idx < 384) {
+      fit.chnl_mpv[idx] = value;
+      fit.chnl_mpv_err[idx] = err;
+    } else if (sscanf(line, "sp_gap %zu %lf", &idx, &value) == 2 && idx < 96) {
+      fit.sp_gaps[idx] = value;
+    }
+  }
+  fclose(infile);
+  return fit;
+}
+
+/**
+ * @brief Fingerprint of the columns of the block database which do not come from the MPVs (the MPV columns are
+ *    rewritten by the pipeline, so they must not count as an input).
+ */
+Fingerprint block_properties(const std::vector<Block> &all_blocks) {
+  Fingerprint fp;
+  for (const Block &block : all_blocks) {
+    fp.add((double) block.sector).add((double) block.block_number).add(block.dbn);
+    for (double value : {block.density, block.fiber_count, block.fiber_t1_count, block.fiber_t2_count,
+                         block.fiber_t3_count, block.fiber_t4_count, block.scint_ratio}) {
+      fp.add(value);
+    }
+    fp.add(block.fiber_type).add(block.fiber_batch.str).add(block.w_powder);
+  }
+  return fp;
+}
+
+/**
+ * @brief Run the stages of run_pipeline and print the reports (and the profile and trace, if on).
+ */
+void run_stages(Pipeline &pipeline, RunFetcher &fetcher, unsigned int n_workers, bool force) {
+  try {
+    pipeline.run(n_workers, force);
+  } catch (const std::exception &e) {
+    fetcher.print_report();
+    pipeline.print_report();
+    throw;
+  }
+  fetcher.print_report();
+  pipeline.print_report();
+  Profiler::instance().finish();
+}
+
+/**
+ * @brief Body of macro: one pipeline from the run folders to the maps, replacing get_physics_runs, todo (write_map_to_file
+ *    and the IB summaries), the manual merge of files/dbn_mpv.csv into the block database, and plot. Stages:
+ *    - fetch <run>: copy the run's histograms.root into physics_runs/ unless local (see RunFetcher).
+ *    - fit sector <s>: the channel MPVs (h_allchannels) and single pixel gaps (h_sp_perchnl) of the sector's run,
+ *      starting as soon as the run is local; cached in .pipeline/.
+ *    - aggregate: all sectors (made in memory, only if an output below is written).
+ *    - export: files/dbn_mpv.csv, the IB summaries, and the block database with the new MPV columns.
+ *    - plots: plot_blocks of the merged blocks (which skips unchanged plots itself).
+ *    Every stage whose inputs (by content) are unchanged since the last run is skipped; see the report.
+ *
+ * @param n_workers stages run at a time (and plots rendered at a time).
+ * @param source_dir directory with Tim's qa_output_000<run> folders (only read for runs not local yet).
+ * @param last_stage "fit", "export" or "plot": stages after it are left out.
+ * @param raster see plot_blocks.
+ * @param force run every stage.
+ */
+void run_pipeline(unsigned int n_workers = 8, std::string source_dir = PHYSICS_RUNS_SOURCE, std::string last_stage = "plot", bool raster = true, bool force = false) {
+  const bool drop_low_rap_edge = true;
+  if (last_stage != "fit" && last_stage != "export" && last_stage != "plot") {
+    throw std::runtime_error(Form("unknown pipeline stage '%s' (fit, export or plot)", last_stage.c_str()));
+  }
+  if (n_workers > 1) {
+    gROOT->SetBatch(true);
+    ROOT::EnableThreadSafety();
+  }
+  std::map<int, int> physics_runs = read_physics_runs();
+  Pipeline pipeline(".pipeline");
+  RunFetcher fetcher(source_dir, "physics_runs");
+
+  Fingerprint fit_code;
+  fit_code.add(pipeline.file_digest("includes/mpv_dbn.cpp")).add(pipeline.file_digest("run_pipeline.cpp"));
+  Fingerprint export_code;
+  export_code.add(pipeline.file_digest("includes/mpv_dbn.cpp")).add(pipeline.file_digest("includes/stats.cpp")).add(pipeline.file_digest("includes/blocks.cpp"));
+  Fingerprint runs_fp;
+  for (std::pair<int, int> p : physics_runs) {
+    runs_fp.add(p.first).add(p.second);
+  }
+
+  // fetch -> fit, per run and sector
+  std::map<int, std::shared_ptr<Product<RunFile>>> run_files;
+  std::map<int, std::shared_ptr<Product<SectorFit>>> sector_fits;
+  for (std::pair<int, int> p : physics_runs) {
+    int sector = p.first;
+    int run = p.second;
+    if (run <= 0) {
+      continue;
+    }
+    if (run_files.find(run) == run_files.end()) {
+      auto run_file = std::make_shared<Product<RunFile>>(Form("run %d", run));
+      pipeline.source<RunFile>(Form("fetch %d", run), *run_file, [&fetcher, run]() {
+        RunFetch fetched = fetcher.fetch_one(run);
+        if (fetched.status == RunFetch::FAILED || fetched.files.empty()) {
+          throw std::runtime_error(fetched.error);
+        }
+        return RunFile{run, fetched.files[0].digest};
+      }, [](const RunFile &file) {
+        return Fingerprint().add(file.run).add(file.digest);
+      });
+      run_files[run] = run_file;
+    }
+    auto fit = std::make_shared<Product<SectorFit>>(Form("sector %d", sector), pipeline.cache_path(Form("sector_%02d.txt", sector)), write_sector_fit, read_sector_fit);
+    pipeline.stage<SectorFit>(Form("fit sector %d", sector), *fit, {run_files[run].get()}, Fingerprint(fit_code).add(sector), [run, sector]() {
+      SectorFit fit = {run, std::vector<double>(384, -1.0), std::vector<double>(384, -1.0), std::vector<double>(96, -1.0)};
+      read_run_chnl_mpv(run, fit.chnl_mpv, fit.chnl_mpv_err);
+      read_run_sp_gaps(run, sector, fit.sp_gaps);
+      return fit;
+    });
+    sector_fits[sector] = fit;
+  }
+
+  // aggregate
+  if (last_stage == "fit") {
+    run_stages(pipeline, fetcher, n_workers, force);
+    return;
+  }
+  std::vector<ProductBase*> fit_inputs;
+  for (auto &p : sector_fits) {
+    fit_inputs.push_back(p.second.get());
+  }
+  Product<SectorFits> all_fits("all sectors");
+  pipeline.stage<SectorFits>("aggregate", all_fits, fit_inputs, runs_fp, [&sector_fits]() {
+    SectorFits fits = {{std::vector<std::vector<double>>(64, std::vector<double>(384, -1.0)), std::vector<std::vector<double>>(64, std::vector<double>(384, -1.0))},
+                       std::vector<std::vector<double>>(64, std::vector<double>(96, -1.0))};
+    for (auto &p : sector_fits) {
+      const SectorFit &fit = p.second->get();
+      fits.chnl_mpv_and_err.first[p.first - 1] = fit.chnl_mpv;
+      fits.chnl_mpv_and_err.second[p.first - 1] = fit.chnl_mpv_err;
+      fits.sp_gaps[p.first - 1] = fit.sp_gaps;
+    }
+    return fits;
+  });
+  Product<std::vector<std::vector<std::string>>> dbns("dbns");
+  pipeline.source<std::vector<std::vector<std::string>>>("read dbns", dbns, get_dbns, [](const std::vector<std::vector<std::string>> &dbns) {
+    Fingerprint fp;
+    for (const std::vector<std::string> &sector : dbns) {
+      for (const std::string &dbn : sector) {
+        fp.add(dbn);
+      }
+    }
+    return fp;
+  });
+  Product<std::vector<Block>> database("block database");
+  pipeline.source<std::vector<Block>>("read block database", database, []() { return read_block_database(BLOCK_DATABASE); }, block_properties);
+  Product<std::vector<Block>> merged("merged blocks");
+  pipeline.stage<std::vector<Block>>("merge blocks", merged, {&database, &all_fits}, Fingerprint().add(drop_low_rap_edge), [&database, &all_fits, drop_low_rap_edge]() {
+    std::vector<Block> all_blocks = database.get();
+    set_block_mpvs(all_blocks, all_fits.get().chnl_mpv_and_err, perimeter_channels(drop_low_rap_edge), -1);
+    return all_blocks;
+  });
+
+  // export
+  pipeline.sink("write dbn_mpv.csv", {"files/dbn_mpv.csv"}, {&dbns, &all_fits}, Fingerprint(export_code).add(drop_low_rap_edge), [&]() {
+    write_map_to_file(drop_low_rap_edge, dbns.get(), all_fits.get().chnl_mpv_and_err);
+  });
+  pipeline.sink("write mpv IB summary", {"files/mpv_avg_ib_mean.csv", "files/mpv_avg_ib_sigma.csv"}, {&all_fits}, Fingerprint(export_code).add(drop_low_rap_edge).add(runs_fp), [&]() {
+    write_mpv_ib(drop_low_rap_edge, all_fits.get().chnl_mpv_and_err, physics_runs);
+  });
+  pipeline.sink("write sp gap IB summary", {"files/sp_gap_avg_ib_mean.csv", "files/sp_gap_avg_ib_sigma.csv"}, {&all_fits}, Fingerprint(export_code).add(runs_fp), [&]() {
+    write_sp_gap_ib(all_fits.get().sp_gaps, physics_runs);
+  });
+  pipeline.sink("write block database", {BLOCK_DATABASE}, {&merged}, export_code, [&]() {
+    write_block_database(BLOCK_DATABASE, merged.get());
+  });
+
+  // plot
+  if (last_stage == "plot") {
+    pipeline.sink("plots", {}, {&merged}, Fingerprint().add(raster).add(pipeline.file_digest("emcal_plots/plot.cpp")), [&]() {
+      plot_blocks(merged.get(), "", raster, "bird", n_workers);
+    });
+  }
+
+  run_stages(pipeline, fetcher, n_workers, force);
+}
@@ -0,0 +1,114 @@
+#include <cstdlib>
+
+#include "includes/run_fetch.h"
+
+/**
+ * @brief Check of RunFetcher against a local directory standing in for GPFS (in /tmp): a fetch, a fetch of a run which
+ *    is already local, a resumed interrupted copy, a resumed copy whose already copied bytes were corrupted,
+ *    and a file recorded with adopt() (as extract_runs writes its slim files).
+ *    Interrupted copies are set up as RunFetcher leaves them: a ".partial" file and its ".source" file in the staging
+ *    directory. Prints every check; run with `root -l -b -q test_run_fetch.cpp`.
+ *
+ * @return number of failed checks.
+ */
+int test_run_fetch() {
+  char tmp_template[] = "/tmp/emcal_fetch_test_XXXXXX";
+  if (!mkdtemp(tmp_template)) {
+    throw std::runtime_error("unable to create a temporary directory");
+  }
+  std::string tmp_dir = tmp_template;
+  std::string source_dir = tmp_dir + "/gpfs";
+  std::string dest_dir = tmp_dir + "/physics_runs";
+  const int run = 21518;
+  const std::string folder = run_folder_name(run);
+  const std::string source = source_dir + "/" + folder + "/histograms.root";
+  const std::string local = dest_dir + "/" + folder + "/histograms.root";
+  const std::string partial = dest_dir + "/.fetch/" + folder + "/histograms.root.partial";
+  const long long size = 3*DIGEST_CHUNK_SIZE + 12345;
+
+  // source file: not chunk aligned, different bytes in every chunk
+  make_directory(source_dir);
+  make_directory(source_dir + "/" + folder);
+  std::vector<char> content(size);
+  for (long long i = 0; i < size; i++) {
+    content[i] = (char) ((i*2654435761u) >> 13);
+  }
+  FILE *file = fopen(source.c_str(), "wb");
+  fwrite(content.data(), 1, size, file);
+  fclose(file);
+  struct stat source_st;
+  stat(source.c_str(), &source_st);
+
+  int n_failed = 0;
+  auto check = [&](bool ok, const char *what) {
+    printf("%s %s\n", ok ? "ok    " : "FAILED", what);
+    n_failed += !ok;
+  };
+  auto local_matches = [&]() {
+    return content_digest(local) == content_digest(source);
+  };
+  // the state an interrupted copy leaves: n_bytes of the source copied, and the source's size and mtime
+  auto interrupt = [&](long long n_bytes) {
+    remove(local.c_str());
+    rmdir((dest_dir + "/" + folder).c_str());
+    make_directory(dest_dir + "/.fetch");
+    make_directory(dest_dir + "/.fetch/" + folder);
+    FILE *f = fopen(partial.c_str(), "wb");
+    fwrite(content.data(), 1, n_bytes, f);
+    fclose(f);
+    f = fopen((partial + ".source").c_str(), "w");
+    fprintf(f, "%lld %lld\n", size, (long long) source_st.st_mtime);
+    fclose(f);
+  };
+
+  {
+    RunFetcher fetcher(source_dir, dest_dir);
+    RunFetch result = fetcher.fetch_one(run);
+    check(result.status == RunFetch::FETCHED && local_matches(), "fetch copies the file");
+    check(result.files.size() == 1 && result.files[0].bytes_copied == size, "fetch copies every byte");
+  }
+  {
+    RunFetcher fetcher(source_dir, dest_dir);
+    RunFetch result = fetcher.fetch_one(run);
+    check(result.status == RunFetch::LOCAL && result.files[0].bytes_copied == 0, "local run is not copied again");
+  }
+  {
+    interrupt(2*DIGEST_CHUNK_SIZE + 100);
+    RunFetcher fetcher(source_dir, dest_dir);
+    RunFetch result = fetcher.fetch_one(run);
+    check(result.status == RunFetch::FETCHED && local_matches(), "interrupted copy is resumed");
+    check(result.files.size() == 1 && result.files[0].bytes_copied == size - 2*(long long) DIGEST_CHUNK_SIZE,
+          "resume copies only from the last whole chunk");
+  }
+  {
+    interrupt(2*DIGEST_CHUNK_SIZE + 100);
+    FILE *f = fopen(partial.c_str(), "r+b");
+    fseek(f, DIGEST_CHUNK_SIZE + 17, SEEK_SET);
+    fputc(content[DIGEST_CHUNK_SIZE + 17] ^ 0x5a, f);
+    fclose(f);
+    RunFetcher fetcher(source_dir, dest_dir);
+    RunFetch result = fetcher.fetch_one(run);
+    check(result.status == RunFetch::FETCHED && local_matches(), "corrupt copied bytes are copied again");
+    check(result.files.size() == 1 && result.files[0].bytes_copied == size - (long long) DIGEST_CHUNK_SIZE,
+          "resume keeps the chunks before the corrupt one");
+  }
+
+  {
+    // a slim file written by extract_runs in place of the fetched one
+    FILE *f = fopen(local.c_str(), "wb");
+    fwrite(content.data(), 1, 1000, f);
+    fclose(f);
+    RunFetcher fetcher(source_dir, dest_dir);
+    fetcher.adopt(run);
+    RunFetch result = fetcher.fetch_one(run);
+    struct stat st;
+    check(result.status == RunFetch::LOCAL && stat(local.c_str(), &st) == 0 && st.st_size == 1000,
+          "adopted file is not copied over");
+  }
+
+  if (system(("rm -rf '" + tmp_dir + "'").c_str()) != 0) {
+    printf("unable to remove %s\n", tmp_dir.c_str());
+  }
+  printf("%d check(s) failed\n", n_failed);
+  return n_failed;
+}
@@ -1,7 +1,38 @@
 #include "includes/mpv_dbn.h"
+#include "includes/job_graph.h"
+#include "includes/fingerprint.h"
 
-void todo() {
-  write_map_to_file(true);
-  // get_mpvs(true);
-  // get_sp_gaps(true);
-}
\ No newline at end of file
+/**
+ * @brief Fingerprint of the inputs of the files/ outputs: the run list, the histograms of every sector's run, the block
+ *    database and the code writing them.
+ */
+Fingerprint physics_run_inputs(FingerprintStore &fingerprints) {
+  Fingerprint fp;
+  for (const char *file_name : {"files/physics_runs.csv", "files/Blocks database - Sectors.csv"}) {
+    fp.add(fingerprints.file_digest(file_name));
+  }
+  for (const char *source : {"includes/mpv_dbn.cpp", "includes/stats.cpp"}) {
+    fp.add(fingerprints.source_digest(source));
+  }
+  for (std::pair<int, int> p : read_physics_runs()) {
+    if (p.second > 0) {
+      fp.add(p.first).add(fingerprints.file_digest(Form("physics_runs/qa_output_000%i/histograms.root", p.second)));
+    }
+  }
+  return fp;
+}
+
+/**
+ * @brief Write the files/ outputs whose inputs changed (see files/.fingerprints).
+ *
+ * @param force write every output.
+ */
+void todo(bool force = false) {
+  FingerprintStore fingerprints("files/.fingerprints");
+  Fingerprint inputs = physics_run_inputs(fingerprints);
+  JobGraph graph({}, &fingerprints);
+  graph.add({"write_map_to_file", {"files/dbn_mpv.csv"}, {}, []() { write_map_to_file(true); }, false, Fingerprint(inputs).add(true).hex()});
+  graph.run(1, JobExecutor::THREADS, force);
+  graph.print_report();
+  Profiler::instance().finish();
+}
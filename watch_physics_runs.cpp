@@ -0,0 +1,154 @@
+#include "includes/mpv_dbn.h"
+#include "includes/run_watch.h"
+#include "emcal_plots/plot.cpp"
+
+/**
+ * @brief Per-sector results of the physics runs, kept in memory so that a new run only re-reads its own sector.
+ */
+typedef struct SectorData {
+  std::map<int, int> physics_runs;
+  std::vector<std::vector<std::string>> dbns;
+  std::pair<std::vector<std::vector<double>>, std::vector<std::vector<double>>> chnl_mpv_and_err;
+  std::vector<std::vector<double>> sp_gaps;
+  std::vector<Block> all_blocks;
+} SectorData;
+
+/**
+ * @brief Re-read the channel MPVs and single pixel gaps of a sector from its run.
+ *
+ * @param data
+ * @param sector 1-based.
+ */
+void read_sector(SectorData &data, int sector) {
+  std::vector<double> &chnl_mpv = data.chnl_mpv_and_err.first[sector - 1];
+  std::vector<double> &chnl_mpv_err = data.chnl_mpv_and_err.second[sector - 1];
+  std::vector<double> &sp_gaps = data.sp_gaps[sector - 1];
+  chnl_mpv.assign(384, -1.0);
+  chnl_mpv_err.assign(384, -1.0);
+  sp_gaps.assign(96, -1.0);
+  auto it = data.physics_runs.find(sector);
+  if (it != data.physics_runs.end() && it->second > 0) {
+    read_run_chnl_mpv(it->second, chnl_mpv, chnl_mpv_err);
+    read_run_sp_gaps(it->second, sector, sp_gaps);
+  }
+}
+
+/**
+ * @brief Re-read the given sectors and rewrite the files/ outputs (from memory for the other sectors) and the plots
+ *    whose blocks changed.
+ *
+ * @param data
+ * @param sectors 1-based sectors to re-read.
+ * @param drop_low_rap_edge see write_map_to_file.
+ * @param plots whether to update the plots (see plot_blocks).
+ * @param raster see plot_blocks.
+ */
+void process_sectors(SectorData &data, const std::set<int> &sectors, bool drop_low_rap_edge, bool plots, bool raster) {
+  auto start = std::chrono::steady_clock::now();
+  std::set<int> perimeter = perimeter_channels(drop_low_rap_edge);
+  for (int sector : sectors) {
+    printf("processing sector %d (run %d)\n", sector, data.physics_runs[sector]);
+    read_sector(data, sector);
+    set_block_mpvs(data.all_blocks, data.chnl_mpv_and_err, perimeter, sector);
+  }
+  write_map_to_file(drop_low_rap_edge, data.dbns, data.chnl_mpv_and_err);
+  write_mpv_ib(drop_low_rap_edge, data.chnl_mpv_and_err, data.physics_runs);
+  write_sp_gap_ib(data.sp_gaps, data.physics_runs);
+  if (plots) {
+    plot_blocks(data.all_blocks, "", raster);
+  }
+  printf("processed %zu sectors in %.3f s\n", sectors.size(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * @brief Body of macro: watch physics_runs/, the all_runs* directories and files/physics_runs.csv, and process each
+ *    sector whose run landed (or whose run was changed in files/physics_runs.csv) once it settled: channel and block
+ *    MPVs (files/dbn_mpv.csv), IB summaries, and the plots (starting from the block database, with the MPV columns
+ *    of processed sectors replaced). Runs forever.
+ *
+ * NOTE: Linux only (inotify). Runs landing in all_runs* are not fitted here (their QA histograms need the fits of
+ *    old_scripts_and_data/fit_all_runs.cpp): fit_command, if given, is run for them, with "{dir}" and "{run}" replaced.
+ *
+ * @param debounce_seconds how long a run folder must be unchanged before it is processed.
+ * @param plots update the plots.
+ * @param raster see plot_blocks.
+ * @param fit_command e.g. "./fit_run.sh {dir} {run}"
+ */
+void watch_physics_runs(double debounce_seconds = 5, bool plots = true, bool raster = true, std::string fit_command = "") {
+  const bool drop_low_rap_edge = true;
+  SectorData data;
+  data.physics_runs = read_physics_runs();
+  data.dbns = get_dbns();
+  data.chnl_mpv_and_err = get_chnl_mpv_with_err();
+  data.sp_gaps = get_sp_gaps(false);
+  data.all_blocks = read_block_database("files/sPHENIX_EMCal_blocks - dbn_mpv.csv");
+
+  RunWatcher watcher(debounce_seconds);
+  watcher.watch_runs("physics_runs");
+  DIR *dir = opendir(".");
+  struct dirent *entry;
+  while (dir && (entry = readdir(dir))) {
+    std::string name = entry->d_name;
+    struct stat st;
+    if (name.rfind("all_runs", 0) == 0 && stat(name.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      watcher.watch_runs(name);
+      printf("watching %s/\n", name.c_str());
+    }
+  }
+  if (dir) {
+    closedir(dir);
+  }
+  watcher.watch_file("files/physics_runs.csv");
+  printf("watching physics_runs/ and files/physics_runs.csv\n");
+
+  std::vector<RunEvent> runs;
+  std::vector<std::string> files;
+  while (true) {
+    watcher.wait(runs, files);
+    std::set<int> sectors;
+    if (!files.empty()) {
+      // the run list changed: sectors which got another run
+      std::map<int, int> physics_runs = read_physics_runs();
+      for (int sector = 1; sector <= 64; sector++) {
+        if (physics_runs[sector] != data.physics_runs[sector]) {
+          sectors.insert(sector);
+        }
+      }
+      data.physics_runs = physics_runs;
+    }
+    for (const RunEvent &event : runs) {
+      if (event.dir != "physics_runs") {
+        printf("new run %d in %s/\n", event.run, event.dir.c_str());
+        if (!fit_command.empty()) {
+          std::string command = fit_command;
+          for (auto p : {std::make_pair(std::string("{dir}"), event.dir), std::make_pair(std::string("{run}"), std::to_string(event.run))}) {
+            for (size_t pos = command.find(p.first); pos != std::string::npos; pos = command.find(p.first, pos + p.second.size())) {
+              command.replace(pos, p.first.size(), p.second);
+            }
+          }
+          if (system(command.c_str()) != 0) {
+            printf("FAILED: %s\n", command.c_str());
+          }
+        }
+        continue;
+      }
+      bool listed = false;
+      for (std::pair<int, int> p : data.physics_runs) {
+        if (p.second == event.run) {
+          sectors.insert(p.first);
+          listed = true;
+        }
+      }
+      if (!listed) {
+        printf("run %d is not in files/physics_runs.csv (add it to process its sector)\n", event.run);
+      }
+    }
+    if (!sectors.empty()) {
+      try {
+        process_sectors(data, sectors, drop_low_rap_edge, plots, raster);
+      } catch (const std::exception &e) {
+        printf("FAILED to process sectors: %s\n", e.what());
+      }
+    }
+  }
+}